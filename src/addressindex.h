@@ -59,6 +59,11 @@ struct CAddressUnspentKey {
         txhash.SetNull();
         index = 0;
     }
+
+    friend bool operator==(const CAddressUnspentKey &a, const CAddressUnspentKey &b) {
+        return a.type == b.type && a.hashBytes == b.hashBytes
+            && a.txhash == b.txhash && a.index == b.index;
+    }
 };
 
 struct CAddressUnspentValue {
@@ -156,6 +161,12 @@ struct CAddressIndexKey {
         index = 0;
         spending = false;
     }
+
+    friend bool operator==(const CAddressIndexKey &a, const CAddressIndexKey &b) {
+        return a.type == b.type && a.hashBytes == b.hashBytes
+            && a.blockHeight == b.blockHeight && a.txindex == b.txindex
+            && a.txhash == b.txhash && a.index == b.index && a.spending == b.spending;
+    }
 };
 
 struct CAddressIndexIteratorKey {
@@ -191,6 +202,45 @@ struct CAddressIndexIteratorKey {
     }
 };
 
+/** Running totals of all address index deltas for one (type, addressHash) */
+struct CAddressBalanceValue {
+    CAmount balance;
+    CAmount received;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(balance);
+        READWRITE(received);
+    }
+
+    CAddressBalanceValue(CAmount nBalance, CAmount nReceived) {
+        balance = nBalance;
+        received = nReceived;
+    }
+
+    CAddressBalanceValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        balance = 0;
+        received = 0;
+    }
+
+    bool IsNull() const {
+        return (balance == 0 && received == 0);
+    }
+
+    void Apply(CAmount nDelta, bool fUndo) {
+        int nSign = fUndo ? -1 : 1;
+        balance += nSign * nDelta;
+        if (nDelta > 0)
+            received += nSign * nDelta;
+    }
+};
+
 struct CAddressIndexIteratorHeightKey {
     unsigned int type;
     uint256 hashBytes;
@@ -10,6 +10,7 @@
 #include <secp256k1_mlsag.h>
 
 #include "blind.h"
+#include "rctcache.h"
 #include "rctindex.h"
 #include "txdb.h"
 #include "txmempool.h"
@@ -17,7 +18,30 @@
 #include "validation.h"
 
 
-bool VerifyMLSAG(const CTransaction &tx, CValidationState &state)
+bool VerifyMLSAGSignature(const CTransaction &tx, unsigned int nIn, size_t nCols, size_t nRows, const std::vector<uint8_t> &vM, bool fCacheStore)
+{
+    if (nIn >= tx.vin.size())
+        return false;
+    const CTxIn &txin = tx.vin[nIn];
+    const std::vector<uint8_t> &vKeyImages = txin.scriptData.stack[0];
+    const std::vector<uint8_t> &vDL = txin.scriptWitness.stack[1];
+
+    uint256 entry = RCTCacheMLSAGEntry(tx.GetHash(), nIn, nCols, nRows, vM, vKeyImages, vDL);
+    if (RCTCacheGet(entry, !fCacheStore))
+        return true;
+
+    int rv;
+    if (0 != (rv = secp256k1_verify_mlsag(secp256k1_ctx_blind,
+        tx.GetHash().begin(), nCols, nRows,
+        &vM[0], &vKeyImages[0], &vDL[0], &vDL[32])))
+        return error("%s: verify-mlsag-failed %d", __func__, rv);
+
+    if (fCacheStore)
+        RCTCacheSet(entry);
+    return true;
+};
+
+bool VerifyMLSAG(const CTransaction &tx, CValidationState &state, std::vector<CScriptCheck> *pvChecks, bool fCacheStore)
 {
     int rv;
     std::set<int64_t> setHaveI; // Anon prev-outputs can only be used once per transaction.
@@ -49,8 +73,9 @@ bool VerifyMLSAG(const CTransaction &tx, CValidationState &state)
     if (fSplitCommitments)
         vpInputSplitCommits.reserve(tx.vin.size());
 
-    for (const auto &txin : tx.vin)
+    for (unsigned int nIn = 0; nIn < tx.vin.size(); ++nIn)
     {
+        const CTxIn &txin = tx.vin[nIn];
         if (!txin.IsAnonInput())
             return state.DoS(100, false, REJECT_MALFORMED, "bad-anon-input");
 
@@ -122,8 +147,8 @@ bool VerifyMLSAG(const CTransaction &tx, CValidationState &state)
             if (!setHaveI.insert(nIndex).second)
                 return state.DoS(100, false, REJECT_MALFORMED, "bad-anonin-dup-i");
 
-            CAnonOutput ao;
-            if (!pblocktree->ReadRCTOutput(nIndex, ao))
+            CRCTOutputTable::Entry ao;
+            if (!rctOutputTable.Get(nIndex, ao))
             {
                 return state.DoS(100, false, REJECT_MALFORMED, "bad-anonin-unknown-i");
             };
@@ -154,13 +179,20 @@ bool VerifyMLSAG(const CTransaction &tx, CValidationState &state)
                 return state.DoS(100, false, REJECT_INVALID, "bad-anonin-dup-ki");
             };
 
-            if (pblocktree->ReadRCTKeyImage(ki, txhashKI)
-                && txhashKI != txhash)
+            // Most key images are unspent, skip the txdb read when the filter rules it out
+            if (rctKeyImageFilter.MaybeContains(ki))
             {
-                if (LogAcceptCategory(BCLog::RINGCT))
-                    LogPrintf("%s: Duplicate keyimage detected %s, used in %s.\n", __func__,
-                        HexStr(ki.begin(), ki.end()), txhashKI.ToString());
-                return state.DoS(100, false, REJECT_INVALID, "bad-anonin-dup-ki");
+                if (!pblocktree->ReadRCTKeyImage(ki, txhashKI))
+                {
+                    rctKeyImageFilter.RecordFalsePositive();
+                } else
+                if (txhashKI != txhash)
+                {
+                    if (LogAcceptCategory(BCLog::RINGCT))
+                        LogPrintf("%s: Duplicate keyimage detected %s, used in %s.\n", __func__,
+                            HexStr(ki.begin(), ki.end()), txhashKI.ToString());
+                    return state.DoS(100, false, REJECT_INVALID, "bad-anonin-dup-ki");
+                };
             };
         };
 
@@ -169,10 +201,16 @@ bool VerifyMLSAG(const CTransaction &tx, CValidationState &state)
             &vpInCommits[0], &vpOutCommits[0], nullptr)))
             return state.DoS(100, error("%s: prepare-mlsag-failed %d", __func__, rv), REJECT_INVALID, "prepare-mlsag-failed");
 
-        if (0 != (rv = secp256k1_verify_mlsag(secp256k1_ctx_blind,
-            txhash.begin(), nCols, nRows,
-            &vM[0], &vKeyImages[0], &vDL[0], &vDL[32])))
-            return state.DoS(100, error("%s: verify-mlsag-failed %d", __func__, rv), REJECT_INVALID, "verify-mlsag-failed");
+        if (pvChecks)
+        {
+            pvChecks->push_back(CScriptCheck());
+            CScriptCheck check(vM, nCols, nRows, tx, nIn, fCacheStore);
+            check.swap(pvChecks->back());
+            continue;
+        };
+
+        if (!VerifyMLSAGSignature(tx, nIn, nCols, nRows, vM, fCacheStore))
+            return state.DoS(100, false, REJECT_INVALID, "verify-mlsag-failed");
     };
 
     // Verify commitment sums match
@@ -317,8 +355,10 @@ bool RollBackRCTIndex(int64_t nLastValidRCTOutput, std::set<CCmpPubKey> &setKi)
         pblocktree->EraseRCTKeyImage(ki);
     };
 
-    if (!pblocktree->WriteLastRCTOutput(nLastValidRCTOutput))
-        return error("%s: WriteLastRCTOutput failed.", __func__);
+    pblocktree->WriteLastRCTOutput(nLastValidRCTOutput);
+    if (!pblocktree->FlushRCTIndex())
+        return error("%s: FlushRCTIndex failed.", __func__);
+    rctOutputTable.Truncate(nLastValidRCTOutput);
 
     return true;
 };
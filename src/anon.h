@@ -20,7 +20,11 @@ const size_t MAX_ANON_INPUTS = 32; // To raise see MLSAG_MAX_ROWS also
 const size_t ANON_FEE_MULTIPLIER = 2;
 
 
-bool VerifyMLSAG(const CTransaction &tx, CValidationState &state);
+class CScriptCheck;
+
+/** If pvChecks is not null the MLSAG signature checks are pushed onto it instead of being run inline */
+bool VerifyMLSAG(const CTransaction &tx, CValidationState &state, std::vector<CScriptCheck> *pvChecks = nullptr, bool fCacheStore = true);
+bool VerifyMLSAGSignature(const CTransaction &tx, unsigned int nIn, size_t nCols, size_t nRows, const std::vector<uint8_t> &vM, bool fCacheStore);
 
 bool AddKeyImagesToMempool(const CTransaction &tx, CTxMemPool &pool);
 bool RemoveKeyImagesFromMempool(const uint256 &hash, const CTxIn &txin, CTxMemPool &pool);
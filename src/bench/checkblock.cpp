@@ -52,5 +52,46 @@ static void DeserializeAndCheckBlockTest(benchmark::State& state)
     }
 }
 
+// Particl transactions with several blinded outputs each, the range proofs are
+// kept small so the cost of allocating the outputs is not hidden by copying proof data.
+static void DeserializeParticlBlockTest(benchmark::State& state)
+{
+    CBlock block;
+    block.nVersion = PARTICL_BLOCK_VERSION;
+    for (int i = 0; i < 1000; ++i) {
+        CMutableTransaction txn;
+        txn.nVersion = PARTICL_TXN_VERSION;
+        txn.vin.push_back(CTxIn(COutPoint(uint256S("01"), i)));
+        txn.vin.push_back(CTxIn(COutPoint(uint256S("02"), i)));
+
+        OUTPUT_PTR<CTxOutStandard> outStandard = MAKE_OUTPUT<CTxOutStandard>();
+        outStandard->nValue = 1000 + i;
+        outStandard->scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<uint8_t>(20, i & 0xFF) << OP_EQUALVERIFY << OP_CHECKSIG;
+        txn.vpout.push_back(outStandard);
+
+        for (int k = 0; k < 3; ++k) {
+            OUTPUT_PTR<CTxOutCT> outCT = MAKE_OUTPUT<CTxOutCT>();
+            outCT->vData.resize(33, k);
+            outCT->scriptPubKey = outStandard->scriptPubKey;
+            outCT->vRangeproof.resize(64, k);
+            txn.vpout.push_back(outCT);
+        }
+        block.vtx.push_back(MakeTransactionRef(txn));
+    }
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << block;
+    size_t nSize = stream.size();
+    char a = '\0';
+    stream.write(&a, 1); // Prevent compaction
+
+    while (state.KeepRunning()) {
+        CBlock blockOut;
+        stream >> blockOut;
+        assert(stream.Rewind(nSize));
+    }
+}
+
 BENCHMARK(DeserializeBlockTest);
 BENCHMARK(DeserializeAndCheckBlockTest);
+BENCHMARK(DeserializeParticlBlockTest);
@@ -0,0 +1,73 @@
+// Copyright (c) 2017 The Particl Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "primitives/transaction.h"
+#include "script/interpreter.h"
+#include "script/script.h"
+#include "uint256.h"
+
+// A transaction with many standard inputs spending into blinded outputs,
+// the range proofs dominate the serialised size as in real CT transactions.
+static CMutableTransaction BuildLargeCTTransaction()
+{
+    CMutableTransaction txn;
+    txn.nVersion = PARTICL_TXN_VERSION;
+    for (int i = 0; i < 100; ++i)
+        txn.vin.push_back(CTxIn(COutPoint(uint256S("01"), i)));
+
+    for (int k = 0; k < 20; ++k)
+    {
+        OUTPUT_PTR<CTxOutCT> outCT = MAKE_OUTPUT<CTxOutCT>();
+        memset(outCT->commitment.data, k, 33);
+        outCT->vData.resize(33, k);
+        outCT->scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<uint8_t>(20, k) << OP_EQUALVERIFY << OP_CHECKSIG;
+        outCT->vRangeproof.resize(5134, k);
+        txn.vpout.push_back(outCT);
+
+        OUTPUT_PTR<CTxOutRingCT> outRingCT = MAKE_OUTPUT<CTxOutRingCT>();
+        memset(outRingCT->commitment.data, k, 33);
+        outRingCT->vData.resize(33, k);
+        outRingCT->vRangeproof.resize(5134, k);
+        txn.vpout.push_back(outRingCT);
+    }
+    txn.vpout.push_back(MAKE_OUTPUT<CTxOutData>(std::vector<uint8_t>(9, 0x01)));
+    return txn;
+}
+
+static void SignatureHashCT(benchmark::State& state, bool fPrecompute)
+{
+    const CTransaction tx(BuildLargeCTTransaction());
+    const CScript scriptCode = CScript() << OP_DUP << OP_HASH160 << std::vector<uint8_t>(20, 0xFF) << OP_EQUALVERIFY << OP_CHECKSIG;
+    const std::vector<uint8_t> vchAmount(33, 0x08);
+
+    while (state.KeepRunning())
+    {
+        // As in CheckInputs, the precomputed data is built once per transaction
+        if (fPrecompute)
+        {
+            PrecomputedTransactionData txdata(tx);
+            for (unsigned int i = 0; i < tx.vin.size(); ++i)
+                SignatureHash(scriptCode, tx, i, SIGHASH_ALL, vchAmount, SIGVERSION_BASE, &txdata);
+        } else
+        {
+            for (unsigned int i = 0; i < tx.vin.size(); ++i)
+                SignatureHash(scriptCode, tx, i, SIGHASH_ALL, vchAmount, SIGVERSION_BASE);
+        };
+    }
+}
+
+static void SignatureHashCTPrecomputed(benchmark::State& state)
+{
+    SignatureHashCT(state, true);
+}
+
+static void SignatureHashCTUncached(benchmark::State& state)
+{
+    SignatureHashCT(state, false);
+}
+
+BENCHMARK(SignatureHashCTPrecomputed);
+BENCHMARK(SignatureHashCTUncached);
@@ -0,0 +1,65 @@
+// Copyright (c) 2017 The Particl Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "smsg/smessage.h"
+#include "key.h"
+#include "random.h"
+#include "util.h"
+
+#include <secp256k1.h>
+
+extern secp256k1_context *secp256k1_context_smsg;
+
+// Trial decryption of a message not addressed to any of nKeys receiving addresses,
+// the common case for a node relaying messages.
+static void SmsgScan(benchmark::State& state, size_t nKeys, size_t nThreads)
+{
+    bool fOwnContext = !secp256k1_context_smsg;
+    if (fOwnContext)
+        secp256k1_context_smsg = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+
+    std::vector<SecMsgScanKey> vKeys(nKeys);
+    for (auto &sk : vKeys)
+    {
+        sk.key.MakeNewKey(true);
+        sk.address = sk.key.GetPubKey().GetID();
+    };
+
+    std::vector<uint8_t> vchMsg(SMSG_HDR_LEN + 256);
+    GetRandBytes(vchMsg.data(), vchMsg.size());
+    SecureMessage *psmsg = (SecureMessage*) vchMsg.data();
+    psmsg->version[0] = 2;
+    psmsg->nPayload = vchMsg.size() - SMSG_HDR_LEN;
+    CKey keyR;
+    keyR.MakeNewKey(true);
+    CPubKey pkR = keyR.GetPubKey();
+    memcpy(psmsg->cpkR, pkR.begin(), 33);
+
+    size_t nMatch;
+    while (state.KeepRunning())
+    {
+        if (SecureMsgMatchScanKeys(vKeys, &vchMsg[0], &vchMsg[SMSG_HDR_LEN], psmsg->nPayload, 0, nMatch, nThreads) != SMSG_MAC_MISMATCH)
+            assert(false);
+    };
+
+    if (fOwnContext)
+    {
+        secp256k1_context_destroy(secp256k1_context_smsg);
+        secp256k1_context_smsg = nullptr;
+    };
+}
+
+static void SmsgScan_10(benchmark::State& state) { SmsgScan(state, 10, 1); }
+static void SmsgScan_100(benchmark::State& state) { SmsgScan(state, 100, 1); }
+static void SmsgScan_1000(benchmark::State& state) { SmsgScan(state, 1000, 1); }
+static void SmsgScan_1000_Threads(benchmark::State& state) { SmsgScan(state, 1000, GetNumCores()); }
+static void SmsgScan_10000_Threads(benchmark::State& state) { SmsgScan(state, 10000, GetNumCores()); }
+
+BENCHMARK(SmsgScan_10);
+BENCHMARK(SmsgScan_100);
+BENCHMARK(SmsgScan_1000);
+BENCHMARK(SmsgScan_1000_Threads);
+BENCHMARK(SmsgScan_10000_Threads);
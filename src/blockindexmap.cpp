@@ -0,0 +1,79 @@
+// Copyright (c) 2017 The Particl Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockindexmap.h"
+
+#include "memusage.h"
+
+#include <assert.h>
+#include <limits>
+
+uint32_t CBlockIndexMap::Lookup(const uint256 &hash) const
+{
+    if (vSlots.empty())
+        return nEntries;
+
+    uint64_t nHash = hash.GetCheapHash();
+    uint32_t nTag = nHash >> 32;
+    for (uint32_t i = nHash & nMask;; i = (i + 1) & nMask)
+    {
+        const Slot &slot = vSlots[i];
+        if (!slot.nEntry)
+            return nEntries;
+        if (slot.nTag == nTag && GetEntry(slot.nEntry - 1).kv.first == hash)
+            return slot.nEntry - 1;
+    };
+}
+
+CBlockIndexMap::Entry *CBlockIndexMap::AllocateEntry()
+{
+    assert(nEntries < std::numeric_limits<uint32_t>::max());
+    if ((nEntries >> CHUNK_BITS) == vChunks.size())
+        vChunks.push_back(static_cast<Entry*>(::operator new(sizeof(Entry) * CHUNK_SIZE)));
+    return &GetEntry(nEntries);
+}
+
+void CBlockIndexMap::SetSlot(uint64_t nHash, uint32_t n)
+{
+    uint32_t i = nHash & nMask;
+    while (vSlots[i].nEntry)
+        i = (i + 1) & nMask;
+    vSlots[i].nTag = nHash >> 32;
+    vSlots[i].nEntry = n + 1;
+}
+
+void CBlockIndexMap::AddSlot(const uint256 &hash)
+{
+    // Keep the table at most 3/4 full
+    if ((uint64_t)(nEntries + 1) * 4 > (uint64_t)vSlots.size() * 3)
+    {
+        size_t nSlots = vSlots.empty() ? MIN_SLOTS : vSlots.size() * 2;
+        vSlots.assign(nSlots, Slot());
+        nMask = nSlots - 1;
+        for (uint32_t n = 0; n < nEntries; ++n)
+            SetSlot(GetEntry(n).kv.first.GetCheapHash(), n);
+    };
+
+    SetSlot(hash.GetCheapHash(), nEntries++);
+}
+
+void CBlockIndexMap::clear()
+{
+    for (uint32_t n = 0; n < nEntries; ++n)
+        GetEntry(n).~Entry();
+    for (auto pchunk : vChunks)
+        ::operator delete(pchunk);
+    std::vector<Entry*>().swap(vChunks);
+    nEntries = 0;
+
+    std::vector<Slot>().swap(vSlots);
+    nMask = 0;
+}
+
+size_t CBlockIndexMap::DynamicMemoryUsage() const
+{
+    return memusage::DynamicUsage(vChunks)
+        + vChunks.size() * memusage::MallocUsage(sizeof(Entry) * CHUNK_SIZE)
+        + memusage::DynamicUsage(vSlots);
+}
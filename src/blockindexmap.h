@@ -0,0 +1,158 @@
+// Copyright (c) 2017 The Particl Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PARTICL_BLOCKINDEXMAP_H
+#define PARTICL_BLOCKINDEXMAP_H
+
+#include "chain.h"
+#include "uint256.h"
+
+#include <stdint.h>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Owns the block index entries and finds them by block hash.
+ *
+ * Entries are constructed in place in fixed size chunks of an arena, the block hash is
+ * stored next to the CBlockIndex it belongs to, so phashBlock is set on insertion and
+ * neither entries nor hashes ever move. The lookup table is a flat open addressing
+ * (linear probing) array of 8 byte slots, each holding part of the hash as a tag and the
+ * arena position of the entry; a miss only touches the table.
+ *
+ * Compared to an unordered_map of separately allocated entries this saves the node and
+ * malloc overhead of each entry and keeps entries that were added together, usually
+ * consecutive heights, next to each other in memory.
+ *
+ * Iteration is in insertion order. Iterators stay valid when entries are inserted.
+ * Entries can't be removed individually, clear() frees all of them.
+ */
+class CBlockIndexMap
+{
+public:
+    typedef std::pair<const uint256, CBlockIndex*> value_type;
+    typedef size_t size_type;
+
+private:
+    struct Entry
+    {
+        template <typename... Args>
+        Entry(const uint256 &hash, Args&&... args) : kv(hash, &index), index(std::forward<Args>(args)...)
+        {
+            index.phashBlock = &kv.first;
+        };
+
+        value_type kv;
+        CBlockIndex index;
+    };
+
+    struct Slot
+    {
+        uint32_t nTag;
+        uint32_t nEntry; // Position in the arena + 1, 0 if empty
+    };
+
+    static const uint32_t CHUNK_BITS = 12;
+    static const uint32_t CHUNK_SIZE = 1 << CHUNK_BITS;
+    static const uint32_t MIN_SLOTS = 64;
+
+    std::vector<Entry*> vChunks;
+    uint32_t nEntries = 0;
+
+    std::vector<Slot> vSlots;
+    uint32_t nMask = 0;
+
+    Entry &GetEntry(uint32_t n) const
+    {
+        return vChunks[n >> CHUNK_BITS][n & (CHUNK_SIZE - 1)];
+    };
+
+    /** Returns the arena position of hash, or nEntries if not found */
+    uint32_t Lookup(const uint256 &hash) const;
+    /** Returns storage for the next entry */
+    Entry *AllocateEntry();
+    /** Put entry n in the first free slot from the position of nHash */
+    void SetSlot(uint64_t nHash, uint32_t n);
+    /** Make the entry constructed in AllocateEntry() findable, grows the table if needed */
+    void AddSlot(const uint256 &hash);
+
+public:
+    template <typename T>
+    class Iterator : public std::iterator<std::forward_iterator_tag, T>
+    {
+    private:
+        friend class CBlockIndexMap;
+        const CBlockIndexMap *pmap = nullptr;
+        uint32_t n = 0;
+
+        Iterator(const CBlockIndexMap *pmapIn, uint32_t nIn) : pmap(pmapIn), n(nIn) {};
+
+    public:
+        Iterator() {};
+        // Allow conversion from iterator to const_iterator
+        Iterator(const Iterator<typename std::remove_const<T>::type> &it) : pmap(it.pmap), n(it.n) {};
+
+        T &operator*() const { return pmap->GetEntry(n).kv; };
+        T *operator->() const { return &pmap->GetEntry(n).kv; };
+        Iterator &operator++() { ++n; return *this; };
+        Iterator operator++(int) { Iterator copy(*this); ++n; return copy; };
+        bool operator==(const Iterator &other) const { return n == other.n; };
+        bool operator!=(const Iterator &other) const { return n != other.n; };
+
+        template <typename U> friend class Iterator;
+    };
+
+    typedef Iterator<value_type> iterator;
+    typedef Iterator<const value_type> const_iterator;
+
+    CBlockIndexMap() {};
+    ~CBlockIndexMap() { clear(); };
+
+    CBlockIndexMap(const CBlockIndexMap&) = delete;
+    CBlockIndexMap &operator=(const CBlockIndexMap&) = delete;
+
+    iterator find(const uint256 &hash) { return iterator(this, Lookup(hash)); };
+    const_iterator find(const uint256 &hash) const { return const_iterator(this, Lookup(hash)); };
+    size_type count(const uint256 &hash) const { return Lookup(hash) != nEntries ? 1 : 0; };
+
+    /** Lookup only, returns nullptr if hash is not in the map. */
+    CBlockIndex *operator[](const uint256 &hash) const
+    {
+        uint32_t n = Lookup(hash);
+        return n != nEntries ? &GetEntry(n).index : nullptr;
+    };
+
+    /**
+     * Construct a CBlockIndex from args for hash, with phashBlock pointing to the stored hash.
+     * Returns the existing entry and false if hash is already in the map.
+     */
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(const uint256 &hash, Args&&... args)
+    {
+        uint32_t n = Lookup(hash);
+        if (n != nEntries)
+            return std::make_pair(iterator(this, n), false);
+
+        new (AllocateEntry()) Entry(hash, std::forward<Args>(args)...);
+        AddSlot(hash);
+        return std::make_pair(iterator(this, nEntries - 1), true);
+    };
+
+    iterator begin() { return iterator(this, 0); };
+    iterator end() { return iterator(this, nEntries); };
+    const_iterator begin() const { return const_iterator(this, 0); };
+    const_iterator end() const { return const_iterator(this, nEntries); };
+
+    bool empty() const { return nEntries == 0; };
+    size_type size() const { return nEntries; };
+
+    void clear();
+
+    size_t DynamicMemoryUsage() const;
+};
+
+#endif // PARTICL_BLOCKINDEXMAP_H
@@ -180,7 +180,10 @@ enum BlockStatus: uint32_t {
 class CBlockIndex
 {
 public:
-    //! pointer to the hash of the block, if any. Memory is owned by this CBlockIndex
+    // Members are ordered by how often they are read when walking the index, fields used by
+    // GetAncestor, GetMedianTimePast and chain selection come first to share a cache line.
+
+    //! pointer to the hash of the block, if any. Memory is owned by mapBlockIndex
     const uint256* phashBlock;
 
     //! pointer to the index of the predecessor of this block
@@ -192,51 +195,55 @@ public:
     //! height of the entry in the chain. The genesis block has height 0
     int nHeight;
 
-    //! Which # file this block is stored in (blk?????.dat)
-    int nFile;
-
-    //! Byte offset within blk?????.dat where this block's data is stored
-    unsigned int nDataPos;
+    //! Verification status of this block. See enum BlockStatus
+    unsigned int nStatus;
 
-    //! Byte offset within rev?????.dat where this block's undo data is stored
-    unsigned int nUndoPos;
+    //! block header time
+    unsigned int nTime;
 
-    //! (memory only) Total amount of work (expected number of hashes) in the chain up to and including this block
-    arith_uint256 nChainWork;
+    //! (memory only) Maximum nTime in the chain upto and including this block.
+    unsigned int nTimeMax;
 
-    //! Number of transactions in this block.
-    //! Note: in a potential headers-first mode, this number cannot be relied upon
-    unsigned int nTx;
+    //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
+    int32_t nSequenceId;
 
     //! (memory only) Number of transactions in the chain up to and including this block.
     //! This value will be non-zero only if and only if transactions for this block and all its parents are available.
     //! Change to 64-bit type when necessary; won't happen before 2030
     unsigned int nChainTx;
 
+    //! Number of transactions in this block.
+    //! Note: in a potential headers-first mode, this number cannot be relied upon
+    unsigned int nTx;
 
-    // proof-of-stake specific fields
     unsigned int nFlags;  // pos: block index flags
-    uint256 bnStakeModifier; // hash modifier for proof-of-stake
-    COutPoint prevoutStake;
-    //uint256 hashProof;
-    CAmount nMoneySupply;
 
-    //! Verification status of this block. See enum BlockStatus
-    unsigned int nStatus;
+    //! (memory only) Total amount of work (expected number of hashes) in the chain up to and including this block
+    arith_uint256 nChainWork;
+
+    //! Which # file this block is stored in (blk?????.dat)
+    int nFile;
+
+    //! Byte offset within blk?????.dat where this block's data is stored
+    unsigned int nDataPos;
+
+    //! Byte offset within rev?????.dat where this block's undo data is stored
+    unsigned int nUndoPos;
 
     //! block header
     int nVersion;
-    uint256 hashMerkleRoot;
-    uint256 hashWitnessMerkleRoot;
-    unsigned int nTime;
     unsigned int nBits;
     unsigned int nNonce;
 
-    //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
-    int32_t nSequenceId;
+    // proof-of-stake specific fields
+    CAmount nMoneySupply;
+    uint256 bnStakeModifier; // hash modifier for proof-of-stake
+    COutPoint prevoutStake;
+    //uint256 hashProof;
 
-    //! (memory only) Maximum nTime in the chain upto and including this block.
-    unsigned int nTimeMax;
+    //! block header, only read to rebuild the header
+    uint256 hashMerkleRoot;
+    uint256 hashWitnessMerkleRoot;
 
     void SetNull()
     {
@@ -7,6 +7,7 @@
 #include "consensus/consensus.h"
 #include "memusage.h"
 #include "random.h"
+#include "streams.h"
 
 #include <assert.h>
 
@@ -33,6 +34,65 @@ bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock)
 CCoinsViewCursor *CCoinsViewBacked::Cursor() const { return base->Cursor(); }
 size_t CCoinsViewBacked::EstimateSize() const { return base->EstimateSize(); }
 
+static void SerializeCoinsSetElement(std::vector<unsigned char> &vData, const COutPoint &outpoint, const Coin &coin)
+{
+    CVectorWriter(SER_DISK, PROTOCOL_VERSION, vData, 0) << outpoint << coin;
+}
+
+void CCoinsSetStats::Add(const COutPoint &outpoint, const Coin &coin)
+{
+    std::vector<unsigned char> vData;
+    SerializeCoinsSetElement(vData, outpoint, coin);
+    muhash.Insert(vData.data(), vData.size());
+
+    if (coin.nType == OUTPUT_STANDARD)
+    {
+        nTransactionOutputs++;
+        nTotalAmount += coin.out.nValue;
+    } else
+    if (coin.nType == OUTPUT_CT)
+    {
+        nBlindedTransactionOutputs++;
+    };
+    nBogoSize += GetCoinBogoSize(coin);
+}
+
+void CCoinsSetStats::Remove(const COutPoint &outpoint, const Coin &coin)
+{
+    std::vector<unsigned char> vData;
+    SerializeCoinsSetElement(vData, outpoint, coin);
+    muhash.Remove(vData.data(), vData.size());
+
+    if (coin.nType == OUTPUT_STANDARD)
+    {
+        nTransactionOutputs--;
+        nTotalAmount -= coin.out.nValue;
+    } else
+    if (coin.nType == OUTPUT_CT)
+    {
+        nBlindedTransactionOutputs--;
+    };
+    nBogoSize -= GetCoinBogoSize(coin);
+}
+
+CCoinsSetStats &CCoinsSetStats::operator+=(const CCoinsSetStats &b)
+{
+    nTransactionOutputs += b.nTransactionOutputs;
+    nBlindedTransactionOutputs += b.nBlindedTransactionOutputs;
+    nBogoSize += b.nBogoSize;
+    nTotalAmount += b.nTotalAmount;
+    muhash *= b.muhash;
+    return *this;
+}
+
+uint256 CCoinsSetStats::GetMuHash() const
+{
+    MuHash3072 tmp(muhash);
+    uint256 hash;
+    tmp.Finalize(hash.begin());
+    return hash;
+}
+
 SaltedOutpointHasher::SaltedOutpointHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
 CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), cachedCoinsUsage(0) { }
@@ -181,6 +241,23 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) { // Ignore non-dirty entries (optimization).
             CCoinsMap::iterator itUs = cacheCoins.find(it->first);
+            if (pStatsTracker)
+            {
+                // Replace the coin this view currently has for the outpoint
+                if (itUs != cacheCoins.end())
+                {
+                    if (!itUs->second.coin.IsSpent())
+                        pStatsTracker->Remove(it->first, itUs->second.coin);
+                } else
+                if (!(it->second.flags & CCoinsCacheEntry::FRESH))
+                {
+                    Coin coinOld;
+                    if (base->GetCoin(it->first, coinOld))
+                        pStatsTracker->Remove(it->first, coinOld);
+                };
+                if (!it->second.coin.IsSpent())
+                    pStatsTracker->Add(it->first, it->second.coin);
+            };
             if (itUs == cacheCoins.end()) {
                 // The parent cache does not have an entry, while the child does
                 // We can ignore it if it's both FRESH and pruned in the child
@@ -230,6 +307,8 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
         mapCoins.erase(itOld);
     }
     hashBlock = hashBlockIn;
+    if (pStatsTracker)
+        pStatsTracker->hashBlock = hashBlockIn;
     return true;
 }
 
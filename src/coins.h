@@ -9,6 +9,7 @@
 #include "primitives/transaction.h"
 #include "compressor.h"
 #include "core_memusage.h"
+#include "crypto/muhash.h"
 #include "hash.h"
 #include "memusage.h"
 #include "serialize.h"
@@ -232,6 +233,67 @@ public:
 };
 
 
+/** Serialized size of a coin as counted by gettxoutsetinfo bogosize */
+inline uint64_t GetCoinBogoSize(const Coin &coin)
+{
+    return 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
+           2 /* scriptPubKey len */ + coin.out.scriptPubKey.size() /* scriptPubKey */
+           + 1 /* nType */ + 33 /* commitment */;
+};
+
+/**
+ * Order independent statistics of a set of unspent outputs.
+ * Outputs can be added and removed in any order and the statistics of disjoint sets can be
+ * combined, so the totals can be kept up to date as blocks are connected and disconnected or
+ * computed over ranges of the coins db in parallel.
+ */
+class CCoinsSetStats
+{
+public:
+    uint256 hashBlock;
+    int64_t nTransactionOutputs;
+    int64_t nBlindedTransactionOutputs;
+    int64_t nBogoSize;
+    CAmount nTotalAmount;
+    MuHash3072 muhash; // Over the serialized (COutPoint, Coin) pairs
+
+    CCoinsSetStats()
+    {
+        SetNull();
+    };
+
+    void SetNull()
+    {
+        hashBlock.SetNull();
+        nTransactionOutputs = 0;
+        nBlindedTransactionOutputs = 0;
+        nBogoSize = 0;
+        nTotalAmount = 0;
+        muhash = MuHash3072();
+    };
+
+    void Add(const COutPoint &outpoint, const Coin &coin);
+    void Remove(const COutPoint &outpoint, const Coin &coin);
+
+    CCoinsSetStats &operator+=(const CCoinsSetStats &b);
+
+    /** Finalize a copy of the muhash, the stats remain usable */
+    uint256 GetMuHash() const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action)
+    {
+        READWRITE(hashBlock);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nBlindedTransactionOutputs);
+        READWRITE(nBogoSize);
+        READWRITE(nTotalAmount);
+        READWRITE(muhash);
+    };
+};
+
 /** CCoinsView that adds a memory cache for transactions to another CCoinsView */
 class CCoinsViewCache : public CCoinsViewBacked
 {
@@ -257,6 +319,9 @@ public:
     mutable std::vector<std::pair<int64_t, CAnonOutput> > anonOutputs;
     mutable std::map<CCmpPubKey, int64_t> anonOutputLinks;
     mutable std::vector<std::pair<CCmpPubKey, uint256> > keyImages;
+
+    //! Kept up to date with the coins written into this cache by BatchWrite, if set
+    CCoinsSetStats *pStatsTracker = nullptr;
     
     bool ReadRCTOutputLink(CCmpPubKey &pk, int64_t &index)
     {
@@ -281,6 +346,7 @@ public:
     uint256 GetBestBlock() const override;
     void SetBestBlock(const uint256 &hashBlock);
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    void SetStatsTracker(CCoinsSetStats *pStats) { pStatsTracker = pStats; }
     CCoinsViewCursor* Cursor() const override {
         throw std::logic_error("CCoinsViewCache cursor iteration not supported.");
     }
@@ -12,6 +12,7 @@
 
 #include "blind.h"
 #include "anon.h"
+#include "rctcache.h"
 #include "timedata.h"
 #include "util.h"
 
@@ -214,21 +215,31 @@ bool CheckStandardOutput(CValidationState &state, const Consensus::Params& conse
     return true;
 }
 
-bool CheckBlindOutput(CValidationState &state, const CTxOutCT *p)
+bool VerifyRangeproof(const CTxOutBase *p, bool fCacheStore)
 {
-    if (p->vData.size() < 33 || p->vData.size() > 33 + 5)
-        return state.DoS(100, false, REJECT_INVALID, "bad-ctout-ephem-size");
-
-    size_t nRangeProofLen = 5134;
-    if (p->vRangeproof.size() > nRangeProofLen)
-        return state.DoS(100, false, REJECT_INVALID, "bad-ctout-rangeproof-size");
+    const secp256k1_pedersen_commitment *pcommitment;
+    const std::vector<uint8_t> *pvRangeproof;
+    switch (p->nVersion)
+    {
+        case OUTPUT_CT:
+            pcommitment = &((const CTxOutCT*)p)->commitment;
+            pvRangeproof = &((const CTxOutCT*)p)->vRangeproof;
+            break;
+        case OUTPUT_RINGCT:
+            pcommitment = &((const CTxOutRingCT*)p)->commitment;
+            pvRangeproof = &((const CTxOutRingCT*)p)->vRangeproof;
+            break;
+        default:
+            return false;
+    };
 
-    if ((fBusyImporting) && fSkipRangeproof)
+    uint256 entry = RCTCacheRangeproofEntry(pcommitment, *pvRangeproof);
+    if (RCTCacheGet(entry, !fCacheStore))
         return true;
 
     uint64_t min_value, max_value;
     int rv = secp256k1_rangeproof_verify(secp256k1_ctx_blind, &min_value, &max_value,
-        &p->commitment, p->vRangeproof.data(), p->vRangeproof.size(),
+        pcommitment, pvRangeproof->data(), pvRangeproof->size(),
         nullptr, 0,
         secp256k1_generator_h);
 
@@ -237,12 +248,32 @@ bool CheckBlindOutput(CValidationState &state, const CTxOutCT *p)
             rv, FormatMoney((CAmount)min_value), FormatMoney((CAmount)max_value));
 
     if (rv != 1)
+        return false;
+
+    if (fCacheStore)
+        RCTCacheSet(entry);
+    return true;
+}
+
+bool CheckBlindOutput(CValidationState &state, const CTxOutCT *p, bool fVerifyRangeproof)
+{
+    if (p->vData.size() < 33 || p->vData.size() > 33 + 5)
+        return state.DoS(100, false, REJECT_INVALID, "bad-ctout-ephem-size");
+
+    size_t nRangeProofLen = 5134;
+    if (p->vRangeproof.size() > nRangeProofLen)
+        return state.DoS(100, false, REJECT_INVALID, "bad-ctout-rangeproof-size");
+
+    if (!fVerifyRangeproof || (fBusyImporting && fSkipRangeproof))
+        return true;
+
+    if (!VerifyRangeproof(p))
         return state.DoS(100, false, REJECT_INVALID, "bad-ctout-rangeproof-verify");
 
     return true;
 }
 
-bool CheckAnonOutput(CValidationState &state, const CTxOutRingCT *p)
+bool CheckAnonOutput(CValidationState &state, const CTxOutRingCT *p, bool fVerifyRangeproof)
 {
     if (Params().NetworkID() == "main")
         return state.DoS(100, false, REJECT_INVALID, "AnonOutput in mainnet");
@@ -254,20 +285,10 @@ bool CheckAnonOutput(CValidationState &state, const CTxOutRingCT *p)
     if (p->vRangeproof.size() > nRangeProofLen)
         return state.DoS(100, false, REJECT_INVALID, "bad-rctout-rangeproof-size");
 
-    if ((fBusyImporting) && fSkipRangeproof)
+    if (!fVerifyRangeproof || (fBusyImporting && fSkipRangeproof))
         return true;
 
-    uint64_t min_value, max_value;
-    int rv = secp256k1_rangeproof_verify(secp256k1_ctx_blind, &min_value, &max_value,
-        &p->commitment, p->vRangeproof.data(), p->vRangeproof.size(),
-        nullptr, 0,
-        secp256k1_generator_h);
-
-    if (LogAcceptCategory(BCLog::RINGCT))
-        LogPrintf("%s: rv, min_value, max_value %d, %s, %s\n", __func__,
-            rv, FormatMoney((CAmount)min_value), FormatMoney((CAmount)max_value));
-
-    if (rv != 1)
+    if (!VerifyRangeproof(p))
         return state.DoS(100, false, REJECT_INVALID, "bad-rctout-rangeproof-verify");
 
     return true;
@@ -285,7 +306,7 @@ bool CheckDataOutput(CValidationState &state, const CTxOutData *p)
     return true;
 }
 
-bool CheckTransaction(const CTransaction& tx, CValidationState &state, bool fCheckDuplicateInputs)
+bool CheckTransaction(const CTransaction& tx, CValidationState &state, bool fCheckDuplicateInputs, bool fVerifyRangeproofs)
 {
     // Basic checks that don't depend on any context
     if (tx.vin.empty())
@@ -316,11 +337,11 @@ bool CheckTransaction(const CTransaction& tx, CValidationState &state, bool fChe
                     nStandardOutputs++;
                     break;
                 case OUTPUT_CT:
-                    if (!CheckBlindOutput(state, (CTxOutCT*) txout.get()))
+                    if (!CheckBlindOutput(state, (CTxOutCT*) txout.get(), fVerifyRangeproofs))
                         return false;
                     break;
                 case OUTPUT_RINGCT:
-                    if (!CheckAnonOutput(state, (CTxOutRingCT*) txout.get()))
+                    if (!CheckAnonOutput(state, (CTxOutRingCT*) txout.get(), fVerifyRangeproofs))
                         return false;
                     break;
                 case OUTPUT_DATA:
@@ -11,12 +11,18 @@
 class CBlockIndex;
 class CCoinsViewCache;
 class CTransaction;
+class CTxOutBase;
 class CValidationState;
 
 /** Transaction validation functions */
 
-/** Context-independent validity checks */
-bool CheckTransaction(const CTransaction& tx, CValidationState& state, bool fCheckDuplicateInputs=true);
+/** Context-independent validity checks
+ * Set fVerifyRangeproofs to false when the caller verifies the output rangeproofs itself.
+ */
+bool CheckTransaction(const CTransaction& tx, CValidationState& state, bool fCheckDuplicateInputs=true, bool fVerifyRangeproofs=true);
+
+/** Verify the rangeproof of a blinded or anon output, results are cached in the rct cache */
+bool VerifyRangeproof(const CTxOutBase *p, bool fCacheStore=true);
 
 namespace Consensus {
 /**
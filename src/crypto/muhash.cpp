@@ -0,0 +1,250 @@
+// Copyright (c) 2017 The Particl Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/muhash.h"
+
+#include "crypto/chacha20.h"
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+
+#include <assert.h>
+#include <limits>
+#include <string.h>
+
+namespace {
+
+typedef Num3072::limb_t limb_t;
+typedef Num3072::double_limb_t double_limb_t;
+const int LIMB_SIZE = Num3072::LIMB_SIZE;
+const int LIMBS = Num3072::LIMBS;
+/** 2^3072 - MAX_PRIME_DIFF is the modulus */
+const limb_t MAX_PRIME_DIFF = 1103717;
+
+/** Extract the lowest limb of [c0,c1,c2] into n, and left shift the number by 1 limb. */
+inline void extract3(limb_t &c0, limb_t &c1, limb_t &c2, limb_t &n)
+{
+    n = c0;
+    c0 = c1;
+    c1 = c2;
+    c2 = 0;
+}
+
+/** [c0,c1] = a * b */
+inline void mul(limb_t &c0, limb_t &c1, const limb_t &a, const limb_t &b)
+{
+    double_limb_t t = (double_limb_t)a * b;
+    c1 = t >> LIMB_SIZE;
+    c0 = t;
+}
+
+/** [c0,c1,c2] += n * [d0,d1,d2], c2 is 0 initially */
+inline void mulnadd3(limb_t &c0, limb_t &c1, limb_t &c2, limb_t &d0, limb_t &d1, limb_t &d2, const limb_t &n)
+{
+    double_limb_t t = (double_limb_t)d0 * n + c0;
+    c0 = t;
+    t >>= LIMB_SIZE;
+    t += (double_limb_t)d1 * n + c1;
+    c1 = t;
+    t >>= LIMB_SIZE;
+    c2 = t + d2 * n;
+}
+
+/** [c0,c1] *= n */
+inline void muln2(limb_t &c0, limb_t &c1, const limb_t &n)
+{
+    double_limb_t t = (double_limb_t)c0 * n;
+    c0 = t;
+    t >>= LIMB_SIZE;
+    t += (double_limb_t)c1 * n;
+    c1 = t;
+}
+
+/** [c0,c1,c2] += a * b */
+inline void muladd3(limb_t &c0, limb_t &c1, limb_t &c2, const limb_t &a, const limb_t &b)
+{
+    double_limb_t t = (double_limb_t)a * b;
+    limb_t th = t >> LIMB_SIZE;
+    limb_t tl = t;
+
+    c0 += tl;
+    th += (c0 < tl) ? 1 : 0;
+    c1 += th;
+    c2 += (c1 < th) ? 1 : 0;
+}
+
+/** [c0,c1] += a, then extract the lowest limb of [c0,c1] into n and left shift the number by 1 limb. */
+inline void addnextract2(limb_t &c0, limb_t &c1, const limb_t &a, limb_t &n)
+{
+    limb_t c2 = 0;
+
+    c0 += a;
+    if (c0 < a)
+    {
+        c1 += 1;
+        if (c1 == 0)
+            c2 = 1;
+    };
+
+    n = c0;
+    c0 = c1;
+    c1 = c2;
+}
+
+} // namespace
+
+Num3072::Num3072(const unsigned char (&data)[BYTE_SIZE])
+{
+    for (int i = 0; i < LIMBS; ++i)
+    {
+#ifdef __SIZEOF_INT128__
+        limbs[i] = ReadLE64(data + 8 * i);
+#else
+        limbs[i] = ReadLE32(data + 4 * i);
+#endif
+    };
+}
+
+void Num3072::ToBytes(unsigned char (&out)[BYTE_SIZE]) const
+{
+    for (int i = 0; i < LIMBS; ++i)
+    {
+#ifdef __SIZEOF_INT128__
+        WriteLE64(out + 8 * i, limbs[i]);
+#else
+        WriteLE32(out + 4 * i, limbs[i]);
+#endif
+    };
+}
+
+void Num3072::SetToOne()
+{
+    limbs[0] = 1;
+    for (int i = 1; i < LIMBS; ++i)
+        limbs[i] = 0;
+}
+
+/** True if the value is >= the modulus */
+bool Num3072::IsOverflow() const
+{
+    if (limbs[0] <= std::numeric_limits<limb_t>::max() - MAX_PRIME_DIFF)
+        return false;
+    for (int i = 1; i < LIMBS; ++i)
+        if (limbs[i] != std::numeric_limits<limb_t>::max())
+            return false;
+    return true;
+}
+
+/** Subtract the modulus, by adding MAX_PRIME_DIFF and dropping the carry */
+void Num3072::FullReduce()
+{
+    limb_t c0 = MAX_PRIME_DIFF;
+    limb_t c1 = 0;
+    for (int i = 0; i < LIMBS; ++i)
+        addnextract2(c0, c1, limbs[i], limbs[i]);
+}
+
+void Num3072::Multiply(const Num3072 &a)
+{
+    limb_t c0 = 0, c1 = 0, c2 = 0;
+    Num3072 tmp;
+
+    // Limbs 0..N-2 of this*a, the high half is folded in as 2^3072 = MAX_PRIME_DIFF (mod p)
+    for (int j = 0; j < LIMBS - 1; ++j)
+    {
+        limb_t d0 = 0, d1 = 0, d2 = 0;
+        mul(d0, d1, limbs[1 + j], a.limbs[LIMBS + j - (1 + j)]);
+        for (int i = 2 + j; i < LIMBS; ++i)
+            muladd3(d0, d1, d2, limbs[i], a.limbs[LIMBS + j - i]);
+        mulnadd3(c0, c1, c2, d0, d1, d2, MAX_PRIME_DIFF);
+        for (int i = 0; i < j + 1; ++i)
+            muladd3(c0, c1, c2, limbs[i], a.limbs[j - i]);
+        extract3(c0, c1, c2, tmp.limbs[j]);
+    };
+
+    // Limb N-1
+    assert(c2 == 0);
+    for (int i = 0; i < LIMBS; ++i)
+        muladd3(c0, c1, c2, limbs[i], a.limbs[LIMBS - 1 - i]);
+    extract3(c0, c1, c2, tmp.limbs[LIMBS - 1]);
+
+    // Fold in the remaining carry
+    muln2(c0, c1, MAX_PRIME_DIFF);
+    for (int j = 0; j < LIMBS; ++j)
+        addnextract2(c0, c1, tmp.limbs[j], limbs[j]);
+
+    assert(c1 == 0);
+    assert(c0 == 0 || c0 == 1);
+
+    if (IsOverflow())
+        FullReduce();
+    if (c0)
+        FullReduce();
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // a^(p-2), p - 2 = 2^3072 - MAX_PRIME_DIFF - 2 has every bit set above the lowest limb
+    Num3072 result;
+    for (int i = LIMBS - 1; i >= 0; --i)
+    {
+        limb_t e = i == 0 ? std::numeric_limits<limb_t>::max() - (MAX_PRIME_DIFF + 1) : std::numeric_limits<limb_t>::max();
+        for (int b = LIMB_SIZE - 1; b >= 0; --b)
+        {
+            Num3072 sq(result);
+            result.Multiply(sq);
+            if ((e >> b) & 1)
+                result.Multiply(*this);
+        };
+    };
+    return result;
+}
+
+void Num3072::Divide(const Num3072 &a)
+{
+    Multiply(a.GetInverse());
+}
+
+Num3072 MuHash3072::ToNum3072(const unsigned char *data, size_t len)
+{
+    unsigned char key[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(key);
+
+    unsigned char expanded[Num3072::BYTE_SIZE];
+    ChaCha20(key, sizeof(key)).Output(expanded, sizeof(expanded));
+    return Num3072(expanded);
+}
+
+void MuHash3072::Insert(const unsigned char *data, size_t len)
+{
+    numerator.Multiply(ToNum3072(data, len));
+}
+
+void MuHash3072::Remove(const unsigned char *data, size_t len)
+{
+    denominator.Multiply(ToNum3072(data, len));
+}
+
+MuHash3072 &MuHash3072::operator*=(const MuHash3072 &mul)
+{
+    numerator.Multiply(mul.numerator);
+    denominator.Multiply(mul.denominator);
+    return *this;
+}
+
+MuHash3072 &MuHash3072::operator/=(const MuHash3072 &div)
+{
+    numerator.Multiply(div.denominator);
+    denominator.Multiply(div.numerator);
+    return *this;
+}
+
+void MuHash3072::Finalize(unsigned char out[OUTPUT_SIZE])
+{
+    numerator.Divide(denominator);
+    denominator.SetToOne();
+
+    unsigned char data[Num3072::BYTE_SIZE];
+    numerator.ToBytes(data);
+    CSHA256().Write(data, sizeof(data)).Finalize(out);
+}
@@ -0,0 +1,97 @@
+// Copyright (c) 2017 The Particl Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_MUHASH_H
+#define BITCOIN_CRYPTO_MUHASH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** A number modulo the prime 2^3072 - 1103717. */
+class Num3072
+{
+public:
+    static const size_t BYTE_SIZE = 384;
+
+#ifdef __SIZEOF_INT128__
+    typedef unsigned __int128 double_limb_t;
+    typedef uint64_t limb_t;
+    static const int LIMBS = 48;
+    static const int LIMB_SIZE = 64;
+#else
+    typedef uint64_t double_limb_t;
+    typedef uint32_t limb_t;
+    static const int LIMBS = 96;
+    static const int LIMB_SIZE = 32;
+#endif
+    limb_t limbs[LIMBS];
+
+    Num3072() { SetToOne(); }
+    explicit Num3072(const unsigned char (&data)[BYTE_SIZE]);
+
+    void SetToOne();
+    void Multiply(const Num3072 &a);
+    /** Multiply by the inverse of a */
+    void Divide(const Num3072 &a);
+    void ToBytes(unsigned char (&out)[BYTE_SIZE]) const;
+
+private:
+    bool IsOverflow() const;
+    void FullReduce();
+    Num3072 GetInverse() const;
+};
+
+/**
+ * A hash of a set of byte strings, elements can be added and removed in any order.
+ *
+ * Each element is expanded to a 3072-bit number with ChaCha20 keyed by its SHA256, the set
+ * is the product of the numbers of its elements modulo 2^3072 - 1103717 (MuHash). Removed
+ * elements are multiplied into a denominator so only Finalize needs a modular inverse.
+ * Hashes of disjoint sets can be combined with *=.
+ */
+class MuHash3072
+{
+private:
+    Num3072 numerator;
+    Num3072 denominator;
+
+    static Num3072 ToNum3072(const unsigned char *data, size_t len);
+
+public:
+    static const size_t OUTPUT_SIZE = 32;
+
+    /** The empty set */
+    MuHash3072() {};
+
+    void Insert(const unsigned char *data, size_t len);
+    void Remove(const unsigned char *data, size_t len);
+
+    MuHash3072 &operator*=(const MuHash3072 &mul);
+    MuHash3072 &operator/=(const MuHash3072 &div);
+
+    /** SHA256 of the set value, normalises the internal state */
+    void Finalize(unsigned char out[OUTPUT_SIZE]);
+
+    template <typename Stream>
+    void Serialize(Stream &s) const
+    {
+        unsigned char data[Num3072::BYTE_SIZE];
+        numerator.ToBytes(data);
+        s.write((const char*)data, sizeof(data));
+        denominator.ToBytes(data);
+        s.write((const char*)data, sizeof(data));
+    };
+
+    template <typename Stream>
+    void Unserialize(Stream &s)
+    {
+        unsigned char data[Num3072::BYTE_SIZE];
+        s.read((char*)data, sizeof(data));
+        numerator = Num3072(data);
+        s.read((char*)data, sizeof(data));
+        denominator = Num3072(data);
+    };
+};
+
+#endif // BITCOIN_CRYPTO_MUHASH_H
@@ -10,13 +10,30 @@
 #include <atomic>
 
 #if defined(__x86_64__) || defined(__amd64__)
-#if defined(EXPERIMENTAL_ASM)
 #include <cpuid.h>
+#if defined(EXPERIMENTAL_ASM)
 namespace sha256_sse4
 {
 void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
 }
 #endif
+namespace sha256_sse2
+{
+void Transform4(uint32_t* s, const unsigned char* const* chunks, size_t blocks);
+void Transform4_D64(unsigned char* out, const unsigned char* in);
+}
+#if defined(ENABLE_SHANI)
+namespace sha256_shani
+{
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
+}
+#endif
+#if defined(ENABLE_AVX2)
+namespace sha256_avx2
+{
+void Transform8_D64(unsigned char* out, const unsigned char* in);
+}
+#endif
 #endif
 
 // Internal implementation code.
@@ -174,21 +191,185 @@ bool SelfTest(TransformType tr) {
 
 TransformType Transform = sha256::Transform;
 
+typedef void (*TransformLanesType)(uint32_t*, const unsigned char* const*, size_t);
+
+/** Transform each lane separately, for platforms without a multi-lane implementation. */
+void TransformLanes(uint32_t* s, const unsigned char* const* chunks, size_t blocks)
+{
+    for (size_t i = 0; i < CSHA256Lanes::LANES; ++i)
+        Transform(s + 8 * i, chunks[i], blocks);
+}
+
+bool SelfTestLanes(TransformLanesType tr)
+{
+    // Each lane must match the single lane transform for distinct inputs.
+    unsigned char in[CSHA256Lanes::LANES][128];
+    const unsigned char* chunks[CSHA256Lanes::LANES];
+    uint32_t buf[8 * CSHA256Lanes::LANES], expect[8 * CSHA256Lanes::LANES];
+    for (size_t i = 0; i < CSHA256Lanes::LANES; ++i) {
+        for (size_t k = 0; k < sizeof(in[i]); ++k)
+            in[i][k] = (unsigned char)(i * 131 + k * 7);
+        chunks[i] = in[i];
+        sha256::Initialize(buf + 8 * i);
+        sha256::Initialize(expect + 8 * i);
+        sha256::Transform(expect + 8 * i, in[i], 2);
+    }
+    tr(buf, chunks, 2);
+    return memcmp(buf, expect, sizeof(buf)) == 0;
+}
+
+TransformLanesType TransformLanesImpl = TransformLanes;
+
+/** Double SHA-256 of a 64-byte input, tr does the compressions. */
+void TransformD64With(TransformType tr, unsigned char* out, const unsigned char* in)
+{
+    // Padding blocks for a 64-byte and a 32-byte message
+    static const unsigned char padding1[64] = {0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0};
+    static const unsigned char padding2[32] = {0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0};
+    uint32_t s[8];
+    unsigned char buf[64];
+    sha256::Initialize(s);
+    tr(s, in, 1);
+    tr(s, padding1, 1);
+    for (int i = 0; i < 8; ++i)
+        WriteBE32(buf + 4 * i, s[i]);
+    memcpy(buf + 32, padding2, 32);
+    sha256::Initialize(s);
+    tr(s, buf, 1);
+    for (int i = 0; i < 8; ++i)
+        WriteBE32(out + 4 * i, s[i]);
+}
+
+/** Double SHA-256 of a 64-byte input with the selected transform. */
+void TransformD64(unsigned char* out, const unsigned char* in)
+{
+    TransformD64With(Transform, out, in);
+}
+
+/** Double SHA-256 of a 64-byte input with the generic transform. */
+void TransformD64Standard(unsigned char* out, const unsigned char* in)
+{
+    TransformD64With(sha256::Transform, out, in);
+}
+
+typedef void (*TransformD64Type)(unsigned char*, const unsigned char*);
+
+/** Must match TransformD64 for each of ways distinct inputs. */
+bool SelfTestD64(TransformD64Type tr, size_t ways)
+{
+    unsigned char in[64 * 8], out[32 * 8], expect[32 * 8];
+    assert(ways <= 8);
+    for (size_t k = 0; k < sizeof(in); ++k)
+        in[k] = (unsigned char)(k * 13 + 5);
+    for (size_t i = 0; i < ways; ++i)
+        TransformD64Standard(expect + 32 * i, in + 64 * i);
+    tr(out, in);
+    return memcmp(out, expect, 32 * ways) == 0;
+}
+
+TransformD64Type TransformD64_4way = nullptr;
+TransformD64Type TransformD64_8way = nullptr;
+
+std::string sha256_implementation = "standard";
+
+#if defined(__x86_64__) || defined(__amd64__)
+void inline cpuid(uint32_t leaf, uint32_t subleaf, uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d)
+{
+    __cpuid_count(leaf, subleaf, a, b, c, d);
+}
+
+/** Whether the OS saves the AVX registers on context switch. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
 } // namespace
 
-std::string SHA256AutoDetect()
+SHA256Kernels SHA256DetectKernels()
 {
-#if defined(EXPERIMENTAL_ASM) && (defined(__x86_64__) || defined(__amd64__))
+    SHA256Kernels kernels;
+    kernels.transform = sha256::Transform;
+    kernels.transform_d64 = TransformD64Standard;
+#if defined(__x86_64__) || defined(__amd64__)
     uint32_t eax, ebx, ecx, edx;
-    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx >> 19) & 1) {
-        Transform = sha256_sse4::Transform;
-        assert(SelfTest(Transform));
-        return "sse4";
+    cpuid(0, 0, eax, ebx, ecx, edx);
+    uint32_t max_leaf = eax;
+    cpuid(1, 0, eax, ebx, ecx, edx);
+    bool have_sse4 = (ecx >> 19) & 1;
+    bool have_avx = ((ecx >> 27) & 1) && ((ecx >> 28) & 1) && AVXEnabled(); // OSXSAVE and AVX
+    bool have_avx2 = false, have_shani = false;
+    if (max_leaf >= 7) {
+        cpuid(7, 0, eax, ebx, ecx, edx);
+        have_avx2 = have_avx && ((ebx >> 5) & 1);
+        have_shani = (ebx >> 29) & 1;
     }
+    (void)have_sse4; (void)have_avx2; (void)have_shani; // Unused when built without the optional units
+
+#if defined(EXPERIMENTAL_ASM)
+    if (have_sse4)
+        kernels.transform_sse4 = sha256_sse4::Transform;
+#endif
+#if defined(ENABLE_SHANI)
+    if (have_shani && have_sse4)
+        kernels.transform_shani = sha256_shani::Transform;
+#endif
+    kernels.transform4_sse2 = sha256_sse2::Transform4;
+    kernels.transform4_d64_sse2 = sha256_sse2::Transform4_D64;
+#if defined(ENABLE_AVX2)
+    if (have_avx2)
+        kernels.transform8_d64_avx2 = sha256_avx2::Transform8_D64;
+#endif
 #endif
+    return kernels;
+}
+
+std::string SHA256AutoDetect()
+{
+    std::string ret = "standard";
+    const SHA256Kernels kernels = SHA256DetectKernels();
+
+    if (kernels.transform_shani) {
+        Transform = kernels.transform_shani;
+        assert(SelfTest(Transform));
+        ret = "shani";
+    } else if (kernels.transform_sse4) {
+        Transform = kernels.transform_sse4;
+        assert(SelfTest(Transform));
+        ret = "sse4";
+    }
+
+    if (kernels.transform4_sse2) {
+        TransformLanesImpl = kernels.transform4_sse2;
+        assert(SelfTestLanes(TransformLanesImpl));
+    }
+
+    // A single SHA-NI stream outruns the SSE2 4-way kernel, the AVX2 8-way kernel keeps up with it
+    if (kernels.transform4_d64_sse2 && !kernels.transform_shani) {
+        TransformD64_4way = kernels.transform4_d64_sse2;
+        assert(SelfTestD64(TransformD64_4way, 4));
+        ret += ", sse2(4way)";
+    }
+    if (kernels.transform8_d64_avx2) {
+        TransformD64_8way = kernels.transform8_d64_avx2;
+        assert(SelfTestD64(TransformD64_8way, 8));
+        ret += ", avx2(8way)";
+    }
 
     assert(SelfTest(Transform));
-    return "standard";
+    sha256_implementation = ret;
+    return ret;
+}
+
+std::string SHA256Implementation()
+{
+    return sha256_implementation;
 }
 
 ////// SHA-256
@@ -247,3 +428,98 @@ CSHA256& CSHA256::Reset()
     sha256::Initialize(s);
     return *this;
 }
+
+////// SHA-256, multiple lanes
+
+CSHA256Lanes::CSHA256Lanes() : bytes(0)
+{
+    for (size_t i = 0; i < LANES; ++i)
+        sha256::Initialize(s + 8 * i);
+}
+
+CSHA256Lanes& CSHA256Lanes::Write(const unsigned char* const* data, size_t len)
+{
+    const unsigned char* chunks[LANES];
+    size_t bufsize = bytes % 64;
+    size_t done = 0;
+    if (bufsize && bufsize + len >= 64) {
+        // Fill the buffers, and process them.
+        for (size_t i = 0; i < LANES; ++i) {
+            memcpy(buf + 64 * i + bufsize, data[i], 64 - bufsize);
+            chunks[i] = buf + 64 * i;
+        }
+        bytes += 64 - bufsize;
+        done += 64 - bufsize;
+        TransformLanesImpl(s, chunks, 1);
+        bufsize = 0;
+    }
+    if (len - done >= 64) {
+        size_t blocks = (len - done) / 64;
+        for (size_t i = 0; i < LANES; ++i)
+            chunks[i] = data[i] + done;
+        TransformLanesImpl(s, chunks, blocks);
+        done += 64 * blocks;
+        bytes += 64 * blocks;
+    }
+    if (len > done) {
+        // Fill the buffers with what remains.
+        for (size_t i = 0; i < LANES; ++i)
+            memcpy(buf + 64 * i + bufsize, data[i] + done, len - done);
+        bytes += len - done;
+    }
+    return *this;
+}
+
+CSHA256Lanes& CSHA256Lanes::WriteAll(const unsigned char* data, size_t len)
+{
+    const unsigned char* lanes[LANES];
+    for (size_t i = 0; i < LANES; ++i)
+        lanes[i] = data;
+    return Write(lanes, len);
+}
+
+void CSHA256Lanes::Finalize(unsigned char hash[OUTPUT_SIZE * LANES])
+{
+    static const unsigned char pad[64] = {0x80};
+    unsigned char sizedesc[8];
+    WriteBE64(sizedesc, bytes << 3);
+    WriteAll(pad, 1 + ((119 - (bytes % 64)) % 64));
+    WriteAll(sizedesc, 8);
+    for (size_t i = 0; i < LANES; ++i)
+        for (size_t k = 0; k < 8; ++k)
+            WriteBE32(hash + OUTPUT_SIZE * i + 4 * k, s[8 * i + k]);
+}
+
+CSHA256Lanes& CSHA256Lanes::Reset()
+{
+    bytes = 0;
+    for (size_t i = 0; i < LANES; ++i)
+        sha256::Initialize(s + 8 * i);
+    return *this;
+}
+
+void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks)
+{
+    if (TransformD64_8way) {
+        while (blocks >= 8) {
+            TransformD64_8way(out, in);
+            out += 32 * 8;
+            in += 64 * 8;
+            blocks -= 8;
+        }
+    }
+    if (TransformD64_4way) {
+        while (blocks >= 4) {
+            TransformD64_4way(out, in);
+            out += 32 * 4;
+            in += 64 * 4;
+            blocks -= 4;
+        }
+    }
+    while (blocks) {
+        TransformD64(out, in);
+        out += 32;
+        in += 64;
+        --blocks;
+    }
+}
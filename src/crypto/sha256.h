@@ -26,9 +26,65 @@ public:
     CSHA256& Reset();
 };
 
+/** A hasher for LANES messages of equal length, hashed together by the multi-lane transform where available. */
+class CSHA256Lanes
+{
+public:
+    static const size_t OUTPUT_SIZE = CSHA256::OUTPUT_SIZE;
+    static const size_t LANES = 4;
+
+private:
+    uint32_t s[8 * LANES];
+    unsigned char buf[64 * LANES];
+    uint64_t bytes;
+
+public:
+    CSHA256Lanes();
+    /** Write len bytes to each lane, data[i] is the input for lane i. */
+    CSHA256Lanes& Write(const unsigned char* const* data, size_t len);
+    /** Write the same len bytes to every lane. */
+    CSHA256Lanes& WriteAll(const unsigned char* data, size_t len);
+    /** The hash of lane i is written to hash + OUTPUT_SIZE * i. */
+    void Finalize(unsigned char hash[OUTPUT_SIZE * LANES]);
+    CSHA256Lanes& Reset();
+};
+
+/** Compute the double SHA-256 of blocks 64-byte inputs.
+ *  out: blocks * 32 bytes, the hash of input i is written to out + 32 * i.
+ *  in: blocks * 64 bytes, may be the same buffer as out.
+ */
+void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks);
+
+/** The SHA-256 kernels built in and supported by this CPU, null when not available.
+ *  SHA256AutoDetect selects from these, they are exposed to test each against the generic code.
+ */
+struct SHA256Kernels
+{
+    typedef void (*TransformType)(uint32_t* s, const unsigned char* chunk, size_t blocks);
+    typedef void (*TransformLanesType)(uint32_t* s, const unsigned char* const* chunks, size_t blocks);
+    typedef void (*TransformD64Type)(unsigned char* out, const unsigned char* in);
+
+    /** Generic implementations */
+    TransformType transform = nullptr;
+    TransformD64Type transform_d64 = nullptr;
+
+    TransformType transform_sse4 = nullptr;
+    TransformType transform_shani = nullptr;
+    /** 4 lanes, chunks[i] is the input of lane i and s + 8 * i its state */
+    TransformLanesType transform4_sse2 = nullptr;
+    /** 4 and 8 way double SHA-256 of 64-byte inputs */
+    TransformD64Type transform4_d64_sse2 = nullptr;
+    TransformD64Type transform8_d64_avx2 = nullptr;
+};
+
+SHA256Kernels SHA256DetectKernels();
+
 /** Autodetect the best available SHA256 implementation.
  *  Returns the name of the implementation.
  */
 std::string SHA256AutoDetect();
 
+/** The implementation selected by SHA256AutoDetect, as returned by it. */
+std::string SHA256Implementation();
+
 #endif // BITCOIN_CRYPTO_SHA256_H
@@ -0,0 +1,159 @@
+// Copyright (c) 2017 The Particl Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// 8-way double SHA-256 of 64-byte inputs, each 32-bit AVX2 lane holds the state of an independent message.
+// Built with AVX2 enabled, only called after the cpuid check in SHA256AutoDetect.
+// Avoid inline functions from shared headers here, the linker may keep this unit's AVX2 copy for all callers.
+
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <immintrin.h>
+
+namespace sha256_avx2
+{
+namespace
+{
+static const uint32_t K256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+/** K + W for the padding block of a 64-byte message, its message schedule does not depend on the input. */
+static const uint32_t PADDING_KW[64] = {
+    0xc28a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf374,
+    0x649b69c1, 0xf0fe4786, 0x0fe1edc6, 0x240cf254, 0x4fe9346f, 0x6cc984be, 0x61b9411e, 0x16f988fa,
+    0xf2c65152, 0xa88e5a6d, 0xb019fc65, 0xb9d99ec7, 0x9a1231c3, 0xe70eeaa0, 0xfdb1232b, 0xc7353eb0,
+    0x3069bad5, 0xcb976d5f, 0x5a0f118f, 0xdc1eeefd, 0x0a35b689, 0xde0b7a04, 0x58f4ca9d, 0xe15d5b16,
+    0x007f3e86, 0x37088980, 0xa507ea32, 0x6fab9537, 0x17406110, 0x0d8cd6f1, 0xcdaa3b6d, 0xc0bbbe37,
+    0x83613bda, 0xdb48a363, 0x0b02e931, 0x6fd15ca7, 0x521afaca, 0x31338431, 0x6ed41a95, 0x6d437890,
+    0xc39c91f2, 0x9eccabbd, 0xb5c9a0e6, 0x532fb63c, 0xd2c741c6, 0x07237ea3, 0xa4954b68, 0x4c191d76,
+};
+
+__m256i inline K(uint32_t x) { return _mm256_set1_epi32(x); }
+
+__m256i inline Add(__m256i x, __m256i y) { return _mm256_add_epi32(x, y); }
+__m256i inline Add(__m256i x, __m256i y, __m256i z) { return Add(Add(x, y), z); }
+__m256i inline Add(__m256i x, __m256i y, __m256i z, __m256i w) { return Add(Add(x, y), Add(z, w)); }
+__m256i inline Add(__m256i x, __m256i y, __m256i z, __m256i w, __m256i v) { return Add(Add(x, y, z), Add(w, v)); }
+__m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+__m256i inline Xor(__m256i x, __m256i y, __m256i z) { return Xor(Xor(x, y), z); }
+__m256i inline Or(__m256i x, __m256i y) { return _mm256_or_si256(x, y); }
+__m256i inline And(__m256i x, __m256i y) { return _mm256_and_si256(x, y); }
+__m256i inline ShR(__m256i x, int n) { return _mm256_srli_epi32(x, n); }
+__m256i inline ShL(__m256i x, int n) { return _mm256_slli_epi32(x, n); }
+__m256i inline RotR(__m256i x, int n) { return Or(ShR(x, n), ShL(x, 32 - n)); }
+
+__m256i inline Ch(__m256i x, __m256i y, __m256i z) { return Xor(z, And(x, Xor(y, z))); }
+__m256i inline Maj(__m256i x, __m256i y, __m256i z) { return Or(And(x, y), And(z, Or(x, y))); }
+__m256i inline Sigma0(__m256i x) { return Xor(RotR(x, 2), RotR(x, 13), RotR(x, 22)); }
+__m256i inline Sigma1(__m256i x) { return Xor(RotR(x, 6), RotR(x, 11), RotR(x, 25)); }
+__m256i inline sigma0(__m256i x) { return Xor(RotR(x, 7), RotR(x, 18), ShR(x, 3)); }
+__m256i inline sigma1(__m256i x) { return Xor(RotR(x, 17), RotR(x, 19), ShR(x, 10)); }
+
+uint32_t inline LoadBE32(const unsigned char* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+void inline StoreBE32(unsigned char* p, uint32_t x)
+{
+    p[0] = x >> 24;
+    p[1] = x >> 16;
+    p[2] = x >> 8;
+    p[3] = x;
+}
+
+/** Load big endian word i of each lane, input for lane j is at in + 64 * j. */
+__m256i inline Read8(const unsigned char* in, int i)
+{
+    return _mm256_set_epi32(
+        LoadBE32(in + 448 + 4 * i), LoadBE32(in + 384 + 4 * i), LoadBE32(in + 320 + 4 * i), LoadBE32(in + 256 + 4 * i),
+        LoadBE32(in + 192 + 4 * i), LoadBE32(in + 128 + 4 * i), LoadBE32(in + 64 + 4 * i), LoadBE32(in + 4 * i));
+}
+
+/** Write word i of the state of each lane big endian, output for lane j is at out + 32 * j. */
+void inline Write8(unsigned char* out, int i, __m256i x)
+{
+    uint32_t v[8];
+    _mm256_storeu_si256((__m256i*)v, x);
+    for (int j = 0; j < 8; ++j)
+        StoreBE32(out + 32 * j + 4 * i, v[j]);
+}
+
+void inline Round(__m256i a, __m256i b, __m256i c, __m256i& d, __m256i e, __m256i f, __m256i g, __m256i& h, __m256i kw)
+{
+    __m256i t1 = Add(h, Sigma1(e), Ch(e, f, g), kw);
+    __m256i t2 = Add(Sigma0(a), Maj(a, b, c));
+    d = Add(d, t1);
+    h = Add(t1, t2);
+}
+
+/** 64 rounds over the state in x, w holds the first 16 words of the message schedule. */
+void inline Compress(__m256i* x, __m256i* w)
+{
+    for (int i = 0; i < 64; ++i)
+    {
+        if (i >= 16)
+            w[i & 15] = Add(w[i & 15], sigma1(w[(i - 2) & 15]), w[(i - 7) & 15], sigma0(w[(i - 15) & 15]));
+        Round(x[(64 - i) & 7], x[(65 - i) & 7], x[(66 - i) & 7], x[(67 - i) & 7],
+              x[(68 - i) & 7], x[(69 - i) & 7], x[(70 - i) & 7], x[(71 - i) & 7], Add(K(K256[i]), w[i & 15]));
+    }
+}
+
+void inline Initialize8(__m256i* x)
+{
+    x[0] = K(0x6a09e667ul);
+    x[1] = K(0xbb67ae85ul);
+    x[2] = K(0x3c6ef372ul);
+    x[3] = K(0xa54ff53aul);
+    x[4] = K(0x510e527ful);
+    x[5] = K(0x9b05688cul);
+    x[6] = K(0x1f83d9abul);
+    x[7] = K(0x5be0cd19ul);
+}
+} // namespace
+
+/** Double SHA-256 of 8 64-byte inputs, input i is at in + 64 * i and its hash is written to out + 32 * i. */
+void Transform8_D64(unsigned char* out, const unsigned char* in)
+{
+    __m256i x[8], s[8], w[16];
+
+    // First hash, the input block
+    Initialize8(x);
+    for (int i = 0; i < 16; ++i)
+        w[i] = Read8(in, i);
+    Compress(x, w);
+    Initialize8(s);
+    for (int i = 0; i < 8; ++i)
+        x[i] = s[i] = Add(x[i], s[i]);
+
+    // First hash, the padding block, its schedule is precomputed
+    for (int i = 0; i < 64; ++i)
+        Round(x[(64 - i) & 7], x[(65 - i) & 7], x[(66 - i) & 7], x[(67 - i) & 7],
+              x[(68 - i) & 7], x[(69 - i) & 7], x[(70 - i) & 7], x[(71 - i) & 7], K(PADDING_KW[i]));
+    for (int i = 0; i < 8; ++i)
+        w[i] = Add(x[i], s[i]);
+
+    // Second hash, the 32-byte digest and its padding
+    w[8] = K(0x80000000ul);
+    for (int i = 9; i < 15; ++i)
+        w[i] = _mm256_setzero_si256();
+    w[15] = K(256);
+    Initialize8(x);
+    Compress(x, w);
+    Initialize8(s);
+    for (int i = 0; i < 8; ++i)
+        Write8(out, i, Add(x[i], s[i]));
+}
+}
+
+#endif
@@ -0,0 +1,83 @@
+// Copyright (c) 2017 The Particl Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// SHA-256 transform using the Intel SHA extensions, the state is kept as ABEF/CDGH for sha256rnds2.
+// Built with SHA-NI and SSE4.1 enabled, only called after the cpuid check in SHA256AutoDetect.
+// Avoid inline functions from shared headers here, the linker may keep this unit's copy for all callers.
+
+#ifdef ENABLE_SHANI
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <immintrin.h>
+
+namespace sha256_shani
+{
+namespace
+{
+alignas(16) static const uint32_t K256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+} // namespace
+
+/** Perform a number of SHA-256 transformations, processing 64-byte chunks. */
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bull, 0x0405060700010203ull);
+    __m128i m[4], msg, s0, s1, so0, so1;
+
+    // ABCD, EFGH to ABEF, CDGH
+    s0 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)s), 0xB1);
+    s1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(s + 4)), 0x1B);
+    so0 = _mm_alignr_epi8(s0, s1, 8);
+    s1 = _mm_blend_epi16(s1, s0, 0xF0);
+    s0 = so0;
+
+    while (blocks--)
+    {
+        so0 = s0;
+        so1 = s1;
+
+        // 16 groups of four rounds, message words 16 onwards are expanded four at a time
+        for (int q = 0; q < 16; ++q)
+        {
+            if (q < 4)
+                m[q] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(chunk + 16 * q)), mask);
+
+            msg = _mm_add_epi32(m[q & 3], _mm_load_si128((const __m128i*)(K256 + 4 * q)));
+            s1 = _mm_sha256rnds2_epu32(s1, s0, msg);
+
+            if (q >= 3 && q < 15)
+                m[(q + 1) & 3] = _mm_sha256msg2_epu32(
+                    _mm_add_epi32(m[(q + 1) & 3], _mm_alignr_epi8(m[q & 3], m[(q - 1) & 3], 4)), m[q & 3]);
+
+            s0 = _mm_sha256rnds2_epu32(s0, s1, _mm_shuffle_epi32(msg, 0x0E));
+
+            if (q >= 1 && q < 13)
+                m[(q - 1) & 3] = _mm_sha256msg1_epu32(m[(q - 1) & 3], m[q & 3]);
+        }
+
+        s0 = _mm_add_epi32(s0, so0);
+        s1 = _mm_add_epi32(s1, so1);
+        chunk += 64;
+    }
+
+    // ABEF, CDGH back to ABCD, EFGH
+    so0 = _mm_shuffle_epi32(s0, 0x1B);
+    s1 = _mm_shuffle_epi32(s1, 0xB1);
+    s0 = _mm_blend_epi16(so0, s1, 0xF0);
+    s1 = _mm_alignr_epi8(s1, so0, 8);
+    _mm_storeu_si128((__m128i*)s, s0);
+    _mm_storeu_si128((__m128i*)(s + 4), s1);
+}
+}
+
+#endif
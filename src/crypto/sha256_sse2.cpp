@@ -0,0 +1,226 @@
+// Copyright (c) 2017 The Particl Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// 4-way SHA-256 transforms, each 32-bit SSE2 lane holds the state of an independent message.
+// SSE2 is part of the x86-64 baseline, no runtime detection is needed.
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(__x86_64__) || defined(__amd64__)
+
+#include <emmintrin.h>
+
+#include "crypto/common.h"
+
+namespace sha256_sse2
+{
+namespace
+{
+static const uint32_t K256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+__m128i inline K(uint32_t x) { return _mm_set1_epi32(x); }
+
+__m128i inline Add(__m128i x, __m128i y) { return _mm_add_epi32(x, y); }
+__m128i inline Add(__m128i x, __m128i y, __m128i z) { return Add(Add(x, y), z); }
+__m128i inline Add(__m128i x, __m128i y, __m128i z, __m128i w) { return Add(Add(x, y), Add(z, w)); }
+__m128i inline Add(__m128i x, __m128i y, __m128i z, __m128i w, __m128i v) { return Add(Add(x, y, z), Add(w, v)); }
+__m128i inline Xor(__m128i x, __m128i y) { return _mm_xor_si128(x, y); }
+__m128i inline Xor(__m128i x, __m128i y, __m128i z) { return Xor(Xor(x, y), z); }
+__m128i inline Or(__m128i x, __m128i y) { return _mm_or_si128(x, y); }
+__m128i inline And(__m128i x, __m128i y) { return _mm_and_si128(x, y); }
+__m128i inline ShR(__m128i x, int n) { return _mm_srli_epi32(x, n); }
+__m128i inline ShL(__m128i x, int n) { return _mm_slli_epi32(x, n); }
+__m128i inline RotR(__m128i x, int n) { return Or(ShR(x, n), ShL(x, 32 - n)); }
+
+__m128i inline Ch(__m128i x, __m128i y, __m128i z) { return Xor(z, And(x, Xor(y, z))); }
+__m128i inline Maj(__m128i x, __m128i y, __m128i z) { return Or(And(x, y), And(z, Or(x, y))); }
+__m128i inline Sigma0(__m128i x) { return Xor(RotR(x, 2), RotR(x, 13), RotR(x, 22)); }
+__m128i inline Sigma1(__m128i x) { return Xor(RotR(x, 6), RotR(x, 11), RotR(x, 25)); }
+__m128i inline sigma0(__m128i x) { return Xor(RotR(x, 7), RotR(x, 18), ShR(x, 3)); }
+__m128i inline sigma1(__m128i x) { return Xor(RotR(x, 17), RotR(x, 19), ShR(x, 10)); }
+
+/** Load big endian word i of the current chunk of each lane. */
+__m128i inline Read4(const unsigned char* const* chunks, size_t offset, int i)
+{
+    return _mm_set_epi32(
+        ReadBE32(chunks[3] + offset + 4 * i), ReadBE32(chunks[2] + offset + 4 * i),
+        ReadBE32(chunks[1] + offset + 4 * i), ReadBE32(chunks[0] + offset + 4 * i));
+}
+
+/** Lanes of the state are stored message major, s[8 * lane + word]. */
+__m128i inline Load4(const uint32_t* s, int i)
+{
+    return _mm_set_epi32(s[24 + i], s[16 + i], s[8 + i], s[i]);
+}
+
+void inline Store4(uint32_t* s, int i, __m128i x)
+{
+    uint32_t v[4];
+    _mm_storeu_si128((__m128i*)v, x);
+    s[i] = v[0];
+    s[8 + i] = v[1];
+    s[16 + i] = v[2];
+    s[24 + i] = v[3];
+}
+
+/** Write word i of the state of each lane big endian, output for lane j is at out + 32 * j. */
+void inline Write4(unsigned char* out, int i, __m128i x)
+{
+    uint32_t v[4];
+    _mm_storeu_si128((__m128i*)v, x);
+    WriteBE32(out + 4 * i, v[0]);
+    WriteBE32(out + 32 + 4 * i, v[1]);
+    WriteBE32(out + 64 + 4 * i, v[2]);
+    WriteBE32(out + 96 + 4 * i, v[3]);
+}
+
+/** K + W for the padding block of a 64-byte message, its message schedule does not depend on the input. */
+struct PaddingSchedule
+{
+    uint32_t kw[64];
+
+    PaddingSchedule()
+    {
+        auto rotr = [](uint32_t x, int n) { return (x >> n) | (x << (32 - n)); };
+        uint32_t w[64] = {0x80000000ul};
+        w[15] = 512;
+        for (int i = 16; i < 64; ++i)
+            w[i] = (rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10)) + w[i - 7]
+                + (rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3)) + w[i - 16];
+        for (int i = 0; i < 64; ++i)
+            kw[i] = K256[i] + w[i];
+    }
+};
+
+static const PaddingSchedule padding64;
+
+void inline Round(__m128i a, __m128i b, __m128i c, __m128i& d, __m128i e, __m128i f, __m128i g, __m128i& h, __m128i kw)
+{
+    __m128i t1 = Add(h, Sigma1(e), Ch(e, f, g), kw);
+    __m128i t2 = Add(Sigma0(a), Maj(a, b, c));
+    d = Add(d, t1);
+    h = Add(t1, t2);
+}
+
+/** 64 rounds over the state in x, w holds the first 16 words of the message schedule. */
+void inline Compress(__m128i* x, __m128i* w)
+{
+    for (int i = 0; i < 64; ++i)
+    {
+        if (i >= 16)
+            w[i & 15] = Add(w[i & 15], sigma1(w[(i - 2) & 15]), w[(i - 7) & 15], sigma0(w[(i - 15) & 15]));
+        Round(x[(64 - i) & 7], x[(65 - i) & 7], x[(66 - i) & 7], x[(67 - i) & 7],
+              x[(68 - i) & 7], x[(69 - i) & 7], x[(70 - i) & 7], x[(71 - i) & 7], Add(K(K256[i]), w[i & 15]));
+    }
+}
+
+void inline Initialize4(__m128i* x)
+{
+    x[0] = K(0x6a09e667ul);
+    x[1] = K(0xbb67ae85ul);
+    x[2] = K(0x3c6ef372ul);
+    x[3] = K(0xa54ff53aul);
+    x[4] = K(0x510e527ful);
+    x[5] = K(0x9b05688cul);
+    x[6] = K(0x1f83d9abul);
+    x[7] = K(0x5be0cd19ul);
+}
+} // namespace
+
+/** Perform a number of SHA-256 transformations on 4 states, chunks[i] is the input for state i. */
+void Transform4(uint32_t* s, const unsigned char* const* chunks, size_t blocks)
+{
+    __m128i a = Load4(s, 0), b = Load4(s, 1), c = Load4(s, 2), d = Load4(s, 3);
+    __m128i e = Load4(s, 4), f = Load4(s, 5), g = Load4(s, 6), h = Load4(s, 7);
+
+    for (size_t offset = 0; offset < blocks * 64; offset += 64)
+    {
+        __m128i sa = a, sb = b, sc = c, sd = d, se = e, sf = f, sg = g, sh = h;
+        __m128i w[16];
+
+        for (int i = 0; i < 64; ++i)
+        {
+            if (i < 16)
+                w[i] = Read4(chunks, offset, i);
+            else
+                w[i & 15] = Add(w[i & 15], sigma1(w[(i - 2) & 15]), w[(i - 7) & 15], sigma0(w[(i - 15) & 15]));
+
+            __m128i t1 = Add(h, Sigma1(e), Ch(e, f, g), K(K256[i]), w[i & 15]);
+            __m128i t2 = Add(Sigma0(a), Maj(a, b, c));
+            h = g;
+            g = f;
+            f = e;
+            e = Add(d, t1);
+            d = c;
+            c = b;
+            b = a;
+            a = Add(t1, t2);
+        }
+
+        a = Add(a, sa);
+        b = Add(b, sb);
+        c = Add(c, sc);
+        d = Add(d, sd);
+        e = Add(e, se);
+        f = Add(f, sf);
+        g = Add(g, sg);
+        h = Add(h, sh);
+    }
+
+    Store4(s, 0, a);
+    Store4(s, 1, b);
+    Store4(s, 2, c);
+    Store4(s, 3, d);
+    Store4(s, 4, e);
+    Store4(s, 5, f);
+    Store4(s, 6, g);
+    Store4(s, 7, h);
+}
+
+/** Double SHA-256 of 4 64-byte inputs, input i is at in + 64 * i and its hash is written to out + 32 * i. */
+void Transform4_D64(unsigned char* out, const unsigned char* in)
+{
+    const unsigned char* chunks[4] = {in, in + 64, in + 128, in + 192};
+    __m128i x[8], s[8], w[16];
+
+    // First hash, the input block
+    Initialize4(x);
+    for (int i = 0; i < 16; ++i)
+        w[i] = Read4(chunks, 0, i);
+    Compress(x, w);
+    Initialize4(s);
+    for (int i = 0; i < 8; ++i)
+        x[i] = s[i] = Add(x[i], s[i]);
+
+    // First hash, the padding block, its schedule is precomputed
+    for (int i = 0; i < 64; ++i)
+        Round(x[(64 - i) & 7], x[(65 - i) & 7], x[(66 - i) & 7], x[(67 - i) & 7],
+              x[(68 - i) & 7], x[(69 - i) & 7], x[(70 - i) & 7], x[(71 - i) & 7], K(padding64.kw[i]));
+    for (int i = 0; i < 8; ++i)
+        w[i] = Add(x[i], s[i]);
+
+    // Second hash, the 32-byte digest and its padding
+    w[8] = K(0x80000000ul);
+    for (int i = 9; i < 15; ++i)
+        w[i] = _mm_setzero_si128();
+    w[15] = K(256);
+    Initialize4(x);
+    Compress(x, w);
+    Initialize4(s);
+    for (int i = 0; i < 8; ++i)
+        Write4(out, i, Add(x[i], s[i]));
+}
+}
+
+#endif
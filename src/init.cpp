@@ -50,6 +50,7 @@
 #endif
 #include "warnings.h"
 #include "anon.h"
+#include "rctcache.h"
 #include "core_io.h"
 #include <stdint.h>
 #include <stdio.h>
@@ -247,6 +248,9 @@ void Shutdown()
         if (pcoinsTip != nullptr) {
             FlushStateToDisk();
         }
+        if (pblocktree != nullptr) {
+            DumpRCTKeyImageFilter();
+        }
         delete pcoinsTip;
         pcoinsTip = nullptr;
         delete pcoinscatcher;
@@ -413,6 +417,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain a full address index, used to query for the balance, txids and unspent outputs for addresses (default: %u)"), DEFAULT_ADDRESSINDEX));
     strUsage += HelpMessageOpt("-timestampindex", strprintf(_("Maintain a timestamp index for block hashes, used to query blocks hashes by a range of timestamps (default: %u)"), DEFAULT_TIMESTAMPINDEX));
     strUsage += HelpMessageOpt("-spentindex", strprintf(_("Maintain a full spent index, used to query the spending txid and input index for an outpoint (default: %u)"), DEFAULT_SPENTINDEX));
+    strUsage += HelpMessageOpt("-coinstatsindex", strprintf(_("Maintain running totals of the UTXO set statistics, used by gettxoutsetinfo with hash_type muhash (default: %u)"), DEFAULT_COINSTATSINDEX));
 
     strUsage += HelpMessageOpt("-spentindex", strprintf(_("Maintain a full spent index, used to query the spending txid and input index for an outpoint (default: %u)"), DEFAULT_SPENTINDEX));
 
@@ -511,6 +516,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-logtimemicros", strprintf("Add microsecond precision to debug timestamps (default: %u)", DEFAULT_LOGTIMEMICROS));
         strUsage += HelpMessageOpt("-mocktime=<n>", "Replace actual time with <n> seconds since epoch (default: 0)");
         strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit sum of signature cache and script execution cache sizes to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
+        strUsage += HelpMessageOpt("-rctcachesize=<n>", strprintf("Limit rangeproof and MLSAG verification cache size to <n> MiB (default: %u)", DEFAULT_RCT_CACHE_SIZE));
         strUsage += HelpMessageOpt("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE));
     }
     strUsage += HelpMessageOpt("-maxtxfee=<amt>", strprintf(_("Maximum total fees (in %s) to use in a single wallet transaction or raw transaction; setting this too low may abort large transactions (default: %s)"),
@@ -682,6 +688,12 @@ void ThreadImport(std::vector<fs::path> vImportFiles)
     fBusyImporting = true;
     {
     CImportingNow imp;
+    // Connect blocks while later blocks are still being read and checked.
+    // This includes -reindex while fReindex is still set. LoadExternalBlockFile connects the genesis
+    // block and ProcessNewBlock connects blocks received from peers during a reindex already, and
+    // ActivateBestChain only connects blocks whose ancestors all have data. fReindex keeps the node
+    // in initial block download and stops FlushStateToDisk from pruning files not yet reindexed.
+    CImportConnector connector(chainparams);
 
     // -reindex
     if (fReindex) {
@@ -694,7 +706,7 @@ void ThreadImport(std::vector<fs::path> vImportFiles)
             if (!file)
                 break; // This error is logged in OpenBlockFile
             LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
-            LoadExternalBlockFile(chainparams, file, &pos);
+            LoadExternalBlockFile(chainparams, file, &pos, &connector);
             nFile++;
         }
         pblocktree->WriteReindexing(false);
@@ -711,7 +723,7 @@ void ThreadImport(std::vector<fs::path> vImportFiles)
         if (file) {
             fs::path pathBootstrapOld = GetDataDir() / "bootstrap.dat.old";
             LogPrintf("Importing bootstrap.dat...\n");
-            LoadExternalBlockFile(chainparams, file);
+            LoadExternalBlockFile(chainparams, file, nullptr, &connector);
             RenameOver(pathBootstrap, pathBootstrapOld);
         } else {
             LogPrintf("Warning: Could not open bootstrap file %s\n", pathBootstrap.string());
@@ -723,7 +735,7 @@ void ThreadImport(std::vector<fs::path> vImportFiles)
         FILE *file = fsbridge::fopen(path, "rb");
         if (file) {
             LogPrintf("Importing blocks file %s...\n", path.string());
-            LoadExternalBlockFile(chainparams, file);
+            LoadExternalBlockFile(chainparams, file, nullptr, &connector);
         } else {
             LogPrintf("Warning: Could not open blocks file %s\n", path.string());
         }
@@ -1320,6 +1332,7 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     InitSignatureCache();
     InitScriptExecutionCache();
+    InitRCTCache();
 
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
@@ -1469,6 +1482,7 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     fReindex = gArgs.GetBoolArg("-reindex", false);
     fSkipRangeproof = gArgs.GetBoolArg("-skiprangeproofverify", false);
+    fCoinStatsIndex = gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX);
     bool fReindexChainState = gArgs.GetBoolArg("-reindex-chainstate", false);
 
     fs::path blocksDir = GetDataDir() / "blocks";
@@ -1579,7 +1593,7 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
 
                 // Check for changed -prune state.  What we are concerned about is a user who has pruned blocks
                 // in the past, but is now trying to run unpruned.
-                if (fHavePruned && !fPruneMode) {
+                if (fHavePruned && !fPruneMode && !fHaveUTXOSnapshot) {
                     strLoadError = _("You need to rebuild the database using -reindex to go back to unpruned mode.  This will redownload the entire blockchain");
                     break;
                 }
@@ -1614,6 +1628,7 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
 
                 // The on-disk coinsdb is now in a good state, create the cache
                 pcoinsTip = new CCoinsViewCache(pcoinscatcher);
+                InitCoinsSetStats();
 
                 bool is_coinsview_empty = fReset || fReindexChainState || pcoinsTip->GetBestBlock().IsNull();
                 if (!is_coinsview_empty) {
@@ -1706,6 +1721,12 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
         LogPrintf(" block index %15dms\n", GetTimeMillis() - nStart);
     }
 
+    {
+        LOCK(cs_main);
+        if (!LoadRCTKeyImageFilter())
+            return InitError(_("Error loading the RCT key image filter"));
+    }
+
     fs::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
     CAutoFile est_filein(fsbridge::fopen(est_path, "rb"), SER_DISK, CLIENT_VERSION);
     // Allowed to fail as this file IS missing on first startup.
@@ -1801,7 +1822,7 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     // ********************************************************* Step 11: start node
 
     //// debug print
-    LogPrintf("mapBlockIndex.size() = %u\n", mapBlockIndex.size());
+    LogPrintf("mapBlockIndex.size() = %u, %.1fMiB\n", mapBlockIndex.size(), mapBlockIndex.DynamicMemoryUsage() * (1.0 / (1 << 20)));
     LogPrintf("nBestHeight = %d\n", chainActive.Height());
     if (gArgs.GetBoolArg("-listenonion", DEFAULT_LISTEN_ONION))
         StartTorControl(threadGroup, scheduler);
@@ -181,7 +181,34 @@ int StealthShared(const CKey &secret, const ec_point &pubkey, CKey &sharedSOut)
     return 0;
 };
 
+int StealthParsePubKey(const ec_point &pk, secp256k1_pubkey &out)
+{
+    if (pk.size() != EC_COMPRESSED_SIZE)
+        return errorN(1, "%s: sanity checks failed.", __func__);
+
+    if (!secp256k1_ec_pubkey_parse(secp256k1_ctx_stealth, &out, &pk[0], EC_COMPRESSED_SIZE))
+        return errorN(1, "%s: secp256k1_ec_pubkey_parse failed.", __func__);
+
+    return 0;
+};
+
 int StealthSecret(const CKey &secret, const ec_point &pubkey, const ec_point &pkSpend, CKey &sharedSOut, ec_point &pkOut)
+{
+    if (pubkey.size() != EC_COMPRESSED_SIZE
+        || pkSpend.size() != EC_COMPRESSED_SIZE)
+        return errorN(1, "%s: sanity checks failed.", __func__);
+
+    secp256k1_pubkey Q, R;
+    if (!secp256k1_ec_pubkey_parse(secp256k1_ctx_stealth, &Q, &pubkey[0], EC_COMPRESSED_SIZE))
+        return errorN(1, "%s: secp256k1_ec_pubkey_parse Q failed.", __func__);
+
+    if (!secp256k1_ec_pubkey_parse(secp256k1_ctx_stealth, &R, &pkSpend[0], EC_COMPRESSED_SIZE))
+        return errorN(1, "%s: secp256k1_ec_pubkey_parse R failed.", __func__);
+
+    return StealthSecret(secret, Q, R, sharedSOut, pkOut);
+};
+
+int StealthSecret(const CKey &secret, const secp256k1_pubkey &pubkey, const secp256k1_pubkey &pkSpend, CKey &sharedSOut, ec_point &pkOut)
 {
     /*
     send:
@@ -212,16 +239,7 @@ int StealthSecret(const CKey &secret, const ec_point &pubkey, const ec_point &pk
     test 0 and infinity?
     */
 
-    if (pubkey.size() != EC_COMPRESSED_SIZE
-        || pkSpend.size() != EC_COMPRESSED_SIZE)
-        return errorN(1, "%s: sanity checks failed.", __func__);
-
-    secp256k1_pubkey Q, R;
-    if (!secp256k1_ec_pubkey_parse(secp256k1_ctx_stealth, &Q, &pubkey[0], EC_COMPRESSED_SIZE))
-        return errorN(1, "%s: secp256k1_ec_pubkey_parse Q failed.", __func__);
-
-    if (!secp256k1_ec_pubkey_parse(secp256k1_ctx_stealth, &R, &pkSpend[0], EC_COMPRESSED_SIZE))
-        return errorN(1, "%s: secp256k1_ec_pubkey_parse R failed.", __func__);
+    secp256k1_pubkey Q = pubkey, R = pkSpend;
 
     // eQ
     if (!secp256k1_ec_pubkey_tweak_mul(secp256k1_ctx_stealth, &Q, secret.begin()))
@@ -17,6 +17,8 @@
 #include "uint256.h"
 #include "key/types.h"
 
+#include <secp256k1.h>
+
 const uint32_t MAX_STEALTH_NARRATION_SIZE = 48;
 
 const uint32_t MIN_STEALTH_RAW_SIZE = 1 + 33 + 1 + 33 + 1 + 1; // without checksum (4bytes) or version (1byte)
@@ -126,6 +128,10 @@ int SecretToPublicKey(const CKey &secret, ec_point &out);
 
 int StealthShared(const CKey &secret, const ec_point &pubkey, CKey &sharedSOut);
 int StealthSecret(const CKey &secret, const ec_point &pubkey, const ec_point &pkSpend, CKey &sharedSOut, ec_point &pkOut);
+
+/** Parse pk once for repeated use with the StealthSecret overload below */
+int StealthParsePubKey(const ec_point &pk, secp256k1_pubkey &out);
+int StealthSecret(const CKey &secret, const secp256k1_pubkey &pubkey, const secp256k1_pubkey &pkSpend, CKey &sharedSOut, ec_point &pkOut);
 int StealthSecretSpend(const CKey &scanSecret, const ec_point &ephemPubkey, const CKey &spendSecret, CKey &secretOut);
 int StealthSharedToSecretSpend(const CKey &sharedS, const CKey &spendSecret, CKey &secretOut);
 
@@ -609,6 +609,7 @@ public:
         lastMatched     = 0;
         ignoreUntil     = 0;
         nWakeCounter    = 0;
+        nProtoFlags     = 0;
         fEnabled        = false;
     };
     
@@ -619,6 +620,7 @@ public:
     int64_t                     lastMatched;
     int64_t                     ignoreUntil;
     uint32_t                    nWakeCounter;
+    uint32_t                    nProtoFlags;    // SMSG_PROTO_* features the peer sent in smsgPing/smsgPong
     bool                        fEnabled;
     
 };
@@ -0,0 +1,140 @@
+// Copyright (c) 2017 The Particl developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file license.txt or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rctcache.h"
+
+#include "crypto/sha256.h"
+#include "random.h"
+#include "util.h"
+
+#include "cuckoocache.h"
+#include "script/sigcache.h"
+
+#include <atomic>
+#include <boost/thread.hpp>
+
+namespace {
+/**
+ * Valid rangeproof and MLSAG cache, shares its layout with the signature cache.
+ */
+class CRCTCache
+{
+private:
+    //! Entries are SHA256(nonce || type || verification inputs)
+    uint256 nonce;
+    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
+    map_type setValid;
+    boost::shared_mutex cs_rctcache;
+
+public:
+    size_t nBytes = 0;
+    size_t nMaxElements = 0;
+    std::atomic<uint64_t> nHits{0};
+    std::atomic<uint64_t> nMisses{0};
+    std::atomic<uint64_t> nInserts{0};
+
+    CRCTCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+    }
+
+    CSHA256 Hasher(uint8_t nType) const
+    {
+        CSHA256 hasher;
+        hasher.Write(nonce.begin(), 32).Write(&nType, 1);
+        return hasher;
+    }
+
+    bool Get(const uint256 &entry, const bool erase)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_rctcache);
+        if (setValid.contains(entry, erase))
+        {
+            nHits++;
+            return true;
+        };
+        nMisses++;
+        return false;
+    }
+
+    void Set(const uint256 &entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_rctcache);
+        setValid.insert(entry);
+        nInserts++;
+    }
+
+    uint32_t setup_bytes(size_t n)
+    {
+        return setValid.setup_bytes(n);
+    }
+};
+
+enum RCTCacheEntryType
+{
+    RCE_RANGEPROOF  = 1,
+    RCE_MLSAG       = 2,
+};
+
+static CRCTCache rctCache;
+} // namespace
+
+uint256 RCTCacheRangeproofEntry(const secp256k1_pedersen_commitment *commitment, const std::vector<uint8_t> &vRangeproof)
+{
+    uint256 entry;
+    rctCache.Hasher(RCE_RANGEPROOF)
+        .Write(commitment->data, 33)
+        .Write(vRangeproof.data(), vRangeproof.size())
+        .Finalize(entry.begin());
+    return entry;
+};
+
+uint256 RCTCacheMLSAGEntry(const uint256 &txhash, uint32_t nIn, size_t nCols, size_t nRows,
+    const std::vector<uint8_t> &vM, const std::vector<uint8_t> &vKeyImages, const std::vector<uint8_t> &vDL)
+{
+    uint256 entry;
+    uint32_t nDims[2] = {(uint32_t)nCols, (uint32_t)nRows};
+    rctCache.Hasher(RCE_MLSAG)
+        .Write(txhash.begin(), 32)
+        .Write((const uint8_t*)&nIn, sizeof(nIn))
+        .Write((const uint8_t*)nDims, sizeof(nDims))
+        .Write(vM.data(), vM.size())
+        .Write(vKeyImages.data(), vKeyImages.size())
+        .Write(vDL.data(), vDL.size())
+        .Finalize(entry.begin());
+    return entry;
+};
+
+bool RCTCacheGet(const uint256 &entry, bool erase)
+{
+    return rctCache.Get(entry, erase);
+};
+
+void RCTCacheSet(const uint256 &entry)
+{
+    rctCache.Set(entry);
+};
+
+// To be called once in AppInitMain/BasicTestingSetup
+void InitRCTCache()
+{
+    // If -rctcachesize is set to zero, setup_bytes creates the minimum possible cache (2 elements).
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, gArgs.GetArg("-rctcachesize", DEFAULT_RCT_CACHE_SIZE)), MAX_RCT_CACHE_SIZE) * ((size_t) 1 << 20);
+    size_t nElems = rctCache.setup_bytes(nMaxCacheSize);
+    rctCache.nBytes = nElems * sizeof(uint256);
+    rctCache.nMaxElements = nElems;
+    LogPrintf("Using %zu MiB out of %zu requested for rangeproof and MLSAG cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
+};
+
+RCTCacheStats GetRCTCacheStats()
+{
+    RCTCacheStats stats;
+    stats.nBytes = rctCache.nBytes;
+    stats.nMaxElements = rctCache.nMaxElements;
+    stats.nHits = rctCache.nHits;
+    stats.nMisses = rctCache.nMisses;
+    stats.nInserts = rctCache.nInserts;
+    return stats;
+};
@@ -0,0 +1,45 @@
+// Copyright (c) 2017 The Particl developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file license.txt or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PARTICL_RCTCACHE_H
+#define PARTICL_RCTCACHE_H
+
+#include <secp256k1_rangeproof.h>
+#include <inttypes.h>
+#include <vector>
+
+#include "uint256.h"
+
+// Limit the rangeproof and MLSAG verification cache to 16MB by default
+static const unsigned int DEFAULT_RCT_CACHE_SIZE = 16;
+static const int64_t MAX_RCT_CACHE_SIZE = 16384;
+
+struct RCTCacheStats
+{
+    size_t nBytes = 0;
+    size_t nMaxElements = 0;
+    uint64_t nHits = 0;
+    uint64_t nMisses = 0;
+    uint64_t nInserts = 0;
+};
+
+/**
+ * Cache of successfully verified rangeproofs and MLSAG signatures, so
+ * outputs and inputs verified at mempool acceptance are not verified again
+ * when the block containing them is connected.
+ *
+ * Entries are salted hashes over all data the verification depends on.
+ */
+uint256 RCTCacheRangeproofEntry(const secp256k1_pedersen_commitment *commitment, const std::vector<uint8_t> &vRangeproof);
+uint256 RCTCacheMLSAGEntry(const uint256 &txhash, uint32_t nIn, size_t nCols, size_t nRows,
+    const std::vector<uint8_t> &vM, const std::vector<uint8_t> &vKeyImages, const std::vector<uint8_t> &vDL);
+
+/** Returns true if entry is in the cache, if erase is set a matching entry is removed */
+bool RCTCacheGet(const uint256 &entry, bool erase);
+void RCTCacheSet(const uint256 &entry);
+
+void InitRCTCache();
+RCTCacheStats GetRCTCacheStats();
+
+#endif // PARTICL_RCTCACHE_H
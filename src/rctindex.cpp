@@ -0,0 +1,249 @@
+// Copyright (c) 2017 The Particl Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rctindex.h"
+
+#include "hash.h"
+#include "memusage.h"
+#include "random.h"
+#include "util.h"
+
+#include <bitset>
+#include <cmath>
+
+
+CRCTOutputTable rctOutputTable;
+CRCTKeyImageFilter rctKeyImageFilter;
+
+bool CRCTOutputTable::Get(int64_t nIndex, Entry &entry) const
+{
+    LOCK(cs);
+    if (nIndex < 1 || nIndex > (int64_t)vEntries.size())
+        return false;
+    entry = vEntries[nIndex-1];
+    return true;
+};
+
+bool CRCTOutputTable::Set(int64_t nIndex, const CAnonOutput &ao)
+{
+    LOCK(cs);
+    if (nIndex < 1 || nIndex > (int64_t)vEntries.size() + 1)
+        return false;
+
+    if (nIndex == (int64_t)vEntries.size() + 1)
+        vEntries.emplace_back();
+
+    Entry &entry = vEntries[nIndex-1];
+    entry.pubkey = ao.pubkey;
+    entry.commitment = ao.commitment;
+    entry.nBlockHeight = ao.nBlockHeight;
+    return true;
+};
+
+void CRCTOutputTable::Assign(std::vector<Entry> &vEntriesIn)
+{
+    LOCK(cs);
+    vEntries.swap(vEntriesIn);
+    vEntriesIn.clear();
+};
+
+void CRCTOutputTable::Truncate(int64_t nLastIndex)
+{
+    LOCK(cs);
+    if (nLastIndex < 0)
+        nLastIndex = 0;
+    if (nLastIndex < (int64_t)vEntries.size())
+        vEntries.resize(nLastIndex);
+};
+
+void CRCTOutputTable::Clear()
+{
+    LOCK(cs);
+    vEntries.clear();
+    vEntries.shrink_to_fit();
+};
+
+int64_t CRCTOutputTable::GetLastIndex() const
+{
+    LOCK(cs);
+    return vEntries.size();
+};
+
+size_t CRCTOutputTable::DynamicMemoryUsage() const
+{
+    LOCK(cs);
+    return memusage::DynamicUsage(vEntries);
+};
+
+
+uint64_t CRCTKeyImageFilter::Hash(const CCmpPubKey &ki) const
+{
+    return CSipHasher(k0, k1).Write(ki.begin(), 33).Finalize();
+};
+
+size_t CRCTKeyImageFilter::BlockOffset(uint64_t h) const
+{
+    // Map the high bits onto the blocks without a modulo
+    size_t nBlocks = vData.size() / BLOCK_WORDS;
+    return ((h >> 32) * nBlocks >> 32) * BLOCK_WORDS;
+};
+
+bool CRCTKeyImageFilter::MaybeContains(const CCmpPubKey &ki) const
+{
+    LOCK(cs);
+    if (!fLoaded)
+        return true;
+    nQueries++;
+
+    uint64_t h = Hash(ki);
+    const uint64_t *pBlock = &vData[BlockOffset(h)];
+    uint32_t nBit = h & 511, nStep = ((h >> 9) & 511) | 1;
+    for (int i = 0; i < NUM_PROBES; ++i, nBit = (nBit + nStep) & 511)
+    {
+        if (!(pBlock[nBit >> 6] & (1ull << (nBit & 63))))
+        {
+            nSkipped++;
+            return false;
+        };
+    };
+    return true;
+};
+
+void CRCTKeyImageFilter::RecordFalsePositive() const
+{
+    LOCK(cs);
+    nFalsePositives++;
+};
+
+void CRCTKeyImageFilter::Insert(const CCmpPubKey &ki)
+{
+    LOCK(cs);
+    if (!fLoaded)
+        return;
+
+    uint64_t h = Hash(ki);
+    uint64_t *pBlock = &vData[BlockOffset(h)];
+    uint32_t nBit = h & 511, nStep = ((h >> 9) & 511) | 1;
+    for (int i = 0; i < NUM_PROBES; ++i, nBit = (nBit + nStep) & 511)
+        pBlock[nBit >> 6] |= 1ull << (nBit & 63);
+    nInserted++;
+};
+
+void CRCTKeyImageFilter::NoteErased(size_t n)
+{
+    LOCK(cs);
+    nErased += n;
+};
+
+void CRCTKeyImageFilter::Reset(size_t nElements)
+{
+    LOCK(cs);
+    // Leave room to grow before the next rebuild
+    nCapacity = std::max(nElements * 2, (size_t)MIN_CAPACITY);
+    size_t nBlocks = (nCapacity * BITS_PER_ELEMENT + 511) / 512;
+    vData.assign(nBlocks * BLOCK_WORDS, 0);
+    vData.shrink_to_fit();
+    k0 = GetRand(std::numeric_limits<uint64_t>::max());
+    k1 = GetRand(std::numeric_limits<uint64_t>::max());
+    nInserted = 0;
+    nErased = 0;
+    fLoaded = true;
+};
+
+void CRCTKeyImageFilter::Clear()
+{
+    LOCK(cs);
+    fLoaded = false;
+    vData.clear();
+    vData.shrink_to_fit();
+    nCapacity = 0;
+    nInserted = 0;
+    nErased = 0;
+};
+
+bool CRCTKeyImageFilter::IsLoaded() const
+{
+    LOCK(cs);
+    return fLoaded;
+};
+
+bool CRCTKeyImageFilter::NeedsResize() const
+{
+    LOCK(cs);
+    return fLoaded && nInserted > nCapacity;
+};
+
+bool CRCTKeyImageFilter::Write(CAutoFile &fileout) const
+{
+    LOCK(cs);
+    if (!fLoaded)
+        return false;
+    try {
+        uint32_t nVersion = VERSION;
+        fileout << nVersion;
+        fileout << k0 << k1;
+        fileout << (uint64_t)nCapacity << (uint64_t)nInserted << (uint64_t)nErased;
+        fileout << vData;
+    } catch (const std::exception&) {
+        return error("%s: Unable to write key image filter.", __func__);
+    }
+    return true;
+};
+
+bool CRCTKeyImageFilter::Read(CAutoFile &filein)
+{
+    LOCK(cs);
+    try {
+        uint32_t nVersion;
+        uint64_t nCapacityIn, nInsertedIn, nErasedIn;
+        std::vector<uint64_t> vDataIn;
+        filein >> nVersion;
+        if (nVersion != VERSION)
+            return error("%s: Unknown key image filter version %d.", __func__, nVersion);
+        filein >> k0 >> k1;
+        filein >> nCapacityIn >> nInsertedIn >> nErasedIn;
+        filein >> vDataIn;
+        if (vDataIn.size() == 0 || vDataIn.size() % BLOCK_WORDS != 0)
+            return error("%s: Bad key image filter size %d.", __func__, vDataIn.size());
+
+        vData.swap(vDataIn);
+        nCapacity = nCapacityIn;
+        nInserted = nInsertedIn;
+        nErased = nErasedIn;
+        fLoaded = true;
+    } catch (const std::exception&) {
+        fLoaded = false;
+        return error("%s: Unable to read key image filter.", __func__);
+    }
+    return true;
+};
+
+size_t CRCTKeyImageFilter::DynamicMemoryUsage() const
+{
+    LOCK(cs);
+    return memusage::DynamicUsage(vData);
+};
+
+RCTKeyImageFilterStats CRCTKeyImageFilter::GetStats() const
+{
+    LOCK(cs);
+    RCTKeyImageFilterStats stats;
+    stats.nBytes = memusage::DynamicUsage(vData);
+    stats.nElements = nInserted;
+    stats.nCapacity = nCapacity;
+    stats.nErased = nErased;
+    stats.nQueries = nQueries;
+    stats.nSkipped = nSkipped;
+    stats.nFalsePositives = nFalsePositives;
+
+    if (vData.size() > 0)
+    {
+        // Chance of a random key image hitting only set bits
+        size_t nSet = 0;
+        for (const auto w : vData)
+            nSet += std::bitset<64>(w).count();
+        stats.dFPRate = std::pow((double)nSet / (vData.size() * 64), NUM_PROBES);
+    };
+    return stats;
+};
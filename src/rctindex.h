@@ -6,6 +6,11 @@
 #define PARTICL_RCTINDEX_H
 
 #include "primitives/transaction.h"
+#include "pubkey.h"
+#include "streams.h"
+#include "sync.h"
+
+#include <vector>
 
 class CAnonOutput
 {
@@ -37,6 +42,108 @@ public:
     };
 };
 
+/**
+ * Compact in-memory copy of the RCT output index, avoids a txdb read per ring member.
+ * Entry i - 1 holds RCT output index i, the outpoint is only available from txdb.
+ */
+class CRCTOutputTable
+{
+public:
+    struct Entry
+    {
+        CCmpPubKey pubkey;
+        secp256k1_pedersen_commitment commitment;
+        int nBlockHeight;
+    };
+
+    bool Get(int64_t nIndex, Entry &entry) const;
+
+    /** Set index nIndex, the table can only grow by appending */
+    bool Set(int64_t nIndex, const CAnonOutput &ao);
+
+    /** Replace the table contents, takes ownership of vEntriesIn */
+    void Assign(std::vector<Entry> &vEntriesIn);
+
+    /** Remove all entries above nLastIndex */
+    void Truncate(int64_t nLastIndex);
+    void Clear();
+
+    int64_t GetLastIndex() const;
+    size_t DynamicMemoryUsage() const;
+
+private:
+    mutable CCriticalSection cs;
+    std::vector<Entry> vEntries;
+};
+
+extern CRCTOutputTable rctOutputTable;
+
+struct RCTKeyImageFilterStats
+{
+    size_t nBytes = 0;
+    size_t nElements = 0;
+    size_t nCapacity = 0;
+    size_t nErased = 0;
+    uint64_t nQueries = 0;
+    uint64_t nSkipped = 0;
+    uint64_t nFalsePositives = 0;
+    double dFPRate = 0.0;
+};
+
+/**
+ * Blocked Bloom filter over all key images in txdb.
+ * A key image not in the filter is not in txdb, MaybeContains returning true means txdb must be read.
+ * Key images erased from txdb are left set, the filter is rebuilt when it reaches capacity.
+ * Before the filter is loaded every key image may be present.
+ */
+class CRCTKeyImageFilter
+{
+public:
+    static const uint32_t VERSION = 1;
+    static const size_t BITS_PER_ELEMENT = 16;
+    static const size_t MIN_CAPACITY = 1 << 16;
+
+    bool MaybeContains(const CCmpPubKey &ki) const;
+    void RecordFalsePositive() const;
+
+    /** Has no effect before the filter is loaded */
+    void Insert(const CCmpPubKey &ki);
+    void NoteErased(size_t n);
+
+    /** Empty the filter, size it for nElements and mark it loaded */
+    void Reset(size_t nElements);
+    void Clear();
+
+    bool IsLoaded() const;
+    bool NeedsResize() const;
+
+    bool Write(CAutoFile &fileout) const;
+    bool Read(CAutoFile &filein);
+
+    size_t DynamicMemoryUsage() const;
+    RCTKeyImageFilterStats GetStats() const;
+
+private:
+    static const size_t BLOCK_WORDS = 8;
+    static const int NUM_PROBES = 8;
+
+    uint64_t Hash(const CCmpPubKey &ki) const;
+    size_t BlockOffset(uint64_t h) const;
+
+    mutable CCriticalSection cs;
+    bool fLoaded = false;
+    uint64_t k0 = 0, k1 = 0;
+    std::vector<uint64_t> vData;
+    size_t nCapacity = 0;
+    size_t nInserted = 0;
+    size_t nErased = 0;
+
+    mutable uint64_t nQueries = 0;
+    mutable uint64_t nSkipped = 0;
+    mutable uint64_t nFalsePositives = 0;
+};
+
+extern CRCTKeyImageFilter rctKeyImageFilter;
 
 #endif // PARTICL_RCTINDEX_H
 
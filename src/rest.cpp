@@ -11,6 +11,7 @@
 #include "validation.h"
 #include "httpserver.h"
 #include "rpc/blockchain.h"
+#include "rpc/misc.h"
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
@@ -588,6 +589,54 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+// Address index queries: /rest/<name>/<address>[/<limit>[/<cursor>]].json
+static bool rest_address_page(HTTPRequest* req, const std::string& strURIPart,
+                              UniValue (*fnToJSON)(const UniValue&))
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+
+    switch (rf) {
+    case RF_JSON: {
+        UniValue params(UniValue::VARR);
+        UniValue result;
+        try {
+            params.push_back(addressQueryFromPath(param));
+            result = fnToJSON(params);
+        } catch (const UniValue& objError) {
+            return RESTERR(req, HTTP_BAD_REQUEST, find_value(objError, "message").getValStr());
+        }
+        std::string strJSON = result.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: json)");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
+static bool rest_address_txids(HTTPRequest* req, const std::string& strURIPart)
+{
+    return rest_address_page(req, strURIPart, addressTxidsToJSON);
+}
+
+static bool rest_address_deltas(HTTPRequest* req, const std::string& strURIPart)
+{
+    return rest_address_page(req, strURIPart, addressDeltasToJSON);
+}
+
+static bool rest_address_utxos(HTTPRequest* req, const std::string& strURIPart)
+{
+    return rest_address_page(req, strURIPart, addressUtxosToJSON);
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(HTTPRequest* req, const std::string& strReq);
@@ -600,6 +649,9 @@ static const struct {
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
       {"/rest/getutxos", rest_getutxos},
+      {"/rest/addresstxids/", rest_address_txids},
+      {"/rest/addressdeltas/", rest_address_deltas},
+      {"/rest/addressutxos/", rest_address_utxos},
 };
 
 bool StartREST()
@@ -1036,88 +1036,6 @@ UniValue getblock(const JSONRPCRequest& request)
     return blockToJSON(block, pblockindex, verbosity >= 2);
 }
 
-struct CCoinsStats
-{
-    int nHeight;
-    uint256 hashBlock;
-    uint64_t nTransactions;
-    uint64_t nTransactionOutputs;
-    uint64_t nBlindedTransactionOutputs;
-    uint64_t nBogoSize;
-    uint256 hashSerialized;
-    uint64_t nDiskSize;
-    CAmount nTotalAmount;
-
-    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBlindedTransactionOutputs(0), nBogoSize(0), nDiskSize(0), nTotalAmount(0) {}
-};
-
-static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
-{
-    assert(!outputs.empty());
-    ss << hash;
-    ss << VARINT(outputs.begin()->second.nHeight * 2 + outputs.begin()->second.fCoinBase);
-    stats.nTransactions++;
-    for (const auto output : outputs) {
-        ss << VARINT(output.first + 1);
-        ss << output.second.out.scriptPubKey;
-
-        if (output.second.nType == OUTPUT_STANDARD)
-        {
-            ss << VARINT(output.second.out.nValue);
-            stats.nTransactionOutputs++;
-            stats.nTotalAmount += output.second.out.nValue;
-        } else
-        if (output.second.nType == OUTPUT_CT)
-        {
-            //ss << output.second.commitment;
-            ss.write((char*)&output.second.commitment.data[0], 33);
-            stats.nBlindedTransactionOutputs++;
-        };
-        stats.nBogoSize += 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
-                           2 /* scriptPubKey len */ + output.second.out.scriptPubKey.size() /* scriptPubKey */
-                           + 1 /* nType */ + 33 /* commitment */;
-    }
-    ss << VARINT(0);
-}
-
-//! Calculate statistics about the unspent transaction output set
-static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
-{
-    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
-
-    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = pcursor->GetBestBlock();
-    {
-        LOCK(cs_main);
-        stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
-    }
-    ss << stats.hashBlock;
-    uint256 prevkey;
-    std::map<uint32_t, Coin> outputs;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        COutPoint key;
-        Coin coin;
-        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
-            if (!outputs.empty() && key.hash != prevkey) {
-                ApplyStats(stats, ss, prevkey, outputs);
-                outputs.clear();
-            }
-            prevkey = key.hash;
-            outputs[key.n] = std::move(coin);
-        } else {
-            return error("%s: unable to read value", __func__);
-        }
-        pcursor->Next();
-    }
-    if (!outputs.empty()) {
-        ApplyStats(stats, ss, prevkey, outputs);
-    }
-    stats.hashSerialized = ss.GetHash();
-    stats.nDiskSize = view->EstimateSize();
-    return true;
-}
-
 UniValue pruneblockchain(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1)
@@ -1169,29 +1087,73 @@ UniValue pruneblockchain(const JSONRPCRequest& request)
 
 UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 2)
         throw std::runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_type\" full_scan )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "Note this call may take some time, except for hash_type muhash with -coinstatsindex once the running totals have been built.\n"
+            "\nArguments:\n"
+            "1. \"hash_type\"  (string, optional, default=hash_serialized_2) Which UTXO set hash to calculate, hash_serialized_2 or muhash.\n"
+            "                  muhash is order independent, with -coinstatsindex it is kept up to date as blocks are connected,\n"
+            "                  otherwise the UTXO set is scanned in parallel.\n"
+            "2. full_scan    (boolean, optional, default=false) With muhash and -coinstatsindex, scan the whole UTXO set instead of using the running totals.\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
-            "  \"transactions\": n,      (numeric) The number of transactions\n"
+            "  \"transactions\": n,      (numeric) The number of transactions, omitted for muhash unless scanned\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
             "  \"bogosize\": n,          (numeric) A meaningless metric for UTXO set size\n"
-            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash\n"
+            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash, for hash_type hash_serialized_2\n"
+            "  \"muhash\": \"hash\",     (string) The rolling hash of the UTXO set, for hash_type muhash\n"
             "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "\"muhash\"")
             + HelpExampleRpc("gettxoutsetinfo", "")
         );
 
+    std::string sHashType = request.params.size() > 0 ? request.params[0].get_str() : "hash_serialized_2";
+    bool fFullScan = request.params.size() > 1 ? request.params[1].get_bool() : false;
+
     UniValue ret(UniValue::VOBJ);
 
+    if (sHashType == "muhash")
+    {
+        CCoinsSetStats stats;
+        uint64_t nTransactions = 0;
+        if (!GetCoinsSetStats(stats, fFullScan, &nTransactions))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
+
+        int nHeight = 0;
+        {
+            LOCK(cs_main);
+            BlockMap::iterator mi = mapBlockIndex.find(stats.hashBlock);
+            if (mi != mapBlockIndex.end())
+                nHeight = mi->second->nHeight;
+        }
+        ret.push_back(Pair("height", (int64_t)nHeight));
+        ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
+        if (nTransactions > 0)
+            ret.push_back(Pair("transactions", (int64_t)nTransactions));
+        ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
+        if (fParticlMode)
+            ret.push_back(Pair("txouts_blinded", (int64_t)stats.nBlindedTransactionOutputs));
+        ret.push_back(Pair("bogosize", (int64_t)stats.nBogoSize));
+        ret.push_back(Pair("muhash", stats.GetMuHash().GetHex()));
+        ret.push_back(Pair("disk_size", (uint64_t)pcoinsdbview->EstimateSize()));
+
+        ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+        return ret;
+    };
+
+    if (sHashType != "hash_serialized_2")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown hash_type " + sHashType);
+    if (fFullScan)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "full_scan is only used with hash_type muhash, hash_serialized_2 always scans");
+
     CCoinsStats stats;
     FlushStateToDisk();
     if (GetUTXOStats(pcoinsdbview, stats)) {
@@ -1212,6 +1174,98 @@ UniValue gettxoutsetinfo(const JSONRPCRequest& request)
     return ret;
 }
 
+static UniValue UTXOSnapshotToJSON(const CUTXOSnapshotHeader &header, const fs::path &path)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("bestblock", header.hashBlock.GetHex()));
+    ret.push_back(Pair("height", (int64_t)header.nHeight));
+    ret.push_back(Pair("coins", (int64_t)header.nCoins));
+    ret.push_back(Pair("rct_outputs", (int64_t)header.nLastRCTOutput));
+    ret.push_back(Pair("key_images", (int64_t)header.nKeyImages));
+    ret.push_back(Pair("moneysupply", ValueFromAmount(header.nMoneySupply)));
+    ret.push_back(Pair("hash_serialized_2", header.hashSerialized.GetHex()));
+    ret.push_back(Pair("snapshot_hash", header.GetHash().GetHex()));
+    ret.push_back(Pair("path", path.string()));
+    return ret;
+}
+
+static const std::string UTXO_SNAPSHOT_RESULT_HELP =
+    "{\n"
+    "  \"bestblock\": \"hex\",   (string) the block hash the snapshot was taken at\n"
+    "  \"height\": n,            (numeric) the block height\n"
+    "  \"coins\": n,             (numeric) The number of unspent outputs\n"
+    "  \"rct_outputs\": n,       (numeric) The number of anon outputs\n"
+    "  \"key_images\": n,        (numeric) The number of spent anon key images\n"
+    "  \"moneysupply\": x.xxx,   (numeric) The money supply at the block\n"
+    "  \"hash_serialized_2\": \"hash\", (string) The serialized hash of the UTXO set, as in gettxoutsetinfo\n"
+    "  \"snapshot_hash\": \"hash\", (string) The hash of the whole snapshot, including the anon outputs, key images and money supply\n"
+    "  \"path\": \"path\"        (string) The snapshot file\n"
+    "}\n";
+
+UniValue dumputxoset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "dumputxoset \"path\"\n"
+            "\nWrite the unspent transaction output set, anon output index and spent key images at the current tip to a snapshot file.\n"
+            "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"path\"     (string, required) The file to write, relative paths are in the data directory\n"
+            "\nResult:\n"
+            + UTXO_SNAPSHOT_RESULT_HELP +
+            "\nExamples:\n"
+            + HelpExampleCli("dumputxoset", "\"utxo.dat\"")
+            + HelpExampleRpc("dumputxoset", "\"utxo.dat\"")
+        );
+
+    fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    if (fs::exists(path))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+
+    CUTXOSnapshotHeader header;
+    CValidationState state;
+    if (!DumpUTXOSnapshot(path, header, state))
+        throw JSONRPCError(RPC_DATABASE_ERROR, state.GetRejectReason());
+
+    return UTXOSnapshotToJSON(header, path);
+}
+
+UniValue loadutxoset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
+        throw std::runtime_error(
+            "loadutxoset \"path\" ( \"snapshot_hash\" unsafe )\n"
+            "\nReplace the chainstate with a snapshot written by dumputxoset.\n"
+            "The node must not have connected any blocks past genesis and must have the header of the snapshot block.\n"
+            "Blocks below the snapshot are treated as pruned.\n"
+            "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"path\"     (string, required) The snapshot file, relative paths are in the data directory\n"
+            "2. \"snapshot_hash\" (string, required unless unsafe is set) The expected snapshot_hash, from dumputxoset on a trusted node\n"
+            "3. unsafe     (boolean, optional, default=false) Load a snapshot without snapshot_hash, its contents are not checked against any trusted source\n"
+            "\nResult:\n"
+            + UTXO_SNAPSHOT_RESULT_HELP +
+            "\nExamples:\n"
+            + HelpExampleCli("loadutxoset", "\"utxo.dat\" \"hash\"")
+            + HelpExampleRpc("loadutxoset", "\"utxo.dat\", \"hash\"")
+        );
+
+    fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    uint256 hashExpected;
+    if (request.params.size() > 1 && !request.params[1].isNull() && !request.params[1].get_str().empty())
+        hashExpected = ParseHashV(request.params[1], "snapshot_hash");
+    bool fUnsafe = request.params.size() > 2 && request.params[2].get_bool();
+    if (hashExpected.IsNull() && !fUnsafe)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "snapshot_hash is required, set unsafe to load an unverified snapshot");
+
+    CUTXOSnapshotHeader header;
+    CValidationState state;
+    if (!LoadUTXOSnapshot(Params(), path, hashExpected, fUnsafe, header, state))
+        throw JSONRPCError(RPC_DATABASE_ERROR, state.GetRejectReason());
+
+    return UTXOSnapshotToJSON(header, path);
+}
+
 UniValue gettxout(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 2 || request.params.size() > 3)
@@ -1827,7 +1881,9 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true,  {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          true,  {"verbose"} },
     { "blockchain",         "gettxout",               &gettxout,               true,  {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  {} },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  {"hash_type","full_scan"} },
+    { "blockchain",         "dumputxoset",            &dumputxoset,            true,  {"path"} },
+    { "blockchain",         "loadutxoset",            &loadutxoset,            false, {"path","snapshot_hash","unsafe"} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        true,  {"height"} },
     { "blockchain",         "verifychain",            &verifychain,            true,  {"checklevel","nblocks"} },
     { "blockchain",         "preciousblock",          &preciousblock,          true,  {"blockhash"} },
@@ -7,12 +7,16 @@
 #include "chain.h"
 #include "clientversion.h"
 #include "core_io.h"
+#include "crypto/sha256.h"
 #include "init.h"
 #include "validation.h"
 #include "httpserver.h"
 #include "net.h"
 #include "netbase.h"
+#include "rctcache.h"
+#include "rctindex.h"
 #include "rpc/blockchain.h"
+#include "rpc/misc.h"
 #include "rpc/server.h"
 #include "timedata.h"
 #include "txmempool.h"
@@ -31,6 +35,8 @@
 #include <malloc.h>
 #endif
 
+#include <boost/algorithm/string.hpp>
+
 #include <univalue.h>
 
 /**
@@ -587,6 +593,33 @@ static UniValue RPCLockedMemoryInfo()
     return obj;
 }
 
+static UniValue RPCRCTCacheInfo()
+{
+    RCTCacheStats stats = GetRCTCacheStats();
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("bytes", uint64_t(stats.nBytes)));
+    obj.push_back(Pair("max_elements", uint64_t(stats.nMaxElements)));
+    obj.push_back(Pair("hits", stats.nHits));
+    obj.push_back(Pair("misses", stats.nMisses));
+    obj.push_back(Pair("inserts", stats.nInserts));
+    return obj;
+}
+
+static UniValue RPCRCTKeyImageFilterInfo()
+{
+    RCTKeyImageFilterStats stats = rctKeyImageFilter.GetStats();
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("bytes", uint64_t(stats.nBytes)));
+    obj.push_back(Pair("elements", uint64_t(stats.nElements)));
+    obj.push_back(Pair("capacity", uint64_t(stats.nCapacity)));
+    obj.push_back(Pair("erased", uint64_t(stats.nErased)));
+    obj.push_back(Pair("queries", stats.nQueries));
+    obj.push_back(Pair("skipped", stats.nSkipped));
+    obj.push_back(Pair("false_positives", stats.nFalsePositives));
+    obj.push_back(Pair("fp_rate", stats.dFPRate));
+    return obj;
+}
+
 #ifdef HAVE_MALLOC_INFO
 static std::string RPCMallocInfo()
 {
@@ -628,7 +661,25 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
             "    \"locked\": xxxxxx,       (numeric) Amount of bytes that succeeded locking. If this number is smaller than total, locking pages failed at some point and key data could be swapped to disk.\n"
             "    \"chunks_used\": xxxxx,   (numeric) Number allocated chunks\n"
             "    \"chunks_free\": xxxxx,   (numeric) Number unused chunks\n"
-            "  }\n"
+            "  },\n"
+            "  \"rctcache\": {             (json object) Information about the rangeproof and MLSAG verification cache\n"
+            "    \"bytes\": xxxxx,         (numeric) Number of bytes allocated\n"
+            "    \"max_elements\": xxxxx,  (numeric) Number of entries the cache can hold\n"
+            "    \"hits\": xxxxx,          (numeric) Number of verifications skipped\n"
+            "    \"misses\": xxxxx,        (numeric) Number of lookups not found\n"
+            "    \"inserts\": xxxxx,       (numeric) Number of entries added\n"
+            "  },\n"
+            "  \"rctkeyimages\": {         (json object) Information about the spent key image filter\n"
+            "    \"bytes\": xxxxx,         (numeric) Number of bytes allocated\n"
+            "    \"elements\": xxxxx,      (numeric) Number of key images added\n"
+            "    \"capacity\": xxxxx,      (numeric) Number of key images the filter is sized for\n"
+            "    \"erased\": xxxxx,        (numeric) Number of key images disconnected but still set\n"
+            "    \"queries\": xxxxx,       (numeric) Number of lookups\n"
+            "    \"skipped\": xxxxx,       (numeric) Number of lookups that skipped the database\n"
+            "    \"false_positives\": xxxxx, (numeric) Number of lookups not found in the database\n"
+            "    \"fp_rate\": x.xxx,       (numeric) Estimated false positive rate\n"
+            "  },\n"
+            "  \"sha256\": \"xxxxx\"        (string) The SHA256 implementations in use\n"
             "}\n"
             "\nResult (mode \"mallocinfo\"):\n"
             "\"<malloc version=\"1\">...\"\n"
@@ -641,6 +692,9 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
     if (mode == "stats") {
         UniValue obj(UniValue::VOBJ);
         obj.push_back(Pair("locked", RPCLockedMemoryInfo()));
+        obj.push_back(Pair("rctcache", RPCRCTCacheInfo()));
+        obj.push_back(Pair("rctkeyimages", RPCRCTKeyImageFilterInfo()));
+        obj.push_back(Pair("sha256", SHA256Implementation()));
         return obj;
     } else if (mode == "mallocinfo") {
 #ifdef HAVE_MALLOC_INFO
@@ -784,6 +838,151 @@ bool getAddressesFromParams(const UniValue& params, std::vector<std::pair<uint25
     return true;
 }
 
+bool getPaginationFromParams(const UniValue& params, size_t &nLimit, std::string &sCursor)
+{
+    nLimit = 0;
+    sCursor.clear();
+    if (!params[0].isObject()) {
+        return false;
+    }
+
+    UniValue limitValue = find_value(params[0].get_obj(), "limit");
+    UniValue cursorValue = find_value(params[0].get_obj(), "cursor");
+    if (limitValue.isNum()) {
+        int nLimitIn = limitValue.get_int();
+        if (nLimitIn < 1) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Limit is expected to be greater than zero");
+        }
+        nLimit = nLimitIn;
+    }
+    if (cursorValue.isStr()) {
+        sCursor = cursorValue.get_str();
+    }
+
+    return nLimit > 0 || !sCursor.empty();
+}
+
+UniValue addressQueryFromPath(const std::string& strPath)
+{
+    std::vector<std::string> vParts;
+    boost::split(vParts, strPath, boost::is_any_of("/"));
+    if (vParts.size() < 1 || vParts.size() > 3 || vParts[0].empty()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Expected <address>[/<limit>[/<cursor>]]");
+    }
+
+    UniValue addresses(UniValue::VARR);
+    addresses.push_back(vParts[0]);
+    UniValue query(UniValue::VOBJ);
+    query.pushKV("addresses", addresses);
+    if (vParts.size() > 1) {
+        int32_t nLimit;
+        if (!ParseInt32(vParts[1], &nLimit) || nLimit < 1) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid limit: " + vParts[1]);
+        }
+        query.pushKV("limit", nLimit);
+    }
+    if (vParts.size() > 2) {
+        query.pushKV("cursor", vParts[2]);
+    }
+
+    return query;
+}
+
+/** Cursors are the hex encoded index key of the last entry returned */
+template<typename K>
+static std::string encodeIndexCursor(const K &key)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << key;
+    return HexStr(ss.begin(), ss.end());
+}
+
+template<typename K>
+static void decodeIndexCursor(const std::string &sCursor, K &key)
+{
+    if (!IsHex(sCursor)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    }
+    std::vector<uint8_t> vCursor = ParseHex(sCursor);
+    CDataStream ss(vCursor, SER_DISK, CLIENT_VERSION);
+    try {
+        ss >> key;
+    } catch (const std::exception &) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    }
+    if (!ss.empty()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    }
+}
+
+/**
+ * Read up to nLimit index entries over all addresses in order, resuming after sCursor if set.
+ * sNextCursor is set when the limit was reached and more entries may follow.
+ */
+template<typename K, typename V, typename F>
+static void readAddressIndexPage(const std::vector<std::pair<uint256, int> > &addresses,
+                                 size_t nLimit, const std::string &sCursor,
+                                 std::vector<std::pair<K, V> > &entries, std::string &sNextCursor, F fnRead)
+{
+    K keyAfter;
+    size_t nFirst = 0;
+    if (!sCursor.empty()) {
+        decodeIndexCursor(sCursor, keyAfter);
+        for (; nFirst < addresses.size(); nFirst++) {
+            if (addresses[nFirst].first == keyAfter.hashBytes && addresses[nFirst].second == (int)keyAfter.type) {
+                break;
+            }
+        }
+        if (nFirst == addresses.size()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Cursor does not match any address");
+        }
+    }
+
+    for (size_t i = nFirst; i < addresses.size(); i++) {
+        size_t nRemaining = 0;
+        if (nLimit > 0) {
+            if (entries.size() >= nLimit) {
+                break;
+            }
+            nRemaining = nLimit - entries.size();
+        }
+        const K *pAfter = (i == nFirst && !sCursor.empty()) ? &keyAfter : nullptr;
+        if (!fnRead(addresses[i].first, addresses[i].second, entries, nRemaining, pAfter)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        }
+    }
+
+    sNextCursor.clear();
+    if (nLimit > 0 && entries.size() >= nLimit) {
+        sNextCursor = encodeIndexCursor(entries.back().first);
+    }
+}
+
+static void readAddressIndexPage(const std::vector<std::pair<uint256, int> > &addresses, int start, int end,
+                                 size_t nLimit, const std::string &sCursor,
+                                 std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, std::string &sNextCursor)
+{
+    if (start <= 0 || end <= 0) {
+        start = end = 0; // Height range applies only if both are set
+    }
+    readAddressIndexPage(addresses, nLimit, sCursor, addressIndex, sNextCursor,
+        [start, end](const uint256 &hash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> > &vect,
+                     size_t nRemaining, const CAddressIndexKey *pAfter) {
+            return GetAddressIndex(hash, type, vect, start, end, nRemaining, pAfter);
+        });
+}
+
+static void readAddressUnspentPage(const std::vector<std::pair<uint256, int> > &addresses,
+                                   size_t nLimit, const std::string &sCursor,
+                                   std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs, std::string &sNextCursor)
+{
+    readAddressIndexPage(addresses, nLimit, sCursor, unspentOutputs, sNextCursor,
+        [](const uint256 &hash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect,
+           size_t nRemaining, const CAddressUnspentKey *pAfter) {
+            return GetAddressUnspent(hash, type, vect, nRemaining, pAfter);
+        });
+}
+
 bool heightSort(std::pair<CAddressUnspentKey, CAddressUnspentValue> a,
                 std::pair<CAddressUnspentKey, CAddressUnspentValue> b) {
     return a.second.blockHeight < b.second.blockHeight;
@@ -882,6 +1081,8 @@ UniValue getaddressutxos(const JSONRPCRequest& request)
             "      ,...\n"
             "    ],\n"
             "  \"chainInfo\"  (boolean) Include chain info with results\n"
+            "  \"limit\"  (number, optional) Return at most limit outputs, results are wrapped in an object\n"
+            "  \"cursor\"  (string, optional) Continue after the cursor returned by a previous call\n"
             "}\n"
             "\nResult\n"
             "[\n"
@@ -894,17 +1095,25 @@ UniValue getaddressutxos(const JSONRPCRequest& request)
             "    \"satoshis\"  (number) The number of satoshis of the output\n"
             "  }\n"
             "]\n"
+            "\nWhen paginating, the outputs are returned in an object as \"utxos\", along with a \"cursor\" if more\n"
+            "outputs may follow. Outputs are sorted by height within each page only.\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"Pb7FLL3DyaAVP2eGfRiEkj4U8ZJ3RHLY9g\"]}'")
+            + HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"Pb7FLL3DyaAVP2eGfRiEkj4U8ZJ3RHLY9g\"], \"limit\": 1000}'")
             + HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"Pb7FLL3DyaAVP2eGfRiEkj4U8ZJ3RHLY9g\"]}")
             );
 
+    return addressUtxosToJSON(request.params);
+}
+
+UniValue addressUtxosToJSON(const UniValue& params)
+{
     if (!fAddressIndex)
         throw JSONRPCError(RPC_MISC_ERROR, "Address index is not enabled.");
 
     bool includeChainInfo = false;
-    if (request.params[0].isObject()) {
-        UniValue chainInfo = find_value(request.params[0].get_obj(), "chainInfo");
+    if (params[0].isObject()) {
+        UniValue chainInfo = find_value(params[0].get_obj(), "chainInfo");
         if (chainInfo.isBool()) {
             includeChainInfo = chainInfo.get_bool();
         }
@@ -912,17 +1121,16 @@ UniValue getaddressutxos(const JSONRPCRequest& request)
 
     std::vector<std::pair<uint256, int> > addresses;
 
-    if (!getAddressesFromParams(request.params, addresses)) {
+    if (!getAddressesFromParams(params, addresses)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    size_t nLimit;
+    std::string sCursor, sNextCursor;
+    bool fPaginate = getPaginationFromParams(params, nLimit, sCursor);
 
-    for (std::vector<std::pair<uint256, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-        }
-    }
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    readAddressUnspentPage(addresses, nLimit, sCursor, unspentOutputs, sNextCursor);
 
     std::sort(unspentOutputs.begin(), unspentOutputs.end(), heightSort);
 
@@ -944,13 +1152,18 @@ UniValue getaddressutxos(const JSONRPCRequest& request)
         utxos.push_back(output);
     }
 
-    if (includeChainInfo) {
+    if (includeChainInfo || fPaginate) {
         UniValue result(UniValue::VOBJ);
         result.push_back(Pair("utxos", utxos));
+        if (!sNextCursor.empty()) {
+            result.push_back(Pair("cursor", sNextCursor));
+        }
 
-        LOCK(cs_main);
-        result.push_back(Pair("hash", chainActive.Tip()->GetBlockHash().GetHex()));
-        result.push_back(Pair("height", (int)chainActive.Height()));
+        if (includeChainInfo) {
+            LOCK(cs_main);
+            result.push_back(Pair("hash", chainActive.Tip()->GetBlockHash().GetHex()));
+            result.push_back(Pair("height", (int)chainActive.Height()));
+        }
         return result;
     } else {
         return utxos;
@@ -973,6 +1186,8 @@ UniValue getaddressdeltas(const JSONRPCRequest& request)
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
             "  \"chainInfo\" (boolean) Include chain info in results, only applies if start and end specified\n"
+            "  \"limit\" (number, optional) Return at most limit deltas, results are wrapped in an object\n"
+            "  \"cursor\" (string, optional) Continue after the cursor returned by a previous call\n"
             "}\n"
             "\nResult:\n"
             "[\n"
@@ -984,18 +1199,26 @@ UniValue getaddressdeltas(const JSONRPCRequest& request)
             "    \"address\"  (string) The base58check encoded address\n"
             "  }\n"
             "]\n"
+            "\nWhen paginating, the deltas are returned in an object as \"deltas\", along with a \"cursor\" if more\n"
+            "deltas may follow.\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"Pb7FLL3DyaAVP2eGfRiEkj4U8ZJ3RHLY9g\"]}'")
+            + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"Pb7FLL3DyaAVP2eGfRiEkj4U8ZJ3RHLY9g\"], \"limit\": 1000}'")
             + HelpExampleRpc("getaddressdeltas", "{\"addresses\": [\"Pb7FLL3DyaAVP2eGfRiEkj4U8ZJ3RHLY9g\"]}")
         );
 
+    return addressDeltasToJSON(request.params);
+}
+
+UniValue addressDeltasToJSON(const UniValue& params)
+{
     if (!fAddressIndex)
         throw JSONRPCError(RPC_MISC_ERROR, "Address index is not enabled.");
 
-    UniValue startValue = find_value(request.params[0].get_obj(), "start");
-    UniValue endValue = find_value(request.params[0].get_obj(), "end");
+    UniValue startValue = find_value(params[0].get_obj(), "start");
+    UniValue endValue = find_value(params[0].get_obj(), "end");
 
-    UniValue chainInfo = find_value(request.params[0].get_obj(), "chainInfo");
+    UniValue chainInfo = find_value(params[0].get_obj(), "chainInfo");
     bool includeChainInfo = false;
     if (chainInfo.isBool()) {
         includeChainInfo = chainInfo.get_bool();
@@ -1017,23 +1240,16 @@ UniValue getaddressdeltas(const JSONRPCRequest& request)
 
     std::vector<std::pair<uint256, int> > addresses;
 
-    if (!getAddressesFromParams(request.params, addresses)) {
+    if (!getAddressesFromParams(params, addresses)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    size_t nLimit;
+    std::string sCursor, sNextCursor;
+    bool fPaginate = getPaginationFromParams(params, nLimit, sCursor);
 
-    for (std::vector<std::pair<uint256, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        } else {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        }
-    }
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    readAddressIndexPage(addresses, start, end, nLimit, sCursor, addressIndex, sNextCursor);
 
     UniValue deltas(UniValue::VARR);
 
@@ -1077,6 +1293,16 @@ UniValue getaddressdeltas(const JSONRPCRequest& request)
         result.push_back(Pair("deltas", deltas));
         result.push_back(Pair("start", startInfo));
         result.push_back(Pair("end", endInfo));
+        if (!sNextCursor.empty()) {
+            result.push_back(Pair("cursor", sNextCursor));
+        }
+
+        return result;
+    } else if (fPaginate) {
+        result.push_back(Pair("deltas", deltas));
+        if (!sNextCursor.empty()) {
+            result.push_back(Pair("cursor", sNextCursor));
+        }
 
         return result;
     } else {
@@ -1117,22 +1343,16 @@ UniValue getaddressbalance(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-
-    for (std::vector<std::pair<uint256, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-        }
-    }
-
     CAmount balance = 0;
     CAmount received = 0;
 
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
-        if (it->second > 0) {
-            received += it->second;
+    for (std::vector<std::pair<uint256, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+        CAddressBalanceValue value;
+        if (!GetAddressBalance((*it).first, (*it).second, value)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
         }
-        balance += it->second;
+        balance += value.balance;
+        received += value.received;
     }
 
     UniValue result(UniValue::VOBJ);
@@ -1157,50 +1377,53 @@ UniValue getaddresstxids(const JSONRPCRequest& request)
             "    ]\n"
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
+            "  \"limit\" (number, optional) Read at most limit index entries, results are wrapped in an object\n"
+            "  \"cursor\" (string, optional) Continue after the cursor returned by a previous call\n"
             "}\n"
             "\nResult:\n"
             "[\n"
             "  \"transactionid\"  (string) The transaction id\n"
             "  ,...\n"
             "]\n"
+            "\nWhen paginating, the txids are returned in an object as \"txids\", along with a \"cursor\" if more\n"
+            "txids may follow. A txid may be repeated on the next page if it has several entries for the address.\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"Pb7FLL3DyaAVP2eGfRiEkj4U8ZJ3RHLY9g\"]}'")
+            + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"Pb7FLL3DyaAVP2eGfRiEkj4U8ZJ3RHLY9g\"], \"limit\": 1000}'")
             + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"Pb7FLL3DyaAVP2eGfRiEkj4U8ZJ3RHLY9g\"]}")
         );
 
+    return addressTxidsToJSON(request.params);
+}
+
+UniValue addressTxidsToJSON(const UniValue& params)
+{
     if (!fAddressIndex)
       throw JSONRPCError(RPC_MISC_ERROR, "Address index is not enabled.");
 
     std::vector<std::pair<uint256, int> > addresses;
 
-    if (!getAddressesFromParams(request.params, addresses)) {
+    if (!getAddressesFromParams(params, addresses)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
     int start = 0;
     int end = 0;
-    if (request.params[0].isObject()) {
-        UniValue startValue = find_value(request.params[0].get_obj(), "start");
-        UniValue endValue = find_value(request.params[0].get_obj(), "end");
+    if (params[0].isObject()) {
+        UniValue startValue = find_value(params[0].get_obj(), "start");
+        UniValue endValue = find_value(params[0].get_obj(), "end");
         if (startValue.isNum() && endValue.isNum()) {
             start = startValue.get_int();
             end = endValue.get_int();
         }
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    size_t nLimit;
+    std::string sCursor, sNextCursor;
+    bool fPaginate = getPaginationFromParams(params, nLimit, sCursor);
 
-    for (std::vector<std::pair<uint256, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        } else {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        }
-    }
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    readAddressIndexPage(addresses, start, end, nLimit, sCursor, addressIndex, sNextCursor);
 
     std::set<std::pair<int, std::string> > txids;
     UniValue result(UniValue::VARR);
@@ -1224,6 +1447,15 @@ UniValue getaddresstxids(const JSONRPCRequest& request)
         }
     }
 
+    if (fPaginate) {
+        UniValue page(UniValue::VOBJ);
+        page.push_back(Pair("txids", result));
+        if (!sNextCursor.empty()) {
+            page.push_back(Pair("cursor", sNextCursor));
+        }
+        return page;
+    }
+
     return result;
 }
 
@@ -0,0 +1,24 @@
+// Copyright (c) 2017 The Particl Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PARTICL_RPC_MISC_H
+#define PARTICL_RPC_MISC_H
+
+#include <string>
+
+class UniValue;
+
+/** Address index query of the getaddress* RPCs from a path: <address>[/<limit>[/<cursor>]] */
+UniValue addressQueryFromPath(const std::string& strPath);
+
+/** Unspent outputs of the addresses in params[0] to JSON, as getaddressutxos */
+UniValue addressUtxosToJSON(const UniValue& params);
+
+/** Balance changes of the addresses in params[0] to JSON, as getaddressdeltas */
+UniValue addressDeltasToJSON(const UniValue& params);
+
+/** Txids of the addresses in params[0] to JSON, as getaddresstxids */
+UniValue addressTxidsToJSON(const UniValue& params);
+
+#endif // PARTICL_RPC_MISC_H
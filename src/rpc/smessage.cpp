@@ -13,6 +13,7 @@
 #include "script/ismine.h"
 #include "utilstrencodings.h"
 #include "core_io.h"
+#include "crypto/sha256.h"
 
 #ifdef ENABLE_WALLET
 #include "wallet/wallet.h"
@@ -274,6 +275,7 @@ UniValue smsglocalkeys(const JSONRPCRequest &request)
             result.pushKV("result", "Unknown operation.");
             return result;
         };
+        SecureMsgInvalidateScanKeys();
 
         std::string sInfo;
         sInfo = std::string("Receive ") + (it->fReceiveEnabled ? "on, " : "off,");
@@ -328,6 +330,7 @@ UniValue smsglocalkeys(const JSONRPCRequest &request)
             result.pushKV("result", "Unknown operation.");
             return result;
         };
+        SecureMsgInvalidateScanKeys();
 
         std::string sInfo;
         sInfo = std::string("Receive ") + (it->fReceiveEnabled ? "on, " : "off,");
@@ -688,92 +691,103 @@ UniValue smsginbox(const JSONRPCRequest &request)
     vchKey.resize(16);
     memset(&vchKey[0], 0, 16);
 
+    SecMsgDB dbInbox;
     {
         LOCK(cs_smsgDB);
-
-        SecMsgDB dbInbox;
-
         if (!dbInbox.Open("cr+"))
             throw std::runtime_error("Could not open DB.");
+        dbInbox.Snapshot();
+    } // cs_smsgDB
 
-        uint32_t nMessages = 0;
-        char cbuf[256];
-
-        std::string sPrefix("im");
-        unsigned char chKey[18];
+    uint32_t nMessages = 0;
+    char cbuf[256];
 
-        if (mode == "clear")
-        {
-            dbInbox.TxnBegin();
+    std::string sPrefix("im");
+    unsigned char chKey[18];
 
-            leveldb::Iterator *it = dbInbox.pdb->NewIterator(leveldb::ReadOptions());
-            while (dbInbox.NextSmesgKey(it, sPrefix, chKey))
-            {
-                dbInbox.EraseSmesg(chKey);
-                nMessages++;
-            };
-            delete it;
-            dbInbox.TxnCommit();
+    if (mode == "clear")
+    {
+        LOCK(cs_smsgDB);
+        dbInbox.TxnBegin();
 
-            result.pushKV("result", strprintf("Deleted %u messages.", nMessages));
-        } else
-        if (mode == "all"
-            || mode == "unread")
+        leveldb::Iterator *it = dbInbox.NewIterator();
+        while (dbInbox.NextSmesgKey(it, sPrefix, chKey))
         {
-            int fCheckReadStatus = mode == "unread" ? 1 : 0;
+            dbInbox.EraseSmesg(chKey);
+            nMessages++;
+        };
+        delete it;
+        dbInbox.TxnCommit();
 
-            SecMsgStored smsgStored;
-            MessageData msg;
+        result.pushKV("result", strprintf("Deleted %u messages.", nMessages));
+    } else
+    if (mode == "all"
+        || mode == "unread")
+    {
+        int fCheckReadStatus = mode == "unread" ? 1 : 0;
 
-            dbInbox.TxnBegin();
+        SecMsgStored smsgStored;
+        MessageData msg;
+        std::vector<std::vector<uint8_t> > vMarkRead;
 
-            leveldb::Iterator *it = dbInbox.pdb->NewIterator(leveldb::ReadOptions());
-            UniValue messageList(UniValue::VARR);
+        // Decrypt from the snapshot, messages arriving meanwhile are not blocked
+        leveldb::Iterator *it = dbInbox.NewIterator();
+        UniValue messageList(UniValue::VARR);
 
-            while (dbInbox.NextSmesg(it, sPrefix, chKey, smsgStored))
-            {
-                if (fCheckReadStatus
-                    && !(smsgStored.status & SMSG_MASK_UNREAD))
-                    continue;
+        while (dbInbox.NextSmesg(it, sPrefix, chKey, smsgStored))
+        {
+            if (fCheckReadStatus
+                && !(smsgStored.status & SMSG_MASK_UNREAD))
+                continue;
 
-                uint32_t nPayload = smsgStored.vchMessage.size() - SMSG_HDR_LEN;
-                if (SecureMsgDecrypt(false, smsgStored.addrTo, &smsgStored.vchMessage[0], &smsgStored.vchMessage[SMSG_HDR_LEN], nPayload, msg) == 0)
-                {
-                    UniValue objM(UniValue::VOBJ);
-                    objM.pushKV("success", "1");
-                    objM.pushKV("received", part::GetTimeString(smsgStored.timeReceived, cbuf, sizeof(cbuf)));
-                    objM.pushKV("sent", part::GetTimeString(msg.timestamp, cbuf, sizeof(cbuf)));
-                    objM.pushKV("from", msg.sFromAddress);
-                    objM.pushKV("to", CBitcoinAddress(smsgStored.addrTo).ToString());
-                    objM.pushKV("text", std::string((char*)&msg.vchMessage[0])); // ugh
+            uint32_t nPayload = smsgStored.vchMessage.size() - SMSG_HDR_LEN;
+            if (SecureMsgDecrypt(false, smsgStored.addrTo, &smsgStored.vchMessage[0], &smsgStored.vchMessage[SMSG_HDR_LEN], nPayload, msg) == 0)
+            {
+                UniValue objM(UniValue::VOBJ);
+                objM.pushKV("success", "1");
+                objM.pushKV("received", part::GetTimeString(smsgStored.timeReceived, cbuf, sizeof(cbuf)));
+                objM.pushKV("sent", part::GetTimeString(msg.timestamp, cbuf, sizeof(cbuf)));
+                objM.pushKV("from", msg.sFromAddress);
+                objM.pushKV("to", CBitcoinAddress(smsgStored.addrTo).ToString());
+                objM.pushKV("text", std::string((char*)&msg.vchMessage[0])); // ugh
+
+                messageList.push_back(objM);
+            } else
+            {
+                UniValue objM(UniValue::VOBJ);
+                objM.pushKV("success", "0");
+                messageList.push_back(objM);
+            };
 
-                    messageList.push_back(objM);
-                } else
-                {
-                    UniValue objM(UniValue::VOBJ);
-                    objM.pushKV("success", "0");
-                    messageList.push_back(objM);
-                };
+            if (fCheckReadStatus)
+                vMarkRead.emplace_back(chKey, chKey + 18);
+            nMessages++;
+        };
+        delete it;
 
-                if (fCheckReadStatus)
-                {
-                    smsgStored.status &= ~SMSG_MASK_UNREAD;
-                    dbInbox.WriteSmesg(chKey, smsgStored);
-                };
-                nMessages++;
+        if (vMarkRead.size() > 0)
+        {
+            // Status is rewritten from the current record, which may have changed since the snapshot
+            LOCK(cs_smsgDB);
+            dbInbox.TxnBegin();
+            for (auto &vchMarkKey : vMarkRead)
+            {
+                if (!dbInbox.ReadSmesg(&vchMarkKey[0], smsgStored))
+                    continue;
+                smsgStored.status &= ~SMSG_MASK_UNREAD;
+                dbInbox.WriteSmesg(&vchMarkKey[0], smsgStored);
             };
-            delete it;
             dbInbox.TxnCommit();
+        };
 
-            result.pushKV("messages", messageList);
-            result.pushKV("result", strprintf("%u", nMessages));
+        result.pushKV("messages", messageList);
+        result.pushKV("result", strprintf("%u", nMessages));
 
-        } else
-        {
-            result.pushKV("result", "Unknown Mode.");
-            result.pushKV("expected", "[all|unread|clear].");
-        };
-    } // cs_smsgDB
+    } else
+    {
+        result.pushKV("result", "Unknown Mode.");
+        result.pushKV("expected", "[all|unread|clear].");
+    };
 #else
     UniValue result(UniValue::VOBJ);
     throw std::runtime_error("No wallet.");
@@ -809,73 +823,73 @@ UniValue smsgoutbox(const JSONRPCRequest &request)
     unsigned char chKey[18];
     memset(&chKey[0], 0, 18);
 
+    SecMsgDB dbOutbox;
     {
         LOCK(cs_smsgDB);
-
-        SecMsgDB dbOutbox;
-
         if (!dbOutbox.Open("cr+"))
             throw std::runtime_error("Could not open DB.");
+        dbOutbox.Snapshot();
+    } // cs_smsgDB
 
-        uint32_t nMessages = 0;
-        char cbuf[256];
+    uint32_t nMessages = 0;
+    char cbuf[256];
+
+    if (mode == "clear")
+    {
+        LOCK(cs_smsgDB);
+        dbOutbox.TxnBegin();
 
-        if (mode == "clear")
+        leveldb::Iterator *it = dbOutbox.NewIterator();
+        while (dbOutbox.NextSmesgKey(it, sPrefix, chKey))
         {
-            dbOutbox.TxnBegin();
+            dbOutbox.EraseSmesg(chKey);
+            nMessages++;
+        };
+        delete it;
+        dbOutbox.TxnCommit();
 
-            leveldb::Iterator *it = dbOutbox.pdb->NewIterator(leveldb::ReadOptions());
-            while (dbOutbox.NextSmesgKey(it, sPrefix, chKey))
-            {
-                dbOutbox.EraseSmesg(chKey);
-                nMessages++;
-            };
-            delete it;
-            dbOutbox.TxnCommit();
 
+        result.pushKV("result", strprintf("Deleted %u messages.", nMessages));
+    } else
+    if (mode == "all")
+    {
+        SecMsgStored smsgStored;
+        MessageData msg;
+        leveldb::Iterator *it = dbOutbox.NewIterator();
 
-            result.pushKV("result", strprintf("Deleted %u messages.", nMessages));
-        } else
-        if (mode == "all")
-        {
-            SecMsgStored smsgStored;
-            MessageData msg;
-            leveldb::Iterator *it = dbOutbox.pdb->NewIterator(leveldb::ReadOptions());
+        UniValue messageList(UniValue::VARR);
 
-            UniValue messageList(UniValue::VARR);
+        while (dbOutbox.NextSmesg(it, sPrefix, chKey, smsgStored))
+        {
+            uint32_t nPayload = smsgStored.vchMessage.size() - SMSG_HDR_LEN;
 
-            while (dbOutbox.NextSmesg(it, sPrefix, chKey, smsgStored))
+            if (SecureMsgDecrypt(false, smsgStored.addrOutbox, &smsgStored.vchMessage[0], &smsgStored.vchMessage[SMSG_HDR_LEN], nPayload, msg) == 0)
             {
-                uint32_t nPayload = smsgStored.vchMessage.size() - SMSG_HDR_LEN;
-
-                if (SecureMsgDecrypt(false, smsgStored.addrOutbox, &smsgStored.vchMessage[0], &smsgStored.vchMessage[SMSG_HDR_LEN], nPayload, msg) == 0)
-                {
-                    UniValue objM(UniValue::VOBJ);
-                    objM.pushKV("success", "1");
-                    objM.pushKV("sent", part::GetTimeString(msg.timestamp, cbuf, sizeof(cbuf)));
-                    objM.pushKV("from", msg.sFromAddress);
-                    objM.pushKV("to", CBitcoinAddress(smsgStored.addrTo).ToString());
-                    objM.pushKV("text", std::string((char*)&msg.vchMessage[0])); // ugh
+                UniValue objM(UniValue::VOBJ);
+                objM.pushKV("success", "1");
+                objM.pushKV("sent", part::GetTimeString(msg.timestamp, cbuf, sizeof(cbuf)));
+                objM.pushKV("from", msg.sFromAddress);
+                objM.pushKV("to", CBitcoinAddress(smsgStored.addrTo).ToString());
+                objM.pushKV("text", std::string((char*)&msg.vchMessage[0])); // ugh
 
-                    messageList.push_back(objM);
-                } else
-                {
-                    UniValue objM(UniValue::VOBJ);
-                    objM.pushKV("success", "0");
-                    messageList.push_back(objM);
-                };
-                nMessages++;
+                messageList.push_back(objM);
+            } else
+            {
+                UniValue objM(UniValue::VOBJ);
+                objM.pushKV("success", "0");
+                messageList.push_back(objM);
             };
-            delete it;
-
-            result.pushKV("messages" ,messageList);
-            result.pushKV("result", strprintf("%u", nMessages));
-        } else
-        {
-            result.pushKV("result", "Unknown Mode.");
-            result.pushKV("expected", "[all|clear].");
+            nMessages++;
         };
-    }
+        delete it;
+
+        result.pushKV("messages" ,messageList);
+        result.pushKV("result", strprintf("%u", nMessages));
+    } else
+    {
+        result.pushKV("result", "Unknown Mode.");
+        result.pushKV("expected", "[all|clear].");
+    };
 #else
     UniValue result(UniValue::VOBJ);
     throw std::runtime_error("No wallet.");
@@ -983,16 +997,7 @@ UniValue smsgbuckets(const JSONRPCRequest &request)
 
             for (it = smsgBuckets.begin(); it != smsgBuckets.end(); ++it)
             {
-                std::string sFile = std::to_string(it->first) + "_01.dat";
-
-                try {
-                    boost::filesystem::path fullPath = GetDataDir() / "smsgstore" / sFile;
-                    boost::filesystem::remove(fullPath);
-                } catch (const boost::filesystem::filesystem_error& ex)
-                {
-                    //objM.push_back(Pair("file size, error", ex.what()));
-                    LogPrintf("Error removing bucket file %s.\n", ex.what());
-                };
+                SecureMsgRemoveBucketFiles(it->first);
             };
             smsgBuckets.clear();
         }; // cs_smsg
@@ -1201,10 +1206,13 @@ UniValue smsgview(const JSONRPCRequest &request)
     size_t debugEmptySent = 0;
 
     {
-        LOCK(cs_smsgDB);
         SecMsgDB dbMsg;
-        if (!dbMsg.Open("cr"))
-            throw std::runtime_error("Could not open DB.");
+        {
+            LOCK(cs_smsgDB);
+            if (!dbMsg.Open("cr"))
+                throw std::runtime_error("Could not open DB.");
+            dbMsg.Snapshot();
+        } // cs_smsgDB
 
         std::vector<std::string>::iterator itp;
         std::vector<CKeyID>::iterator its;
@@ -1212,9 +1220,7 @@ UniValue smsgview(const JSONRPCRequest &request)
         {
             bool fInbox = *itp == std::string("im");
 
-            dbMsg.TxnBegin();
-
-            leveldb::Iterator *it = dbMsg.pdb->NewIterator(leveldb::ReadOptions());
+            leveldb::Iterator *it = dbMsg.NewIterator();
             SecMsgStored smsgStored;
             MessageData msg;
 
@@ -1310,10 +1316,8 @@ UniValue smsgview(const JSONRPCRequest &request)
                 };
             };
             delete it;
-
-            dbMsg.TxnCommit();
         };
-    } // cs_smsgDB
+    }
 
 
     std::sort(vMessages.begin(), vMessages.end(), fDesc ? sortMsgDesc : sortMsgAsc);
@@ -1344,6 +1348,41 @@ UniValue smsgview(const JSONRPCRequest &request)
 
 
 
+UniValue smsggetinfo(const JSONRPCRequest &request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "smsggetinfo\n"
+            "Returns an object containing secure messaging state and proof of work statistics.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"enabled\": true|false,    (boolean) if secure messaging is enabled\n"
+            "  \"powthreads\": n,          (numeric) threads used for proof of work\n"
+            "  \"powlanes\": n,            (numeric) nonces hashed per pass in each thread\n"
+            "  \"powmessages\": n,         (numeric) messages with proof of work done since startup\n"
+            "  \"powhashes\": n,           (numeric) hashes computed since startup\n"
+            "  \"powhashrate\": n,         (numeric) average hashes per second\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("smsggetinfo", "")
+            + HelpExampleRpc("smsggetinfo", ""));
+
+    UniValue result(UniValue::VOBJ);
+
+    uint64_t nHashes = smsgPowStats.nHashes;
+    int64_t nTimeMs = smsgPowStats.nTimeMs;
+
+    result.pushKV("enabled", UniValue(fSecMsgEnabled));
+    result.pushKV("powthreads", (uint64_t)SecureMsgGetPowThreads());
+    result.pushKV("powlanes", (int)CSHA256Lanes::LANES);
+    result.pushKV("powmessages", smsgPowStats.nMessages.load());
+    result.pushKV("powhashes", nHashes);
+    result.pushKV("powhashrate", nTimeMs > 0 ? (uint64_t)(nHashes * 1000 / nTimeMs) : 0);
+
+    return result;
+};
+
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         okSafeMode
   //  --------------------- ------------------------  -----------------------  ----------
@@ -1362,6 +1401,7 @@ static const CRPCCommand commands[] =
     { "smsg",               "smsgoutbox",             &smsgoutbox,             true, {} },
     { "smsg",               "smsgbuckets",            &smsgbuckets,            true, {} },
     { "smsg",               "smsgview",               &smsgview,               true, {} },
+    { "smsg",               "smsggetinfo",            &smsggetinfo,            true, {} },
 
     /* Not shown in help */
     //{ "hidden",             "setmocktime",            &setmocktime,            true  },
@@ -1194,28 +1194,68 @@ uint256 GetOutputsHash(const CTransaction& txTo) {
 } // namespace
 
 PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction& txTo)
+    : ssPrefixAll(SER_GETHASH, 0), ssPrefixSingleNone(SER_GETHASH, 0), ssPrefixAnyoneCanPay(SER_GETHASH, 0), fReady(false)
 {
+    for (const auto &txin : txTo.vin)
+    {
+        if (!txin.IsAnonInput())
+        {
+            fReady = true;
+            break;
+        };
+    };
+    if (!fReady)
+        return;
+
     hashPrevouts = GetPrevoutHash(txTo);
     hashSequence = GetSequenceHash(txTo);
     hashOutputs = GetOutputsHash(txTo);
+
+    uint256 zero;
+    ssPrefixAll << txTo.nVersion << hashPrevouts << hashSequence;
+    ssPrefixSingleNone << txTo.nVersion << hashPrevouts << zero;
+    ssPrefixAnyoneCanPay << txTo.nVersion << zero << zero;
 }
 
+namespace {
+
+/** Continue the sighash of input nIn from the fields after hashPrevouts and hashSequence. */
+uint256 SignatureHashInput(CHashWriter &ss, const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const std::vector<uint8_t>& amount, const uint256 &hashOutputs)
+{
+    // The input being signed (replacing the scriptSig with scriptCode + amount)
+    // The prevout may already be contained in hashPrevout, and the nSequence
+    // may already be contain in hashSequence.
+    ss << txTo.vin[nIn].prevout;
+    ss << scriptCode;
+
+    //ss << amount;
+    if (amount.size() > 0)
+        ss.write((const char*)&amount[0], amount.size()); // Make unit tests still pass, same as << CAmount when amount.size() == 8
+
+    ss << txTo.vin[nIn].nSequence;
+    // Outputs (none/one/all, depending on flags)
+    ss << hashOutputs;
+    // Locktime
+    ss << txTo.nLockTime;
+    // Sighash type
+    ss << nHashType;
+
+    return ss.GetHash();
+}
+
+} // namespace
+
 uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const std::vector<uint8_t>& amount, SigVersion sigversion, const PrecomputedTransactionData* cache)
 {
     if (sigversion == SIGVERSION_WITNESS_V0
         || txTo.IsParticlVersion()) {
+        if (cache && !cache->fReady)
+            cache = nullptr;
+
         uint256 hashPrevouts;
         uint256 hashSequence;
         uint256 hashOutputs;
 
-        if (!(nHashType & SIGHASH_ANYONECANPAY)) {
-            hashPrevouts = cache ? cache->hashPrevouts : GetPrevoutHash(txTo);
-        }
-
-        if (!(nHashType & SIGHASH_ANYONECANPAY) && (nHashType & 0x1f) != SIGHASH_SINGLE && (nHashType & 0x1f) != SIGHASH_NONE) {
-            hashSequence = cache ? cache->hashSequence : GetSequenceHash(txTo);
-        }
-
         if ((nHashType & 0x1f) != SIGHASH_SINGLE && (nHashType & 0x1f) != SIGHASH_NONE) {
             hashOutputs = cache ? cache->hashOutputs : GetOutputsHash(txTo);
         } else if ((nHashType & 0x1f) == SIGHASH_SINGLE && nIn < txTo.GetNumVOuts()) {
@@ -1228,31 +1268,35 @@ uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsig
             hashOutputs = ss.GetHash();
         }
 
+        if (cache) {
+            // Resume from the midstate matching the prevouts and sequence hashes selected by nHashType
+            if (nHashType & SIGHASH_ANYONECANPAY) {
+                CHashWriter ss(cache->ssPrefixAnyoneCanPay);
+                return SignatureHashInput(ss, scriptCode, txTo, nIn, nHashType, amount, hashOutputs);
+            }
+            if ((nHashType & 0x1f) != SIGHASH_SINGLE && (nHashType & 0x1f) != SIGHASH_NONE) {
+                CHashWriter ss(cache->ssPrefixAll);
+                return SignatureHashInput(ss, scriptCode, txTo, nIn, nHashType, amount, hashOutputs);
+            }
+            CHashWriter ss(cache->ssPrefixSingleNone);
+            return SignatureHashInput(ss, scriptCode, txTo, nIn, nHashType, amount, hashOutputs);
+        }
+
+        if (!(nHashType & SIGHASH_ANYONECANPAY)) {
+            hashPrevouts = GetPrevoutHash(txTo);
+        }
+
+        if (!(nHashType & SIGHASH_ANYONECANPAY) && (nHashType & 0x1f) != SIGHASH_SINGLE && (nHashType & 0x1f) != SIGHASH_NONE) {
+            hashSequence = GetSequenceHash(txTo);
+        }
+
         CHashWriter ss(SER_GETHASH, 0);
         // Version
         ss << txTo.nVersion;
         // Input prevouts/nSequence (none/all, depending on flags)
         ss << hashPrevouts;
         ss << hashSequence;
-        // The input being signed (replacing the scriptSig with scriptCode + amount)
-        // The prevout may already be contained in hashPrevout, and the nSequence
-        // may already be contain in hashSequence.
-        ss << txTo.vin[nIn].prevout;
-        ss << scriptCode;
-
-        //ss << amount;
-        if (amount.size() > 0)
-            ss.write((const char*)&amount[0], amount.size()); // Make unit tests still pass, same as << CAmount when amount.size() == 8
-
-        ss << txTo.vin[nIn].nSequence;
-        // Outputs (none/one/all, depending on flags)
-        ss << hashOutputs;
-        // Locktime
-        ss << txTo.nLockTime;
-        // Sighash type
-        ss << nHashType;
-
-        return ss.GetHash();
+        return SignatureHashInput(ss, scriptCode, txTo, nIn, nHashType, amount, hashOutputs);
     }
 
     static const uint256 one(uint256S("0000000000000000000000000000000000000000000000000000000000000001"));
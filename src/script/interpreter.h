@@ -6,6 +6,7 @@
 #ifndef BITCOIN_SCRIPT_INTERPRETER_H
 #define BITCOIN_SCRIPT_INTERPRETER_H
 
+#include "hash.h"
 #include "script_error.h"
 #include "primitives/transaction.h"
 
@@ -114,6 +115,14 @@ struct PrecomputedTransactionData
 {
     uint256 hashPrevouts, hashSequence, hashOutputs;
 
+    /** Sighash writers with nVersion, hashPrevouts and hashSequence already written,
+     *  one per combination of the prevouts/sequence hashes the hash type selects. */
+    CHashWriter ssPrefixAll, ssPrefixSingleNone, ssPrefixAnyoneCanPay;
+
+    /** False when no input of the transaction is signed with SignatureHash (all anon inputs),
+     *  the outputs, including every range proof, are then not hashed. */
+    bool fReady;
+
     PrecomputedTransactionData(const CTransaction& tx);
 };
 
@@ -10,13 +10,15 @@
 
 
 CCriticalSection cs_smsgDB;
-leveldb::DB *smsgDB = nullptr;
+std::shared_ptr<leveldb::DB> smsgDB;
 
 bool SecMsgDB::Open(const char *pszMode)
 {
+    AssertLockHeld(cs_smsgDB);
     if (smsgDB)
     {
-        pdb = smsgDB;
+        pdbRef = smsgDB;
+        pdb = pdbRef.get();
         return true;
     };
 
@@ -34,7 +36,8 @@ bool SecMsgDB::Open(const char *pszMode)
 
     leveldb::Options options;
     options.create_if_missing = fCreate;
-    leveldb::Status s = leveldb::DB::Open(options, fullpath.string(), &smsgDB);
+    leveldb::DB *pdbNew = nullptr;
+    leveldb::Status s = leveldb::DB::Open(options, fullpath.string(), &pdbNew);
 
     if (!s.ok())
     {
@@ -42,11 +45,31 @@ bool SecMsgDB::Open(const char *pszMode)
         return false;
     };
 
-    pdb = smsgDB;
+    smsgDB.reset(pdbNew);
+    pdbRef = smsgDB;
+    pdb = pdbRef.get();
 
     return true;
 };
 
+bool SecMsgDB::Snapshot()
+{
+    if (!pdb)
+        return false;
+
+    if (pSnapshot)
+        pdb->ReleaseSnapshot(pSnapshot);
+    pSnapshot = pdb->GetSnapshot();
+    return true;
+};
+
+leveldb::Iterator *SecMsgDB::NewIterator() const
+{
+    leveldb::ReadOptions readOptions;
+    readOptions.snapshot = pSnapshot;
+    return pdb->NewIterator(readOptions);
+};
+
 
 class SecMsgBatchScanner : public leveldb::WriteBatch::Handler
 {
@@ -8,6 +8,8 @@
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
+#include <memory>
+
 #include "sync.h"
 #include "serialize.h"
 #include "streams.h"
@@ -17,14 +19,16 @@ class CKeyID;
 class CPubKey;
 
 extern CCriticalSection cs_smsgDB;
-extern leveldb::DB *smsgDB;
+extern std::shared_ptr<leveldb::DB> smsgDB;
 
 class SecMsgDB
 {
 public:
     SecMsgDB()
     {
+        pdb = nullptr;
         activeBatch = nullptr;
+        pSnapshot = nullptr;
     };
 
     ~SecMsgDB()
@@ -32,10 +36,19 @@ public:
         // Deletes only data scoped to this SecMsgDB object.
         if (activeBatch)
             delete activeBatch;
+        if (pSnapshot)
+            pdb->ReleaseSnapshot(pSnapshot);
     };
 
     bool Open(const char *pszMode="r+");
 
+    /**
+     * Pin the current state of the db, iterators from NewIterator() read the
+     * snapshot and may be used without cs_smsgDB held.
+     */
+    bool Snapshot();
+    leveldb::Iterator *NewIterator() const;
+
     bool ScanBatch(const CDataStream &key, std::string *value, bool *deleted) const;
 
     bool TxnBegin();
@@ -54,7 +67,9 @@ public:
     bool EraseSmesg(uint8_t *chKey);
 
     leveldb::DB *pdb;       // points to the global instance
+    std::shared_ptr<leveldb::DB> pdbRef; // keeps the global instance open while in use
     leveldb::WriteBatch *activeBatch;
+    const leveldb::Snapshot *pSnapshot;
 };
 
 #endif // PARTICL_SMSG_DB_H
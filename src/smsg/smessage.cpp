@@ -30,21 +30,33 @@ Notes:
 #include <stdexcept>
 #include <errno.h>
 #include <limits>
+#include <memory>
+#include <atomic>
+#include <cstddef>
 
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
 
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include <secp256k1.h>
 #include <secp256k1_ecdh.h>
 #include <secp256k1_recovery.h>
 
 #include "crypto/hmac_sha256.h"
+#include "crypto/sha256.h"
 #include "crypto/sha512.h"
 
 #include "script/ismine.h"
 #include "policy/policy.h"
 #include "support/allocators/secure.h"
+#include "support/cleanse.h"
 #include "consensus/validation.h"
 #include "validation.h"
 #include "validationinterface.h"
@@ -55,6 +67,7 @@ Notes:
 #include "chain.h"
 #include "netmessagemaker.h"
 #include "fs.h"
+#include "workerpool.h"
 
 #ifdef ENABLE_WALLET
 #include "wallet/coincontrol.h"
@@ -85,6 +98,10 @@ bool fSecMsgEnabled = false;
 std::map<int64_t, SecMsgBucket> smsgBuckets;
 std::vector<SecMsgAddress>      smsgAddresses;
 SecMsgOptions                   smsgOptions;
+SecMsgPowStats                  smsgPowStats;
+
+static size_t nSmsgPowThreads = 1;
+static std::unique_ptr<CWorkerPool> pSmsgPowPool; // nSmsgPowThreads - 1 threads, the pow thread is the last
 
 
 CCriticalSection cs_smsg;
@@ -195,21 +212,10 @@ void ThreadSecureMsg()
 
                     std::string fileName = std::to_string(it->first);
 
-                    fs::path fullPath = GetDataDir() / "smsgstore" / (fileName + "_01.dat");
-                    if (fs::exists(fullPath))
-                    {
-                        try { fs::remove(fullPath);
-                        } catch (const fs::filesystem_error &ex)
-                        {
-                            LogPrintf("Error removing bucket file %s.\n", ex.what());
-                        };
-                    } else
-                    {
-                        LogPrintf("Path %s does not exist \n", fullPath.string());
-                    };
+                    SecureMsgRemoveBucketFiles(it->first);
 
                     // Look for a wl file, it stores incoming messages when wallet is locked
-                    fullPath = GetDataDir() / "smsgstore" / (fileName + "_01_wl.dat");
+                    fs::path fullPath = GetDataDir() / "smsgstore" / (fileName + "_01_wl.dat");
                     if (fs::exists(fullPath))
                     {
                         try { fs::remove(fullPath);
@@ -280,16 +286,22 @@ void ThreadSecureMsg()
     };
 };
 
+struct SecMsgPowItem
+{
+    uint8_t chKey[18];
+    SecMsgStored smsgStored;
+    int rv = SMSG_NO_ERROR;
+};
+
 void ThreadSecureMsgPow()
 {
     // Proof of work thread
+    // Reads up to one queued message per pow thread, the proof of work for the batch runs in parallel
 
     int rv;
     std::vector<uint8_t> vchKey;
-    SecMsgStored smsgStored;
 
     std::string sPrefix("qm");
-    uint8_t chKey[18];
 
     while (fSecMsgEnabled)
     {
@@ -308,110 +320,147 @@ void ThreadSecureMsgPow()
         }
         // Break up lock, SecureMsgSetHash will take long
 
-        for (;;)
+        bool fShutdown = false;
+        while (!fShutdown)
         {
             if (!fSecMsgEnabled)
                 break;
+
+            size_t nThreads = nSmsgPowThreads;
+            std::vector<SecMsgPowItem> vBatch;
             {
                 LOCK(cs_smsgDB);
-                if (!dbOutbox.NextSmesg(it, sPrefix, chKey, smsgStored))
-                    break;
+                while (vBatch.size() < nThreads)
+                {
+                    vBatch.emplace_back();
+                    if (!dbOutbox.NextSmesg(it, sPrefix, vBatch.back().chKey, vBatch.back().smsgStored))
+                    {
+                        vBatch.pop_back();
+                        break;
+                    };
+                };
             }
+            if (vBatch.empty())
+                break;
 
-            uint8_t *pHeader = &smsgStored.vchMessage[0];
-            uint8_t *pPayload = &smsgStored.vchMessage[SMSG_HDR_LEN];
-            SecureMessage *psmsg = (SecureMessage*) pHeader;
-
-            const int64_t FUND_TXN_TIMEOUT = 3600 * 48;
-            int64_t now = GetTime();
+            // Do proof of work, the pow pool is shared between the messages of the batch
+            size_t nThreadsPerMsg = std::max((size_t)1, nThreads / vBatch.size());
+            auto powTask = [&vBatch, nThreadsPerMsg](size_t i) {
+                SecMsgPowItem &item = vBatch[i];
+                uint8_t *pHeader = &item.smsgStored.vchMessage[0];
+                uint8_t *pPayload = &item.smsgStored.vchMessage[SMSG_HDR_LEN];
+                SecureMessage *psmsg = (SecureMessage*) pHeader;
+                if (psmsg->version[0] == 3)
+                    return;
+                item.rv = SecureMsgSetHash(pHeader, pPayload, psmsg->nPayload, nThreadsPerMsg);
+            };
+            if (pSmsgPowPool)
+                pSmsgPowPool->Run(vBatch.size(), powTask);
+            else
+                for (size_t i = 0; i < vBatch.size(); ++i)
+                    powTask(i);
 
-            if (psmsg->version[0] == 3)
+            for (auto &item : vBatch)
             {
-                uint256 txid;
-                uint160 msgId;
-                if (0 != SecureMsgHash(*psmsg, pPayload, psmsg->nPayload-32, msgId)
-                    || !GetFundingTxid(pPayload, psmsg->nPayload, txid))
-                {
-                    LogPrintf("%s: Get msgID or Txn Hash failed.\n", __func__);
-                    LOCK(cs_smsgDB);
-                    dbOutbox.EraseSmesg(chKey);
-                    continue;
-                };
+                uint8_t *chKey = item.chKey;
+                uint8_t *pHeader = &item.smsgStored.vchMessage[0];
+                uint8_t *pPayload = &item.smsgStored.vchMessage[SMSG_HDR_LEN];
+                SecureMessage *psmsg = (SecureMessage*) pHeader;
 
+                const int64_t FUND_TXN_TIMEOUT = 3600 * 48;
+                int64_t now = GetTime();
 
-                CTransactionRef txOut;
-                uint256 hashBlock;
+                if (psmsg->version[0] == 3)
                 {
-                    LOCK(cs_main);
-                    if (!GetTransaction(txid, txOut, Params().GetConsensus(), hashBlock))
+                    uint256 txid;
+                    uint160 msgId;
+                    if (0 != SecureMsgHash(*psmsg, pPayload, psmsg->nPayload-32, msgId)
+                        || !GetFundingTxid(pPayload, psmsg->nPayload, txid))
                     {
-                        // drop through
+                        LogPrintf("%s: Get msgID or Txn Hash failed.\n", __func__);
+                        LOCK(cs_smsgDB);
+                        dbOutbox.EraseSmesg(chKey);
+                        continue;
+                    };
+
+
+                    CTransactionRef txOut;
+                    uint256 hashBlock;
+                    {
+                        LOCK(cs_main);
+                        if (!GetTransaction(txid, txOut, Params().GetConsensus(), hashBlock))
+                        {
+                            // drop through
+                        }
                     }
-                }
 
-                int blockDepth = -1;
-                if (!hashBlock.IsNull())
-                {
-                    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
-                    if (mi != mapBlockIndex.end())
+                    int blockDepth = -1;
+                    if (!hashBlock.IsNull())
                     {
-                        CBlockIndex *pindex = (*mi).second;
-                        if (pindex && chainActive.Contains(pindex))
-                            blockDepth = chainActive.Height() - pindex->nHeight + 1;
+                        BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+                        if (mi != mapBlockIndex.end())
+                        {
+                            CBlockIndex *pindex = (*mi).second;
+                            if (pindex && chainActive.Contains(pindex))
+                                blockDepth = chainActive.Height() - pindex->nHeight + 1;
+                        };
                     };
-                };
 
-                if (blockDepth > 0)
-                {
+                    if (blockDepth > 0)
+                    {
 
-                    LogPrintf("Found txn %s at depth %d\n", txid.ToString(), blockDepth);
+                        LogPrintf("Found txn %s at depth %d\n", txid.ToString(), blockDepth);
+                    } else
+                    {
+                        // Failure
+                        if (psmsg->timestamp > now + FUND_TXN_TIMEOUT)
+                        {
+                            LogPrintf("%s: Funding txn timeout, dropping message %s\n", __func__, msgId.ToString());
+                            LOCK(cs_smsgDB);
+                            dbOutbox.EraseSmesg(chKey);
+                        }
+                        continue;
+                    }
                 } else
                 {
-                    // Failure
-                    if (psmsg->timestamp > now + FUND_TXN_TIMEOUT)
+                    // Proof of work was done above
+                    rv = item.rv;
+                    if (rv == SMSG_SHUTDOWN_DETECTED)
+                    {
+                        fShutdown = true;
+                        break; // leave message in db, if terminated due to shutdown
+                    };
+                    if (rv != 0)
                     {
-                        LogPrintf("%s: Funding txn timeout, dropping message %s\n", __func__, msgId.ToString());
+                        LogPrintf("SecMsgPow: Could not get proof of work hash, message removed.\n");
                         LOCK(cs_smsgDB);
                         dbOutbox.EraseSmesg(chKey);
-                    }
-                    continue;
-                }
-            } else
-            {
-                // Do proof of work
-                rv = SecureMsgSetHash(pHeader, pPayload, psmsg->nPayload);
-                if (rv == SMSG_SHUTDOWN_DETECTED)
-                    break; // leave message in db, if terminated due to shutdown
-                if (rv != 0)
+                        continue;
+                    };
+                };
+
+
+                // Remove message from queue
                 {
-                    LogPrintf("SecMsgPow: Could not get proof of work hash, message removed.\n");
                     LOCK(cs_smsgDB);
                     dbOutbox.EraseSmesg(chKey);
-                    continue;
-                };
-            };
-
+                }
 
-            // Remove message from queue
-            {
-                LOCK(cs_smsgDB);
-                dbOutbox.EraseSmesg(chKey);
-            }
+                // Add to message store
+                {
+                    LOCK(cs_smsg);
+                    if (SecureMsgStore(pHeader, pPayload, psmsg->nPayload, true) != 0)
+                    {
+                        LogPrintf("SecMsgPow: Could not place message in buckets, message removed.\n");
+                        continue;
+                    };
+                }
 
-            // Add to message store
-            {
-                LOCK(cs_smsg);
-                if (SecureMsgStore(pHeader, pPayload, psmsg->nPayload, true) != 0)
+                // Test if message was sent to self
+                if (SecureMsgScanMessage(pHeader, pPayload, psmsg->nPayload, true) != 0)
                 {
-                    LogPrintf("SecMsgPow: Could not place message in buckets, message removed.\n");
-                    continue;
+                    // Message recipient is not this node (or failed)
                 };
-            }
-
-            // Test if message was sent to self
-            if (SecureMsgScanMessage(pHeader, pPayload, psmsg->nPayload, true) != 0)
-            {
-                // Message recipient is not this node (or failed)
             };
         };
 
@@ -432,6 +481,7 @@ std::string SecureMsgGetHelpString(bool showDebug)
     strUsage += HelpMessageOpt("-smsgscanincoming", _("Scan incoming blocks for public key addresses. (default: false)"));
     strUsage += HelpMessageOpt("-smsgnotify=<cmd>", _("Execute command when a message is received. (%s in cmd is replaced by receiving address)"));
     strUsage += HelpMessageOpt("-smsgsaddnewkeys", _("Scan for incoming messages on new wallet keys. (default: false)"));
+    strUsage += HelpMessageOpt("-smsgpowthreads=<n>", strprintf(_("Number of threads used for message proof of work, 0 to use all cores. (default: %d)"), SMSG_DEFAULT_POW_THREADS));
 
     return strUsage;
 };
@@ -476,6 +526,324 @@ const char *SecureMessageGetString(size_t errorCode)
     return "No Error";
 };
 
+/*
+    Bucket index files
+
+    Each bucket file <time>_01.dat has an index file <time>_01.idx holding a
+    token for every message in the bucket file, in file order.
+    The bucket set is built from the index files, only message data appended
+    after the last indexed message must be read.
+
+    header: magic[4] version[4]
+    entry:  timestamp[8] sample[8] offset[4] nPayload[4] ttl[1]
+*/
+static const uint8_t SMSG_IDX_MAGIC[4] = {'s', 'm', 'i', 'x'};
+static const uint32_t SMSG_IDX_VERSION = 1;
+static const size_t SMSG_IDX_HDR_LEN = 8;
+static const size_t SMSG_IDX_ENTRY_LEN = 25;
+
+static const size_t SMSG_MAX_MAPPED_FILES = 64;
+
+static fs::path SecureMsgBucketPath(int64_t bucketTime, const char *suffix)
+{
+    return GetDataDir() / "smsgstore" / (std::to_string(bucketTime) + suffix);
+};
+
+/** Read only view of a bucket file, memory mapped where available. */
+class SecMsgMappedFile
+{
+public:
+    SecMsgMappedFile() {};
+    SecMsgMappedFile(const SecMsgMappedFile&) = delete;
+    SecMsgMappedFile& operator=(const SecMsgMappedFile&) = delete;
+    ~SecMsgMappedFile() { Close(); };
+
+    bool Open(const fs::path &path);
+    void Close();
+
+    const uint8_t *data() const { return pData; };
+    size_t size() const { return nSize; };
+
+private:
+    uint8_t *pData = nullptr;
+    size_t nSize = 0;
+#ifdef WIN32
+    std::vector<uint8_t> vData;
+#endif
+};
+
+bool SecMsgMappedFile::Open(const fs::path &path)
+{
+    Close();
+
+#ifdef WIN32
+    FILE *fp;
+    errno = 0;
+    if (!(fp = fopen(path.string().c_str(), "rb")))
+        return error("%s: fopen failed: %s.", __func__, strerror(errno));
+
+    if (fseek(fp, 0, SEEK_END) != 0)
+    {
+        fclose(fp);
+        return error("%s: fseek failed: %s.", __func__, strerror(errno));
+    };
+    long int nLen = ftell(fp);
+    rewind(fp);
+
+    vData.resize(nLen > 0 ? nLen : 0);
+    if (vData.size() > 0
+        && fread(vData.data(), 1, vData.size(), fp) != vData.size())
+    {
+        fclose(fp);
+        vData.clear();
+        return error("%s: fread failed: %s.", __func__, strerror(errno));
+    };
+    fclose(fp);
+
+    pData = vData.data();
+    nSize = vData.size();
+#else
+    int fd;
+    errno = 0;
+    if ((fd = open(path.string().c_str(), O_RDONLY)) < 0)
+        return error("%s: open failed: %s.", __func__, strerror(errno));
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return error("%s: fstat failed: %s.", __func__, strerror(errno));
+    };
+
+    if (st.st_size > 0)
+    {
+        void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            close(fd);
+            return error("%s: mmap failed: %s.", __func__, strerror(errno));
+        };
+        // Peers request scattered messages, don't read ahead
+        madvise(p, st.st_size, MADV_RANDOM);
+        pData = (uint8_t*) p;
+        nSize = st.st_size;
+    };
+    close(fd);
+#endif
+
+    return true;
+};
+
+void SecMsgMappedFile::Close()
+{
+#ifdef WIN32
+    vData.clear();
+    vData.shrink_to_fit();
+#else
+    if (pData)
+        munmap(pData, nSize);
+#endif
+    pData = nullptr;
+    nSize = 0;
+};
+
+static std::map<int64_t, std::unique_ptr<SecMsgMappedFile> > mapSmsgMappedFiles; // cs_smsg
+
+static const SecMsgMappedFile *SecureMsgMapBucketFile(int64_t bucketTime, size_t nMinSize)
+{
+    // Mappings stay valid as messages are appended, remap only if the wanted range is past the end
+    AssertLockHeld(cs_smsg);
+
+    std::map<int64_t, std::unique_ptr<SecMsgMappedFile> >::iterator it = mapSmsgMappedFiles.find(bucketTime);
+    if (it != mapSmsgMappedFiles.end()
+        && it->second->size() >= nMinSize)
+        return it->second.get();
+
+    std::unique_ptr<SecMsgMappedFile> pFile(new SecMsgMappedFile());
+    if (!pFile->Open(SecureMsgBucketPath(bucketTime, "_01.dat")))
+        return nullptr;
+
+    if (it == mapSmsgMappedFiles.end())
+    {
+        if (mapSmsgMappedFiles.size() >= SMSG_MAX_MAPPED_FILES)
+            mapSmsgMappedFiles.erase(mapSmsgMappedFiles.begin()); // oldest bucket
+        it = mapSmsgMappedFiles.insert(std::make_pair(bucketTime, nullptr)).first;
+    };
+    it->second = std::move(pFile);
+
+    return it->second.get();
+};
+
+static void SecureMsgIndexEntry(uint8_t *p, const uint8_t *pHeader, const uint8_t *pPayload, uint32_t offset)
+{
+    const SecureMessage *psmsg = (const SecureMessage*) pHeader;
+    uint8_t nDaysToLive = psmsg->version[0] < 3 ? 2 : psmsg->nonce[0];
+    uint32_t nPayload = psmsg->nPayload;
+
+    memcpy(p, &psmsg->timestamp, 8);
+    if (nPayload < 8)
+        memset(p+8, 0, 8);
+    else
+        memcpy(p+8, pPayload, 8);
+    memcpy(p+16, &offset, 4);
+    memcpy(p+20, &nPayload, 4);
+    p[24] = nDaysToLive;
+};
+
+static void SecureMsgAddIndexEntry(SecMsgBucket &bucket, const uint8_t *p)
+{
+    SecMsgToken token;
+    uint32_t offset, nPayload;
+    memcpy(&token.timestamp, p, 8);
+    memcpy(token.sample, p+8, 8);
+    memcpy(&offset, p+16, 4);
+    memcpy(&nPayload, p+20, 4);
+    token.offset = offset;
+    token.ttl = p[24];
+
+    if (bucket.nLeastTTL == 0 || token.ttl < bucket.nLeastTTL)
+        bucket.nLeastTTL = token.ttl;
+
+    if (nPayload < 8)
+        return;
+
+    bucket.setTokens.insert(token);
+};
+
+static bool SecureMsgReadIndex(const fs::path &pathIdx, uint64_t nFileSize, SecMsgBucket &bucket, uint64_t &nIndexed)
+{
+    // Returns false if the index is unusable and must be rebuilt
+    nIndexed = 0;
+
+    SecMsgMappedFile idx;
+    if (!idx.Open(pathIdx))
+        return false;
+
+    if (idx.size() < SMSG_IDX_HDR_LEN
+        || memcmp(idx.data(), SMSG_IDX_MAGIC, 4) != 0)
+        return error("%s: Bad header %s.", __func__, pathIdx.string());
+
+    uint32_t nVersion;
+    memcpy(&nVersion, idx.data() + 4, 4);
+    if (nVersion != SMSG_IDX_VERSION)
+        return error("%s: Unknown version %u.", __func__, nVersion);
+
+    if ((idx.size() - SMSG_IDX_HDR_LEN) % SMSG_IDX_ENTRY_LEN != 0)
+        return error("%s: Truncated entry %s.", __func__, pathIdx.string());
+
+    for (size_t ofs = SMSG_IDX_HDR_LEN; ofs < idx.size(); ofs += SMSG_IDX_ENTRY_LEN)
+    {
+        const uint8_t *p = idx.data() + ofs;
+        uint32_t offset, nPayload;
+        memcpy(&offset, p+16, 4);
+        memcpy(&nPayload, p+20, 4);
+
+        // Entries must cover the bucket file contiguously
+        if (offset != nIndexed
+            || nIndexed + SMSG_HDR_LEN + nPayload > nFileSize)
+            return error("%s: Entry at %u does not match bucket file.", __func__, offset);
+
+        SecureMsgAddIndexEntry(bucket, p);
+        nIndexed += SMSG_HDR_LEN + nPayload;
+    };
+
+    return true;
+};
+
+static int SecureMsgWriteIndex(const fs::path &pathIdx, const uint8_t *pEntries, size_t nLen, bool fTruncate)
+{
+    FILE *fp;
+    errno = 0;
+    if (!(fp = fopen(pathIdx.string().c_str(), fTruncate ? "wb" : "ab")))
+        return errorN(SMSG_GENERAL_ERROR, "%s: fopen failed: %s.", __func__, strerror(errno));
+
+    // On windows ftell will always return 0 after fopen(ab), call fseek to set.
+    if (fseek(fp, 0, SEEK_END) != 0)
+    {
+        fclose(fp);
+        return errorN(SMSG_GENERAL_ERROR, "%s: fseek failed: %s.", __func__, strerror(errno));
+    };
+
+    if (ftell(fp) == 0)
+    {
+        if (fwrite(SMSG_IDX_MAGIC, 1, 4, fp) != 4
+            || fwrite(&SMSG_IDX_VERSION, 4, 1, fp) != 1)
+        {
+            fclose(fp);
+            return errorN(SMSG_GENERAL_ERROR, "%s: fwrite failed: %s.", __func__, strerror(errno));
+        };
+    };
+
+    if (nLen > 0
+        && fwrite(pEntries, 1, nLen, fp) != nLen)
+    {
+        fclose(fp);
+        return errorN(SMSG_GENERAL_ERROR, "%s: fwrite failed: %s.", __func__, strerror(errno));
+    };
+
+    fclose(fp);
+    return SMSG_NO_ERROR;
+};
+
+static int SecureMsgIndexBucketFile(const fs::path &pathDat, uint64_t nFrom, SecMsgBucket &bucket, std::vector<uint8_t> &vchEntries)
+{
+    // Read messages from nFrom to the end of the bucket file, add tokens to bucket and index entries to vchEntries
+    SecMsgMappedFile file;
+    if (!file.Open(pathDat))
+        return SMSG_GENERAL_ERROR;
+
+    uint64_t ofs = nFrom;
+    while (ofs + SMSG_HDR_LEN <= file.size())
+    {
+        const uint8_t *pHeader = file.data() + ofs;
+        const SecureMessage *psmsg = (const SecureMessage*) pHeader;
+        if (ofs + SMSG_HDR_LEN + psmsg->nPayload > file.size())
+            break;
+
+        size_t nEntry = vchEntries.size();
+        vchEntries.resize(nEntry + SMSG_IDX_ENTRY_LEN);
+        SecureMsgIndexEntry(&vchEntries[nEntry], pHeader, pHeader + SMSG_HDR_LEN, ofs);
+        SecureMsgAddIndexEntry(bucket, &vchEntries[nEntry]);
+
+        ofs += SMSG_HDR_LEN + psmsg->nPayload;
+    };
+
+    if (ofs != file.size())
+        LogPrintf("%s: Ignoring %u trailing bytes in %s.\n", __func__, file.size() - ofs, pathDat.string());
+
+    return SMSG_NO_ERROR;
+};
+
+void SecureMsgRemoveBucketFiles(int64_t bucketTime)
+{
+    AssertLockHeld(cs_smsg);
+
+    mapSmsgMappedFiles.erase(bucketTime);
+
+    fs::path fullPath = SecureMsgBucketPath(bucketTime, "_01.dat");
+    if (fs::exists(fullPath))
+    {
+        try { fs::remove(fullPath);
+        } catch (const fs::filesystem_error &ex)
+        {
+            LogPrintf("Error removing bucket file %s.\n", ex.what());
+        };
+    } else
+    {
+        LogPrintf("Path %s does not exist \n", fullPath.string());
+    };
+
+    fullPath = SecureMsgBucketPath(bucketTime, "_01.idx");
+    if (fs::exists(fullPath))
+    {
+        try { fs::remove(fullPath);
+        } catch (const fs::filesystem_error &ex)
+        {
+            LogPrintf("Error removing bucket index file %s.\n", ex.what());
+        };
+    };
+};
+
 int SecureMsgBuildBucketSet()
 {
     /*
@@ -488,6 +856,7 @@ int SecureMsgBuildBucketSet()
 
     int64_t  now            = GetAdjustedTime();
     uint32_t nFiles         = 0;
+    uint32_t nIndexedFiles  = 0;
     uint32_t nMessages      = 0;
 
     fs::path pathSmsgDir = GetDataDir() / "smsgstore";
@@ -507,6 +876,22 @@ int SecureMsgBuildBucketSet()
 
         std::string fileType = (*itd).path().extension().string();
 
+        if (fileType.compare(".idx") == 0)
+        {
+            // Remove index files left without a bucket file
+            fs::path pathDat = (*itd).path();
+            pathDat.replace_extension(".dat");
+            if (!fs::exists(pathDat))
+            {
+                try {
+                    fs::remove((*itd).path());
+                } catch (const fs::filesystem_error &ex) {
+                    LogPrintf("Error removing bucket index %s, %s.\n", (*itd).path().string(), ex.what());
+                };
+            };
+            continue;
+        };
+
         if (fileType.compare(".dat") != 0)
             continue;
 
@@ -535,6 +920,8 @@ int SecureMsgBuildBucketSet()
             LogPrintf("Dropping file %s, expired.\n", fileName);
             try {
                 fs::remove((*itd).path());
+                if (!boost::algorithm::ends_with(fileName, "_wl.dat"))
+                    fs::remove(SecureMsgBucketPath(fileTime, "_01.idx"));
             } catch (const fs::filesystem_error &ex) {
                 LogPrintf("Error removing bucket file %s, %s.\n", fileName, ex.what());
             };
@@ -548,73 +935,53 @@ int SecureMsgBuildBucketSet()
         };
 
         size_t nTokenSetSize = 0;
-        SecureMessage smsg;
         {
             LOCK(cs_smsg);
 
             SecMsgBucket &bucket = smsgBuckets[fileTime];
-            std::set<SecMsgToken> &tokenSet = bucket.setTokens;
 
-            FILE *fp;
-            if (!(fp = fopen((*itd).path().string().c_str(), "rb")))
+            fs::path pathIdx = SecureMsgBucketPath(fileTime, "_01.idx");
+            uint64_t nFileSize = 0, nIndexed = 0;
+            bool fRebuild = !fs::exists(pathIdx);
+            try { nFileSize = fs::file_size((*itd).path());
+            } catch (const fs::filesystem_error &ex)
             {
-                LogPrintf("Error opening file: %s\n", strerror(errno));
+                LogPrintf("Error reading bucket file size %s.\n", ex.what());
                 continue;
             };
 
-            for (;;)
+            if (!fRebuild
+                && !SecureMsgReadIndex(pathIdx, nFileSize, bucket, nIndexed))
             {
-                long int ofs = ftell(fp);
-                SecMsgToken token;
-                token.offset = ofs;
-                errno = 0;
-                if (fread(smsg.data(), sizeof(uint8_t), SMSG_HDR_LEN, fp) != (size_t)SMSG_HDR_LEN)
-                {
-                    if (errno != 0)
-                    {
-                        LogPrintf("fread header failed: %s\n", strerror(errno));
-                    } else
-                    {
-                        //LogPrintf("End of file.\n");
-                    };
-                    break;
-                };
-                token.timestamp = smsg.timestamp;
-
-                uint32_t nDaysToLive = smsg.version[0] < 3 ? 2 : smsg.nonce[0];
-                if (bucket.nLeastTTL == 0 || nDaysToLive < bucket.nLeastTTL)
-                    bucket.nLeastTTL = nDaysToLive;
-
-                if (smsg.nPayload < 8)
-                    continue;
-
-                if (fread(token.sample, sizeof(uint8_t), 8, fp) != 8)
-                {
-                    LogPrintf("fread failed: %s\n", strerror(errno));
-                    break;
-                };
-
-                if (fseek(fp, smsg.nPayload-8, SEEK_CUR) != 0)
-                {
-                    LogPrintf("fseek failed: %s.\n", strerror(errno));
-                    break;
-                };
-
-                tokenSet.insert(token);
+                LogPrintf("Rebuilding index for bucket %d.\n", fileTime);
+                bucket.setTokens.clear();
+                bucket.nLeastTTL = 0;
+                nIndexed = 0;
+                fRebuild = true;
             };
 
-            fclose(fp);
+            if (fRebuild || nIndexed < nFileSize)
+            {
+                // Index messages written since the index was last updated
+                std::vector<uint8_t> vchEntries;
+                if (SecureMsgIndexBucketFile((*itd).path(), nIndexed, bucket, vchEntries) != 0)
+                    LogPrintf("Error reading bucket file %s.\n", fileName);
+                else
+                if (SecureMsgWriteIndex(pathIdx, vchEntries.data(), vchEntries.size(), fRebuild) != 0)
+                    LogPrintf("Error writing bucket index %s.\n", pathIdx.string());
+                nIndexedFiles++;
+            };
 
-            smsgBuckets[fileTime].hashBucket();
+            bucket.hashBucket();
 
-            nTokenSetSize = tokenSet.size();
+            nTokenSetSize = bucket.setTokens.size();
         } // cs_smsg
 
         nMessages += nTokenSetSize;
         LogPrint(BCLog::SMSG, "Bucket %d contains %u messages.\n", fileTime, nTokenSetSize);
     };
 
-    LogPrintf("Processed %u files, loaded %u buckets containing %u messages.\n", nFiles, smsgBuckets.size(), nMessages);
+    LogPrintf("Processed %u files, indexed %u, loaded %u buckets containing %u messages.\n", nFiles, nIndexedFiles, smsgBuckets.size(), nMessages);
     return SMSG_NO_ERROR;
 };
 
@@ -672,6 +1039,7 @@ int SecureMsgAddWalletAddresses()
         smsgAddresses.push_back(SecMsgAddress(keyID, recvEnabled, recvAnon));
         nAdded++;
     };
+    SecureMsgInvalidateScanKeys();
 
     LogPrint(BCLog::SMSG, "Added %u addresses to whitelist.\n", nAdded);
 #endif
@@ -736,7 +1104,10 @@ int SecureMsgReadIni()
                 if (k.IsNull())
                     LogPrintf("Could not parse key line %s, rv %d.\n", pValue, rv);
                 else
+                {
                     smsgAddresses.push_back(SecMsgAddress(k, addrRecv, addrRecvAnon));
+                    SecureMsgInvalidateScanKeys();
+                };
             } else
             {
                 LogPrintf("Could not parse key line %s, rv %d.\n", pValue, rv);
@@ -839,6 +1210,12 @@ bool SecureMsgStart(CWallet *pwallet, bool fDontStart, bool fScanChain)
     if (SecureMsgReadIni() != 0)
         LogPrintf("Failed to read smsg.ini\n");
 
+    int nPowThreads = gArgs.GetArg("-smsgpowthreads", SMSG_DEFAULT_POW_THREADS);
+    if (nPowThreads <= 0)
+        nPowThreads = GetNumCores();
+    nSmsgPowThreads = std::max(1, nPowThreads);
+    LogPrintf("Secure messaging proof of work threads: %d, lanes: %d.\n", nSmsgPowThreads, (int)CSHA256Lanes::LANES);
+
     if (smsgAddresses.size() < 1)
     {
         LogPrintf("No address keys loaded.\n");
@@ -877,6 +1254,7 @@ bool SecureMsgStart(CWallet *pwallet, bool fDontStart, bool fScanChain)
     };
 
     threadGroupSmsg.create_thread(boost::bind(&TraceThread<void (*)()>, "smsg", &ThreadSecureMsg));
+    pSmsgPowPool.reset(new CWorkerPool(nSmsgPowThreads - 1, "smsg-pow"));
     threadGroupSmsg.create_thread(boost::bind(&TraceThread<void (*)()>, "smsg-pow", &ThreadSecureMsgPow));
 
     return true;
@@ -897,13 +1275,12 @@ bool SecureMsgShutdown()
 
     threadGroupSmsg.interrupt_all();
     threadGroupSmsg.join_all();
+    pSmsgPowPool.reset();
 
-    if (smsgDB)
     {
         LOCK(cs_smsgDB);
-        delete smsgDB;
-        smsgDB = nullptr;
-    };
+        smsgDB.reset(); // Closed once the last open SecMsgDB releases it
+    }
 
     if (secp256k1_context_smsg)
         secp256k1_context_destroy(secp256k1_context_smsg);
@@ -913,6 +1290,118 @@ bool SecureMsgShutdown()
     return true;
 };
 
+static std::vector<uint8_t> SecureMsgProtoFlags()
+{
+    std::vector<uint8_t> vchData(4);
+    uint32_t nFlags = SMSG_PROTO_FLAGS;
+    memcpy(&vchData[0], &nFlags, 4);
+    return vchData;
+};
+
+static void SecureMsgReadProtoFlags(CNode *pfrom, CDataStream &vRecv)
+{
+    // Peers older than SMSG_PROTO_FLAGS send smsgPing and smsgPong without data
+    uint32_t nFlags = 0;
+    if (!vRecv.empty())
+    {
+        std::vector<uint8_t> vchData;
+        vRecv >> vchData;
+        if (vchData.size() >= 4)
+            memcpy(&nFlags, &vchData[0], 4);
+    };
+
+    LOCK(pfrom->smsgData.cs_smsg_net);
+    pfrom->smsgData.nProtoFlags = nFlags;
+};
+
+static_assert(SMSG_SUB_BUCKETS <= 64, "smsgShowPart sends sub-buckets as a 64 bit mask");
+
+static bool SecureMsgReadBucketCount(const std::vector<uint8_t> &vchData, uint32_t &nBuckets)
+{
+    // smsgShow and smsgShowSub start with the number of 8 byte bucket times that follow
+    if (vchData.size() < 4)
+        return false;
+    memcpy(&nBuckets, &vchData[0], 4);
+
+    if (nBuckets > SMSG_MAX_SHOW_BUCKETS)
+    {
+        LogPrint(BCLog::SMSG, "Peer requested more buckets than possible %u, %u.\n", nBuckets, SMSG_MAX_SHOW_BUCKETS);
+        return false;
+    };
+    return vchData.size() >= 4 + (size_t)nBuckets * 8;
+};
+
+static inline size_t SecureMsgSubBucket(const SecMsgToken &token)
+{
+    return token.sample[0] % SMSG_SUB_BUCKETS;
+};
+
+void SecureMsgSubBucketDigest(const std::set<SecMsgToken> &tokenSet, int64_t now, uint8_t *pDigest)
+{
+    // Count and hash the active tokens of each sub-bucket, as SecMsgBucket::hashBucket does for the whole bucket
+    XXH32_stateSpace_t states[SMSG_SUB_BUCKETS];
+    uint32_t nCounts[SMSG_SUB_BUCKETS];
+    for (size_t i = 0; i < SMSG_SUB_BUCKETS; ++i)
+    {
+        XXH32_resetState(&states[i], 1);
+        nCounts[i] = 0;
+    };
+
+    for (const auto &token : tokenSet)
+    {
+        if (token.timestamp + token.ttl * SMSG_SECONDS_IN_DAY < now)
+            continue;
+        size_t nSub = SecureMsgSubBucket(token);
+        XXH32_update(&states[nSub], token.sample, 8);
+        nCounts[nSub]++;
+    };
+
+    for (size_t i = 0; i < SMSG_SUB_BUCKETS; ++i, pDigest += 8)
+    {
+        uint32_t nHash = XXH32_intermediateDigest(&states[i]);
+        memcpy(pDigest, &nCounts[i], 4);
+        memcpy(pDigest+4, &nHash, 4);
+    };
+};
+
+uint64_t SecureMsgSubBucketMask(const std::set<SecMsgToken> &tokenSet, int64_t now, const uint8_t *pPeerDigest)
+{
+    uint8_t digest[SMSG_SUB_DIGEST_SIZE];
+    SecureMsgSubBucketDigest(tokenSet, now, digest);
+
+    // Peer may hold messages this node lacks in any non empty sub-bucket that differs
+    uint64_t nMask = 0;
+    for (size_t k = 0; k < SMSG_SUB_BUCKETS; ++k)
+    {
+        uint32_t nPeerCount;
+        memcpy(&nPeerCount, pPeerDigest + k * 8, 4);
+        if (nPeerCount > 0
+            && memcmp(pPeerDigest + k * 8, digest + k * 8, 8) != 0)
+            nMask |= ((uint64_t)1) << k;
+    };
+    return nMask;
+};
+
+void SecureMsgListTokens(const std::set<SecMsgToken> &tokenSet, int64_t time, int64_t now, uint64_t nMask,
+    std::vector<uint8_t> &vchDataOut)
+{
+    vchDataOut.reserve(8 + 16 * tokenSet.size());
+    vchDataOut.resize(8);
+    memcpy(&vchDataOut[0], &time, 8);
+
+    for (const auto &token : tokenSet)
+    {
+        if (token.timestamp + token.ttl * SMSG_SECONDS_IN_DAY < now
+            || !((nMask >> SecureMsgSubBucket(token)) & 1))
+            continue;
+
+        size_t nd = vchDataOut.size();
+        vchDataOut.resize(nd + 16);
+        memcpy(&vchDataOut[nd], &token.timestamp, 8);
+        memcpy(&vchDataOut[nd+8], token.sample, 8);
+    };
+};
+
 bool SecureMsgEnable(CWallet *pwallet)
 {
     // Start secure messaging at runtime
@@ -927,6 +1416,7 @@ bool SecureMsgEnable(CWallet *pwallet)
 
         smsgAddresses.clear(); // should be empty already
         smsgBuckets.clear(); // should be empty already
+        SecureMsgInvalidateScanKeys();
 
         if (!SecureMsgStart(pwallet, false, false))
             return error("%s: SecureMsgStart failed.\n", __func__);
@@ -940,9 +1430,9 @@ bool SecureMsgEnable(CWallet *pwallet)
             if (!(pnode->GetLocalServices() & NODE_SMSG))
                 continue;
             g_connman->PushMessage(pnode,
-                CNetMsgMaker(INIT_PROTO_VERSION).Make("smsgPing"));
+                CNetMsgMaker(INIT_PROTO_VERSION).Make("smsgPing", SecureMsgProtoFlags()));
             g_connman->PushMessage(pnode,
-                CNetMsgMaker(INIT_PROTO_VERSION).Make("smsgPong")); // Send pong as have missed initial ping sent by peer when it connected
+                CNetMsgMaker(INIT_PROTO_VERSION).Make("smsgPong", SecureMsgProtoFlags())); // Send pong as have missed initial ping sent by peer when it connected
         };
     } // g_connman->cs_vNodes
 
@@ -969,6 +1459,8 @@ bool SecureMsgDisable()
             it->second.setTokens.clear();
         smsgBuckets.clear();
         smsgAddresses.clear();
+        SecureMsgInvalidateScanKeys();
+        mapSmsgMappedFiles.clear();
     } // cs_smsg
 
     // Tell each smsg enabled peer that this node is disabling
@@ -1019,6 +1511,13 @@ int SecureMsgReceiveData(CNode *pfrom, const std::string &strCommand, CDataStrea
             (2) respond with smsgHave - contains all the message hashes within the requested buckets.
         + smsgHave =
             (1) A list of all the message hashes which a node has in response to smsgShow.
+        + smsgShowSub =
+            (1) As smsgShow, sent instead to peers advertising SMSG_PROTO_SUB_BUCKETS.
+            (2) respond with smsgHaveSub - the count and hash of each of the SMSG_SUB_BUCKETS sub-buckets of the requested buckets.
+        + smsgHaveSub =
+            (1) The sub-bucket digest of a bucket, reply with smsgShowPart for the sub-buckets that differ.
+        + smsgShowPart =
+            (1) A bucket and a mask of sub-buckets, respond with smsgHave listing only the message hashes in those sub-buckets.
         + smsgWant =
             (1) A list of the message hashes that a node does not have and wants to retrieve from the node which sent smsgHave
         + smsgMsg =
@@ -1054,6 +1553,7 @@ int SecureMsgReceiveData(CNode *pfrom, const std::string &strCommand, CDataStrea
         };
 
         int64_t now = GetAdjustedTime();
+        bool fSubBuckets = false;
 
         {
             LOCK(pfrom->smsgData.cs_smsg_net);
@@ -1063,6 +1563,7 @@ int SecureMsgReceiveData(CNode *pfrom, const std::string &strCommand, CDataStrea
                 LogPrint(BCLog::SMSG, "Node is ignoring peer %d until %d.\n", pfrom->GetId(), pfrom->smsgData.ignoreUntil);
                 return SMSG_GENERAL_ERROR;
             };
+            fSubBuckets = pfrom->smsgData.nProtoFlags & SMSG_PROTO_SUB_BUCKETS;
         }
 
         uint32_t nBuckets       = smsgBuckets.size();
@@ -1160,8 +1661,9 @@ int SecureMsgReceiveData(CNode *pfrom, const std::string &strCommand, CDataStrea
         memcpy(&vchDataOut[0], &nShowBuckets, 4);
         if (vchDataOut.size() > 4)
         {
+            // Peers that support it send a digest of sub-buckets rather than every token
             g_connman->PushMessage(pfrom,
-                CNetMsgMaker(INIT_PROTO_VERSION).Make("smsgShow", vchDataOut));
+                CNetMsgMaker(INIT_PROTO_VERSION).Make(fSubBuckets ? "smsgShowSub" : "smsgShow", vchDataOut));
         } else
         if (nLocked < 1) // Don't report buckets as matched if any are locked
         {
@@ -1184,14 +1686,12 @@ int SecureMsgReceiveData(CNode *pfrom, const std::string &strCommand, CDataStrea
         std::vector<uint8_t> vchData;
         vRecv >> vchData;
 
-        if (vchData.size() < 4)
-            return SMSG_GENERAL_ERROR;
-
         uint32_t nBuckets;
-        memcpy(&nBuckets, &vchData[0], 4);
-
-        if (vchData.size() < 4 + nBuckets * 8)
+        if (!SecureMsgReadBucketCount(vchData, nBuckets))
+        {
+            Misbehaving(pfrom->GetId(), 1);
             return SMSG_GENERAL_ERROR;
+        };
 
         LogPrint(BCLog::SMSG, "smsgShow: peer wants to see content of %u buckets.\n", nBuckets);
 
@@ -1249,6 +1749,148 @@ int SecureMsgReceiveData(CNode *pfrom, const std::string &strCommand, CDataStrea
                 CNetMsgMaker(INIT_PROTO_VERSION).Make("smsgHave", vchDataOut));
         };
     } else
+    if (strCommand == "smsgShowSub")
+    {
+        std::vector<uint8_t> vchData;
+        vRecv >> vchData;
+
+        uint32_t nBuckets;
+        if (!SecureMsgReadBucketCount(vchData, nBuckets)
+            || vchData.size() != 4 + (size_t)nBuckets * 8)
+        {
+            Misbehaving(pfrom->GetId(), 1);
+            return SMSG_GENERAL_ERROR;
+        };
+
+        LogPrint(BCLog::SMSG, "smsgShowSub: peer wants to see sub-buckets of %u buckets.\n", nBuckets);
+
+        std::vector<uint8_t> vchDataOut(8 + SMSG_SUB_DIGEST_SIZE);
+        int64_t time;
+        uint8_t* pIn = &vchData[4];
+        for (uint32_t i = 0; i < nBuckets; ++i, pIn += 8)
+        {
+            memcpy(&time, pIn, 8);
+
+            {
+                LOCK(cs_smsg);
+                std::map<int64_t, SecMsgBucket>::iterator itb = smsgBuckets.find(time);
+                if (itb == smsgBuckets.end())
+                {
+                    LogPrint(BCLog::SMSG, "Don't have bucket %d.\n", time);
+                    continue;
+                };
+
+                // A short token list is smaller than the digest, send it directly
+                if (itb->second.setTokens.size() * 16 <= SMSG_SUB_DIGEST_SIZE)
+                {
+                    std::vector<uint8_t> vchHave;
+                    SecureMsgListTokens(itb->second.setTokens, time, GetAdjustedTime(), ~((uint64_t)0), vchHave);
+                    if (vchHave.size() > 8)
+                        g_connman->PushMessage(pfrom,
+                            CNetMsgMaker(INIT_PROTO_VERSION).Make("smsgHave", vchHave));
+                    continue;
+                };
+
+                SecureMsgSubBucketDigest(itb->second.setTokens, GetAdjustedTime(), &vchDataOut[8]);
+            }
+
+            memcpy(&vchDataOut[0], &time, 8);
+            g_connman->PushMessage(pfrom,
+                CNetMsgMaker(INIT_PROTO_VERSION).Make("smsgHaveSub", vchDataOut));
+        };
+    } else
+    if (strCommand == "smsgHaveSub")
+    {
+        // Peer sent the sub-bucket digest of a bucket
+        std::vector<uint8_t> vchData;
+        vRecv >> vchData;
+
+        if (vchData.size() != 8 + SMSG_SUB_DIGEST_SIZE)
+        {
+            Misbehaving(pfrom->GetId(), 1);
+            return SMSG_GENERAL_ERROR;
+        };
+
+        int64_t time;
+        memcpy(&time, &vchData[0], 8);
+
+        // Check time valid:
+        int64_t now = GetAdjustedTime();
+        if (time < now - SMSG_RETENTION)
+        {
+            LogPrint(BCLog::SMSG, "Not interested in peer bucket %d, has expired.\n", time);
+            return SMSG_GENERAL_ERROR;
+        };
+        if (time > now + SMSG_TIME_LEEWAY)
+        {
+            LogPrint(BCLog::SMSG, "Not interested in peer bucket %d, in the future.\n", time);
+            Misbehaving(pfrom->GetId(), 1);
+            return SMSG_GENERAL_ERROR;
+        };
+
+        uint64_t nMask = 0;
+        {
+            LOCK(cs_smsg);
+            // Don't create the bucket, smsgHave adds it when tokens are received
+            std::map<int64_t, SecMsgBucket>::iterator itb = smsgBuckets.find(time);
+            if (itb == smsgBuckets.end())
+            {
+                nMask = SecureMsgSubBucketMask(std::set<SecMsgToken>(), now, &vchData[8]);
+            } else
+            {
+                if (itb->second.nLockCount > 0)
+                {
+                    LogPrint(BCLog::SMSG, "Bucket %d lock count %u, waiting for message data from peer %u.\n", time, itb->second.nLockCount, itb->second.nLockPeerId);
+                    return SMSG_GENERAL_ERROR;
+                };
+                nMask = SecureMsgSubBucketMask(itb->second.setTokens, now, &vchData[8]);
+            };
+        } // cs_smsg
+
+        if (nMask != 0)
+        {
+            LogPrint(BCLog::SMSG, "Requesting sub-buckets %016x of bucket %d.\n", nMask, time);
+
+            std::vector<uint8_t> vchDataOut(16);
+            memcpy(&vchDataOut[0], &time, 8);
+            memcpy(&vchDataOut[8], &nMask, 8);
+            g_connman->PushMessage(pfrom,
+                CNetMsgMaker(INIT_PROTO_VERSION).Make("smsgShowPart", vchDataOut));
+        };
+    } else
+    if (strCommand == "smsgShowPart")
+    {
+        std::vector<uint8_t> vchData;
+        vRecv >> vchData;
+
+        if (vchData.size() != 16)
+        {
+            Misbehaving(pfrom->GetId(), 1);
+            return SMSG_GENERAL_ERROR;
+        };
+
+        int64_t time;
+        uint64_t nMask;
+        memcpy(&time, &vchData[0], 8);
+        memcpy(&nMask, &vchData[8], 8);
+
+        std::vector<uint8_t> vchDataOut;
+        {
+            LOCK(cs_smsg);
+            std::map<int64_t, SecMsgBucket>::iterator itb = smsgBuckets.find(time);
+            if (itb == smsgBuckets.end())
+            {
+                LogPrint(BCLog::SMSG, "Don't have bucket %d.\n", time);
+                return SMSG_GENERAL_ERROR;
+            };
+
+            SecureMsgListTokens(itb->second.setTokens, time, GetAdjustedTime(), nMask, vchDataOut);
+        } // cs_smsg
+
+        if (vchDataOut.size() > 8)
+            g_connman->PushMessage(pfrom,
+                CNetMsgMaker(INIT_PROTO_VERSION).Make("smsgHave", vchDataOut));
+    } else
     if (strCommand == "smsgHave")
     {
         // Peer has these messages in bucket
@@ -1344,7 +1986,6 @@ int SecureMsgReceiveData(CNode *pfrom, const std::string &strCommand, CDataStrea
         if (vchData.size() < 8)
             return SMSG_GENERAL_ERROR;
 
-        std::vector<uint8_t> vchOne;
         std::vector<uint8_t> vchBunch;
 
         vchBunch.resize(4+8); // nmessages + bucketTime
@@ -1369,6 +2010,7 @@ int SecureMsgReceiveData(CNode *pfrom, const std::string &strCommand, CDataStrea
 
             std::set<SecMsgToken> &tokenSet = itb->second.setTokens;
             std::set<SecMsgToken>::iterator it;
+            std::vector<SecMsgToken> vWanted;
             SecMsgToken token;
             uint8_t *p = &vchData[8];
             for (int i = 0; i < n; ++i)
@@ -1378,32 +2020,16 @@ int SecureMsgReceiveData(CNode *pfrom, const std::string &strCommand, CDataStrea
 
                 it = tokenSet.find(token);
                 if (it == tokenSet.end())
-                {
                     LogPrint(BCLog::SMSG, "Don't have wanted message %d.\n", token.timestamp);
-                } else
-                {
-                    //LogPrintf("Have message at %d.\n", it->offset); // DEBUG
-                    token.offset = it->offset;
-
-                    // Place in vchOne so if SecureMsgRetrieve fails it won't corrupt vchBunch
-                    if (SecureMsgRetrieve(token, vchOne) == 0)
-                    {
-                        nBunch++;
-                        vchBunch.insert(vchBunch.end(), vchOne.begin(), vchOne.end()); // append
-                    } else
-                    {
-                        LogPrintf("SecureMsgRetrieve failed %d.\n", token.timestamp);
-                    };
-
-                    if (nBunch >= 500
-                        || vchBunch.size() >= 96000)
-                    {
-                        LogPrint(BCLog::SMSG, "Break bunch %u, %u.\n", nBunch, vchBunch.size());
-                        break; // end here, peer will send more want messages if needed.
-                    };
-                };
+                else
+                    vWanted.push_back(*it);
                 p += 16;
             };
+
+            // Read all wanted messages from the bucket file in one pass,
+            // end at the limit, peer will send more want messages if needed.
+            if (SecureMsgRetrieve(time, vWanted, vchBunch, nBunch, 500, 96000) != 0)
+                LogPrintf("SecureMsgRetrieve failed for bucket %d.\n", time);
         } // cs_smsg
 
         if (nBunch > 0)
@@ -1462,13 +2088,16 @@ int SecureMsgReceiveData(CNode *pfrom, const std::string &strCommand, CDataStrea
     if (strCommand == "smsgPing")
     {
         // smsgPing is the initial message, send reply
+        SecureMsgReadProtoFlags(pfrom, vRecv);
         g_connman->PushMessage(pfrom,
-            CNetMsgMaker(INIT_PROTO_VERSION).Make("smsgPong"));
+            CNetMsgMaker(INIT_PROTO_VERSION).Make("smsgPong", SecureMsgProtoFlags()));
     } else
     if (strCommand == "smsgPong")
     {
         LogPrint(BCLog::SMSG, "Peer replied, secure messaging enabled.\n");
 
+        SecureMsgReadProtoFlags(pfrom, vRecv);
+
         {
             LOCK(pfrom->smsgData.cs_smsg_net);
             pfrom->smsgData.fEnabled = true;
@@ -1532,7 +2161,7 @@ bool SecureMsgSendData(CNode *pto, bool fSendTrickle)
         LogPrint(BCLog::SMSG, "%s: New node %s, peer id %u.\n", __func__, pto->GetAddrName(), pto->GetId());
         // Send smsgPing once, do nothing until receive 1st smsgPong (then set fEnabled)
         g_connman->PushMessage(pto,
-            CNetMsgMaker(INIT_PROTO_VERSION).Make("smsgPing"));
+            CNetMsgMaker(INIT_PROTO_VERSION).Make("smsgPing", SecureMsgProtoFlags()));
         pto->smsgData.lastSeen = GetTime();
         return true;
     } else
@@ -1834,6 +2463,69 @@ bool SecureMsgScanBlockChain()
     return true;
 };
 
+#ifdef ENABLE_WALLET
+static bool SecureMsgReadStoreFile(const fs::path &path, std::vector<uint8_t> &vchFile, bool fRemove)
+{
+    // Copy a message file out while cs_smsg is held, so it can be scanned after the lock is released
+    AssertLockHeld(cs_smsg);
+
+    FILE *fp;
+    errno = 0;
+    if (!(fp = fopen(path.string().c_str(), "rb")))
+        return error("%s: Error opening file: %s", __func__, strerror(errno));
+
+    size_t nFileSize = 0;
+    try { nFileSize = fs::file_size(path);
+        vchFile.resize(nFileSize);
+    } catch (std::exception &e)
+    {
+        fclose(fp);
+        return error("%s: Could not read %s, %s", __func__, path.string(), e.what());
+    };
+
+    if (nFileSize > 0
+        && fread(&vchFile[0], sizeof(uint8_t), nFileSize, fp) != nFileSize)
+    {
+        fclose(fp);
+        return error("%s: fread failed: %s", __func__, strerror(errno));
+    };
+    fclose(fp);
+
+    if (fRemove)
+    {
+        try {
+            fs::remove(path);
+        } catch (const fs::filesystem_error &ex)
+        {
+            return error("%s: Could not remove file %s - %s", __func__, path.string(), ex.what());
+        };
+    };
+
+    return true;
+};
+
+static void SecureMsgScanStoreData(std::vector<uint8_t> &vchFile, uint32_t &nMessages, uint32_t &nFoundMessages)
+{
+    size_t ofs = 0;
+    while (ofs + SMSG_HDR_LEN <= vchFile.size())
+    {
+        SecureMessage *psmsg = (SecureMessage*) &vchFile[ofs];
+        if (ofs + SMSG_HDR_LEN + psmsg->nPayload > vchFile.size())
+        {
+            LogPrintf("%s: Truncated message at offset %u.\n", __func__, ofs);
+            break;
+        };
+
+        // Don't report to gui,
+        if (SecureMsgScanMessage(&vchFile[ofs], &vchFile[ofs + SMSG_HDR_LEN], psmsg->nPayload, false) == SMSG_NO_ERROR)
+            nFoundMessages++;
+
+        nMessages++;
+        ofs += SMSG_HDR_LEN + psmsg->nPayload;
+    };
+};
+#endif
+
 bool SecureMsgScanBuckets()
 {
     LogPrint(BCLog::SMSG, "%s\n", __func__);
@@ -1860,7 +2552,6 @@ bool SecureMsgScanBuckets()
         return true; // not an error
     };
 
-    SecureMessage smsg;
     std::vector<uint8_t> vchData;
 
     for (fs::directory_iterator itd(pathSmsgDir); itd != itend; ++itd)
@@ -1914,67 +2605,11 @@ bool SecureMsgScanBuckets()
 
         {
             LOCK(cs_smsg);
-            FILE *fp;
-            errno = 0;
-            if (!(fp = fopen((*itd).path().string().c_str(), "rb")))
-            {
-                LogPrintf("Error opening file: %s\n", strerror(errno));
+            if (!SecureMsgReadStoreFile((*itd).path(), vchData, false))
                 continue;
-            };
-
-            for (;;)
-            {
-                errno = 0;
-                if (fread(smsg.data(), sizeof(uint8_t), SMSG_HDR_LEN, fp) != (size_t)SMSG_HDR_LEN)
-                {
-                    if (errno != 0)
-                    {
-                        LogPrintf("fread header failed: %s\n", strerror(errno));
-                    } else
-                    {
-                        //LogPrintf("End of file.\n");
-                    };
-                    break;
-                };
-
-                try { vchData.resize(smsg.nPayload); } catch (std::exception &e)
-                {
-                    LogPrintf("SecureMsgWalletUnlocked(): Could not resize vchData, %u, %s\n", smsg.nPayload, e.what());
-                    fclose(fp);
-                    return false;
-                };
-
-                if (fread(&vchData[0], sizeof(uint8_t), smsg.nPayload, fp) != smsg.nPayload)
-                {
-                    LogPrintf("fread data failed: %s\n", strerror(errno));
-                    break;
-                };
-
-                // Don't report to gui,
-                int rv = SecureMsgScanMessage(smsg.data(), &vchData[0], smsg.nPayload, false);
-
-                if (rv == SMSG_NO_ERROR)
-                {
-                    nFoundMessages++;
-                } else
-                {
-                    // SecureMsgScanMessage failed
-                };
-
-                nMessages++;
-            };
-
-            fclose(fp);
-
-            // Remove wl file when scanned
-            try {
-                fs::remove((*itd).path());
-            } catch (const boost::filesystem::filesystem_error &ex)
-            {
-                LogPrintf("Error removing wl file %s - %s\n", fileName, ex.what());
-                return false;
-            };
         } // cs_smsg
+
+        SecureMsgScanStoreData(vchData, nMessages, nFoundMessages);
     };
 
     LogPrintf("Processed %u files, scanned %u messages, received %u messages.\n", nFiles, nMessages, nFoundMessages);
@@ -2005,6 +2640,7 @@ int SecureMsgManageLocalKey(CKeyID &keyId, ChangeType mode)
                 if (itFound == smsgAddresses.end())
                 {
                     smsgAddresses.push_back(SecMsgAddress(keyId, smsgOptions.fNewAddressRecv, smsgOptions.fNewAddressAnon));
+                    SecureMsgInvalidateScanKeys();
                 } else
                 {
                     LogPrint(BCLog::SMSG, "%s: Already have address: %s.\n", __func__, CBitcoinAddress(keyId).ToString());
@@ -2015,6 +2651,7 @@ int SecureMsgManageLocalKey(CKeyID &keyId, ChangeType mode)
                 if (itFound != smsgAddresses.end())
                 {
                     smsgAddresses.erase(itFound);
+                    SecureMsgInvalidateScanKeys();
                 } else
                 {
                     return SMSG_KEY_NOT_EXISTS;
@@ -2057,7 +2694,6 @@ int SecureMsgWalletUnlocked()
         return SMSG_NO_ERROR; // not an error
     };
 
-    SecureMessage smsg;
     std::vector<uint8_t> vchData;
 
     for (fs::directory_iterator itd(pathSmsgDir); itd != itend; ++itd)
@@ -2101,68 +2737,13 @@ int SecureMsgWalletUnlocked()
         };
 
         {
+            // Removed under the same lock, SecureMsgStoreUnscanned appends to wl files with cs_smsg held
             LOCK(cs_smsg);
-            FILE *fp;
-            errno = 0;
-            if (!(fp = fopen((*itd).path().string().c_str(), "rb")))
-            {
-                LogPrintf("Error opening file: %s\n", strerror(errno));
-                continue;
-            };
-
-            for (;;)
-            {
-                errno = 0;
-                if (fread(smsg.data(), sizeof(uint8_t), SMSG_HDR_LEN, fp) != (size_t)SMSG_HDR_LEN)
-                {
-                    if (errno != 0)
-                    {
-                        LogPrintf("fread header failed: %s\n", strerror(errno));
-                    } else
-                    {
-                        //LogPrintf("End of file.\n");
-                    };
-                    break;
-                };
-
-                try { vchData.resize(smsg.nPayload); } catch (std::exception &e)
-                {
-                    LogPrintf("%s: Could not resize vchData, %u, %s\n", __func__, smsg.nPayload, e.what());
-                    fclose(fp);
-                    return SMSG_GENERAL_ERROR;
-                };
-
-                if (fread(&vchData[0], sizeof(uint8_t), smsg.nPayload, fp) != smsg.nPayload)
-                {
-                    LogPrintf("fread data failed: %s\n", strerror(errno));
-                    break;
-                };
-
-                // Don't report to gui,
-                int rv = SecureMsgScanMessage(smsg.data(), &vchData[0], smsg.nPayload, false);
-
-                if (rv == 0)
-                {
-                    nFoundMessages++;
-                } else
-                if (rv != 0)
-                {
-                    // SecureMsgScanMessage failed
-                };
-
-                nMessages++;
-            };
-
-            fclose(fp);
-
-            // Remove wl file when scanned
-            try {
-                fs::remove((*itd).path());
-            } catch (const fs::filesystem_error &ex)
-            {
-                return errorN(SMSG_GENERAL_ERROR, "%s: Could not remove wl file %s - %s.", __func__, fileName, ex.what());
-            };
+            if (!SecureMsgReadStoreFile((*itd).path(), vchData, true))
+                return errorN(SMSG_GENERAL_ERROR, "%s: Could not process wl file %s.", __func__, fileName);
         } // cs_smsg
+
+        SecureMsgScanStoreData(vchData, nMessages, nFoundMessages);
     };
 
     LogPrintf("Processed %u files, scanned %u messages, received %u messages.\n", nFiles, nMessages, nFoundMessages);
@@ -2198,6 +2779,151 @@ int SecureMsgWalletKeyChanged(CKeyID &keyId, const std::string &sLabel, ChangeTy
     return SecureMsgManageLocalKey(keyId, mode);
 };
 
+static const size_t SMSG_SCAN_KEYS_PER_THREAD = 256;
+
+static std::shared_ptr<const std::vector<SecMsgScanKey> > pSmsgScanKeys; // cs_smsg
+static uint64_t nSmsgScanKeysGeneration = 0; // cs_smsg
+
+void SecureMsgInvalidateScanKeys()
+{
+    // Call when smsgAddresses changes or the wallet is locked.
+    // CKey keeps its data in secure memory, which is cleansed when the last reference,
+    // held by this cache or by a scan in progress, is released.
+    std::shared_ptr<const std::vector<SecMsgScanKey> > pKeys;
+    {
+        LOCK(cs_smsg);
+        pKeys.swap(pSmsgScanKeys);
+        nSmsgScanKeysGeneration++;
+    }
+};
+
+static CWorkerPool &SecureMsgScanPool()
+{
+    // The calling thread takes part in the search
+    static CWorkerPool pool(std::max(GetNumCores(), 1) - 1, "smsg-scan");
+    return pool;
+};
+
+#ifdef ENABLE_WALLET
+static std::shared_ptr<const std::vector<SecMsgScanKey> > SecureMsgGetScanKeys()
+{
+    // Fetch the private key of each receiving address once, rather than for every message
+    std::vector<SecMsgAddress> vAddresses;
+    uint64_t nGeneration;
+    {
+        LOCK(cs_smsg);
+        if (pSmsgScanKeys)
+            return pSmsgScanKeys;
+        vAddresses = smsgAddresses;
+        nGeneration = nSmsgScanKeysGeneration;
+    }
+
+    // cs_smsg is released before reading keys, GetKey locks cs_wallet and CHDWallet::Unlock
+    // takes cs_smsg with cs_wallet held. Callers must not hold cs_smsg.
+    std::shared_ptr<std::vector<SecMsgScanKey> > pKeys = std::make_shared<std::vector<SecMsgScanKey> >();
+    pKeys->reserve(vAddresses.size());
+    for (const auto &addr : vAddresses)
+    {
+        if (!addr.fReceiveEnabled)
+            continue;
+
+        CKey key;
+        if (!pwalletSmsg->GetKey(addr.address, key))
+        {
+            LogPrint(BCLog::SMSG, "%s: Could not get private key for %s.\n", __func__, CBitcoinAddress(addr.address).ToString());
+            continue;
+        };
+        pKeys->emplace_back(addr.address, key, addr.fReceiveAnon);
+    };
+
+    LogPrint(BCLog::SMSG, "%s: Prepared %u keys.\n", __func__, pKeys->size());
+
+    LOCK(cs_smsg);
+    if (nGeneration == nSmsgScanKeysGeneration)
+        pSmsgScanKeys = pKeys;
+    return pKeys;
+};
+#endif
+
+int SecureMsgMatchScanKeys(const std::vector<SecMsgScanKey> &vKeys, const uint8_t *pHeader, const uint8_t *pPayload, uint32_t nPayload,
+    size_t nBegin, size_t &nMatch, size_t nThreads)
+{
+    /*
+        Find the first key from nBegin the message MAC verifies with.
+        Only the MAC is checked, the message is not decrypted.
+        The ephemeral public key is parsed once for all keys.
+
+        returns SMSG_NO_ERROR if a key matched, SMSG_MAC_MISMATCH if none did
+    */
+
+    const SecureMessage *psmsg = (const SecureMessage*) pHeader;
+
+    if (psmsg->version[0] == 3)
+    {
+        nPayload -= 32; // Exclude funding txid
+    } else
+    if (psmsg->version[0] != 2)
+    {
+        return errorN(SMSG_UNKNOWN_VERSION, "%s: Unknown version number.", __func__);
+    };
+
+    if (!secp256k1_context_smsg)
+        return errorN(SMSG_GENERAL_ERROR, "%s: secp256k1_context_smsg is not set.", __func__);
+
+    secp256k1_pubkey R;
+    if (!secp256k1_ec_pubkey_parse(secp256k1_context_smsg, &R, psmsg->cpkR, 33))
+        return errorN(SMSG_GENERAL_ERROR, "%s: secp256k1_ec_pubkey_parse failed: %s.", __func__, HexStr(psmsg->cpkR, psmsg->cpkR+33));
+
+    std::atomic<size_t> nFound(vKeys.size());
+
+    auto search = [&](size_t nFirst, size_t nStep)
+    {
+        uint8_t P[32], H[64], MAC[32];
+        for (size_t i = nFirst; i < nFound; i += nStep)
+        {
+            if (!secp256k1_ecdh(secp256k1_context_smsg, P, &R, vKeys[i].key.begin()))
+                continue;
+
+            // key_m is the last 32 bytes of SHA512(P)
+            CSHA512().Write(P, 32).Finalize(H);
+
+            CHMAC_SHA256 ctx(&H[32], 32);
+            ctx.Write((uint8_t*) &psmsg->timestamp, sizeof(psmsg->timestamp));
+            ctx.Write((uint8_t*) psmsg->iv, sizeof(psmsg->iv));
+            ctx.Write((uint8_t*) pPayload, nPayload);
+            ctx.Finalize(MAC);
+
+            if (part::memcmp_nta(MAC, psmsg->mac, 32) != 0)
+                continue;
+
+            size_t nPrev = nFound;
+            while (i < nPrev && !nFound.compare_exchange_weak(nPrev, i));
+            break;
+        };
+        memory_cleanse(P, sizeof(P));
+        memory_cleanse(H, sizeof(H));
+    };
+
+    size_t nKeys = nBegin < vKeys.size() ? vKeys.size() - nBegin : 0;
+    nThreads = std::max((size_t)1, std::min(nThreads, nKeys / SMSG_SCAN_KEYS_PER_THREAD));
+    if (nThreads < 2)
+    {
+        search(nBegin, 1);
+    } else
+    {
+        // Interleave keys so the search can stop early once a low index has matched
+        CWorkerPool &pool = SecureMsgScanPool();
+        nThreads = std::min(nThreads, pool.Size() + 1);
+        pool.Run(nThreads, [&](size_t t) { search(nBegin + t, nThreads); });
+    };
+
+    if (nFound >= vKeys.size())
+        return SMSG_MAC_MISMATCH;
+
+    nMatch = nFound;
+    return SMSG_NO_ERROR;
+};
+
 int SecureMsgScanMessage(uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload, bool reportToGui)
 {
 #ifdef ENABLE_WALLET
@@ -2223,6 +2949,8 @@ int SecureMsgScanMessage(uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload,
     {
         LogPrint(BCLog::SMSG, "%s: Wallet is locked, storing message to scan later.\n", __func__);
 
+        SecureMsgInvalidateScanKeys(); // Don't keep private keys while locked
+
         int rv;
         if ((rv = SecureMsgStoreUnscanned(pHeader, pPayload, nPayload)) != 0)
             return SMSG_GENERAL_ERROR;
@@ -2234,14 +2962,18 @@ int SecureMsgScanMessage(uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload,
     MessageData msg; // placeholder
     bool fOwnMessage = false;
 
-    for (std::vector<SecMsgAddress>::iterator it = smsgAddresses.begin(); it != smsgAddresses.end(); ++it)
+    std::shared_ptr<const std::vector<SecMsgScanKey> > pKeys = SecureMsgGetScanKeys();
+    size_t nMatch = 0;
+    for (size_t nBegin = 0; nBegin < pKeys->size(); nBegin = nMatch + 1)
     {
-        if (!it->fReceiveEnabled)
-            continue;
+        // MAC check against all keys first, decrypt only with a key that matched
+        if (SecureMsgMatchScanKeys(*pKeys, pHeader, pPayload, nPayload, nBegin, nMatch, GetNumCores()) != 0)
+            break;
 
-        addressTo = it->address;
+        const SecMsgScanKey &scanKey = (*pKeys)[nMatch];
+        addressTo = scanKey.address;
 
-        if (!it->fReceiveAnon)
+        if (!scanKey.fReceiveAnon)
         {
             // Have to do full decrypt to see address from
             if (SecureMsgDecrypt(false, addressTo, pHeader, pPayload, nPayload, msg) == 0)
@@ -2255,15 +2987,12 @@ int SecureMsgScanMessage(uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload,
             };
         } else
         {
-            if (SecureMsgDecrypt(true, addressTo, pHeader, pPayload, nPayload, msg) == 0)
-            {
-                if (LogAcceptCategory(BCLog::SMSG))
-                    LogPrintf("Decrypted message with %s.\n", CBitcoinAddress(addressTo).ToString());
+            if (LogAcceptCategory(BCLog::SMSG))
+                LogPrintf("Decrypted message with %s.\n", CBitcoinAddress(addressTo).ToString());
 
-                fOwnMessage = true;
-                break;
-            };
-        }
+            fOwnMessage = true;
+            break;
+        };
     };
 
     if (fOwnMessage)
@@ -2454,58 +3183,74 @@ int SecureMsgAddLocalAddress(std::string &sAddress)
 #endif
 };
 
-int SecureMsgRetrieve(SecMsgToken &token, std::vector<uint8_t> &vchData)
+int SecureMsgRetrieve(int64_t bucketTime, const std::vector<SecMsgToken> &vTokens, std::vector<uint8_t> &vchData,
+    uint32_t &nMessages, size_t nMaxMessages, size_t nMaxBytes)
 {
-    LogPrint(BCLog::SMSG, "%s: %d.\n", __func__, token.timestamp);
+    /*
+        Append messages from one bucket to vchData, reading from the mapped bucket file.
+        Stops after nMaxMessages or when vchData reaches nMaxBytes.
+    */
 
-    // Has cs_smsg lock from SecureMsgReceiveData
+    LogPrint(BCLog::SMSG, "%s: %d, %u tokens.\n", __func__, bucketTime, vTokens.size());
 
-    fs::path pathSmsgDir = GetDataDir() / "smsgstore";
+    AssertLockHeld(cs_smsg);
 
-    //LogPrintf("token.offset %d.\n", token.offset); // DEBUG
-    int64_t bucket = token.timestamp - (token.timestamp % SMSG_BUCKET_LEN);
-    std::string fileName = std::to_string(bucket) + "_01.dat";
-    fs::path fullpath = pathSmsgDir / fileName;
+    nMessages = 0;
+    if (vTokens.empty())
+        return SMSG_NO_ERROR;
 
-    //LogPrintf("bucket %d.\n", bucket);
-    //LogPrintf("bucket d %d.\n", bucket);
-    //LogPrintf("fileName %s.\n", fileName);
+    int64_t nMaxOffset = 0;
+    for (const auto &token : vTokens)
+        nMaxOffset = std::max(nMaxOffset, token.offset);
 
-    FILE *fp;
-    errno = 0;
-    if (!(fp = fopen(fullpath.string().c_str(), "rb")))
-        return errorN(SMSG_GENERAL_ERROR, "%s - Can't open file: %s\nPath %s.", __func__, strerror(errno), fullpath.string());
+    const SecMsgMappedFile *pFile = SecureMsgMapBucketFile(bucketTime, nMaxOffset + SMSG_HDR_LEN);
+    if (!pFile)
+        return errorN(SMSG_GENERAL_ERROR, "%s - Can't map bucket %d.", __func__, bucketTime);
 
-    errno = 0;
-    if (fseek(fp, token.offset, SEEK_SET) != 0)
+    for (const auto &token : vTokens)
     {
-        fclose(fp);
-        return errorN(SMSG_GENERAL_ERROR, "%s - fseek, strerror: %s.", __func__, strerror(errno));
-    };
+        if (token.offset + SMSG_HDR_LEN > pFile->size())
+        {
+            LogPrintf("%s: Offset %d past end of bucket %d.\n", __func__, token.offset, bucketTime);
+            continue;
+        };
 
-    SecureMessage smsg;
-    errno = 0;
-    if (fread(smsg.data(), sizeof(uint8_t), SMSG_HDR_LEN, fp) != (size_t)SMSG_HDR_LEN)
-    {
-        fclose(fp);
-        return errorN(SMSG_GENERAL_ERROR, "%s - read header failed, strerror: %s.", __func__, strerror(errno));
-    };
+        const SecureMessage *psmsg = (const SecureMessage*) (pFile->data() + token.offset);
+        size_t nLen = SMSG_HDR_LEN + psmsg->nPayload;
+        if (token.offset + nLen > pFile->size())
+        {
+            // Message written after the file was mapped
+            if (!(pFile = SecureMsgMapBucketFile(bucketTime, token.offset + nLen))
+                || token.offset + nLen > pFile->size())
+                return errorN(SMSG_GENERAL_ERROR, "%s - Message at %d past end of bucket %d.", __func__, token.offset, bucketTime);
+        };
 
-    try {vchData.resize(SMSG_HDR_LEN + smsg.nPayload);} catch (std::exception &e)
-    {
-        fclose(fp);
-        return errorN(SMSG_ALLOCATE_FAILED, "%s - Could not resize vchData, %u, %s.", __func__, SMSG_HDR_LEN + smsg.nPayload, e.what());
-    };
+        const uint8_t *p = pFile->data() + token.offset;
+        vchData.insert(vchData.end(), p, p + nLen);
+        nMessages++;
 
-    memcpy(&vchData[0], smsg.data(), SMSG_HDR_LEN);
-    errno = 0;
-    if (fread(&vchData[SMSG_HDR_LEN], sizeof(uint8_t), smsg.nPayload, fp) != smsg.nPayload)
-    {
-        fclose(fp);
-        return errorN(SMSG_GENERAL_ERROR, "%s - fread data failed: %s. Wanted %u bytes.", __func__, strerror(errno), smsg.nPayload);
+        if (nMessages >= nMaxMessages
+            || vchData.size() >= nMaxBytes)
+            break;
     };
 
-    fclose(fp);
+    return SMSG_NO_ERROR;
+};
+
+int SecureMsgRetrieve(SecMsgToken &token, std::vector<uint8_t> &vchData)
+{
+    LogPrint(BCLog::SMSG, "%s: %d.\n", __func__, token.timestamp);
+
+    // Has cs_smsg lock from SecureMsgReceiveData
+
+    int64_t bucket = token.timestamp - (token.timestamp % SMSG_BUCKET_LEN);
+
+    uint32_t nMessages;
+    std::vector<SecMsgToken> vTokens(1, token);
+    vchData.clear();
+    if (SecureMsgRetrieve(bucket, vTokens, vchData, nMessages, 1, 0) != 0
+        || nMessages != 1)
+        return SMSG_GENERAL_ERROR;
 
     return SMSG_NO_ERROR;
 };
@@ -2590,14 +3335,14 @@ int SecureMsgReceive(CNode *pfrom, std::vector<uint8_t> &vchData)
                 // message dropped
                 break; // continue?
             };
-
-            //uint32_t nPayload = TODO
-            if (SecureMsgScanMessage(&vchData[n], &vchData[n + SMSG_HDR_LEN], psmsg->nPayload, true) != 0)
-            {
-                // message recipient is not this node (or failed)
-            };
         } // cs_smsg
 
+        // Scan without cs_smsg held, the bucket set is not touched and the inbox has its own lock
+        if (SecureMsgScanMessage(&vchData[n], &vchData[n + SMSG_HDR_LEN], psmsg->nPayload, true) != 0)
+        {
+            // message recipient is not this node (or failed)
+        };
+
         n += SMSG_HDR_LEN + psmsg->nPayload;
     };
 
@@ -2655,6 +3400,7 @@ int SecureMsgStoreUnscanned(uint8_t *pHeader, uint8_t *pPayload, uint32_t nPaylo
     std::string fileName = std::to_string(bucket) + "_01_wl.dat";
     fs::path fullpath = pathSmsgDir / fileName;
 
+    LOCK(cs_smsg); // SecureMsgWalletUnlocked reads and removes wl files
     FILE *fp;
     errno = 0;
     if (!(fp = fopen(fullpath.string().c_str(), "ab")))
@@ -2772,6 +3518,11 @@ int SecureMsgStore(uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload, bool
 
     fclose(fp);
 
+    uint8_t entry[SMSG_IDX_ENTRY_LEN];
+    SecureMsgIndexEntry(entry, pHeader, pPayload, ofs);
+    if (SecureMsgWriteIndex(SecureMsgBucketPath(bucketTime, "_01.idx"), entry, SMSG_IDX_ENTRY_LEN, false) != 0)
+        LogPrintf("%s: Failed to update bucket index, will be rebuilt on restart.\n", __func__);
+
     token.offset = ofs;
 
     //LogPrintf("token.offset: %d\n", token.offset); // DEBUG
@@ -2793,6 +3544,13 @@ int SecureMsgStore(SecureMessage& smsg, bool fHashBucket)
     return SecureMsgStore(smsg.data(), smsg.pPayload, smsg.nPayload, fHashBucket);
 };
 
+static inline bool SecureMsgPowMatch(const uint8_t *sha256Hash)
+{
+    return sha256Hash[31] == 0
+        && sha256Hash[30] == 0
+        && (~(sha256Hash[29]) & ((1<<0) | (1<<1) | (1<<2)));
+};
+
 int SecureMsgValidate(uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload)
 {
     // return SecureMessageCodes
@@ -2995,9 +3753,7 @@ int SecureMsgValidate(uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload)
     ctx.Write((uint8_t*) pPayload, nPayload);
     ctx.Finalize(sha256Hash);
 
-    if (sha256Hash[31] == 0
-        && sha256Hash[30] == 0
-        && (~(sha256Hash[29]) & ((1<<0) | (1<<1) | (1<<2)) ))
+    if (SecureMsgPowMatch(sha256Hash))
     {
         LogPrint(BCLog::SMSG, "Hash Valid.\n");
         rv = SMSG_NO_ERROR; // smsg is valid
@@ -3012,11 +3768,66 @@ int SecureMsgValidate(uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload)
     return rv;
 };
 
-int SecureMsgSetHash(uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload)
+/**
+ * HMAC_SHA256 of the header after the hash field and the payload, keyed with the nonce repeated,
+ * for CSHA256Lanes::LANES consecutive nonces starting at nonce.
+ * vHeaders holds a copy of the header for each lane, the nonce field is overwritten.
+ */
+static void SecureMsgPowHashLanes(uint8_t vHeaders[][SMSG_HDR_LEN], const uint8_t *pPayload, uint32_t nPayload,
+    uint32_t nonce, uint8_t *pHashes)
+{
+    const size_t LANES = CSHA256Lanes::LANES;
+    const size_t nNonceOfs = offsetof(SecureMessage, nonce);
+
+    uint8_t rkey[LANES][64];
+    const uint8_t *pKeys[LANES], *pHeaders[LANES], *pInner[LANES];
+    uint8_t inner[CSHA256Lanes::OUTPUT_SIZE * LANES];
+
+    for (size_t i = 0; i < LANES; ++i)
+    {
+        uint32_t nonceLane = nonce + i;
+        memcpy(&vHeaders[i][nNonceOfs], &nonceLane, 4);
+
+        // The 32 byte key is shorter than a block, pad with zeros as CHMAC_SHA256
+        for (int k = 0; k < 32; k+=4)
+            memcpy(&rkey[i][k], &nonceLane, 4);
+        memset(&rkey[i][32], 0, 32);
+        for (int k = 0; k < 64; k++)
+            rkey[i][k] ^= 0x36;
+
+        pKeys[i] = rkey[i];
+        pHeaders[i] = &vHeaders[i][4];
+        pInner[i] = &inner[CSHA256Lanes::OUTPUT_SIZE * i];
+    };
+
+    CSHA256Lanes()
+        .Write(pKeys, 64)
+        .Write(pHeaders, SMSG_HDR_LEN-4)
+        .WriteAll(pPayload, nPayload)
+        .Finalize(inner);
+
+    for (size_t i = 0; i < LANES; ++i)
+        for (int k = 0; k < 64; k++)
+            rkey[i][k] ^= 0x5c ^ 0x36;
+
+    CSHA256Lanes()
+        .Write(pKeys, 64)
+        .Write(pInner, CSHA256Lanes::OUTPUT_SIZE)
+        .Finalize(pHashes);
+};
+
+size_t SecureMsgGetPowThreads()
+{
+    return nSmsgPowThreads;
+};
+
+int SecureMsgSetHash(uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload, size_t nThreads)
 {
     /*  proof of work and checksum
 
         May run in a thread, if shutdown detected, return.
+        The nonce space is split between nThreads threads, each hashing CSHA256Lanes::LANES nonces per pass.
+        The lowest matching nonce is used, as when searching sequentially.
 
         returns SecureMessageCodes
     */
@@ -3027,65 +3838,82 @@ int SecureMsgSetHash(uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload)
     uint8_t civ[32];
     uint8_t sha256Hash[32];
 
-    bool found = false;
+    const size_t LANES = CSHA256Lanes::LANES;
+    const uint64_t NOT_FOUND = std::numeric_limits<uint64_t>::max();
+    nThreads = pSmsgPowPool ? std::max(nThreads, (size_t)1) : 1; // Threads of the pow pool
 
-    uint32_t nonce = 0;
+    std::atomic<uint64_t> nFound(NOT_FOUND);
+    std::atomic<uint64_t> nHashes(0);
 
-    //CBigNum bnTarget(2);
-    //bnTarget = bnTarget.pow(256 - 40);
-
-    // Break for HMAC_CTX_cleanup
-    for (;;)
+    auto search = [&](size_t nThread)
     {
-        if (!fSecMsgEnabled)
-           break;
-
-        //psmsg->timestamp = GetTime();
-        //memcpy(&psmsg->timestamp, &now, 8);
-        memcpy(&psmsg->nonce[0], &nonce, 4);
-
-        for (int i = 0; i < 32; i+=4)
-            memcpy(civ+i, &nonce, 4);
-
-        CHMAC_SHA256 ctx(&civ[0], 32);
-        ctx.Write((uint8_t*) pHeader+4, SMSG_HDR_LEN-4);
-        ctx.Write((uint8_t*) pPayload, nPayload);
-        ctx.Finalize(sha256Hash);
+        uint8_t vHeaders[LANES][SMSG_HDR_LEN];
+        uint8_t hashes[CSHA256Lanes::OUTPUT_SIZE * LANES];
+        for (size_t i = 0; i < LANES; ++i)
+            memcpy(vHeaders[i], pHeader, SMSG_HDR_LEN);
 
-        if (sha256Hash[31] == 0
-            && sha256Hash[30] == 0
-            && (~(sha256Hash[29]) & ((1<<0) | (1<<1) | (1<<2)) ))
-        //    && sha256Hash[29] == 0)
+        uint64_t nDone = 0;
+        for (uint64_t nonce = nThread * LANES; nonce <= 4294967295U && nonce < nFound; nonce += nThreads * LANES)
         {
-            found = true;
-            //if (fDebugSmsg)
-            //    LogPrintf("Match %u\n", nonce);
-            break;
-        };
+            if (!fSecMsgEnabled)
+                break;
 
-        if (nonce >= 4294967295U) // UINT32_MAX
-        {
-            LogPrint(BCLog::SMSG, "No match %u\n", nonce);
-            break;
+            SecureMsgPowHashLanes(vHeaders, pPayload, nPayload, nonce, hashes);
+            nDone += LANES;
+
+            for (size_t i = 0; i < LANES; ++i)
+            {
+                if (nonce + i > 4294967295U)
+                    break;
+                if (!SecureMsgPowMatch(&hashes[CSHA256Lanes::OUTPUT_SIZE * i]))
+                    continue;
+                uint64_t nPrev = nFound;
+                while (nonce + i < nPrev && !nFound.compare_exchange_weak(nPrev, nonce + i));
+                break;
+            };
         };
-        nonce++;
+        nHashes += nDone;
     };
 
+    if (nThreads < 2)
+        search(0);
+    else
+        pSmsgPowPool->Run(nThreads, search);
+
+    int64_t nTook = GetTimeMillis() - nStart;
+    smsgPowStats.nHashes += nHashes;
+    smsgPowStats.nTimeMs += nTook;
+
     if (!fSecMsgEnabled)
     {
         LogPrint(BCLog::SMSG, "%s: Stopped, shutdown detected.\n", __func__);
         return SMSG_SHUTDOWN_DETECTED;
     };
 
-    if (!found)
+    if (nFound == NOT_FOUND)
     {
-        LogPrint(BCLog::SMSG, "%s: Failed, took %d ms, nonce %u\n", __func__, GetTimeMillis() - nStart, nonce);
+        LogPrint(BCLog::SMSG, "%s: Failed, took %d ms, %u hashes\n", __func__, nTook, nHashes.load());
         return SMSG_GENERAL_ERROR;
     };
 
+    uint32_t nonce = nFound;
+    memcpy(&psmsg->nonce[0], &nonce, 4);
+
+    for (int i = 0; i < 32; i+=4)
+        memcpy(civ+i, &nonce, 4);
+
+    CHMAC_SHA256 ctx(&civ[0], 32);
+    ctx.Write((uint8_t*) pHeader+4, SMSG_HDR_LEN-4);
+    ctx.Write((uint8_t*) pPayload, nPayload);
+    ctx.Finalize(sha256Hash);
+
+    if (!SecureMsgPowMatch(sha256Hash))
+        return errorN(SMSG_GENERAL_ERROR, "%s: Multi-lane hash mismatch, nonce %u.", __func__, nonce);
+
     memcpy(psmsg->hash, sha256Hash, 4);
+    smsgPowStats.nMessages++;
 
-    LogPrint(BCLog::SMSG, "%s: Took %d ms, nonce %u\n", __func__, GetTimeMillis() - nStart, nonce);
+    LogPrint(BCLog::SMSG, "%s: Took %d ms, nonce %u, %d threads\n", __func__, nTook, nonce, nThreads);
 
     return SMSG_NO_ERROR;
 };
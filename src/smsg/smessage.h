@@ -11,6 +11,7 @@
 #include "base58.h"
 #include "serialize.h"
 #include "ui_interface.h"
+#include "key.h"
 
 
 enum SecureMessageCodes {
@@ -73,6 +74,15 @@ const unsigned int SMSG_MAX_MSG_WORST = LZ4_COMPRESSBOUND(SMSG_MAX_MSG_BYTES+SMS
 
 static const int MIN_SMSG_PROTO_VERSION = 90006;
 
+static const int SMSG_DEFAULT_POW_THREADS = 0;              // 0 = use all cores
+
+// Features advertised in smsgPing and smsgPong
+const uint32_t SMSG_PROTO_SUB_BUCKETS  = (1 << 0);          // reconcile buckets by sub-bucket, smsgShowSub / smsgHaveSub / smsgShowPart
+const uint32_t SMSG_PROTO_FLAGS        = SMSG_PROTO_SUB_BUCKETS;
+const unsigned int SMSG_SUB_BUCKETS    = 64;                // tokens are split by first byte of sample
+const unsigned int SMSG_SUB_DIGEST_SIZE = SMSG_SUB_BUCKETS * 8; // count and hash of each sub-bucket in smsgHaveSub
+const unsigned int SMSG_MAX_SHOW_BUCKETS = SMSG_RETENTION / SMSG_BUCKET_LEN + 1; // most buckets that can be requested in smsgShow / smsgShowSub
+
 
 const CAmount nFundingTxnFeePerK = 200000;
 const CAmount nMsgFeePerKPerDay =   50000;
@@ -104,6 +114,15 @@ extern CWallet                          *pwalletSmsg;
 
 extern CCriticalSection cs_smsg;            // all except inbox and outbox
 
+// Totals for the proof of work done by this node
+struct SecMsgPowStats
+{
+    std::atomic<uint64_t> nMessages{0};
+    std::atomic<uint64_t> nHashes{0};
+    std::atomic<int64_t> nTimeMs{0};
+};
+extern SecMsgPowStats                   smsgPowStats;
+
 
 inline bool GetFundingTxid(const uint8_t *pPayload, size_t nPayload, uint256 &txid)
 {
@@ -275,6 +294,19 @@ public:
     };
 };
 
+// Receiving address with its private key, prepared for trial decryption
+class SecMsgScanKey
+{
+public:
+    SecMsgScanKey() {};
+    SecMsgScanKey(const CKeyID &addr, const CKey &key_, bool receiveAnon)
+        : address(addr), key(key_), fReceiveAnon(receiveAnon) {};
+
+    CKeyID      address;
+    CKey        key;
+    bool        fReceiveAnon = false;
+};
+
 class SecMsgOptions
 {
 public:
@@ -344,6 +376,14 @@ bool SecureMsgEnable(CWallet *pwallet);
 bool SecureMsgDisable();
 
 int SecureMsgReceiveData(CNode *pfrom, const std::string &strCommand, CDataStream &vRecv);
+
+/** Write the count and hash of the active tokens in each sub-bucket to pDigest, SMSG_SUB_DIGEST_SIZE bytes */
+void SecureMsgSubBucketDigest(const std::set<SecMsgToken> &tokenSet, int64_t now, uint8_t *pDigest);
+/** Mask of the sub-buckets in which a peer with pPeerDigest may have tokens missing from tokenSet */
+uint64_t SecureMsgSubBucketMask(const std::set<SecMsgToken> &tokenSet, int64_t now, const uint8_t *pPeerDigest);
+/** Build smsgHave data from the active tokens of the sub-buckets set in nMask */
+void SecureMsgListTokens(const std::set<SecMsgToken> &tokenSet, int64_t time, int64_t now, uint64_t nMask,
+    std::vector<uint8_t> &vchDataOut);
 bool SecureMsgSendData(CNode *pto, bool fSendTrickle);
 
 bool SecureMsgScanBlock(const CBlock &block);
@@ -355,6 +395,9 @@ int SecureMsgManageLocalKey(CKeyID &keyId, ChangeType mode);
 int SecureMsgWalletUnlocked();
 int SecureMsgWalletKeyChanged(CKeyID &keyId, const std::string &sLabel, ChangeType mode);
 
+void SecureMsgInvalidateScanKeys();
+int SecureMsgMatchScanKeys(const std::vector<SecMsgScanKey> &vKeys, const uint8_t *pHeader, const uint8_t *pPayload, uint32_t nPayload,
+    size_t nBegin, size_t &nMatch, size_t nThreads=1);
 int SecureMsgScanMessage(uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload, bool reportToGui);
 
 int SecureMsgGetStoredKey(CKeyID &ckid, CPubKey &cpkOut);
@@ -366,6 +409,9 @@ int SecureMsgAddAddress(std::string &address, std::string &publicKey);
 int SecureMsgAddLocalAddress(std::string &sAddress);
 
 int SecureMsgRetrieve(SecMsgToken &token, std::vector<uint8_t> &vchData);
+int SecureMsgRetrieve(int64_t bucketTime, const std::vector<SecMsgToken> &vTokens, std::vector<uint8_t> &vchData,
+    uint32_t &nMessages, size_t nMaxMessages, size_t nMaxBytes);
+void SecureMsgRemoveBucketFiles(int64_t bucketTime);
 
 int SecureMsgReceive(CNode *pfrom, std::vector<uint8_t> &vchData);
 
@@ -379,7 +425,8 @@ int SecureMsgHash(const SecureMessage &smsg, const uint8_t *pPayload, uint32_t n
 int SecureMsgFund(SecureMessage &smsg, std::string &sError, bool fTestFee, CAmount *nFee);
 
 int SecureMsgValidate(uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload);
-int SecureMsgSetHash (uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload);
+size_t SecureMsgGetPowThreads();
+int SecureMsgSetHash (uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload, size_t nThreads=1);
 
 int SecureMsgEncrypt(SecureMessage &smsg, const CKeyID &addressFrom, const CKeyID &addressTo, const std::string &message);
 
@@ -0,0 +1,307 @@
+// Copyright (c) 2017 The Particl Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindex.h"
+#include "base58.h"
+#include "coins.h"
+#include "consensus/validation.h"
+#include "random.h"
+#include "rpc/misc.h"
+#include "rpc/rpcutil.h"
+#include "txdb.h"
+#include "validation.h"
+
+#include "test/test_particl.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <univalue.h>
+
+#include <functional>
+#include <set>
+
+struct AddressIndexTestingSetup : public TestingSetup {
+    AddressIndexTestingSetup() : TestingSetup(CBaseChainParams::REGTEST)
+    {
+        fAddressIndex = true;
+    }
+    ~AddressIndexTestingSetup()
+    {
+        fAddressIndex = false;
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(addressindex_tests, AddressIndexTestingSetup)
+
+static void CheckAddressBalance(const uint256 &addressHash, int type, CAmount nBalanceExpect)
+{
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    BOOST_REQUIRE(pblocktree->ReadAddressIndex(addressHash, type, addressIndex));
+
+    CAddressBalanceValue sum;
+    for (const auto &delta : addressIndex)
+        sum.Apply(delta.second, false);
+
+    CAddressBalanceValue value;
+    BOOST_REQUIRE(GetAddressBalance(addressHash, type, value));
+    BOOST_CHECK_EQUAL(value.balance, sum.balance);
+    BOOST_CHECK_EQUAL(value.received, sum.received);
+    BOOST_CHECK_EQUAL(value.balance, nBalanceExpect);
+}
+
+BOOST_AUTO_TEST_CASE(address_balance_connect_disconnect)
+{
+    const int type = ADDR_INDT_PUBKEY_ADDRESS;
+    uint256 addressHash = InsecureRand256(), addressOther = InsecureRand256();
+
+    // The address index deltas ConnectBlock records for each block: every block pays the
+    // address once and, from the second block on, spends the previous block's output
+    const int nBlocks = 10;
+    std::vector<std::vector<std::pair<CAddressIndexKey, CAmount> > > vBlockDeltas(nBlocks + 1);
+    std::vector<CAmount> vBalances(nBlocks + 1, 0);
+    CAmount nValuePrev = 0;
+    for (int h = 1; h <= nBlocks; ++h)
+    {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > &vDeltas = vBlockDeltas[h];
+        uint256 txid = InsecureRand256();
+        CAmount nValue = h * COIN;
+        vDeltas.push_back(std::make_pair(CAddressIndexKey(type, addressHash, h, 1, txid, 0, false), nValue));
+        vDeltas.push_back(std::make_pair(CAddressIndexKey(type, addressOther, h, 1, txid, 1, false), COIN));
+        if (h > 1)
+            vDeltas.push_back(std::make_pair(CAddressIndexKey(type, addressHash, h, 1, txid, 0, true), -nValuePrev));
+        vBalances[h] = nValue;
+
+        nValuePrev = nValue;
+    };
+
+    CValidationState state;
+    auto FlushDeltas = [&](int h, bool fDisconnecting) {
+        CCoinsViewCache view(pcoinsTip);
+        view.addressIndex = vBlockDeltas[h];
+        BOOST_REQUIRE(FlushView(&view, state, fDisconnecting));
+    };
+
+    for (int h = 1; h <= nBlocks; ++h)
+    {
+        FlushDeltas(h, false);
+        CheckAddressBalance(addressHash, type, vBalances[h]);
+        CheckAddressBalance(addressOther, type, h * COIN);
+    };
+
+    CAddressBalanceValue value;
+    BOOST_REQUIRE(GetAddressBalance(addressHash, type, value));
+    BOOST_CHECK_EQUAL(value.received, (nBlocks * (nBlocks + 1) / 2) * COIN);
+
+    // A block connected again after an unclean shutdown is not counted twice
+    FlushDeltas(nBlocks, false);
+    CheckAddressBalance(addressHash, type, vBalances[nBlocks]);
+
+    // Disconnect back to height 3
+    for (int h = nBlocks; h > 3; --h)
+    {
+        FlushDeltas(h, true);
+        CheckAddressBalance(addressHash, type, vBalances[h - 1]);
+        CheckAddressBalance(addressOther, type, (h - 1) * COIN);
+    };
+
+    // Erasing deltas that are already gone changes nothing
+    FlushDeltas(4, true);
+    CheckAddressBalance(addressHash, type, vBalances[3]);
+
+    // Reconnect
+    for (int h = 4; h <= nBlocks; ++h)
+    {
+        FlushDeltas(h, false);
+        CheckAddressBalance(addressHash, type, vBalances[h]);
+    };
+
+    // Disconnecting everything removes the totals
+    for (int h = nBlocks; h > 0; --h)
+        FlushDeltas(h, true);
+    CheckAddressBalance(addressHash, type, 0);
+    CheckAddressBalance(addressOther, type, 0);
+    BOOST_REQUIRE(GetAddressBalance(addressHash, type, value));
+    BOOST_CHECK(value.IsNull());
+
+    // The totals rebuilt from the deltas match the running totals
+    for (int h = 1; h <= nBlocks; ++h)
+        FlushDeltas(h, false);
+    BOOST_REQUIRE(pblocktree->RebuildAddressBalanceIndex());
+    CheckAddressBalance(addressHash, type, vBalances[nBlocks]);
+    CheckAddressBalance(addressOther, type, nBlocks * COIN);
+}
+
+static UniValue QueryParams(const std::vector<std::string> &vAddresses, int nLimit, const std::string &sCursor = "")
+{
+    UniValue addresses(UniValue::VARR);
+    for (const auto &address : vAddresses)
+        addresses.push_back(address);
+    UniValue query(UniValue::VOBJ);
+    query.pushKV("addresses", addresses);
+    if (nLimit != 0)
+        query.pushKV("limit", nLimit);
+    if (!sCursor.empty())
+        query.pushKV("cursor", sCursor);
+    UniValue params(UniValue::VARR);
+    params.push_back(query);
+    return params;
+}
+
+/** Follow the cursors from fnPage(cursor) to the last page, returns the entries of all pages */
+static UniValue ReadAllPages(const std::string &sKey, size_t nLimit, size_t &nPages,
+                             const std::function<UniValue(const std::string&)> &fnPage)
+{
+    UniValue all(UniValue::VARR);
+    std::string sCursor;
+    for (nPages = 1; nPages < 100; ++nPages)
+    {
+        UniValue page = fnPage(sCursor);
+        BOOST_REQUIRE(page.isObject());
+        const UniValue &entries = find_value(page, sKey);
+        BOOST_REQUIRE(entries.isArray());
+        BOOST_CHECK(entries.size() <= nLimit);
+        for (size_t i = 0; i < entries.size(); ++i)
+            all.push_back(entries[i]);
+
+        const UniValue &cursor = find_value(page, "cursor");
+        if (cursor.isNull())
+        {
+            // Only a full page has a cursor
+            BOOST_CHECK(entries.size() < nLimit);
+            break;
+        };
+        BOOST_CHECK_EQUAL(entries.size(), nLimit);
+        sCursor = cursor.get_str();
+    };
+    return all;
+}
+
+BOOST_AUTO_TEST_CASE(address_index_pagination)
+{
+    const int type = ADDR_INDT_PUBKEY_ADDRESS;
+    uint256 rand = InsecureRand256();
+    CKeyID idA(uint160(std::vector<uint8_t>(rand.begin(), rand.begin() + 20)));
+    rand = InsecureRand256();
+    CKeyID idB(uint160(std::vector<uint8_t>(rand.begin(), rand.begin() + 20)));
+    std::string sAddrA = CBitcoinAddress(idA).ToString(), sAddrB = CBitcoinAddress(idB).ToString();
+    uint256 hashA, hashB;
+    int typeA, typeB;
+    BOOST_REQUIRE(CBitcoinAddress(sAddrA).GetIndexKey(hashA, typeA) && typeA == type);
+    BOOST_REQUIRE(CBitcoinAddress(sAddrB).GetIndexKey(hashB, typeB) && typeB == type);
+
+    // 6 blocks paying both addresses, the outputs to A stay unspent
+    const int nBlocks = 6;
+    CValidationState state;
+    {
+        CCoinsViewCache view(pcoinsTip);
+        for (int h = 1; h <= nBlocks; ++h)
+        {
+            uint256 txid = InsecureRand256();
+            view.addressIndex.push_back(std::make_pair(CAddressIndexKey(type, hashA, h, 1, txid, 0, false), h * COIN));
+            view.addressIndex.push_back(std::make_pair(CAddressIndexKey(type, hashB, h, 1, txid, 1, false), COIN));
+            view.addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(type, hashA, txid, 0),
+                CAddressUnspentValue(h * COIN, CScript() << OP_TRUE, h)));
+        };
+        BOOST_REQUIRE(FlushView(&view, state, false));
+    }
+
+    std::vector<std::string> vAddresses {sAddrA, sAddrB};
+    UniValue deltasAll = addressDeltasToJSON(QueryParams(vAddresses, 0));
+    BOOST_REQUIRE(deltasAll.isArray());
+    BOOST_REQUIRE_EQUAL(deltasAll.size(), 2 * nBlocks);
+
+    // Pages concatenate to the unpaginated result, over both addresses
+    for (size_t nLimit : {1, 4, 5, 12, 20})
+    {
+        size_t nPages;
+        UniValue deltas = ReadAllPages("deltas", nLimit, nPages, [&](const std::string &sCursor) {
+            return addressDeltasToJSON(QueryParams(vAddresses, nLimit, sCursor));
+        });
+        BOOST_CHECK_EQUAL(nPages, deltasAll.size() / nLimit + 1);
+        BOOST_CHECK_EQUAL(deltas.write(), deltasAll.write());
+    };
+
+    UniValue txidsAll = addressTxidsToJSON(QueryParams(vAddresses, 0));
+    BOOST_REQUIRE(txidsAll.isArray());
+    BOOST_CHECK_EQUAL(txidsAll.size(), nBlocks);
+    {
+        size_t nPages;
+        UniValue txids = ReadAllPages("txids", 5, nPages, [&](const std::string &sCursor) {
+            return addressTxidsToJSON(QueryParams(vAddresses, 5, sCursor));
+        });
+        BOOST_CHECK_EQUAL(nPages, 3);
+        // Pages dedupe txids within a page only
+        std::set<std::string> setTxids;
+        for (size_t i = 0; i < txids.size(); ++i)
+            setTxids.insert(txids[i].get_str());
+        BOOST_CHECK_EQUAL(setTxids.size(), nBlocks);
+    }
+
+    UniValue utxosAll = addressUtxosToJSON(QueryParams(vAddresses, 0));
+    BOOST_REQUIRE(utxosAll.isArray());
+    BOOST_REQUIRE_EQUAL(utxosAll.size(), nBlocks);
+    {
+        size_t nPages;
+        UniValue utxos = ReadAllPages("utxos", 4, nPages, [&](const std::string &sCursor) {
+            return addressUtxosToJSON(QueryParams(vAddresses, 4, sCursor));
+        });
+        BOOST_CHECK_EQUAL(nPages, 2);
+        // Sorted by height within each page only
+        std::set<std::string> setAll, setPaged;
+        for (size_t i = 0; i < utxosAll.size(); ++i)
+            setAll.insert(utxosAll[i].write());
+        for (size_t i = 0; i < utxos.size(); ++i)
+            setPaged.insert(utxos[i].write());
+        BOOST_CHECK(setAll == setPaged);
+    }
+
+    // Invalid limits and cursors
+    BOOST_CHECK_THROW(addressDeltasToJSON(QueryParams(vAddresses, -1)), UniValue);
+    UniValue params;
+    BOOST_CHECK_THROW(addressDeltasToJSON(QueryParams(vAddresses, 2, "not hex")), UniValue);
+    BOOST_CHECK_THROW(addressDeltasToJSON(QueryParams(vAddresses, 2, "00")), UniValue);
+    BOOST_CHECK_THROW(addressUtxosToJSON(QueryParams(vAddresses, 2, "00")), UniValue);
+    std::string sCursorA = find_value(addressDeltasToJSON(QueryParams({sAddrA}, 2)), "cursor").get_str();
+    BOOST_CHECK_NO_THROW(addressDeltasToJSON(QueryParams({sAddrA}, 2, sCursorA)));
+    BOOST_CHECK_THROW(addressDeltasToJSON(QueryParams({sAddrA}, 2, sCursorA + "00")), UniValue);
+    // A cursor of another address
+    BOOST_CHECK_THROW(addressDeltasToJSON(QueryParams({sAddrB}, 2, sCursorA)), UniValue);
+    // A delta cursor doesn't decode as an unspent output cursor
+    BOOST_CHECK_THROW(addressUtxosToJSON(QueryParams({sAddrA}, 2, sCursorA)), UniValue);
+
+    // Through the RPC interface
+    UniValue result;
+    BOOST_CHECK_NO_THROW(result = CallRPC("getaddressdeltas {\"addresses\":[\"" + sAddrA + "\"],\"limit\":4}"));
+    BOOST_CHECK_EQUAL(find_value(result, "deltas").size(), 4);
+    std::string sCursor = find_value(result, "cursor").get_str();
+    BOOST_CHECK_NO_THROW(result = CallRPC("getaddressdeltas {\"addresses\":[\"" + sAddrA + "\"],\"limit\":4,\"cursor\":\"" + sCursor + "\"}"));
+    BOOST_CHECK_EQUAL(find_value(result, "deltas").size(), 2);
+    BOOST_CHECK(find_value(result, "cursor").isNull());
+    BOOST_CHECK_THROW(CallRPC("getaddressdeltas {\"addresses\":[\"" + sAddrA + "\"],\"limit\":4,\"cursor\":\"zz\"}"), std::runtime_error);
+    BOOST_CHECK_THROW(CallRPC("getaddresstxids {\"addresses\":[\"" + sAddrA + "\"],\"limit\":0}"), std::runtime_error);
+
+    // Through the REST path query, /rest/addressdeltas/<address>[/<limit>[/<cursor>]].json
+    {
+        size_t nPages;
+        UniValue deltas = ReadAllPages("deltas", 4, nPages, [&](const std::string &sCursor) {
+            UniValue params(UniValue::VARR);
+            params.push_back(addressQueryFromPath(sAddrA + "/4" + (sCursor.empty() ? "" : "/" + sCursor)));
+            return addressDeltasToJSON(params);
+        });
+        BOOST_CHECK_EQUAL(nPages, 2);
+        BOOST_CHECK_EQUAL(deltas.size(), nBlocks);
+    }
+    params = UniValue(UniValue::VARR);
+    params.push_back(addressQueryFromPath(sAddrA));
+    BOOST_CHECK(addressUtxosToJSON(params).isArray());
+    BOOST_CHECK_THROW(addressQueryFromPath(""), UniValue);
+    BOOST_CHECK_THROW(addressQueryFromPath(sAddrA + "/0"), UniValue);
+    BOOST_CHECK_THROW(addressQueryFromPath(sAddrA + "/x"), UniValue);
+    BOOST_CHECK_THROW(addressQueryFromPath(sAddrA + "/1/00/00"), UniValue);
+    params = UniValue(UniValue::VARR);
+    params.push_back(addressQueryFromPath(sAddrA + "/1/zz"));
+    BOOST_CHECK_THROW(addressDeltasToJSON(params), UniValue);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,139 @@
+// Copyright (c) 2017 The Particl Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "consensus/merkle.h"
+#include "consensus/validation.h"
+#include "pow.h"
+#include "random.h"
+#include "streams.h"
+#include "validation.h"
+
+#include "test/test_particl.h"
+
+#include <boost/test/unit_test.hpp>
+
+struct BlockImportTestingSetup : public TestingSetup {
+    BlockImportTestingSetup() : TestingSetup(CBaseChainParams::REGTEST) {}
+};
+
+BOOST_FIXTURE_TEST_SUITE(blockimport_tests, BlockImportTestingSetup)
+
+static CBlock MakeBlock(const CChainParams &chainparams, const uint256 &hashPrev, int nHeight)
+{
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << nHeight << OP_0;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 0;
+    coinbase.vout[0].scriptPubKey = CScript() << OP_TRUE;
+
+    CBlock block;
+    block.nVersion = 1;
+    block.hashPrevBlock = hashPrev;
+    block.nTime = chainparams.GenesisBlock().nTime + nHeight * 60;
+    block.nBits = chainparams.GenesisBlock().nBits;
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    while (!CheckProofOfWork(block.GetHash(), block.nBits, chainparams.GetConsensus()))
+        ++block.nNonce;
+    return block;
+}
+
+static void WriteRecord(CAutoFile &file, const CChainParams &chainparams, const std::vector<uint8_t> &vData)
+{
+    file << FLATDATA(chainparams.MessageStart()) << (unsigned int)vData.size();
+    file.write((const char*)vData.data(), vData.size());
+}
+
+static void WriteBlock(CAutoFile &file, const CChainParams &chainparams, const CBlock &block)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << block;
+    WriteRecord(file, chainparams, std::vector<uint8_t>(ss.begin(), ss.end()));
+}
+
+BOOST_AUTO_TEST_CASE(import_block_file_test)
+{
+    const CChainParams &chainparams = Params();
+    const int nBlocks = 120;
+
+    std::vector<CBlock> vBlocks;
+    uint256 hashPrev = chainparams.GenesisBlock().GetHash();
+    for (int i = 1; i <= nBlocks; ++i)
+    {
+        vBlocks.push_back(MakeBlock(chainparams, hashPrev, i));
+        hashPrev = vBlocks.back().GetHash();
+    };
+    const CBlock &blockTip = vBlocks.back();
+
+    // A block on an unknown parent, it never becomes connectable
+    CBlock blockOrphan = MakeBlock(chainparams, InsecureRand256(), 50);
+
+    // A copy of block 61 with a changed coinbase, the merkle root no longer matches
+    CBlock blockCorrupt = vBlocks[60];
+    CMutableTransaction txCorrupt(*blockCorrupt.vtx[0]);
+    txCorrupt.vout[0].nValue = 1;
+    blockCorrupt.vtx[0] = MakeTransactionRef(txCorrupt);
+
+    // Written as a block file so out of order blocks can be read back from their position, as on -reindex
+    CDiskBlockPos pos(1, 0);
+    {
+        CAutoFile file(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
+        BOOST_REQUIRE(!file.IsNull());
+        for (int i = 1; i <= 40; ++i)
+            WriteBlock(file, chainparams, vBlocks[i-1]);
+        // 42 to 60 arrive before their ancestor 41
+        for (int i = 42; i <= 60; ++i)
+            WriteBlock(file, chainparams, vBlocks[i-1]);
+        WriteBlock(file, chainparams, vBlocks[40]);
+        WriteBlock(file, chainparams, blockOrphan);
+        WriteBlock(file, chainparams, blockCorrupt);
+
+        // A record that doesn't deserialise
+        std::vector<uint8_t> vGarbage(200);
+        GetRandBytes(vGarbage.data(), vGarbage.size());
+        WriteRecord(file, chainparams, vGarbage);
+
+        for (int i = 61; i <= nBlocks; ++i)
+            WriteBlock(file, chainparams, vBlocks[i-1]);
+    }
+
+    {
+        CImportConnector connector(chainparams);
+        FILE *file = OpenBlockFile(pos, true);
+        BOOST_REQUIRE(file);
+        BOOST_CHECK(LoadExternalBlockFile(chainparams, file, &pos, &connector));
+    }
+
+    {
+        LOCK(cs_main);
+        // The connector ran once 100 blocks were accepted
+        BOOST_CHECK(chainActive.Height() >= 100);
+
+        // The orphan is held back, the corrupt copy didn't replace block 61
+        BOOST_CHECK(mapBlockIndex.count(blockOrphan.GetHash()) == 0);
+        CBlockIndex *pindex61 = mapBlockIndex[vBlocks[60].GetHash()];
+        BOOST_REQUIRE(pindex61);
+        BOOST_CHECK(pindex61->nStatus & BLOCK_HAVE_DATA);
+        BOOST_CHECK(!(pindex61->nStatus & BLOCK_FAILED_MASK));
+    }
+
+    CValidationState state;
+    BOOST_CHECK(ActivateBestChain(state, chainparams));
+
+    LOCK(cs_main);
+    BOOST_CHECK_EQUAL(chainActive.Height(), nBlocks);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == blockTip.GetHash());
+    for (int i = 1; i <= nBlocks; ++i)
+        BOOST_CHECK(chainActive[i]->GetBlockHash() == vBlocks[i-1].GetHash());
+
+    // Blocks are read back from their position in the imported file
+    CBlock blockRead;
+    BOOST_CHECK(ReadBlockFromDisk(blockRead, chainActive[45], chainparams.GetConsensus()));
+    BOOST_CHECK(blockRead.GetHash() == vBlocks[44].GetHash());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
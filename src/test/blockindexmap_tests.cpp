@@ -0,0 +1,186 @@
+// Copyright (c) 2017 The Particl Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockindexmap.h"
+#include "chainparams.h"
+#include "txdb.h"
+#include "validation.h"
+
+#include "test/test_particl.h"
+
+#include <memory>
+#include <string.h>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockindexmap_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(blockindexmap_test)
+{
+    CBlockIndexMap map;
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.begin() == map.end());
+    BOOST_CHECK(map.find(InsecureRand256()) == map.end());
+    BOOST_CHECK(map[InsecureRand256()] == nullptr);
+
+    // Spans several arena chunks and table resizes
+    const int N = 20000;
+    std::vector<uint256> vHashes;
+    std::vector<CBlockIndex*> vIndex;
+    for (int i = 0; i < N; ++i)
+    {
+        uint256 hash = InsecureRand256();
+        // Same table position as the previous hash with a different tag, or with the same tag
+        if (i % 100 == 1)
+            memcpy(hash.begin(), vHashes.back().begin(), 4);
+        if (i % 100 == 2)
+            memcpy(hash.begin(), vHashes.back().begin(), 8);
+
+        CBlockHeader header;
+        header.nTime = i;
+        auto inserted = map.emplace(hash, header);
+        BOOST_REQUIRE(inserted.second);
+        BOOST_CHECK(inserted.first->first == hash);
+        CBlockIndex *pindex = inserted.first->second;
+        BOOST_CHECK(pindex->GetBlockHash() == hash);
+        BOOST_CHECK(pindex->phashBlock == &inserted.first->first);
+        BOOST_CHECK_EQUAL(pindex->nTime, (unsigned int)i);
+        pindex->pprev = vIndex.empty() ? nullptr : vIndex.back();
+        pindex->nHeight = i;
+        vHashes.push_back(hash);
+        vIndex.push_back(pindex);
+    };
+    BOOST_CHECK_EQUAL(map.size(), (size_t)N);
+    BOOST_CHECK(!map.empty());
+
+    // Existing entries are returned and left unchanged
+    auto existing = map.emplace(vHashes[5]);
+    BOOST_CHECK(!existing.second);
+    BOOST_CHECK(existing.first->second == vIndex[5]);
+    BOOST_CHECK_EQUAL(vIndex[5]->nTime, 5U);
+    BOOST_CHECK_EQUAL(map.size(), (size_t)N);
+
+    // Entries don't move as the map grows
+    const CBlockIndexMap &cmap = map;
+    for (int i = 0; i < N; ++i)
+    {
+        CBlockIndexMap::const_iterator mi = cmap.find(vHashes[i]);
+        BOOST_REQUIRE(mi != cmap.end());
+        BOOST_CHECK(mi->second == vIndex[i]);
+        BOOST_CHECK(map[vHashes[i]] == vIndex[i]);
+        BOOST_CHECK_EQUAL(map.count(vHashes[i]), 1U);
+        BOOST_CHECK_EQUAL(vIndex[i]->nHeight, i);
+        BOOST_CHECK(vIndex[i]->GetBlockHash() == vHashes[i]);
+        if (i > 0)
+            BOOST_CHECK(vIndex[i]->pprev == vIndex[i - 1]);
+    };
+    for (int i = 0; i < 1000; ++i)
+        BOOST_CHECK_EQUAL(map.count(InsecureRand256()), 0U);
+
+    // Iteration is in insertion order
+    int n = 0;
+    for (const CBlockIndexMap::value_type &item : map)
+    {
+        BOOST_CHECK(item.first == vHashes[n]);
+        BOOST_CHECK(item.second == vIndex[n]);
+        n++;
+    };
+    BOOST_CHECK_EQUAL(n, N);
+
+    BOOST_CHECK(map.DynamicMemoryUsage() > N * sizeof(CBlockIndex));
+
+    map.clear();
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.begin() == map.end());
+    BOOST_CHECK(map.find(vHashes[0]) == map.end());
+    BOOST_CHECK_EQUAL(map.DynamicMemoryUsage(), 0U);
+
+    // Usable after clear
+    BOOST_CHECK(map.emplace(vHashes[0]).second);
+    BOOST_CHECK_EQUAL(map.size(), 1U);
+    BOOST_CHECK(map[vHashes[0]]->GetBlockHash() == vHashes[0]);
+}
+
+BOOST_FIXTURE_TEST_CASE(load_block_index_test, ParticlTestingSetup)
+{
+    const CChainParams &chainparams = Params();
+    SeedInsecureRand();
+
+    // Enough entries to span several batches read by the loader thread, with a lighter fork
+    std::vector<std::unique_ptr<CBlockIndex> > vIndex;
+    std::vector<std::unique_ptr<uint256> > vHashes;
+    auto addIndex = [&](const CBlockIndex *pprev, int nBitsShift) {
+        vIndex.emplace_back(new CBlockIndex());
+        CBlockIndex *pindex = vIndex.back().get();
+        pindex->pprev = const_cast<CBlockIndex*>(pprev);
+        pindex->nHeight = pprev ? pprev->nHeight + 1 : 0;
+        pindex->nVersion = 0xa0000000;
+        pindex->nTime = 1500000000 + pindex->nHeight * 120;
+        pindex->nBits = 0x1e0fffff - nBitsShift;
+        pindex->nNonce = InsecureRand32();
+        pindex->hashMerkleRoot = InsecureRand256();
+        pindex->hashWitnessMerkleRoot = InsecureRand256();
+        pindex->bnStakeModifier = InsecureRand256();
+        pindex->nMoneySupply = pindex->nHeight * COIN;
+        pindex->nTx = 1;
+        pindex->nStatus = BLOCK_VALID_TRANSACTIONS;
+        vHashes.emplace_back(new uint256(pindex->GetBlockHeader().GetHash()));
+        pindex->phashBlock = vHashes.back().get();
+        pindex->nChainWork = (pprev ? pprev->nChainWork : 0) + GetBlockProof(*pindex);
+        return pindex;
+    };
+
+    const CBlockIndex *pindexGenesis = chainActive.Genesis();
+    vIndex.emplace_back(new CBlockIndex(*pindexGenesis));
+    vHashes.emplace_back(new uint256(pindexGenesis->GetBlockHash()));
+    vIndex.back()->phashBlock = vHashes.back().get();
+    vIndex.back()->nChainWork = GetBlockProof(*pindexGenesis);
+    const CBlockIndex *pindexTip = vIndex.back().get();
+    const CBlockIndex *pindexFork = nullptr;
+    for (int i = 1; i <= 10000; ++i)
+    {
+        pindexTip = addIndex(pindexTip, InsecureRandBits(8));
+        if (i == 5000)
+            pindexFork = pindexTip;
+    };
+    for (int i = 0; i < 100; ++i)
+        pindexFork = addIndex(pindexFork, 0);
+
+    std::vector<const CBlockIndex*> vWrite(vIndex.size());
+    for (size_t i = 0; i < vIndex.size(); ++i)
+        vWrite[i] = vIndex[i].get();
+    CBlockTreeDB *pblocktreeTest = new CBlockTreeDB(1 << 20, true);
+    BOOST_CHECK(pblocktreeTest->WriteBatchSync(std::vector<std::pair<int, const CBlockFileInfo*> >(), 0, vWrite));
+
+    CBlockTreeDB *pblocktreeOld = pblocktree;
+    pblocktree = pblocktreeTest;
+    UnloadBlockIndex();
+    BOOST_CHECK(LoadBlockIndex(chainparams));
+
+    BOOST_CHECK_EQUAL(mapBlockIndex.size(), vIndex.size());
+    for (const auto &pindexExpect : vIndex)
+    {
+        BlockMap::iterator mi = mapBlockIndex.find(pindexExpect->GetBlockHash());
+        BOOST_REQUIRE(mi != mapBlockIndex.end());
+        const CBlockIndex *pindex = mi->second;
+        BOOST_CHECK_EQUAL(pindex->nHeight, pindexExpect->nHeight);
+        BOOST_CHECK(pindex->nChainWork == pindexExpect->nChainWork);
+        BOOST_CHECK(pindex->bnStakeModifier == pindexExpect->bnStakeModifier);
+        BOOST_CHECK_EQUAL(pindex->nMoneySupply, pindexExpect->nMoneySupply);
+        BOOST_CHECK_EQUAL(pindex->nChainTx, (unsigned int)pindex->nHeight + 1);
+        if (pindexExpect->pprev)
+            BOOST_CHECK(pindex->pprev && pindex->pprev->GetBlockHash() == pindexExpect->pprev->GetBlockHash());
+    };
+
+    BOOST_REQUIRE(pindexBestHeader);
+    BOOST_CHECK(pindexBestHeader->GetBlockHash() == pindexTip->GetBlockHash());
+    BOOST_CHECK(pindexBestHeader->GetAncestor(1234)->GetBlockHash() == pindexTip->GetAncestor(1234)->GetBlockHash());
+
+    UnloadBlockIndex();
+    pblocktree = pblocktreeOld;
+    delete pblocktreeTest;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
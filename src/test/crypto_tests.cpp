@@ -10,6 +10,7 @@
 #include "crypto/sha512.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "crypto/muhash.h"
 #include "random.h"
 #include "utilstrencodings.h"
 #include "test/test_particl.h"
@@ -268,6 +269,134 @@ BOOST_AUTO_TEST_CASE(sha256_testvectors) {
     TestSHA256(test1, "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
 }
 
+BOOST_AUTO_TEST_CASE(sha256_lanes) {
+    // Every lane must match CSHA256, with writes split at random points
+    for (size_t len : {0, 1, 55, 56, 63, 64, 65, 100, 1000}) {
+        std::vector<unsigned char> in[CSHA256Lanes::LANES];
+        const unsigned char* lanes[CSHA256Lanes::LANES];
+        unsigned char expect[CSHA256Lanes::OUTPUT_SIZE * CSHA256Lanes::LANES];
+        unsigned char out[CSHA256Lanes::OUTPUT_SIZE * CSHA256Lanes::LANES];
+        for (size_t i = 0; i < CSHA256Lanes::LANES; ++i) {
+            in[i].resize(len);
+            for (auto &c : in[i])
+                c = InsecureRandBits(8);
+            CSHA256().Write(in[i].data(), len).Finalize(expect + CSHA256Lanes::OUTPUT_SIZE * i);
+        }
+        CSHA256Lanes hasher;
+        size_t pos = 0;
+        while (pos < len) {
+            size_t n = InsecureRandRange(len - pos + 1);
+            for (size_t i = 0; i < CSHA256Lanes::LANES; ++i)
+                lanes[i] = in[i].data() + pos;
+            hasher.Write(lanes, n);
+            pos += n;
+        }
+        hasher.Finalize(out);
+        BOOST_CHECK(memcmp(out, expect, sizeof(out)) == 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sha256d64)
+{
+    // Every block count, covering the multi-way path and the remainder
+    for (int i = 0; i <= 32; ++i) {
+        unsigned char in[64 * 32];
+        unsigned char out1[32 * 32], out2[32 * 32];
+        for (int j = 0; j < 64 * i; ++j) {
+            in[j] = InsecureRandBits(8);
+        }
+        for (int j = 0; j < i; ++j) {
+            CHash256().Write(in + 64 * j, 64).Finalize(out1 + 32 * j);
+        }
+        SHA256D64(out2, in, i);
+        BOOST_CHECK(memcmp(out1, out2, 32 * i) == 0);
+        // In place
+        SHA256D64(in, in, i);
+        BOOST_CHECK(memcmp(out1, in, 32 * i) == 0);
+    }
+}
+
+static void TestSHA256Transform(const SHA256Kernels &kernels, SHA256Kernels::TransformType tr, const std::string &name)
+{
+    if (!tr) {
+        BOOST_TEST_MESSAGE("Skipping " << name << ", not supported by this CPU or build");
+        return;
+    }
+    // Random states and inputs, unaligned
+    for (int blocks = 0; blocks <= 8; ++blocks) {
+        unsigned char in[64 * 8 + 1];
+        for (auto &c : in)
+            c = InsecureRandBits(8);
+        uint32_t s[8], expect[8];
+        for (int i = 0; i < 8; ++i)
+            s[i] = expect[i] = InsecureRand32();
+        kernels.transform(expect, in + 1, blocks);
+        tr(s, in + 1, blocks);
+        BOOST_CHECK_MESSAGE(memcmp(s, expect, sizeof(s)) == 0, name << ", " << blocks << " blocks");
+    }
+}
+
+static void TestSHA256D64Ways(const SHA256Kernels &kernels, SHA256Kernels::TransformD64Type tr, size_t ways, const std::string &name)
+{
+    if (!tr) {
+        BOOST_TEST_MESSAGE("Skipping " << name << ", not supported by this CPU or build");
+        return;
+    }
+    for (int n = 0; n < 16; ++n) {
+        unsigned char in[64 * 8], out[32 * 8], expect[32 * 8];
+        for (size_t k = 0; k < 64 * ways; ++k)
+            in[k] = InsecureRandBits(8);
+        for (size_t i = 0; i < ways; ++i)
+            kernels.transform_d64(expect + 32 * i, in + 64 * i);
+        tr(out, in);
+        BOOST_CHECK_MESSAGE(memcmp(out, expect, 32 * ways) == 0, name);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sha256_kernels)
+{
+    // Each kernel the CPU supports against the generic implementation, independent of the one selected
+    const SHA256Kernels kernels = SHA256DetectKernels();
+    BOOST_REQUIRE(kernels.transform && kernels.transform_d64);
+    BOOST_TEST_MESSAGE("Selected SHA-256 implementation: " << SHA256Implementation());
+
+    // The generic double hash against the hasher
+    for (int n = 0; n < 16; ++n) {
+        unsigned char in[64], out[32], expect[32];
+        for (auto &c : in)
+            c = InsecureRandBits(8);
+        CHash256().Write(in, sizeof(in)).Finalize(expect);
+        kernels.transform_d64(out, in);
+        BOOST_CHECK(memcmp(out, expect, sizeof(out)) == 0);
+    }
+
+    TestSHA256Transform(kernels, kernels.transform_sse4, "sse4");
+    TestSHA256Transform(kernels, kernels.transform_shani, "shani");
+
+    if (kernels.transform4_sse2) {
+        for (int blocks = 0; blocks <= 4; ++blocks) {
+            unsigned char in[4][64 * 4 + 1];
+            const unsigned char* chunks[4];
+            uint32_t s[8 * 4], expect[8 * 4];
+            for (int i = 0; i < 4; ++i) {
+                for (auto &c : in[i])
+                    c = InsecureRandBits(8);
+                chunks[i] = in[i] + 1;
+                for (int k = 0; k < 8; ++k)
+                    s[8 * i + k] = expect[8 * i + k] = InsecureRand32();
+                kernels.transform(expect + 8 * i, chunks[i], blocks);
+            }
+            kernels.transform4_sse2(s, chunks, blocks);
+            BOOST_CHECK_MESSAGE(memcmp(s, expect, sizeof(s)) == 0, "sse2 4 lanes, " << blocks << " blocks");
+        }
+    } else {
+        BOOST_TEST_MESSAGE("Skipping sse2 4 lanes, not supported by this CPU or build");
+    }
+
+    TestSHA256D64Ways(kernels, kernels.transform4_d64_sse2, 4, "sse2 4-way double hash");
+    TestSHA256D64Ways(kernels, kernels.transform8_d64_avx2, 8, "avx2 8-way double hash");
+}
+
 BOOST_AUTO_TEST_CASE(sha512_testvectors) {
     TestSHA512("",
                "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
@@ -483,6 +612,88 @@ BOOST_AUTO_TEST_CASE(chacha20_testvector)
                  "fab78c9");
 }
 
+static MuHash3072 MuHashFromInt(unsigned char i)
+{
+    unsigned char tmp[32] = {i, 0};
+    MuHash3072 h;
+    h.Insert(tmp, sizeof(tmp));
+    return h;
+}
+
+BOOST_AUTO_TEST_CASE(muhash_tests)
+{
+    unsigned char out[32];
+
+    // Any order of inserts and removes gives the same hash
+    for (int iter = 0; iter < 10; ++iter)
+    {
+        unsigned char res[32];
+        int table[4];
+        for (int i = 0; i < 4; ++i)
+            table[i] = InsecureRandBits(3);
+        for (int order = 0; order < 4; ++order)
+        {
+            MuHash3072 acc;
+            for (int i = 0; i < 4; ++i)
+            {
+                int t = table[i ^ order];
+                if (t & 4)
+                    acc /= MuHashFromInt(t & 3);
+                else
+                    acc *= MuHashFromInt(t & 3);
+            };
+            acc.Finalize(out);
+            if (order == 0)
+                memcpy(res, out, 32);
+            else
+                BOOST_CHECK(memcmp(res, out, 32) == 0);
+        };
+
+        MuHash3072 x = MuHashFromInt(InsecureRandBits(4));
+        MuHash3072 y = MuHashFromInt(InsecureRandBits(4));
+        MuHash3072 z;
+        z *= x;
+        z *= y;
+        y *= x;
+        z /= y;
+        z.Finalize(out);
+
+        unsigned char empty[32];
+        MuHash3072().Finalize(empty);
+        BOOST_CHECK(memcmp(out, empty, 32) == 0);
+    };
+
+    // Removing from an Insert/Remove accumulator matches dividing
+    unsigned char data[32] = {7, 0};
+    MuHash3072 a = MuHashFromInt(1);
+    a.Insert(data, sizeof(data));
+    a.Remove(data, sizeof(data));
+    unsigned char out2[32];
+    a.Finalize(out);
+    MuHashFromInt(1).Finalize(out2);
+    BOOST_CHECK(memcmp(out, out2, 32) == 0);
+
+    MuHash3072 acc = MuHashFromInt(0);
+    acc *= MuHashFromInt(1);
+    acc /= MuHashFromInt(2);
+    acc.Finalize(out);
+    uint256 hash;
+    memcpy(hash.begin(), out, 32);
+    BOOST_CHECK_EQUAL(hash.ToString(), "10d312b100cbd32ada024a6646e40d3482fcff103668d2625f10002a607d5863");
+
+    // Serialized state round trips
+    CDataStream ss(SER_DISK, 0);
+    MuHash3072 acc2 = MuHashFromInt(0);
+    acc2 /= MuHashFromInt(2);
+    ss << acc2;
+    BOOST_CHECK_EQUAL(ss.size(), 2 * Num3072::BYTE_SIZE);
+    MuHash3072 acc3;
+    ss >> acc3;
+    acc3 *= MuHashFromInt(1);
+    acc3.Finalize(out);
+    BOOST_CHECK(memcmp(out, hash.begin(), 32) == 0);
+}
+
 BOOST_AUTO_TEST_CASE(countbits_tests)
 {
     FastRandomContext ctx;
@@ -3,8 +3,10 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "chainparams.h"
+#include "consensus/validation.h"
 #include "validation.h"
 #include "net.h"
+#include "txdb.h"
 
 #include "test/test_particl.h"
 
@@ -74,4 +76,90 @@ BOOST_AUTO_TEST_CASE(test_combiner_all)
     Test.disconnect(&ReturnTrue);
     BOOST_CHECK(Test());
 }
+
+static void CheckCoinsSetStats()
+{
+    CCoinsSetStats stats, statsScan;
+    uint64_t nTransactions = 0;
+    BOOST_CHECK(GetCoinsSetStats(stats, false));
+    BOOST_CHECK(GetCoinsSetStats(statsScan, true, &nTransactions));
+
+    CCoinsStats utxoStats;
+    BOOST_CHECK(GetUTXOStats(pcoinsdbview, utxoStats));
+
+    BOOST_CHECK(stats.hashBlock == chainActive.Tip()->GetBlockHash());
+    BOOST_CHECK(statsScan.hashBlock == stats.hashBlock);
+    BOOST_CHECK(stats.GetMuHash() == statsScan.GetMuHash());
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, statsScan.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(stats.nBogoSize, statsScan.nBogoSize);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, statsScan.nTotalAmount);
+
+    BOOST_CHECK_EQUAL(nTransactions, utxoStats.nTransactions);
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, (int64_t)utxoStats.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(stats.nBogoSize, (int64_t)utxoStats.nBogoSize);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, utxoStats.nTotalAmount);
+}
+
+BOOST_FIXTURE_TEST_CASE(coins_set_stats_test, TestChain100Setup)
+{
+    const CChainParams &chainparams = Params();
+
+    // Without -coinstatsindex every request scans the coins db
+    BOOST_CHECK(!fCoinStatsIndex);
+    CheckCoinsSetStats();
+    BOOST_CHECK(!fCoinsSetStatsComplete);
+
+    fCoinStatsIndex = true;
+    InitCoinsSetStats();
+    CheckCoinsSetStats();
+    BOOST_CHECK(fCoinsSetStatsComplete);
+
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CreateAndProcessBlock(std::vector<CMutableTransaction>(), scriptPubKey);
+    CheckCoinsSetStats();
+    CCoinsSetStats statsBefore;
+    BOOST_CHECK(GetCoinsSetStats(statsBefore, false));
+
+    // Disconnecting removes the outputs again
+    CBlockIndex *pindexTip = chainActive.Tip();
+    CValidationState state;
+    BOOST_CHECK(InvalidateBlock(state, chainparams, pindexTip));
+    BOOST_CHECK(chainActive.Height() == 100);
+    CheckCoinsSetStats();
+    {
+        LOCK(cs_main);
+        ResetBlockFailureFlags(pindexTip);
+    }
+    BOOST_CHECK(ActivateBestChain(state, chainparams));
+    BOOST_CHECK(chainActive.Tip() == pindexTip);
+    CCoinsSetStats statsAfter;
+    BOOST_CHECK(GetCoinsSetStats(statsAfter, false));
+    BOOST_CHECK(statsAfter.GetMuHash() == statsBefore.GetMuHash());
+
+    // Rebuilt from the coins db when the running totals are unavailable
+    {
+        LOCK(cs_main);
+        coinsSetStats.SetNull();
+        coinsSetStats.hashBlock = chainActive.Tip()->GetBlockHash();
+        fCoinsSetStatsComplete = false;
+    }
+    CheckCoinsSetStats();
+    BOOST_CHECK(fCoinsSetStatsComplete);
+    CreateAndProcessBlock(std::vector<CMutableTransaction>(), scriptPubKey);
+    CheckCoinsSetStats();
+
+    // Stored with the chainstate on flush
+    FlushStateToDisk();
+    CCoinsSetStats statsStored;
+    BOOST_CHECK(pcoinsdbview->ReadCoinsSetStats(statsStored));
+    BOOST_CHECK(statsStored.hashBlock == chainActive.Tip()->GetBlockHash());
+    BOOST_CHECK(statsStored.GetMuHash() == coinsSetStats.GetMuHash());
+
+    fCoinStatsIndex = false;
+    InitCoinsSetStats();
+    CreateAndProcessBlock(std::vector<CMutableTransaction>(), scriptPubKey);
+    CheckCoinsSetStats();
+    BOOST_CHECK(!fCoinsSetStatsComplete);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -3,19 +3,33 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "test/test_particl.h"
+#include "anon.h"
+#include "blind.h"
+#include "chainparams.h"
 #include "net.h"
 #include "keystore.h"
 #include "script/script.h"
 #include "script/ismine.h"
 #include "consensus/merkle.h"
+#include "consensus/validation.h"
 #include "key/extkey.h"
 #include "pos/kernel.h"
+#include "rctindex.h"
+#include "txdb.h"
+#include "validation.h"
+#include "util.h"
 
 #include "script/sign.h"
 #include "policy/policy.h"
 
+#include <secp256k1_rangeproof.h>
+#include <secp256k1_mlsag.h>
+
 #include <boost/test/unit_test.hpp>
 
+extern bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
+                  CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck = false);
+
 BOOST_FIXTURE_TEST_SUITE(particlchain_tests, BasicTestingSetup)
 
 
@@ -131,6 +145,233 @@ BOOST_AUTO_TEST_CASE(particlchain_test)
     txnSpend.nVersion = PARTICL_BLOCK_VERSION;
 }
 
+BOOST_AUTO_TEST_CASE(txout_serialize_test)
+{
+    SeedInsecureRand();
+
+    // Many outputs of all types
+    CMutableTransaction txn;
+    txn.nVersion = PARTICL_TXN_VERSION;
+    txn.nLockTime = 0;
+    txn.vin.push_back(CTxIn(InsecureRand256(), 0));
+    for (size_t k = 0; k < 300; ++k)
+    {
+        switch (k % 4)
+        {
+            case 0:
+                {
+                OUTPUT_PTR<CTxOutStandard> out = MAKE_OUTPUT<CTxOutStandard>();
+                out->nValue = k;
+                out->scriptPubKey = CScript() << OP_RETURN << (int64_t)k;
+                txn.vpout.push_back(out);
+                }
+                break;
+            case 1:
+                {
+                OUTPUT_PTR<CTxOutCT> out = MAKE_OUTPUT<CTxOutCT>();
+                memset(out->commitment.data, k & 0xFF, 33);
+                out->vData.resize(33, k & 0xFF);
+                out->vRangeproof.resize(k, 0x01);
+                txn.vpout.push_back(out);
+                }
+                break;
+            case 2:
+                {
+                OUTPUT_PTR<CTxOutRingCT> out = MAKE_OUTPUT<CTxOutRingCT>();
+                memset(out->commitment.data, k & 0xFF, 33);
+                out->vData.resize(33, k & 0xFF);
+                out->vRangeproof.resize(k, 0x02);
+                txn.vpout.push_back(out);
+                }
+                break;
+            default:
+                txn.vpout.push_back(MAKE_OUTPUT<CTxOutData>(std::vector<uint8_t>(k, 0x03)));
+                break;
+        };
+    };
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << txn;
+    std::vector<char> vSer(ss.begin(), ss.end());
+
+    CTxOutBaseRef outKept;
+    {
+        CTransactionRef tx;
+        ss >> tx;
+        BOOST_REQUIRE(tx->vpout.size() == txn.vpout.size());
+        for (size_t k = 0; k < tx->vpout.size(); ++k)
+            BOOST_CHECK(tx->vpout[k]->GetType() == txn.vpout[k]->GetType());
+        BOOST_CHECK(tx->GetHash() == txn.GetHash());
+
+        CDataStream ssOut(SER_NETWORK, PROTOCOL_VERSION);
+        ssOut << tx;
+        BOOST_CHECK(std::vector<char>(ssOut.begin(), ssOut.end()) == vSer);
+
+        outKept = tx->vpout[5];
+    }
+
+    // Outputs outlive the transaction
+    BOOST_REQUIRE(outKept->IsType(OUTPUT_CT));
+    BOOST_CHECK(outKept->GetPRangeproof()->size() == 5);
+    BOOST_CHECK(outKept->GetPCommitment()->data[32] == 5);
+
+    // Unknown output type stops deserialisation and leaves the output empty
+    CMutableTransaction txnBad;
+    // version, type, locktime, one input with an empty scriptSig, then a 3 byte output count
+    vSer[1 + 1 + 4 + 1 + (32 + 4 + 1 + 4) + 3] = 0x7F;
+    CDataStream ssBad(vSer, SER_NETWORK, PROTOCOL_VERSION);
+    ssBad >> txnBad;
+    BOOST_CHECK(!txnBad.vpout[0]);
+}
+
+BOOST_AUTO_TEST_CASE(rct_keyimage_filter_test)
+{
+    SeedInsecureRand();
+
+    CRCTKeyImageFilter filter;
+
+    std::vector<CCmpPubKey> vKeyImages;
+    for (size_t k = 0; k < 5000; ++k)
+    {
+        std::vector<uint8_t> v(33);
+        v[0] = 0x02 | (k & 1);
+        uint256 r = InsecureRand256();
+        memcpy(&v[1], r.begin(), 32);
+        vKeyImages.push_back(CCmpPubKey(v));
+    };
+
+    // Unloaded filter can't rule anything out
+    BOOST_CHECK(filter.MaybeContains(vKeyImages[0]));
+
+    filter.Reset(1000);
+    for (size_t k = 0; k < 2000; ++k)
+        filter.Insert(vKeyImages[k]);
+    BOOST_CHECK(!filter.NeedsResize());
+
+    for (size_t k = 0; k < 2000; ++k)
+        BOOST_CHECK(filter.MaybeContains(vKeyImages[k]));
+
+    size_t nFalsePositives = 0;
+    for (size_t k = 2000; k < 5000; ++k)
+        if (filter.MaybeContains(vKeyImages[k]))
+            nFalsePositives++;
+    BOOST_CHECK(nFalsePositives < 30);
+
+    RCTKeyImageFilterStats stats = filter.GetStats();
+    BOOST_CHECK(stats.nElements == 2000);
+    BOOST_CHECK(stats.nSkipped == 3000 - nFalsePositives);
+    BOOST_CHECK(stats.dFPRate > 0.0 && stats.dFPRate < 0.01);
+
+    // Round trip through a file
+    fs::path path = fs::temp_directory_path() / fs::unique_path();
+    {
+        CAutoFile fileout(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+        BOOST_CHECK(filter.Write(fileout));
+    }
+    CRCTKeyImageFilter filterRead;
+    {
+        CAutoFile filein(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        BOOST_CHECK(filterRead.Read(filein));
+    }
+    fs::remove(path);
+    BOOST_CHECK(filterRead.IsLoaded());
+    for (size_t k = 0; k < 5000; ++k)
+        BOOST_CHECK(filterRead.MaybeContains(vKeyImages[k]) == filter.MaybeContains(vKeyImages[k]));
+
+    filter.Clear();
+    BOOST_CHECK(!filter.IsLoaded());
+    BOOST_CHECK(filter.MaybeContains(vKeyImages[4999]));
+}
+
+static CCmpPubKey RandomCmpPubKey()
+{
+    std::vector<uint8_t> v(33);
+    v[0] = 0x02;
+    uint256 r = InsecureRand256();
+    memcpy(&v[1], r.begin(), 32);
+    return CCmpPubKey(v);
+}
+
+BOOST_FIXTURE_TEST_CASE(rct_index_pending_test, TestingSetup)
+{
+    SeedInsecureRand();
+
+    CAnonOutput ao1, ao2, aoRead;
+    ao1.pubkey = RandomCmpPubKey();
+    ao1.nBlockHeight = 250;
+    ao2.pubkey = RandomCmpPubKey();
+    ao2.nBlockHeight = 250;
+    CCmpPubKey ki = RandomCmpPubKey();
+    uint256 txhash = InsecureRand256(), txhashRead;
+    int64_t nIndex;
+
+    // Connect
+    {
+        CCoinsViewCache view(pcoinsTip);
+        view.nBlockHeight = 250;
+        view.nLastRCTOutput = 2;
+        view.anonOutputs.emplace_back(1, ao1);
+        view.anonOutputs.emplace_back(2, ao2);
+        view.anonOutputLinks[ao1.pubkey] = 1;
+        view.anonOutputLinks[ao2.pubkey] = 2;
+        view.keyImages.emplace_back(ki, txhash);
+        BOOST_CHECK(pblocktree->WriteRCTIndex(view, false));
+    }
+
+    // Readable, but not written to the database until flushed
+    BOOST_CHECK(pblocktree->ReadLastRCTOutput(nIndex) && nIndex == 2);
+    BOOST_CHECK(pblocktree->ReadRCTOutput(2, aoRead) && aoRead.pubkey == ao2.pubkey);
+    BOOST_CHECK(pblocktree->ReadRCTOutputLink(ao1.pubkey, nIndex) && nIndex == 1);
+    BOOST_CHECK(pblocktree->ReadRCTKeyImage(ki, txhashRead) && txhashRead == txhash);
+    BOOST_CHECK(pblocktree->ReadRCTOutputCheckpoint(250, nIndex) && nIndex == 2);
+    BOOST_CHECK(!pblocktree->Exists(std::make_pair(DB_RCTOUTPUT, (int64_t)2)));
+    BOOST_CHECK(!pblocktree->Exists(std::make_pair(DB_RCTKEYIMAGE, ki)));
+    BOOST_CHECK(pblocktree->RCTIndexPendingUsage() > 0);
+
+    CRCTOutputTable table;
+    BOOST_CHECK(pblocktree->LoadRCTOutputTable(table));
+    BOOST_CHECK(table.GetLastIndex() == 2);
+    CRCTKeyImageFilter filter;
+    BOOST_CHECK(pblocktree->LoadRCTKeyImageFilter(filter));
+    BOOST_CHECK(filter.GetStats().nElements == 1);
+
+    BOOST_CHECK(pblocktree->FlushRCTIndex());
+    BOOST_CHECK(pblocktree->RCTIndexPendingUsage() == 0);
+    BOOST_CHECK(pblocktree->Exists(std::make_pair(DB_RCTOUTPUT, (int64_t)2)));
+    BOOST_CHECK(pblocktree->Exists(std::make_pair(DB_RCTOUTPUT_LINK, ao2.pubkey)));
+    BOOST_CHECK(pblocktree->Exists(std::make_pair(DB_RCTKEYIMAGE, ki)));
+    BOOST_CHECK(pblocktree->Read(DB_RCTOUTPUT_LAST, nIndex) && nIndex == 2);
+
+    // Disconnect the second output and the key image
+    {
+        CCoinsViewCache view(pcoinsTip);
+        view.nBlockHeight = 250;
+        view.nLastRCTOutput = 1;
+        view.anonOutputLinks[ao2.pubkey] = 2;
+        view.keyImages.emplace_back(ki, txhash);
+        BOOST_CHECK(pblocktree->WriteRCTIndex(view, true));
+    }
+
+    BOOST_CHECK(pblocktree->ReadLastRCTOutput(nIndex) && nIndex == 1);
+    BOOST_CHECK(!pblocktree->ReadRCTOutput(2, aoRead));
+    BOOST_CHECK(!pblocktree->ReadRCTOutputLink(ao2.pubkey, nIndex));
+    BOOST_CHECK(!pblocktree->ReadRCTKeyImage(ki, txhashRead));
+    BOOST_CHECK(pblocktree->ReadRCTOutput(1, aoRead) && aoRead.pubkey == ao1.pubkey);
+    BOOST_CHECK(pblocktree->Exists(std::make_pair(DB_RCTOUTPUT, (int64_t)2)));
+
+    BOOST_CHECK(pblocktree->LoadRCTOutputTable(table));
+    BOOST_CHECK(table.GetLastIndex() == 1);
+    BOOST_CHECK(pblocktree->LoadRCTKeyImageFilter(filter));
+    BOOST_CHECK(filter.GetStats().nElements == 0);
+
+    BOOST_CHECK(pblocktree->FlushRCTIndex());
+    BOOST_CHECK(!pblocktree->Exists(std::make_pair(DB_RCTOUTPUT, (int64_t)2)));
+    BOOST_CHECK(!pblocktree->Exists(std::make_pair(DB_RCTOUTPUT_LINK, ao2.pubkey)));
+    BOOST_CHECK(!pblocktree->Exists(std::make_pair(DB_RCTKEYIMAGE, ki)));
+    BOOST_CHECK(pblocktree->Exists(std::make_pair(DB_RCTOUTPUT, (int64_t)1)));
+    BOOST_CHECK(pblocktree->Read(DB_RCTOUTPUT_LAST, nIndex) && nIndex == 1);
+}
+
 BOOST_AUTO_TEST_CASE(opiscoinstake_test)
 {
     SeedInsecureRand();
@@ -253,4 +494,255 @@ BOOST_AUTO_TEST_CASE(opiscoinstake_test)
 }
 
 
+struct BlindTestingSetup : public ParticlTestingSetup {
+    BlindTestingSetup() { ECC_Start_Blinding(); }
+    ~BlindTestingSetup() { ECC_Stop_Blinding(); }
+};
+
+static void AddBlindOutput(CMutableTransaction &txn, CAmount nValue, const uint8_t *blind)
+{
+    OUTPUT_PTR<CTxOutCT> out = MAKE_OUTPUT<CTxOutCT>();
+    BOOST_REQUIRE(secp256k1_pedersen_commit(secp256k1_ctx_blind, &out->commitment, blind, nValue, secp256k1_generator_h));
+
+    CKey kEphem;
+    InsecureNewKey(kEphem, true);
+    CPubKey pkEphem = kEphem.GetPubKey();
+    out->vData.assign(pkEphem.begin(), pkEphem.end());
+
+    uint256 nonce = InsecureRand256();
+    size_t nRangeProofLen = 5134;
+    out->vRangeproof.resize(nRangeProofLen);
+    BOOST_REQUIRE(secp256k1_rangeproof_sign(secp256k1_ctx_blind,
+        &out->vRangeproof[0], &nRangeProofLen,
+        0, &out->commitment,
+        blind, nonce.begin(),
+        2, 32,
+        nValue,
+        nullptr, 0,
+        nullptr, 0,
+        secp256k1_generator_h));
+    out->vRangeproof.resize(nRangeProofLen);
+
+    txn.vpout.push_back(out);
+}
+
+/** Block on the chain tip with a coinbase and txn */
+static CBlock MakeTestBlock(const CMutableTransaction &txn)
+{
+    CMutableTransaction txnCoinbase;
+    txnCoinbase.nVersion = PARTICL_TXN_VERSION;
+    txnCoinbase.SetType(TXN_COINBASE);
+    txnCoinbase.vin.push_back(CTxIn(COutPoint(), CScript() << 1 << OP_0));
+    txnCoinbase.vpout.push_back(MAKE_OUTPUT<CTxOutStandard>(1 * COIN, CScript() << OP_TRUE));
+
+    CBlock block;
+    block.nTime = chainActive.Tip()->nTime + 1;
+    block.hashPrevBlock = chainActive.Tip()->GetBlockHash();
+    block.vtx.push_back(MakeTransactionRef(txnCoinbase));
+    block.vtx.push_back(MakeTransactionRef(txn));
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    return block;
+}
+
+static bool TestConnectBlock(const CBlock &block, CValidationState &state)
+{
+    LOCK(cs_main);
+    CBlockIndex index(block);
+    index.pprev = chainActive.Tip();
+    index.nHeight = index.pprev->nHeight + 1;
+    CCoinsViewCache view(pcoinsTip);
+    return ConnectBlock(block, state, &index, view, Params(), true);
+}
+
+BOOST_FIXTURE_TEST_CASE(mlsag_check_queue_test, BlindTestingSetup)
+{
+    SeedInsecureRand();
+
+    const size_t nCols = MIN_RINGSIZE, nRows = 2, nRealCol = 1;
+    const CAmount nValue = 10 * COIN, nFee = 1 * COIN;
+
+    uint8_t blindIn[32], blindOut[32], blindZero[32];
+    InsecureRandBytes(blindIn, 32);
+    InsecureRandBytes(blindOut, 32);
+    memset(blindZero, 0, 32);
+
+    // Ring members are read from the RCT output table
+    int64_t nLastIndex = rctOutputTable.GetLastIndex();
+    CKey kReal;
+    std::vector<uint8_t> vMI, vm(nCols * nRows * 33);
+    std::vector<secp256k1_pedersen_commitment> vCommitments(nCols);
+    std::vector<const uint8_t*> vpInCommits(nCols);
+    COutPoint op(InsecureRand256(), 0);
+    for (size_t i = 0; i < nCols; ++i)
+    {
+        CKey key;
+        InsecureNewKey(key, true);
+        uint8_t blind[32];
+        InsecureRandBytes(blind, 32);
+        if (i == nRealCol)
+        {
+            kReal = key;
+            memcpy(blind, blindIn, 32);
+        };
+        BOOST_REQUIRE(secp256k1_pedersen_commit(secp256k1_ctx_blind, &vCommitments[i], blind, nValue, secp256k1_generator_h));
+        vpInCommits[i] = vCommitments[i].data;
+
+        CPubKey pk = key.GetPubKey();
+        memcpy(&vm[i * 33], pk.begin(), 33);
+
+        CAnonOutput ao(CCmpPubKey(pk.begin(), pk.end()), vCommitments[i], op, 0, 0);
+        BOOST_REQUIRE(rctOutputTable.Set(nLastIndex + 1 + i, ao));
+        PutVarInt(vMI, nLastIndex + 1 + i);
+    };
+
+    CMutableTransaction txn;
+    txn.nVersion = PARTICL_TXN_VERSION;
+    CTxIn txin;
+    txin.prevout.n = CTxIn::ANON_MARKER;
+    txin.SetAnonInfo(1, nCols);
+    std::vector<uint8_t> vKeyImage(33);
+    BOOST_REQUIRE(0 == secp256k1_get_keyimage(secp256k1_ctx_blind, &vKeyImage[0], &vm[nRealCol * 33], kReal.begin()));
+    txin.scriptData.stack.push_back(vKeyImage);
+    txin.scriptWitness.stack.push_back(vMI);
+    txn.vin.push_back(txin);
+
+    std::vector<uint8_t> vFee(1, DO_FEE);
+    PutVarInt(vFee, nFee);
+    txn.vpout.push_back(MAKE_OUTPUT<CTxOutData>(vFee));
+    AddBlindOutput(txn, nValue - nFee, blindOut);
+
+    // Sign as the wallet does, the fee is a plain output with a zero blinding factor
+    secp256k1_pedersen_commitment plainCommitment;
+    BOOST_REQUIRE(secp256k1_pedersen_commit(secp256k1_ctx_blind, &plainCommitment, blindZero, nFee, secp256k1_generator_h));
+    const uint8_t *vpOutCommits[2] = {plainCommitment.data, txn.vpout[1]->GetPCommitment()->data};
+    const uint8_t *vpBlinds[3] = {blindIn, blindZero, blindOut};
+    uint8_t blindSum[32];
+    BOOST_REQUIRE(0 == secp256k1_prepare_mlsag(&vm[0], blindSum,
+        2, 2, nCols, nRows,
+        &vpInCommits[0], vpOutCommits, vpBlinds));
+
+    const uint8_t *vpsk[2] = {kReal.begin(), blindSum};
+    uint8_t randSeed[32];
+    InsecureRandBytes(randSeed, 32);
+    std::vector<uint8_t> vDL((1 + nRows * nCols) * 32);
+    uint256 txhash = txn.GetHash();
+    BOOST_REQUIRE(0 == secp256k1_generate_mlsag(secp256k1_ctx_blind, &txn.vin[0].scriptData.stack[0][0], &vDL[0], &vDL[32],
+        randSeed, txhash.begin(), nCols, nRows, nRealCol,
+        vpsk, &vm[0]));
+    txn.vin[0].scriptWitness.stack.push_back(vDL);
+
+    CMutableTransaction txnBad(txn);
+    txnBad.vin[0].scriptWitness.stack[1][32] ^= 1;
+
+    CTransaction tx(txn), txBad(txnBad);
+    std::vector<CScriptCheck> vChecks;
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(VerifyMLSAG(tx, state, &vChecks, false));
+        BOOST_REQUIRE(vChecks.size() == 1);
+        BOOST_CHECK(vChecks[0]());
+
+        // A bad signature is only found by the deferred check
+        vChecks.clear();
+        BOOST_CHECK(VerifyMLSAG(txBad, state, &vChecks, false));
+        BOOST_REQUIRE(vChecks.size() == 1);
+        BOOST_CHECK(!vChecks[0]());
+
+        BOOST_CHECK(!VerifyMLSAG(txBad, state, nullptr, false));
+        BOOST_CHECK(state.GetRejectReason() == "verify-mlsag-failed");
+    }
+
+    // ConnectBlock fails on the check queue
+    BOOST_REQUIRE(nScriptCheckThreads > 0);
+    {
+        CValidationState state;
+        BOOST_CHECK(!TestConnectBlock(MakeTestBlock(txnBad), state));
+        BOOST_CHECK(state.GetRejectReason() == "block-validation-failed");
+    }
+
+    // A spent key image is rejected inline, before any check is queued
+    {
+        LOCK(cs_main);
+        CCoinsViewCache view(pcoinsTip);
+        view.nBlockHeight = 1;
+        view.keyImages.emplace_back(CCmpPubKey(vKeyImage.begin(), vKeyImage.end()), InsecureRand256());
+        BOOST_CHECK(pblocktree->WriteRCTIndex(view, false));
+
+        CValidationState state;
+        vChecks.clear();
+        BOOST_CHECK(!VerifyMLSAG(tx, state, &vChecks, false));
+        BOOST_CHECK(state.GetRejectReason() == "bad-anonin-dup-ki");
+        BOOST_CHECK(vChecks.empty());
+    }
+    {
+        CValidationState state;
+        BOOST_CHECK(!TestConnectBlock(MakeTestBlock(txn), state));
+        BOOST_CHECK(state.GetRejectReason() == "bad-anonin-dup-ki");
+    }
+
+    rctOutputTable.Truncate(nLastIndex);
+}
+
+
+BOOST_FIXTURE_TEST_CASE(rangeproof_check_queue_test, BlindTestingSetup)
+{
+    SeedInsecureRand();
+    const Consensus::Params &consensusParams = Params().GetConsensus();
+
+    uint8_t blind[2][32];
+    InsecureRandBytes(blind[0], 32);
+    InsecureRandBytes(blind[1], 32);
+
+    CMutableTransaction txn;
+    txn.nVersion = PARTICL_TXN_VERSION;
+    txn.vin.push_back(CTxIn(InsecureRand256(), 0));
+    AddBlindOutput(txn, 5 * COIN, blind[0]);
+    AddBlindOutput(txn, 3 * COIN, blind[1]);
+
+    // Outputs are shared, copy the one to corrupt
+    CMutableTransaction txnBad(txn);
+    OUTPUT_PTR<CTxOutCT> outBad = MAKE_OUTPUT<CTxOutCT>(*((CTxOutCT*)txn.vpout[1].get()));
+    outBad->vRangeproof[64] ^= 1;
+    txnBad.vpout[1] = outBad;
+
+    CBlock block = MakeTestBlock(txn);
+    CBlock blockBad = MakeTestBlock(txnBad);
+
+    // Verified on the script check threads
+    BOOST_REQUIRE(nScriptCheckThreads > 0);
+    {
+        CValidationState state;
+        BOOST_CHECK(!CheckBlock(blockBad, state, consensusParams, false, false, true));
+        BOOST_CHECK(state.GetRejectReason() == "bad-rangeproof-verify");
+    }
+    {
+        CValidationState state;
+        BOOST_CHECK(CheckBlock(block, state, consensusParams, false, false, true));
+    }
+
+    // Verified inline by CheckTransaction
+    {
+        CValidationState state;
+        BOOST_CHECK(!CheckBlock(blockBad, state, consensusParams, false, false, false));
+        BOOST_CHECK(state.GetRejectReason() == "bad-ctout-rangeproof-verify");
+    }
+    {
+        CValidationState state;
+        BOOST_CHECK(CheckBlock(block, state, consensusParams, false, false, false));
+    }
+
+    // Skipped while importing with -skiprangeproofverify
+    fBusyImporting = true;
+    fSkipRangeproof = true;
+    for (bool fUseCheckQueue : {true, false})
+    {
+        CValidationState state;
+        BOOST_CHECK(CheckBlock(block, state, consensusParams, false, false, fUseCheckQueue));
+        BOOST_CHECK(CheckBlock(blockBad, state, consensusParams, false, false, fUseCheckQueue));
+    };
+    fBusyImporting = false;
+    fSkipRangeproof = false;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
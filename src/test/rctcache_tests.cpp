@@ -0,0 +1,152 @@
+// Copyright (c) 2017 The Particl Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_particl.h"
+
+#include "rctcache.h"
+#include "util.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(rctcache_tests, BasicTestingSetup)
+
+static void RandomCommitment(secp256k1_pedersen_commitment &commitment)
+{
+    uint256 r = InsecureRand256();
+    commitment.data[0] = 0x08;
+    memcpy(&commitment.data[1], r.begin(), 32);
+}
+
+static std::vector<uint8_t> RandomVector(size_t n)
+{
+    std::vector<uint8_t> v(n);
+    for (auto &c : v)
+        c = InsecureRandBits(8);
+    return v;
+}
+
+BOOST_AUTO_TEST_CASE(rctcache_get_set)
+{
+    SeedInsecureRand(true);
+
+    secp256k1_pedersen_commitment commitment;
+    RandomCommitment(commitment);
+    std::vector<uint8_t> vRangeproof = RandomVector(2893);
+
+    RCTCacheStats stats = GetRCTCacheStats();
+
+    uint256 entry = RCTCacheRangeproofEntry(&commitment, vRangeproof);
+    BOOST_CHECK(entry == RCTCacheRangeproofEntry(&commitment, vRangeproof));
+    BOOST_CHECK(!RCTCacheGet(entry, false));
+    RCTCacheSet(entry);
+    BOOST_CHECK(RCTCacheGet(entry, false));
+    BOOST_CHECK(RCTCacheGet(entry, false));
+
+    uint256 txhash = InsecureRand256();
+    std::vector<uint8_t> vM = RandomVector(3 * 2 * 33), vKeyImages = RandomVector(33), vDL = RandomVector((1 + 3 * 2) * 32);
+    entry = RCTCacheMLSAGEntry(txhash, 0, 3, 2, vM, vKeyImages, vDL);
+    BOOST_CHECK(!RCTCacheGet(entry, false));
+    RCTCacheSet(entry);
+    BOOST_CHECK(RCTCacheGet(entry, false));
+
+    RCTCacheStats statsAfter = GetRCTCacheStats();
+    BOOST_CHECK(statsAfter.nHits - stats.nHits == 3);
+    BOOST_CHECK(statsAfter.nMisses - stats.nMisses == 2);
+    BOOST_CHECK(statsAfter.nInserts - stats.nInserts == 2);
+}
+
+BOOST_AUTO_TEST_CASE(rctcache_entries)
+{
+    SeedInsecureRand(true);
+
+    secp256k1_pedersen_commitment commitment;
+    RandomCommitment(commitment);
+    std::vector<uint8_t> vRangeproof = RandomVector(2893);
+
+    uint256 entry = RCTCacheRangeproofEntry(&commitment, vRangeproof);
+    RCTCacheSet(entry);
+
+    // Any change to the verified data is a different entry
+    std::vector<uint256> vOther;
+    std::vector<uint8_t> vRangeproofChanged = vRangeproof;
+    vRangeproofChanged[1000] ^= 1;
+    vOther.push_back(RCTCacheRangeproofEntry(&commitment, vRangeproofChanged));
+    vRangeproofChanged = vRangeproof;
+    vRangeproofChanged.pop_back();
+    vOther.push_back(RCTCacheRangeproofEntry(&commitment, vRangeproofChanged));
+    secp256k1_pedersen_commitment commitmentChanged = commitment;
+    commitmentChanged.data[32] ^= 1;
+    vOther.push_back(RCTCacheRangeproofEntry(&commitmentChanged, vRangeproof));
+
+    uint256 txhash = InsecureRand256();
+    std::vector<uint8_t> vM = RandomVector(3 * 2 * 33), vKeyImages = RandomVector(33), vDL = RandomVector((1 + 3 * 2) * 32);
+    uint256 entryMLSAG = RCTCacheMLSAGEntry(txhash, 0, 3, 2, vM, vKeyImages, vDL);
+    RCTCacheSet(entryMLSAG);
+
+    std::vector<uint8_t> vChanged = vM;
+    vChanged[100] ^= 1;
+    vOther.push_back(RCTCacheMLSAGEntry(txhash, 0, 3, 2, vChanged, vKeyImages, vDL));
+    vChanged = vDL;
+    vChanged[40] ^= 1;
+    vOther.push_back(RCTCacheMLSAGEntry(txhash, 0, 3, 2, vM, vKeyImages, vChanged));
+    vChanged = vKeyImages;
+    vChanged[10] ^= 1;
+    vOther.push_back(RCTCacheMLSAGEntry(txhash, 0, 3, 2, vM, vChanged, vDL));
+    vOther.push_back(RCTCacheMLSAGEntry(txhash, 1, 3, 2, vM, vKeyImages, vDL));
+    vOther.push_back(RCTCacheMLSAGEntry(txhash, 0, 2, 3, vM, vKeyImages, vDL));
+    vOther.push_back(RCTCacheMLSAGEntry(InsecureRand256(), 0, 3, 2, vM, vKeyImages, vDL));
+
+    for (const auto &other : vOther)
+    {
+        BOOST_CHECK(other != entry);
+        BOOST_CHECK(other != entryMLSAG);
+        BOOST_CHECK(!RCTCacheGet(other, false));
+    };
+    BOOST_CHECK(RCTCacheGet(entry, false));
+    BOOST_CHECK(RCTCacheGet(entryMLSAG, false));
+}
+
+/** As test_cache_erase in cuckoocache_tests, through RCTCacheGet with erase set */
+BOOST_AUTO_TEST_CASE(rctcache_erase)
+{
+    SeedInsecureRand(true);
+
+    gArgs.ForceSetArg("-rctcachesize", "1");
+    InitRCTCache();
+
+    uint32_t n_insert = GetRCTCacheStats().nMaxElements;
+    std::vector<uint256> hashes(n_insert);
+    for (auto &h : hashes)
+        h = InsecureRand256();
+
+    // Insert the first half and erase the first quarter on a hit
+    for (uint32_t i = 0; i < (n_insert / 2); ++i)
+        RCTCacheSet(hashes[i]);
+    for (uint32_t i = 0; i < (n_insert / 4); ++i)
+        BOOST_CHECK(RCTCacheGet(hashes[i], true));
+    for (uint32_t i = (n_insert / 2); i < n_insert; ++i)
+        RCTCacheSet(hashes[i]);
+
+    size_t count_erased_but_contained = 0;
+    size_t count_stale = 0;
+    size_t count_fresh = 0;
+    for (uint32_t i = 0; i < (n_insert / 4); ++i)
+        count_erased_but_contained += RCTCacheGet(hashes[i], false);
+    for (uint32_t i = (n_insert / 4); i < (n_insert / 2); ++i)
+        count_stale += RCTCacheGet(hashes[i], false);
+    for (uint32_t i = (n_insert / 2); i < n_insert; ++i)
+        count_fresh += RCTCacheGet(hashes[i], false);
+
+    double hit_rate_erased_but_contained = double(count_erased_but_contained) / (double(n_insert) / 4.0);
+    double hit_rate_stale = double(count_stale) / (double(n_insert) / 4.0);
+    double hit_rate_fresh = double(count_fresh) / (double(n_insert) / 2.0);
+
+    BOOST_CHECK_EQUAL(hit_rate_fresh, 1.0);
+    BOOST_CHECK(hit_rate_stale > 2 * hit_rate_erased_but_contained);
+
+    gArgs.ForceSetArg("-rctcachesize", std::to_string(DEFAULT_RCT_CACHE_SIZE));
+    InitRCTCache();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -232,4 +232,77 @@ BOOST_AUTO_TEST_CASE(sighash_from_data)
             BOOST_CHECK_MESSAGE(sh.GetHex() == sigHashHex, strTest);
     }
 }
+
+// Goal: check that the midstates in PrecomputedTransactionData give the same hash as SignatureHash without a cache
+BOOST_AUTO_TEST_CASE(sighash_precomputed)
+{
+    SeedInsecureRand(false);
+
+    for (int i = 0; i < 200; i++) {
+        CMutableTransaction txTo;
+        txTo.nVersion = PARTICL_TXN_VERSION;
+        txTo.nLockTime = (InsecureRandBool()) ? InsecureRand32() : 0;
+        int ins = (InsecureRandBits(3)) + 1;
+        for (int in = 0; in < ins; in++) {
+            txTo.vin.push_back(CTxIn(InsecureRand256(), InsecureRandBits(2)));
+            txTo.vin.back().nSequence = (InsecureRandBool()) ? InsecureRand32() : (unsigned int)-1;
+        }
+        int outs = (InsecureRandBits(3)) + 1;
+        for (int out = 0; out < outs; out++) {
+            switch (InsecureRandRange(4)) {
+                case 0:
+                    {
+                    OUTPUT_PTR<CTxOutStandard> txout = MAKE_OUTPUT<CTxOutStandard>();
+                    txout->nValue = InsecureRandRange(100000000);
+                    RandomScript(txout->scriptPubKey);
+                    txTo.vpout.push_back(txout);
+                    }
+                    break;
+                case 1:
+                    {
+                    OUTPUT_PTR<CTxOutCT> txout = MAKE_OUTPUT<CTxOutCT>();
+                    memset(txout->commitment.data, InsecureRandBits(8), 33);
+                    RandomScript(txout->scriptPubKey);
+                    txout->vRangeproof.resize(InsecureRandRange(6000), InsecureRandBits(8));
+                    txTo.vpout.push_back(txout);
+                    }
+                    break;
+                case 2:
+                    {
+                    OUTPUT_PTR<CTxOutRingCT> txout = MAKE_OUTPUT<CTxOutRingCT>();
+                    memset(txout->commitment.data, InsecureRandBits(8), 33);
+                    txout->vData.resize(33, InsecureRandBits(8));
+                    txout->vRangeproof.resize(InsecureRandRange(6000), InsecureRandBits(8));
+                    txTo.vpout.push_back(txout);
+                    }
+                    break;
+                default:
+                    txTo.vpout.push_back(MAKE_OUTPUT<CTxOutData>(std::vector<uint8_t>(InsecureRandRange(100), 0x01)));
+                    break;
+            }
+        }
+
+        const CTransaction tx(txTo);
+        PrecomputedTransactionData txdata(tx);
+        BOOST_CHECK(txdata.fReady);
+
+        for (int k = 0; k < 8; k++) {
+            int nHashType = InsecureRand32();
+            CScript scriptCode;
+            RandomScript(scriptCode);
+            int nIn = InsecureRandRange(tx.vin.size());
+            std::vector<uint8_t> vchAmount(InsecureRandBool() ? 8 : 33, InsecureRandBits(8));
+
+            BOOST_CHECK(SignatureHash(scriptCode, tx, nIn, nHashType, vchAmount, SIGVERSION_BASE, &txdata)
+                == SignatureHash(scriptCode, tx, nIn, nHashType, vchAmount, SIGVERSION_BASE));
+        }
+    }
+
+    // Nothing is precomputed when every input is anon
+    CMutableTransaction txAnon;
+    txAnon.nVersion = PARTICL_TXN_VERSION;
+    txAnon.vin.push_back(CTxIn(COutPoint(uint256(), CTxIn::ANON_MARKER)));
+    txAnon.vpout.push_back(MAKE_OUTPUT<CTxOutData>(std::vector<uint8_t>(10, 0x01)));
+    BOOST_CHECK(!PrecomputedTransactionData(CTransaction(txAnon)).fReady);
+}
 BOOST_AUTO_TEST_SUITE_END()
@@ -3,21 +3,28 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "smsg/smessage.h"
+#include "smsg/db.h"
 
 #include "test/test_particl.h"
 #include "net.h"
+#include "net_processing.h"
+#include "random.h"
+#include "timedata.h"
+#include "fs.h"
+#include "crypto/hmac_sha256.h"
+#include "crypto/sha512.h"
 
 #ifdef ENABLE_WALLET
 #include "wallet/wallet.h"
 #endif
 
+#include <secp256k1.h>
+
 #include <boost/test/unit_test.hpp>
 
-struct SmsgTestingSetup : public TestingSetup {
-    SmsgTestingSetup() : TestingSetup(CBaseChainParams::MAIN, true) {}
-};
+extern secp256k1_context *secp256k1_context_smsg;
 
-BOOST_FIXTURE_TEST_SUITE(smsg_tests, SmsgTestingSetup)
+BOOST_FIXTURE_TEST_SUITE(smsg_tests, ParticlTestingSetup)
 
 
 
@@ -100,4 +107,434 @@ BOOST_AUTO_TEST_CASE(smsg_test)
 #endif
 }
 
+BOOST_AUTO_TEST_CASE(smsg_store_index)
+{
+    SeedInsecureRand();
+
+    const size_t nMessages = 20;
+    int64_t now = GetAdjustedTime();
+    int64_t bucketTime = now - (now % SMSG_BUCKET_LEN);
+
+    std::vector<std::vector<uint8_t> > vMessages;
+    {
+        LOCK(cs_smsg);
+        for (size_t i = 0; i < nMessages; ++i)
+        {
+            std::vector<uint8_t> vchMsg(SMSG_HDR_LEN + 16 + i * 7);
+            GetRandBytes(vchMsg.data(), vchMsg.size());
+            SecureMessage *psmsg = (SecureMessage*) vchMsg.data();
+            psmsg->version[0] = 2;
+            psmsg->timestamp = bucketTime + (int64_t)(i % 4);
+            psmsg->nPayload = vchMsg.size() - SMSG_HDR_LEN;
+            BOOST_CHECK(0 == SecureMsgStore(&vchMsg[0], &vchMsg[SMSG_HDR_LEN], psmsg->nPayload, true));
+            vMessages.push_back(vchMsg);
+        };
+    }
+
+    auto checkRetrieve = [&]()
+    {
+        LOCK(cs_smsg);
+        const SecMsgBucket &bucket = smsgBuckets[bucketTime];
+        BOOST_CHECK(bucket.setTokens.size() == nMessages);
+
+        std::vector<SecMsgToken> vTokens(bucket.setTokens.begin(), bucket.setTokens.end());
+        std::vector<uint8_t> vchData;
+        uint32_t nRetrieved = 0;
+        BOOST_CHECK(0 == SecureMsgRetrieve(bucketTime, vTokens, vchData, nRetrieved, 500, 96000));
+        BOOST_CHECK(nRetrieved == nMessages);
+
+        // Every message must come back whole, in token order
+        size_t ofs = 0;
+        for (const auto &token : vTokens)
+        {
+            bool fFound = false;
+            for (const auto &vchMsg : vMessages)
+            {
+                if (ofs + vchMsg.size() > vchData.size()
+                    || memcmp(&vchData[ofs], vchMsg.data(), vchMsg.size()) != 0)
+                    continue;
+                BOOST_CHECK(memcmp(&vchMsg[SMSG_HDR_LEN], token.sample, 8) == 0);
+                ofs += vchMsg.size();
+                fFound = true;
+                break;
+            };
+            BOOST_CHECK(fFound);
+        };
+        BOOST_CHECK(ofs == vchData.size());
+
+        // Limits
+        vchData.clear();
+        BOOST_CHECK(0 == SecureMsgRetrieve(bucketTime, vTokens, vchData, nRetrieved, 3, 96000));
+        BOOST_CHECK(nRetrieved == 3);
+    };
+
+    checkRetrieve();
+
+    // Rebuild from the index
+    uint32_t hash;
+    {
+        LOCK(cs_smsg);
+        hash = smsgBuckets[bucketTime].hash;
+        smsgBuckets.clear();
+    }
+    BOOST_CHECK(0 == SecureMsgBuildBucketSet());
+    checkRetrieve();
+    {
+        LOCK(cs_smsg);
+        BOOST_CHECK(smsgBuckets[bucketTime].hash == hash);
+    }
+
+    // A damaged index is rebuilt from the bucket file
+    fs::path pathIdx = GetDataDir() / "smsgstore" / (std::to_string(bucketTime) + "_01.idx");
+    BOOST_CHECK(fs::exists(pathIdx));
+    fs::resize_file(pathIdx, fs::file_size(pathIdx) - 3);
+    {
+        LOCK(cs_smsg);
+        smsgBuckets.clear();
+    }
+    BOOST_CHECK(0 == SecureMsgBuildBucketSet());
+    checkRetrieve();
+
+    // Missing index
+    fs::remove(pathIdx);
+    {
+        LOCK(cs_smsg);
+        smsgBuckets.clear();
+    }
+    BOOST_CHECK(0 == SecureMsgBuildBucketSet());
+    checkRetrieve();
+    BOOST_CHECK(fs::exists(pathIdx));
+
+    {
+        LOCK(cs_smsg);
+        SecureMsgRemoveBucketFiles(bucketTime);
+        smsgBuckets.clear();
+    }
+    BOOST_CHECK(!fs::exists(pathIdx));
+}
+
+BOOST_AUTO_TEST_CASE(smsg_db_snapshot)
+{
+    SecMsgStored smsgStored;
+    smsgStored.timeReceived = GetTime();
+    smsgStored.status = SMSG_MASK_UNREAD;
+    smsgStored.folderId = 0;
+    smsgStored.vchMessage.resize(SMSG_HDR_LEN + 8);
+
+    uint8_t chKey[18];
+    memset(chKey, 0, sizeof(chKey));
+    memcpy(chKey, "im", 2);
+
+    SecMsgDB db;
+    {
+        LOCK(cs_smsgDB);
+        BOOST_REQUIRE(db.Open("cw"));
+        chKey[17] = 1;
+        BOOST_CHECK(db.WriteSmesg(chKey, smsgStored));
+        BOOST_CHECK(db.Snapshot());
+    }
+
+    {
+        // Writes after the snapshot are visible to reads, not to snapshot iterators
+        LOCK(cs_smsgDB);
+        SecMsgDB dbWrite;
+        BOOST_REQUIRE(dbWrite.Open("cw"));
+        chKey[17] = 2;
+        BOOST_CHECK(dbWrite.WriteSmesg(chKey, smsgStored));
+    }
+    BOOST_CHECK(db.ReadSmesg(chKey, smsgStored));
+
+    {
+        // The db stays open while a SecMsgDB refers to it
+        LOCK(cs_smsgDB);
+        smsgDB.reset();
+    }
+
+    std::string sPrefix("im");
+    size_t nFound = 0;
+    leveldb::Iterator *it = db.NewIterator();
+    while (db.NextSmesg(it, sPrefix, chKey, smsgStored))
+    {
+        BOOST_CHECK(chKey[17] == 1);
+        nFound++;
+    };
+    delete it;
+    BOOST_CHECK(nFound == 1);
+}
+
+BOOST_AUTO_TEST_CASE(smsg_match_scan_keys)
+{
+    SeedInsecureRand();
+
+    bool fOwnContext = !secp256k1_context_smsg;
+    if (fOwnContext)
+        secp256k1_context_smsg = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+
+    const size_t nKeys = 600;
+    std::vector<SecMsgScanKey> vKeys(nKeys);
+    for (auto &sk : vKeys)
+    {
+        InsecureNewKey(sk.key, true);
+        sk.address = sk.key.GetPubKey().GetID();
+    };
+
+    std::vector<uint8_t> vchMsg(SMSG_HDR_LEN + 100);
+    GetRandBytes(vchMsg.data(), vchMsg.size());
+    SecureMessage *psmsg = (SecureMessage*) vchMsg.data();
+    psmsg->version[0] = 2;
+    psmsg->nPayload = vchMsg.size() - SMSG_HDR_LEN;
+    CKey keyR;
+    InsecureNewKey(keyR, true);
+    memcpy(psmsg->cpkR, keyR.GetPubKey().begin(), 33);
+
+    size_t nMatch = 0;
+    BOOST_CHECK(SMSG_MAC_MISMATCH == SecureMsgMatchScanKeys(vKeys, &vchMsg[0], &vchMsg[SMSG_HDR_LEN], psmsg->nPayload, 0, nMatch, 4));
+
+    for (size_t nTo : {(size_t)0, (size_t)7, nKeys-1})
+    {
+        // MAC the message for key nTo, as SecureMsgEncrypt does
+        uint256 P = keyR.ECDH(vKeys[nTo].key.GetPubKey());
+        uint8_t H[64];
+        CSHA512().Write(P.begin(), 32).Finalize(H);
+        CHMAC_SHA256 ctx(&H[32], 32);
+        ctx.Write((uint8_t*) &psmsg->timestamp, sizeof(psmsg->timestamp));
+        ctx.Write((uint8_t*) psmsg->iv, sizeof(psmsg->iv));
+        ctx.Write(&vchMsg[SMSG_HDR_LEN], psmsg->nPayload);
+        ctx.Finalize(psmsg->mac);
+
+        for (size_t nThreads : {1, 4, 64})
+        {
+            BOOST_CHECK(0 == SecureMsgMatchScanKeys(vKeys, &vchMsg[0], &vchMsg[SMSG_HDR_LEN], psmsg->nPayload, 0, nMatch, nThreads));
+            BOOST_CHECK(nMatch == nTo);
+            BOOST_CHECK(SMSG_MAC_MISMATCH == SecureMsgMatchScanKeys(vKeys, &vchMsg[0], &vchMsg[SMSG_HDR_LEN], psmsg->nPayload, nTo+1, nMatch, nThreads));
+        };
+    };
+
+    if (fOwnContext)
+    {
+        secp256k1_context_destroy(secp256k1_context_smsg);
+        secp256k1_context_smsg = nullptr;
+    };
+}
+
+static SecMsgToken RandomToken(int64_t timestamp)
+{
+    uint8_t sample[8];
+    GetRandBytes(sample, 8);
+    return SecMsgToken(timestamp, sample, 8, 0, 2);
+}
+
+static std::vector<SecMsgToken> ParseHaveTokens(const std::vector<uint8_t> &vchHave)
+{
+    std::vector<SecMsgToken> vTokens;
+    for (size_t i = 8; i + 16 <= vchHave.size(); i += 16)
+    {
+        SecMsgToken token;
+        memcpy(&token.timestamp, &vchHave[i], 8);
+        memcpy(token.sample, &vchHave[i+8], 8);
+        token.offset = 0;
+        token.ttl = 2;
+        vTokens.push_back(token);
+    };
+    return vTokens;
+}
+
+BOOST_AUTO_TEST_CASE(smsg_sub_bucket_digest)
+{
+    SeedInsecureRand();
+    int64_t now = GetAdjustedTime();
+    int64_t time = now - now % SMSG_BUCKET_LEN;
+
+    std::set<SecMsgToken> setPeer, setLocal;
+    for (int i = 0; i < 500; ++i)
+        setPeer.insert(RandomToken(time + i % SMSG_BUCKET_LEN));
+    setLocal = setPeer;
+
+    // Local is missing some of the peer's tokens and holds an expired token
+    std::set<SecMsgToken> setMissing;
+    while (setMissing.size() < 20)
+    {
+        auto it = std::next(setLocal.begin(), InsecureRandRange(setLocal.size()));
+        setMissing.insert(*it);
+        setLocal.erase(it);
+    };
+    SecMsgToken tokenExpired = RandomToken(time - 3 * SMSG_SECONDS_IN_DAY);
+    setLocal.insert(tokenExpired);
+
+    uint8_t digestPeer[SMSG_SUB_DIGEST_SIZE], digestLocal[SMSG_SUB_DIGEST_SIZE];
+    SecureMsgSubBucketDigest(setPeer, now, digestPeer);
+    BOOST_CHECK(SecureMsgSubBucketMask(setPeer, now, digestPeer) == 0);
+
+    // Only the sub-buckets holding the missing tokens are requested
+    uint64_t nMask = SecureMsgSubBucketMask(setLocal, now, digestPeer);
+    uint64_t nMaskExpect = 0;
+    for (const auto &token : setMissing)
+        nMaskExpect |= ((uint64_t)1) << (token.sample[0] % SMSG_SUB_BUCKETS);
+    BOOST_CHECK(nMask == nMaskExpect);
+
+    // The peer lists every token in the requested sub-buckets, adding them makes the digests match
+    std::vector<uint8_t> vchHave;
+    SecureMsgListTokens(setPeer, time, now, nMask, vchHave);
+    int64_t timeHave;
+    memcpy(&timeHave, &vchHave[0], 8);
+    BOOST_CHECK(timeHave == time);
+    std::vector<SecMsgToken> vListed = ParseHaveTokens(vchHave);
+    BOOST_CHECK(vListed.size() < setPeer.size());
+    for (const auto &token : vListed)
+        BOOST_CHECK((nMask >> (token.sample[0] % SMSG_SUB_BUCKETS)) & 1);
+    for (const auto &token : setMissing)
+        BOOST_CHECK(std::find_if(vListed.begin(), vListed.end(), [&](const SecMsgToken &t) {
+            return !(t < token) && !(token < t); }) != vListed.end());
+
+    setLocal.insert(vListed.begin(), vListed.end());
+    BOOST_CHECK(SecureMsgSubBucketMask(setLocal, now, digestPeer) == 0);
+    SecureMsgSubBucketDigest(setLocal, now, digestLocal);
+    BOOST_CHECK(memcmp(digestLocal, digestPeer, SMSG_SUB_DIGEST_SIZE) == 0);
+
+    // Sub-buckets the peer has no tokens in are never requested
+    BOOST_CHECK(SecureMsgSubBucketMask(setLocal, now, digestLocal) == 0);
+    SecureMsgSubBucketDigest(std::set<SecMsgToken>(), now, digestLocal);
+    BOOST_CHECK(SecureMsgSubBucketMask(setPeer, now, digestLocal) == 0);
+}
+
+static int ReceiveSmsg(CNode &node, const std::string &strCommand, const std::vector<uint8_t> &vchData, bool fData=true)
+{
+    CDataStream vRecv(SER_NETWORK, PROTOCOL_VERSION);
+    if (fData)
+        vRecv << vchData;
+    return SecureMsgReceiveData(&node, strCommand, vRecv);
+}
+
+static uint64_t SentBytes(CNode &node, const std::string &strCommand)
+{
+    CNodeStats stats;
+    node.copyStats(stats);
+    auto it = stats.mapSendBytesPerMsgCmd.find(strCommand);
+    return it == stats.mapSendBytesPerMsgCmd.end() ? 0 : it->second;
+}
+
+static int GetMisbehavior(CNode &node)
+{
+    CNodeStateStats stats;
+    BOOST_REQUIRE(GetNodeStateStats(node.GetId(), stats));
+    return stats.nMisbehavior;
+}
+
+BOOST_AUTO_TEST_CASE(smsg_sub_bucket_protocol)
+{
+    SeedInsecureRand();
+    bool fSecMsgEnabledBefore = fSecMsgEnabled;
+    fSecMsgEnabled = true;
+
+    CNode node(0, NODE_NETWORK, 0, INVALID_SOCKET, CAddress(), 0, 0, CAddress(), "", true);
+    node.SetSendVersion(PROTOCOL_VERSION);
+    node.nVersion = PROTOCOL_VERSION;
+    peerLogic->InitializeNode(&node);
+
+    int64_t now = GetAdjustedTime();
+    int64_t time = now - now % SMSG_BUCKET_LEN;
+    int64_t timeUnknown = time - SMSG_BUCKET_LEN;
+    {
+        LOCK(cs_smsg);
+        smsgBuckets.erase(time);
+        smsgBuckets.erase(timeUnknown);
+        for (int i = 0; i < 100; ++i)
+            smsgBuckets[time].setTokens.insert(RandomToken(time));
+        smsgBuckets[time].hashBucket();
+    }
+
+    std::vector<uint8_t> vchFlags(4);
+    uint32_t nFlags = SMSG_PROTO_SUB_BUCKETS;
+    memcpy(&vchFlags[0], &nFlags, 4);
+
+    // Old peers send smsgPing without the flag word
+    BOOST_CHECK(SMSG_NO_ERROR == ReceiveSmsg(node, "smsgPing", std::vector<uint8_t>(), false));
+    BOOST_CHECK(node.smsgData.nProtoFlags == 0);
+    BOOST_CHECK(SentBytes(node, "smsgPong") > 0);
+
+    // smsgInv asks an old peer for the tokens of a bucket that differs
+    std::vector<uint8_t> vchInv(4 + 16);
+    uint32_t nInvBuckets = 1, nContent = 200, nHash = 1;
+    memcpy(&vchInv[0], &nInvBuckets, 4);
+    memcpy(&vchInv[4], &time, 8);
+    memcpy(&vchInv[12], &nContent, 4);
+    memcpy(&vchInv[16], &nHash, 4);
+    BOOST_CHECK(SMSG_NO_ERROR == ReceiveSmsg(node, "smsgInv", vchInv));
+    BOOST_CHECK(SentBytes(node, "smsgShow") > 0);
+    BOOST_CHECK(SentBytes(node, "smsgShowSub") == 0);
+
+    // Peers advertising SMSG_PROTO_SUB_BUCKETS in smsgPing or smsgPong are asked for the digest
+    BOOST_CHECK(SMSG_NO_ERROR == ReceiveSmsg(node, "smsgPong", vchFlags));
+    BOOST_CHECK(node.smsgData.nProtoFlags == SMSG_PROTO_SUB_BUCKETS);
+    BOOST_CHECK(node.smsgData.fEnabled);
+    BOOST_CHECK(SMSG_NO_ERROR == ReceiveSmsg(node, "smsgInv", vchInv));
+    BOOST_CHECK(SentBytes(node, "smsgShowSub") > 0);
+
+    node.smsgData.nProtoFlags = 0;
+    BOOST_CHECK(SMSG_NO_ERROR == ReceiveSmsg(node, "smsgPing", vchFlags));
+    BOOST_CHECK(node.smsgData.nProtoFlags == SMSG_PROTO_SUB_BUCKETS);
+
+    // smsgShowSub is answered with the digest of each bucket
+    std::vector<uint8_t> vchShow(4 + 8);
+    uint32_t nBuckets = 1;
+    memcpy(&vchShow[0], &nBuckets, 4);
+    memcpy(&vchShow[4], &time, 8);
+    BOOST_CHECK(SMSG_NO_ERROR == ReceiveSmsg(node, "smsgShowSub", vchShow));
+    uint64_t nSentHaveSub = SentBytes(node, "smsgHaveSub");
+    BOOST_CHECK(nSentHaveSub > 0);
+    BOOST_CHECK_EQUAL(GetMisbehavior(node), 0);
+
+    // Malformed smsgShowSub messages are rejected without reading past the data
+    int nMisbehavior = 0;
+    std::vector<std::vector<uint8_t> > vBadShow;
+    vBadShow.push_back(std::vector<uint8_t>(2));
+    vBadShow.push_back(vchShow);
+    nBuckets = 0x20000000; // nBuckets * 8 overflows 32 bits
+    memcpy(&vBadShow.back()[0], &nBuckets, 4);
+    vBadShow.push_back(std::vector<uint8_t>(4 + (SMSG_MAX_SHOW_BUCKETS + 1) * 8));
+    nBuckets = SMSG_MAX_SHOW_BUCKETS + 1;
+    memcpy(&vBadShow.back()[0], &nBuckets, 4);
+    vBadShow.push_back(vchShow);
+    nBuckets = 2; // more buckets than sent
+    memcpy(&vBadShow.back()[0], &nBuckets, 4);
+    vBadShow.push_back(vchShow);
+    vBadShow.back().resize(4 + 16); // more data than buckets
+    for (const auto &vchBad : vBadShow)
+    {
+        BOOST_CHECK(SMSG_GENERAL_ERROR == ReceiveSmsg(node, "smsgShowSub", vchBad));
+        BOOST_CHECK_EQUAL(GetMisbehavior(node), ++nMisbehavior);
+    };
+    BOOST_CHECK(SentBytes(node, "smsgHaveSub") == nSentHaveSub);
+
+    // smsgHaveSub must carry exactly one digest
+    std::vector<uint8_t> vchHaveSub(8 + SMSG_SUB_DIGEST_SIZE);
+    memcpy(&vchHaveSub[0], &timeUnknown, 8);
+    std::set<SecMsgToken> setPeer;
+    for (int i = 0; i < 10; ++i)
+        setPeer.insert(RandomToken(timeUnknown));
+    SecureMsgSubBucketDigest(setPeer, now, &vchHaveSub[8]);
+    for (size_t nSize : {(size_t)0, (size_t)8, vchHaveSub.size() - 1, vchHaveSub.size() + 1})
+    {
+        std::vector<uint8_t> vchBad(vchHaveSub);
+        vchBad.resize(nSize);
+        BOOST_CHECK(SMSG_GENERAL_ERROR == ReceiveSmsg(node, "smsgHaveSub", vchBad));
+        BOOST_CHECK_EQUAL(GetMisbehavior(node), ++nMisbehavior);
+    };
+    BOOST_CHECK(SentBytes(node, "smsgShowPart") == 0);
+
+    // A digest for a bucket this node doesn't have requests the peer's sub-buckets without creating the bucket
+    BOOST_CHECK(SMSG_NO_ERROR == ReceiveSmsg(node, "smsgHaveSub", vchHaveSub));
+    BOOST_CHECK(SentBytes(node, "smsgShowPart") > 0);
+    {
+        LOCK(cs_smsg);
+        BOOST_CHECK(smsgBuckets.count(timeUnknown) == 0);
+        smsgBuckets.erase(time);
+    }
+    BOOST_CHECK_EQUAL(GetMisbehavior(node), nMisbehavior);
+
+    bool fUpdateConnectionTime = false;
+    peerLogic->FinalizeNode(node.GetId(), fUpdateConnectionTime);
+    fSecMsgEnabled = fSecMsgEnabledBefore;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -229,6 +229,14 @@ BOOST_AUTO_TEST_CASE(stealth_key)
         BOOST_CHECK(pkSendTo == pkSendTo_verify);
         BOOST_CHECK(secretShared == secretShared_verify);
 
+        // Receive with pre-parsed keys, as used when scanning
+        secp256k1_pubkey pkEphemParsed, pkSpendParsed;
+        BOOST_CHECK(StealthParsePubKey(ephem_pubkey, pkEphemParsed) == 0);
+        BOOST_CHECK(StealthParsePubKey(sxAddr.spend_pubkey, pkSpendParsed) == 0);
+        BOOST_CHECK(StealthSecret(sxAddr.scan_secret, pkEphemParsed, pkSpendParsed, secretShared_verify, pkSendTo_verify) == 0);
+        BOOST_CHECK(pkSendTo == pkSendTo_verify);
+        BOOST_CHECK(secretShared == secretShared_verify);
+
         CKeyID iSpend = sxAddr.GetSpendKeyID();
         CKey kSpend;
         BOOST_CHECK(keystore.GetKey(iSpend, kSpend));
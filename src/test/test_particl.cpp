@@ -21,6 +21,7 @@
 #include "rpc/server.h"
 #include "rpc/register.h"
 #include "script/sigcache.h"
+#include "rctcache.h"
 
 #include <memory>
 
@@ -55,6 +56,7 @@ BasicTestingSetup::BasicTestingSetup(const std::string& chainName, bool fParticl
     SetupNetworking();
     InitSignatureCache();
     InitScriptExecutionCache();
+    InitRCTCache();
     fPrintToDebugLog = false; // don't want to write to debug.log file
     fCheckBlockIndex = true;
     SelectParams(chainName);
@@ -91,6 +93,7 @@ TestingSetup::TestingSetup(const std::string& chainName, bool fParticlModeIn) :
     pblocktree = new CBlockTreeDB(1 << 20, true);
     pcoinsdbview = new CCoinsViewDB(1 << 23, true);
     pcoinsTip = new CCoinsViewCache(pcoinsdbview);
+    InitCoinsSetStats();
     if (!LoadGenesisBlock(chainparams)) {
         throw std::runtime_error("LoadGenesisBlock failed.");
     }
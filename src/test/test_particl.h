@@ -78,7 +78,6 @@ struct CConnmanTest {
 
 class PeerLogicValidation;
 struct TestingSetup: public BasicTestingSetup {
-    CCoinsViewDB *pcoinsdbview;
     fs::path pathTemp;
     boost::thread_group threadGroup;
     CConnman* connman;
@@ -89,6 +88,11 @@ struct TestingSetup: public BasicTestingSetup {
     ~TestingSetup();
 };
 
+/** Testing setup in Particl mode on the main chain */
+struct ParticlTestingSetup : public TestingSetup {
+    ParticlTestingSetup() : TestingSetup(CBaseChainParams::MAIN, true) {}
+};
+
 class CBlock;
 struct CMutableTransaction;
 class CScript;
@@ -107,7 +111,6 @@ struct TestChain100Setup : public TestingSetup {
 
     ~TestChain100Setup();
 
-    CCoinsViewDB *pcoinsdbview;
     std::vector<CTransaction> coinbaseTxns; // For convenience, coinbase transactions
     CKey coinbaseKey; // private/public key needed to spend coinbase transactions
 };
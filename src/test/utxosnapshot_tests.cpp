@@ -0,0 +1,132 @@
+// Copyright (c) 2017 The Particl Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "consensus/validation.h"
+#include "streams.h"
+#include "txdb.h"
+#include "validation.h"
+
+#include "test/test_particl.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(utxosnapshot_tests, TestChain100Setup)
+
+/** Copy a snapshot, replacing its header */
+static void WriteSnapshotWithHeader(const fs::path &pathFrom, const fs::path &pathTo, const CUTXOSnapshotHeader &header)
+{
+    fs::remove(pathTo);
+    fs::copy_file(pathFrom, pathTo);
+    CAutoFile file(fsbridge::fopen(pathTo, "r+b"), SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE(!file.IsNull());
+    file << header;
+}
+
+BOOST_AUTO_TEST_CASE(utxo_snapshot_test)
+{
+    const CChainParams &chainparams = Params();
+    fs::path path = GetDataDir() / "utxo.dat";
+
+    CCoinsStats stats;
+    FlushStateToDisk();
+    BOOST_CHECK(GetUTXOStats(pcoinsdbview, stats));
+
+    CUTXOSnapshotHeader header;
+    CValidationState state;
+    BOOST_CHECK(DumpUTXOSnapshot(path, header, state));
+    BOOST_CHECK(header.hashBlock == chainActive.Tip()->GetBlockHash());
+    BOOST_CHECK(header.nHeight == 100);
+    BOOST_CHECK(header.hashSerialized == stats.hashSerialized);
+    BOOST_CHECK(header.nCoins == stats.nTransactionOutputs);
+    const CUTXOSnapshotHeader headerDumped = header;
+    const uint256 hashSnapshot = header.GetHash();
+
+    // Loading requires a node without any blocks past genesis
+    BOOST_CHECK(!LoadUTXOSnapshot(chainparams, path, hashSnapshot, false, header, state));
+    BOOST_CHECK(state.IsError());
+
+    {
+        LOCK(cs_main);
+        delete pcoinsTip;
+        delete pcoinsdbview;
+        pcoinsdbview = new CCoinsViewDB(1 << 23, true, true);
+        pcoinsTip = new CCoinsViewCache(pcoinsdbview);
+        pcoinsTip->SetBestBlock(chainActive.Genesis()->GetBlockHash());
+        pcoinsTip->Flush();
+        fCoinStatsIndex = true;
+        InitCoinsSetStats();
+        chainActive.SetTip(chainActive.Genesis());
+    }
+
+    fs::path pathCorrupt = GetDataDir() / "utxo_corrupt.dat";
+    fs::copy_file(path, pathCorrupt);
+    {
+        FILE *file = fsbridge::fopen(pathCorrupt, "r+b");
+        BOOST_REQUIRE(file);
+        fseek(file, -1, SEEK_END);
+        int c = fgetc(file);
+        fseek(file, -1, SEEK_END);
+        fputc(c ^ 1, file);
+        fclose(file);
+    }
+    state = CValidationState();
+    BOOST_CHECK(!LoadUTXOSnapshot(chainparams, pathCorrupt, uint256(), true, header, state));
+    state = CValidationState();
+    BOOST_CHECK(!LoadUTXOSnapshot(chainparams, path, uint256S("01"), false, header, state));
+
+    // The coins hash alone is not accepted as the anchor
+    state = CValidationState();
+    BOOST_CHECK(!LoadUTXOSnapshot(chainparams, path, stats.hashSerialized, false, header, state));
+
+    // A snapshot can't be loaded without a hash unless explicitly unsafe
+    state = CValidationState();
+    BOOST_CHECK(!LoadUTXOSnapshot(chainparams, path, uint256(), false, header, state));
+
+    // Header fields outside the coins and the records behind hashContents are covered by the snapshot hash
+    CUTXOSnapshotHeader headerTampered = headerDumped;
+    headerTampered.nMoneySupply += COIN;
+    WriteSnapshotWithHeader(path, pathCorrupt, headerTampered);
+    state = CValidationState();
+    BOOST_CHECK(!LoadUTXOSnapshot(chainparams, pathCorrupt, hashSnapshot, false, header, state));
+
+    // A body with dropped key images or changed RCT outputs needs a different hashContents
+    headerTampered = headerDumped;
+    headerTampered.hashContents = uint256S("02");
+    WriteSnapshotWithHeader(path, pathCorrupt, headerTampered);
+    state = CValidationState();
+    BOOST_CHECK(!LoadUTXOSnapshot(chainparams, pathCorrupt, hashSnapshot, false, header, state));
+    state = CValidationState();
+    BOOST_CHECK(!LoadUTXOSnapshot(chainparams, pathCorrupt, uint256(), true, header, state));
+    BOOST_CHECK(chainActive.Height() == 0);
+
+    fCheckBlockIndex = true;
+    state = CValidationState();
+    BOOST_CHECK(LoadUTXOSnapshot(chainparams, path, hashSnapshot, false, header, state));
+    BOOST_CHECK(chainActive.Height() == 100);
+    BOOST_CHECK(fHaveUTXOSnapshot);
+    BOOST_CHECK(header.GetHash() == hashSnapshot);
+
+    CCoinsStats statsLoaded;
+    BOOST_CHECK(GetUTXOStats(pcoinsdbview, statsLoaded));
+    BOOST_CHECK(statsLoaded.hashBlock == stats.hashBlock);
+    BOOST_CHECK(statsLoaded.hashSerialized == stats.hashSerialized);
+
+    // The chain continues from the snapshot
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CreateAndProcessBlock(std::vector<CMutableTransaction>(), scriptPubKey);
+    BOOST_CHECK(chainActive.Height() == 101);
+    fCheckBlockIndex = false;
+
+    // The running coin set statistics were set from the snapshot
+    CCoinsSetStats setStats, setStatsScan;
+    BOOST_CHECK(fCoinsSetStatsComplete);
+    BOOST_CHECK(GetCoinsSetStats(setStats, false));
+    BOOST_CHECK(GetCoinsSetStats(setStatsScan, true));
+    BOOST_CHECK(setStats.hashBlock == chainActive.Tip()->GetBlockHash());
+    BOOST_CHECK(setStats.GetMuHash() == setStatsScan.GetMuHash());
+    fCoinStatsIndex = false;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,77 @@
+// Copyright (c) 2017 The Particl Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "workerpool.h"
+#include "test/test_particl.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(workerpool_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(workerpool_test)
+{
+    for (size_t nThreads : {0, 1, 3})
+    {
+        CWorkerPool pool(nThreads, "test");
+        BOOST_CHECK_EQUAL(pool.Size(), nThreads);
+
+        pool.Run(0, [](size_t) { BOOST_ERROR("no tasks expected"); });
+
+        // Every task runs once, the pool is reused across jobs
+        for (size_t nTasks : {1, 2, 4, 100})
+        {
+            for (int k = 0; k < 20; ++k)
+            {
+                std::vector<std::atomic<int> > vRuns(nTasks);
+                for (auto &n : vRuns)
+                    n = 0;
+                pool.Run(nTasks, [&](size_t i) { vRuns[i]++; });
+                for (auto &n : vRuns)
+                    BOOST_CHECK_EQUAL(n.load(), 1);
+            };
+        };
+    };
+
+    // Jobs from several callers don't mix
+    CWorkerPool pool(2, "test");
+    std::atomic<int> nTotal(0), nMixed(0);
+    std::vector<std::thread> vCallers;
+    for (int c = 0; c < 4; ++c)
+    {
+        vCallers.emplace_back([&]() {
+            for (int k = 0; k < 50; ++k)
+            {
+                std::atomic<int> nRuns(0);
+                pool.Run(8, [&](size_t) { nRuns++; });
+                if (nRuns != 8)
+                    nMixed++;
+                nTotal += nRuns;
+            };
+        });
+    };
+    for (auto &thread : vCallers)
+        thread.join();
+    BOOST_CHECK_EQUAL(nMixed.load(), 0);
+    BOOST_CHECK_EQUAL(nTotal.load(), 4 * 50 * 8);
+
+    // Tasks may start jobs on their own pool, as the smsg pow batch does
+    for (size_t nThreads : {1, 3})
+    {
+        CWorkerPool poolNested(nThreads, "test");
+        std::vector<std::atomic<int> > vRuns(4 * 16);
+        for (auto &n : vRuns)
+            n = 0;
+        poolNested.Run(4, [&](size_t i) {
+            poolNested.Run(16, [&](size_t j) { vRuns[i * 16 + j]++; });
+        });
+        for (auto &n : vRuns)
+            BOOST_CHECK_EQUAL(n.load(), 1);
+    };
+}
+
+BOOST_AUTO_TEST_SUITE_END()
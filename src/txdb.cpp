@@ -21,10 +21,12 @@
 
 static const char DB_COIN = 'C';
 static const char DB_COINS = 'c';
+static const char DB_COINS_SET_STATS = 'M';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
 static const char DB_ADDRESSINDEX = 'a';
 static const char DB_ADDRESSUNSPENTINDEX = 'u';
+static const char DB_ADDRESSBALANCEINDEX = 'q';
 static const char DB_TIMESTAMPINDEX = 's';
 static const char DB_BLOCKHASHINDEX = 'z';
 static const char DB_SPENTINDEX = 'p';
@@ -204,6 +206,31 @@ CCoinsViewCursor *CCoinsViewDB::Cursor() const
     return i;
 }
 
+CCoinsViewCursor *CCoinsViewDB::Cursor(const COutPoint &start) const
+{
+    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper&>(db).NewIterator(), GetBestBlock());
+    i->pcursor->Seek(CoinEntry(&start));
+    // Cache key of first record
+    if (i->pcursor->Valid()) {
+        CoinEntry entry(&i->keyTmp.second);
+        i->pcursor->GetKey(entry);
+        i->keyTmp.first = entry.key;
+    } else {
+        i->keyTmp.first = 0; // Make sure Valid() and GetKey() return false
+    }
+    return i;
+}
+
+bool CCoinsViewDB::ReadCoinsSetStats(CCoinsSetStats &stats) const
+{
+    return db.Read(DB_COINS_SET_STATS, stats);
+}
+
+bool CCoinsViewDB::WriteCoinsSetStats(const CCoinsSetStats &stats)
+{
+    return db.Write(DB_COINS_SET_STATS, stats);
+}
+
 bool CCoinsViewDBCursor::GetKey(COutPoint &key) const
 {
     // Return cached key
@@ -292,16 +319,30 @@ bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddres
 }
 
 bool CBlockTreeDB::ReadAddressUnspentIndex(uint256 addressHash, int type,
-                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
+                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                                           size_t nLimit, const CAddressUnspentKey *pAfter) {
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
-    pcursor->Seek(std::make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    if (pAfter) {
+        pcursor->Seek(std::make_pair(DB_ADDRESSUNSPENTINDEX, *pAfter));
+    } else {
+        pcursor->Seek(std::make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    }
 
+    size_t nRead = 0;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
+        if (nLimit > 0 && nRead >= nLimit) {
+            break;
+        }
         std::pair<char,CAddressUnspentKey> key;
         if (pcursor->GetKey(key) && key.first == DB_ADDRESSUNSPENTINDEX && key.second.hashBytes == addressHash) {
+            if (pAfter && key.second == *pAfter) {
+                pcursor->Next();
+                continue;
+            }
+            nRead++;
             CAddressUnspentValue nValue;
             if (pcursor->GetValue(nValue)) {
                 unspentOutputs.push_back(std::make_pair(key.second, nValue));
@@ -317,10 +358,42 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint256 addressHash, int type,
     return true;
 }
 
+static void UpdateAddressBalances(const CDBWrapper &db, CDBBatch &batch,
+    const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect, bool fUndo)
+{
+    // Sum the deltas per address first, each total is read and written once
+    std::map<std::pair<unsigned int, uint256>, CAddressBalanceValue> mapBalances;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+    {
+        // Skip deltas already applied, a block may be reconnected after an unclean shutdown
+        if (db.Exists(std::make_pair(DB_ADDRESSINDEX, it->first)) != fUndo)
+            continue;
+
+        std::pair<unsigned int, uint256> addr(it->first.type, it->first.hashBytes);
+        std::map<std::pair<unsigned int, uint256>, CAddressBalanceValue>::iterator mi = mapBalances.find(addr);
+        if (mi == mapBalances.end())
+        {
+            mi = mapBalances.insert(std::make_pair(addr, CAddressBalanceValue())).first;
+            if (!db.Read(std::make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey(addr.first, addr.second)), mi->second))
+                mi->second.SetNull(); // First delta for address
+        };
+        mi->second.Apply(it->second, fUndo);
+    };
+
+    for (std::map<std::pair<unsigned int, uint256>, CAddressBalanceValue>::const_iterator mi=mapBalances.begin(); mi!=mapBalances.end(); mi++)
+    {
+        if (mi->second.IsNull())
+            batch.Erase(std::make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey(mi->first.first, mi->first.second)));
+        else
+            batch.Write(std::make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey(mi->first.first, mi->first.second)), mi->second);
+    };
+};
+
 bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
     CDBBatch batch(*this);
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Write(std::make_pair(DB_ADDRESSINDEX, it->first), it->second);
+    UpdateAddressBalances(*this, batch, vect, false);
     return WriteBatch(batch);
 }
 
@@ -328,28 +401,103 @@ bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKe
     CDBBatch batch(*this);
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Erase(std::make_pair(DB_ADDRESSINDEX, it->first));
+    UpdateAddressBalances(*this, batch, vect, true);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressBalanceIndex(uint256 addressHash, int type, CAddressBalanceValue &value) {
+    value.SetNull();
+    std::pair<char, CAddressIndexIteratorKey> key(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey(type, addressHash));
+    if (!Exists(key))
+        return true;
+    return Read(key, value);
+}
+
+bool CBlockTreeDB::RebuildAddressBalanceIndex() {
+    CDBBatch batch(*this);
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    // Clear any partial totals
+    pcursor->Seek(DB_ADDRESSBALANCEINDEX);
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CAddressIndexIteratorKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSBALANCEINDEX)
+            break;
+        batch.Erase(key);
+        pcursor->Next();
+    }
+
+    // Address index keys are ordered by address, so each address is summed in a single run
+    size_t nAddresses = 0;
+    std::pair<char,CAddressIndexIteratorKey> keyLast(0, CAddressIndexIteratorKey());
+    CAddressBalanceValue value;
+    pcursor->Seek(DB_ADDRESSINDEX);
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CAddressIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSINDEX)
+            break;
+        if (keyLast.first != DB_ADDRESSBALANCEINDEX
+            || keyLast.second.type != key.second.type || keyLast.second.hashBytes != key.second.hashBytes) {
+            if (keyLast.first == DB_ADDRESSBALANCEINDEX && !value.IsNull()) {
+                batch.Write(keyLast, value);
+                nAddresses++;
+            }
+            keyLast = std::make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey(key.second.type, key.second.hashBytes));
+            value.SetNull();
+        }
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("failed to get address index value");
+        value.Apply(nValue, false);
+
+        if (batch.SizeEstimate() > (1 << 24)) {
+            if (!WriteBatch(batch))
+                return false;
+            batch.Clear();
+        }
+        pcursor->Next();
+    }
+    if (keyLast.first == DB_ADDRESSBALANCEINDEX && !value.IsNull()) {
+        batch.Write(keyLast, value);
+        nAddresses++;
+    }
+    LogPrintf("%s: Wrote balances for %u addresses.\n", __func__, nAddresses);
+
     return WriteBatch(batch);
 }
 
 bool CBlockTreeDB::ReadAddressIndex(uint256 addressHash, int type,
                                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
-                                    int start, int end) {
+                                    int start, int end, size_t nLimit, const CAddressIndexKey *pAfter) {
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
-    if (start > 0 && end > 0) {
+    if (pAfter) {
+        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, *pAfter));
+    } else if (start > 0 && end > 0) {
         pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
     } else {
         pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
     }
 
+    size_t nRead = 0;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
+        if (nLimit > 0 && nRead >= nLimit) {
+            break;
+        }
         std::pair<char,CAddressIndexKey> key;
         if (pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX && key.second.hashBytes == addressHash) {
             if (end > 0 && key.second.blockHeight > end) {
                 break;
             }
+            if (pAfter && key.second == *pAfter) {
+                pcursor->Next();
+                continue;
+            }
+            nRead++;
             CAmount nValue;
             if (pcursor->GetValue(nValue)) {
                 addressIndex.push_back(std::make_pair(key.second, nValue));
@@ -496,7 +644,14 @@ bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams,
 
 bool CBlockTreeDB::ReadLastRCTOutput(int64_t &rv)
 {
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    {
+        LOCK(cs_rctPending);
+        if (fPendingLastRCTOutput)
+        {
+            rv = nPendingLastRCTOutput;
+            return true;
+        };
+    }
 
     if (!Read(DB_RCTOUTPUT_LAST, rv))
         rv = 0;
@@ -507,73 +662,259 @@ bool CBlockTreeDB::ReadLastRCTOutput(int64_t &rv)
 
 bool CBlockTreeDB::WriteLastRCTOutput(int64_t i)
 {
-    CDBBatch batch(*this);
-    batch.Write(DB_RCTOUTPUT_LAST, i);
-    return WriteBatch(batch);
+    LOCK(cs_rctPending);
+    fPendingLastRCTOutput = true;
+    nPendingLastRCTOutput = i;
+    return true;
 };
 
 bool CBlockTreeDB::ReadRCTOutput(int64_t i, CAnonOutput &ao)
 {
+    {
+        LOCK(cs_rctPending);
+        int rv = pendingRCTOutputs.Get(i, ao);
+        if (rv != 0)
+            return rv > 0;
+    }
     return Read(std::make_pair(DB_RCTOUTPUT, i), ao);
 };
 
 bool CBlockTreeDB::WriteRCTOutput(int64_t i, const CAnonOutput &ao)
 {
-    CDBBatch batch(*this);
-    batch.Write(std::make_pair(DB_RCTOUTPUT, i), ao);
-    return WriteBatch(batch);
+    LOCK(cs_rctPending);
+    pendingRCTOutputs.Write(i, ao);
+    return true;
 };
 
 bool CBlockTreeDB::EraseRCTOutput(int64_t i)
 {
-    CDBBatch batch(*this);
-    batch.Erase(std::make_pair(DB_RCTOUTPUT, i));
-    return WriteBatch(batch);
+    LOCK(cs_rctPending);
+    pendingRCTOutputs.Erase(i);
+    return true;
 };
 
 
 bool CBlockTreeDB::ReadRCTOutputLink(const CCmpPubKey &pk, int64_t &i)
 {
+    {
+        LOCK(cs_rctPending);
+        int rv = pendingRCTOutputLinks.Get(pk, i);
+        if (rv != 0)
+            return rv > 0;
+    }
     return Read(std::make_pair(DB_RCTOUTPUT_LINK, pk), i);
 };
 
 bool CBlockTreeDB::WriteRCTOutputLink(const CCmpPubKey &pk, int64_t i)
 {
-    CDBBatch batch(*this);
-    batch.Write(std::make_pair(DB_RCTOUTPUT_LINK, pk), i);
-    return WriteBatch(batch);
+    LOCK(cs_rctPending);
+    pendingRCTOutputLinks.Write(pk, i);
+    return true;
 };
 
 bool CBlockTreeDB::EraseRCTOutputLink(const CCmpPubKey &pk)
 {
-    CDBBatch batch(*this);
-    batch.Erase(std::make_pair(DB_RCTOUTPUT_LINK, pk));
-    return WriteBatch(batch);
+    LOCK(cs_rctPending);
+    pendingRCTOutputLinks.Erase(pk);
+    return true;
 };
 
 bool CBlockTreeDB::ReadRCTOutputCheckpoint(int nBlock, int64_t &i)
 {
+    {
+        LOCK(cs_rctPending);
+        int rv = pendingRCTCheckpoints.Get(nBlock, i);
+        if (rv != 0)
+            return rv > 0;
+    }
     return Read(std::make_pair(DB_RCTOUTPUT_CHECKPOINT, nBlock), i);
 };
 
 
+bool CBlockTreeDB::LoadRCTOutputTable(CRCTOutputTable &table)
+{
+    int64_t nLastRCTOutput = 0;
+    if (!ReadLastRCTOutput(nLastRCTOutput))
+        return false;
+
+    std::vector<CRCTOutputTable::Entry> vEntries(nLastRCTOutput);
+    std::vector<bool> vHave(nLastRCTOutput, false);
+
+    // Keys are not in index order, fill the table as they come
+    LOCK(cs_rctPending);
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(DB_RCTOUTPUT, (int64_t)0));
+    while (pcursor->Valid())
+    {
+        boost::this_thread::interruption_point();
+        std::pair<char, int64_t> key;
+        if (!pcursor->GetKey(key) || key.first != DB_RCTOUTPUT)
+            break;
+
+        if (key.second > 0 && key.second <= nLastRCTOutput
+            && !pendingRCTOutputs.Has(key.second))
+        {
+            CAnonOutput ao;
+            if (!pcursor->GetValue(ao))
+                return error("%s: Failed to read RCT output %d.", __func__, key.second);
+
+            CRCTOutputTable::Entry &entry = vEntries[key.second-1];
+            entry.pubkey = ao.pubkey;
+            entry.commitment = ao.commitment;
+            entry.nBlockHeight = ao.nBlockHeight;
+            vHave[key.second-1] = true;
+        };
+        pcursor->Next();
+    };
+
+    for (const auto &it : pendingRCTOutputs.mapWrite)
+    {
+        if (it.first < 1 || it.first > nLastRCTOutput)
+            continue;
+        CRCTOutputTable::Entry &entry = vEntries[it.first-1];
+        entry.pubkey = it.second.pubkey;
+        entry.commitment = it.second.commitment;
+        entry.nBlockHeight = it.second.nBlockHeight;
+        vHave[it.first-1] = true;
+    };
+
+    for (int64_t i = 0; i < nLastRCTOutput; ++i)
+        if (!vHave[i])
+            return error("%s: RCT output %d missing.", __func__, i+1);
+
+    table.Assign(vEntries);
+    return true;
+};
+
+bool CBlockTreeDB::LoadRCTKeyImageFilter(CRCTKeyImageFilter &filter)
+{
+    std::vector<CCmpPubKey> vKeyImages;
+
+    LOCK(cs_rctPending);
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(DB_RCTKEYIMAGE, CCmpPubKey()));
+    while (pcursor->Valid())
+    {
+        boost::this_thread::interruption_point();
+        std::pair<char, CCmpPubKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_RCTKEYIMAGE)
+            break;
+        if (!pendingRCTKeyImages.Has(key.second))
+            vKeyImages.push_back(key.second);
+        pcursor->Next();
+    };
+    for (const auto &it : pendingRCTKeyImages.mapWrite)
+        vKeyImages.push_back(it.first);
+
+    filter.Reset(vKeyImages.size());
+    for (const auto &ki : vKeyImages)
+        filter.Insert(ki);
+    return true;
+};
+
 bool CBlockTreeDB::ReadRCTKeyImage(const CCmpPubKey &ki, uint256 &txhash)
 {
+    {
+        LOCK(cs_rctPending);
+        int rv = pendingRCTKeyImages.Get(ki, txhash);
+        if (rv != 0)
+            return rv > 0;
+    }
     return Read(std::make_pair(DB_RCTKEYIMAGE, ki), txhash);
 };
 
 bool CBlockTreeDB::WriteRCTKeyImage(const CCmpPubKey &ki, const uint256 &txhash)
 {
-    CDBBatch batch(*this);
-    batch.Write(std::make_pair(DB_RCTKEYIMAGE, ki), txhash);
-    return WriteBatch(batch);
+    LOCK(cs_rctPending);
+    pendingRCTKeyImages.Write(ki, txhash);
+    return true;
 };
 
 bool CBlockTreeDB::EraseRCTKeyImage(const CCmpPubKey &ki)
 {
+    LOCK(cs_rctPending);
+    pendingRCTKeyImages.Erase(ki);
+    return true;
+};
+
+bool CBlockTreeDB::WriteRCTIndex(const CCoinsViewCache &view, bool fDisconnecting)
+{
+    // Held in memory and written together with the coins by FlushRCTIndex
+    int64_t nLastRCTOutput;
+    if (!ReadLastRCTOutput(nLastRCTOutput))
+        return false;
+
+    LOCK(cs_rctPending);
+    if (fDisconnecting)
+    {
+        for (const auto &it : view.keyImages)
+            pendingRCTKeyImages.Erase(it.first);
+
+        if (view.anonOutputLinks.size() > 0)
+        {
+            for (const auto &it : view.anonOutputLinks)
+            {
+                pendingRCTOutputs.Erase(it.second);
+                pendingRCTOutputLinks.Erase(it.first);
+            };
+
+            fPendingLastRCTOutput = true;
+            nPendingLastRCTOutput = view.nLastRCTOutput;
+        };
+    } else
+    {
+        if (view.anonOutputs.size() > 0)
+        {
+            fPendingLastRCTOutput = true;
+            nPendingLastRCTOutput = view.nLastRCTOutput;
+            nLastRCTOutput = view.nLastRCTOutput;
+        };
+
+        if (view.nBlockHeight % 250 == 0)
+            pendingRCTCheckpoints.Write(view.nBlockHeight, nLastRCTOutput);
+
+        for (const auto &it : view.keyImages)
+            pendingRCTKeyImages.Write(it.first, it.second);
+
+        for (const auto &it : view.anonOutputs)
+            pendingRCTOutputs.Write(it.first, it.second);
+
+        for (const auto &it : view.anonOutputLinks)
+            pendingRCTOutputLinks.Write(it.first, it.second);
+    };
+
+    return true;
+};
+
+bool CBlockTreeDB::FlushRCTIndex()
+{
+    LOCK(cs_rctPending);
     CDBBatch batch(*this);
-    batch.Erase(std::make_pair(DB_RCTKEYIMAGE, ki));
-    return WriteBatch(batch);
+    pendingRCTKeyImages.AddTo(batch, DB_RCTKEYIMAGE);
+    pendingRCTOutputs.AddTo(batch, DB_RCTOUTPUT);
+    pendingRCTOutputLinks.AddTo(batch, DB_RCTOUTPUT_LINK);
+    pendingRCTCheckpoints.AddTo(batch, DB_RCTOUTPUT_CHECKPOINT);
+    if (fPendingLastRCTOutput)
+        batch.Write(DB_RCTOUTPUT_LAST, nPendingLastRCTOutput);
+
+    if (batch.SizeEstimate() > 0 && !WriteBatch(batch, true))
+        return false;
+
+    fPendingLastRCTOutput = false;
+    pendingRCTKeyImages.clear();
+    pendingRCTOutputs.clear();
+    pendingRCTOutputLinks.clear();
+    pendingRCTCheckpoints.clear();
+    return true;
+};
+
+size_t CBlockTreeDB::RCTIndexPendingUsage() const
+{
+    LOCK(cs_rctPending);
+    return pendingRCTKeyImages.DynamicMemoryUsage()
+        + pendingRCTOutputs.DynamicMemoryUsage()
+        + pendingRCTOutputLinks.DynamicMemoryUsage()
+        + pendingRCTCheckpoints.DynamicMemoryUsage();
 };
 
 bool CCoinsViewDB::Upgrade()
@@ -13,8 +13,11 @@
 #include "spentindex.h"
 #include "timestampindex.h"
 #include "rctindex.h"
+#include "memusage.h"
+#include "sync.h"
 
 #include <map>
+#include <set>
 #include <string>
 #include <utility>
 #include <vector>
@@ -89,6 +92,12 @@ public:
     std::vector<uint256> GetHeadBlocks() const override;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
     CCoinsViewCursor *Cursor() const override;
+    //! Get a cursor positioned at the first coin at or after start
+    CCoinsViewCursor *Cursor(const COutPoint &start) const;
+
+    //! Statistics of the coin set, only valid when stats.hashBlock matches the best block
+    bool ReadCoinsSetStats(CCoinsSetStats &stats) const;
+    bool WriteCoinsSetStats(const CCoinsSetStats &stats);
 
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
@@ -117,6 +126,63 @@ private:
     friend class CCoinsViewDB;
 };
 
+/** Writes and erases of one kind of record, held in memory until added to a batch */
+template <typename K, typename V>
+class CPendingRecords
+{
+public:
+    std::map<K, V> mapWrite;
+    std::set<K> setErase;
+
+    void Write(const K &k, const V &v)
+    {
+        setErase.erase(k);
+        mapWrite[k] = v;
+    };
+
+    void Erase(const K &k)
+    {
+        mapWrite.erase(k);
+        setErase.insert(k);
+    };
+
+    /** Returns 1 if k is written, -1 if erased and 0 if the database must be read */
+    int Get(const K &k, V &v) const
+    {
+        auto it = mapWrite.find(k);
+        if (it != mapWrite.end())
+        {
+            v = it->second;
+            return 1;
+        };
+        return setErase.count(k) ? -1 : 0;
+    };
+
+    bool Has(const K &k) const
+    {
+        return mapWrite.count(k) || setErase.count(k);
+    };
+
+    void AddTo(CDBBatch &batch, char chPrefix) const
+    {
+        for (const auto &k : setErase)
+            batch.Erase(std::make_pair(chPrefix, k));
+        for (const auto &it : mapWrite)
+            batch.Write(std::make_pair(chPrefix, it.first), it.second);
+    };
+
+    void clear()
+    {
+        mapWrite.clear();
+        setErase.clear();
+    };
+
+    size_t DynamicMemoryUsage() const
+    {
+        return memusage::DynamicUsage(mapWrite) + memusage::DynamicUsage(setErase);
+    };
+};
+
 /** Access to the block database (blocks/index/) */
 class CBlockTreeDB : public CDBWrapper
 {
@@ -125,6 +191,18 @@ public:
 private:
     CBlockTreeDB(const CBlockTreeDB&);
     void operator=(const CBlockTreeDB&);
+
+    /**
+     * RCT index records of connected and disconnected blocks, written in one batch by
+     * FlushRCTIndex when the coins are flushed. Reads see them before the database.
+     */
+    mutable CCriticalSection cs_rctPending;
+    bool fPendingLastRCTOutput = false;
+    int64_t nPendingLastRCTOutput = 0;
+    CPendingRecords<int64_t, CAnonOutput> pendingRCTOutputs;
+    CPendingRecords<CCmpPubKey, int64_t> pendingRCTOutputLinks;
+    CPendingRecords<int, int64_t> pendingRCTCheckpoints;
+    CPendingRecords<CCmpPubKey, uint256> pendingRCTKeyImages;
 public:
     bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo &fileinfo);
@@ -137,13 +215,17 @@ public:
     bool ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
     bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect);
     bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect);
+    /** Read at most nLimit entries (0 for all), starting after pAfter if set */
     bool ReadAddressUnspentIndex(uint256 addressHash, int type,
-                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
+                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect,
+                                 size_t nLimit = 0, const CAddressUnspentKey *pAfter = nullptr);
     bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
     bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
     bool ReadAddressIndex(uint256 addressHash, int type,
                           std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
-                          int start = 0, int end = 0);
+                          int start = 0, int end = 0, size_t nLimit = 0, const CAddressIndexKey *pAfter = nullptr);
+    bool ReadAddressBalanceIndex(uint256 addressHash, int type, CAddressBalanceValue &value);
+    bool RebuildAddressBalanceIndex();
     bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
     bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &vect);
     bool WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts);
@@ -165,13 +247,19 @@ public:
 
     bool ReadRCTOutputCheckpoint(int nBlock, int64_t &i);
 
+    bool LoadRCTOutputTable(CRCTOutputTable &table);
+    bool LoadRCTKeyImageFilter(CRCTKeyImageFilter &filter);
+
 
     bool ReadRCTKeyImage(const CCmpPubKey &ki, uint256 &txhash);
     bool WriteRCTKeyImage(const CCmpPubKey &ki, const uint256 &txhash);
     bool EraseRCTKeyImage(const CCmpPubKey &ki);
 
-
-    //bool WriteRCTOutputBatch(std::vector<std::pair<int64_t, CAnonOutput> > &vao);
+    /** Write or erase the RCT outputs, links and key images accumulated in view, held until FlushRCTIndex */
+    bool WriteRCTIndex(const CCoinsViewCache &view, bool fDisconnecting);
+    /** Write the held RCT index records in one batch, call before the coins are flushed */
+    bool FlushRCTIndex();
+    size_t RCTIndexPendingUsage() const;
 };
 
 #endif // BITCOIN_TXDB_H
@@ -89,7 +89,9 @@ bool fTxIndex = true;
 bool fAddressIndex = false;
 bool fTimestampIndex = false;
 bool fSpentIndex = false;
+bool fCoinStatsIndex = DEFAULT_COINSTATSINDEX;
 bool fHavePruned = false;
+bool fHaveUTXOSnapshot = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fRequireStandard = true;
@@ -235,6 +237,8 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 
 CCoinsViewDB *pcoinsdbview = nullptr;
 CCoinsViewCache *pcoinsTip = nullptr;
+CCoinsSetStats coinsSetStats;
+bool fCoinsSetStatsComplete = false;
 CBlockTreeDB *pblocktree = nullptr;
 
 
@@ -1090,24 +1094,37 @@ bool HashOnchainActive(const uint256 &hash)
 }
 
 bool GetAddressIndex(uint256 addressHash, int type,
-                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, int start, int end)
+                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, int start, int end,
+                     size_t nLimit, const CAddressIndexKey *pAfter)
 {
     if (!fAddressIndex)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end))
+    if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end, nLimit, pAfter))
         return error("unable to get txids for address");
 
     return true;
 }
 
+bool GetAddressBalance(uint256 addressHash, int type, CAddressBalanceValue &value)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!pblocktree->ReadAddressBalanceIndex(addressHash, type, value))
+        return error("unable to get balance for address");
+
+    return true;
+}
+
 bool GetAddressUnspent(uint256 addressHash, int type,
-                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs)
+                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                       size_t nLimit, const CAddressUnspentKey *pAfter)
 {
     if (!fAddressIndex)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs))
+    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs, nLimit, pAfter))
         return error("unable to get txids for address");
 
     return true;
@@ -1540,6 +1557,14 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight)
 }
 
 bool CScriptCheck::operator()() {
+    switch (nType)
+    {
+        case CHECK_MLSAG:
+            return VerifyMLSAGSignature(*ptxTo, nIn, nCols, nRows, vM, cacheStore);
+        case CHECK_RANGEPROOF:
+            return VerifyRangeproof(ptxTo->vpout[nIn].get(), cacheStore);
+    };
+
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
     const CScriptWitness *witness = &ptxTo->vin[nIn].scriptWitness;
 
@@ -1578,6 +1603,7 @@ void InitScriptExecutionCache() {
  * If pvChecks is not nullptr, script checks are pushed onto it instead of being performed inline. Any
  * script checks which are not necessary (eg due to script execution cache hits) are, obviously,
  * not pushed onto pvChecks/run.
+ * MLSAG signatures of anon inputs are deferred the same way, key images are always checked inline.
  *
  * Setting cacheSigStore/cacheFullScriptStore to false will remove elements from the corresponding cache
  * which are matched. This is useful for checking blocks where we will likely never need the cache
@@ -1687,7 +1713,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
             }
 
             if (fHaveAnonIn && fAnonChecks
-                && !VerifyMLSAG(tx, state))
+                && !VerifyMLSAG(tx, state, pvChecks, cacheSigStore))
                     return false;
 
             if (cacheFullScriptStore && !pvChecks) {
@@ -2802,7 +2828,7 @@ bool FlushStateToDisk(const CChainParams& chainparams, CValidationState &state,
             nLastSetChain = nNow;
         }
         int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
-        int64_t cacheSize = pcoinsTip->DynamicMemoryUsage();
+        int64_t cacheSize = pcoinsTip->DynamicMemoryUsage() + pblocktree->RCTIndexPendingUsage();
         int64_t nTotalSpace = nCoinCacheUsage + std::max<int64_t>(nMempoolSizeMax - nMempoolUsage, 0);
         // The cache is large and we're within 10% and 10 MiB of the limit, but we have time now (not in the middle of a block processing).
         bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize > std::max((9 * nTotalSpace) / 10, nTotalSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024);
@@ -2853,9 +2879,15 @@ bool FlushStateToDisk(const CChainParams& chainparams, CValidationState &state,
             // overwrite one. Still, use a conservative safety factor of 2.
             if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
+            // The RCT index of the blocks connected since the last flush, before the coins which depend on it
+            if (!pblocktree->FlushRCTIndex())
+                return AbortNode(state, "Failed to write RCT index");
             // Flush the chainstate (which may refer to block index entries).
             if (!pcoinsTip->Flush())
                 return AbortNode(state, "Failed to write to coin database");
+            // Stored after the coins, so they are only used when they match the best block
+            if (fCoinsSetStatsComplete && !pcoinsdbview->WriteCoinsSetStats(coinsSetStats))
+                return AbortNode(state, "Failed to write to coin database");
             nLastFlush = nNow;
         }
     }
@@ -2924,55 +2956,25 @@ bool FlushView(CCoinsViewCache *view, CValidationState& state, bool fDisconnecti
     view->addressUnspentIndex.clear();
     view->spentIndex.clear();
 
+    if (!pblocktree->WriteRCTIndex(*view, fDisconnecting))
+        return error("%s: Write RCT index failed.", __func__);
+
     if (fDisconnecting)
     {
-        for (auto &it : view->keyImages)
-            if (!pblocktree->EraseRCTKeyImage(it.first))
-                return error("%s: EraseRCTKeyImage failed, txn %s.", __func__, it.second.ToString());
-
         if (view->anonOutputLinks.size() > 0)
-        {
-            for (auto &it : view->anonOutputLinks)
-            {
-                if (!pblocktree->EraseRCTOutput(it.second))
-                    return error("%s: EraseRCTOutput failed.", __func__);
-
-                if (!pblocktree->EraseRCTOutputLink(it.first))
-                    return error("%s: EraseRCTOutput failed.", __func__);
-            };
-
-            if (!pblocktree->WriteLastRCTOutput(view->nLastRCTOutput))
-                return error("%s: WriteLastRCTOutput failed.", __func__);
-        };
+            rctOutputTable.Truncate(view->nLastRCTOutput);
+        rctKeyImageFilter.NoteErased(view->keyImages.size());
     } else
     {
-        CDBBatch batch(*pblocktree);
-
-
-        if (view->anonOutputs.size() > 0)
-        {
-            batch.Write(DB_RCTOUTPUT_LAST, view->nLastRCTOutput);
-
-            if (view->nBlockHeight % 250 == 0)
-                batch.Write(std::make_pair(DB_RCTOUTPUT_CHECKPOINT, view->nBlockHeight), view->nLastRCTOutput);
-        } else
-        if (view->nBlockHeight % 250 == 0)
-        {
-            if (pblocktree->ReadLastRCTOutput(view->nLastRCTOutput))
-                batch.Write(std::make_pair(DB_RCTOUTPUT_CHECKPOINT, view->nBlockHeight), view->nLastRCTOutput);
-        };
-
-        for (auto &it : view->keyImages)
-            batch.Write(std::make_pair(DB_RCTKEYIMAGE, it.first), it.second);
-
         for (auto &it : view->anonOutputs)
-            batch.Write(std::make_pair(DB_RCTOUTPUT, it.first), it.second);
-
-        for (auto &it : view->anonOutputLinks)
-            batch.Write(std::make_pair(DB_RCTOUTPUT_LINK, it.first), it.second);
-
-        if (!pblocktree->WriteBatch(batch))
-            return error("%s: Write RCT outputs failed.", __func__);
+            if (!rctOutputTable.Set(it.first, it.second))
+                return error("%s: RCT output table out of sync at %d.", __func__, it.first);
+
+        for (const auto &it : view->keyImages)
+            rctKeyImageFilter.Insert(it.first);
+        if (rctKeyImageFilter.NeedsResize()
+            && !pblocktree->LoadRCTKeyImageFilter(rctKeyImageFilter))
+            return error("%s: Rebuild RCT key image filter failed.", __func__);
     };
 
     view->nLastRCTOutput = 0;
@@ -3635,14 +3637,11 @@ static CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
-    assert(pindexNew);
+    CBlockIndex* pindexNew = mapBlockIndex.emplace(hash, block).first->second;
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
     pindexNew->nSequenceId = 0;
-    BlockMap::iterator mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
-    pindexNew->phashBlock = &((*mi).first);
     BlockMap::iterator miPrev = mapBlockIndex.find(block.hashPrevBlock);
     if (miPrev != mapBlockIndex.end())
     {
@@ -3891,7 +3890,7 @@ bool CheckStakeUnique(const CBlock &block, bool fUpdate)
     return AddToMapStakeSeen(kernel, blockHash);
 };
 
-bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW, bool fCheckMerkleRoot)
+bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW, bool fCheckMerkleRoot, bool fUseCheckQueue)
 {
     // These are checks that are independent of context.
 
@@ -3931,7 +3930,9 @@ bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::P
 
     if (fParticlMode)
     {
-        if (!IsInitialBlockDownload()
+        // fImporting implies IsInitialBlockDownload, checked first to keep cs_main out of the import check threads
+        if (!fImporting
+            && !IsInitialBlockDownload()
             && block.vtx[0]->IsCoinStake()
             && !CheckStakeUnique(block))
         {
@@ -3976,14 +3977,31 @@ bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::P
     };
 
     // Check transactions
+    // Rangeproofs of all blinded and anon outputs in the block are verified on the script check threads
+    bool fQueueRangeproofs = fUseCheckQueue && nScriptCheckThreads && !(fBusyImporting && fSkipRangeproof);
+    CCheckQueueControl<CScriptCheck> control(fQueueRangeproofs ? &scriptcheckqueue : nullptr);
     for (const auto& tx : block.vtx)
     {
         //if (!CheckTransaction(*tx, state, false))
-        if (!CheckTransaction(*tx, state)) // Check for duplicate inputs, TODO: UpdateCoins should return a bool, db/coinsview txn should be undone
+        if (!CheckTransaction(*tx, state, true, !fQueueRangeproofs)) // Check for duplicate inputs, TODO: UpdateCoins should return a bool, db/coinsview txn should be undone
             return state.Invalid(false, state.GetRejectCode(), state.GetRejectReason(),
                                  strprintf("Transaction check failed (tx hash %s) %s", tx->GetHash().ToString(), state.GetDebugMessage()));
+
+        if (fQueueRangeproofs)
+        {
+            std::vector<CScriptCheck> vChecks;
+            for (unsigned int k = 0; k < tx->vpout.size(); ++k)
+            {
+                if (tx->vpout[k]->IsType(OUTPUT_CT) || tx->vpout[k]->IsType(OUTPUT_RINGCT))
+                    vChecks.emplace_back(*tx, k, false);
+            };
+            control.Add(vChecks);
+        };
     };
 
+    if (!control.Wait())
+        return state.DoS(100, false, REJECT_INVALID, "bad-rangeproof-verify", false, "rangeproof verification failed");
+
     unsigned int nSigOps = 0;
     for (const auto& tx : block.vtx)
     {
@@ -4925,19 +4943,8 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
     if (hash.IsNull())
         return nullptr;
 
-    // Return existing
-    BlockMap::iterator mi = mapBlockIndex.find(hash);
-    if (mi != mapBlockIndex.end())
-        return (*mi).second;
-
-    // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
-    if (!pindexNew)
-        throw std::runtime_error(std::string(__func__) + ": new CBlockIndex failed");
-    mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
-    pindexNew->phashBlock = &((*mi).first);
-
-    return pindexNew;
+    // Return existing or create new
+    return mapBlockIndex.emplace(hash).first->second;
 }
 
 bool static LoadBlockIndexDB(const CChainParams& chainparams)
@@ -4956,6 +4963,7 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
         vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
     }
     sort(vSortedByHeight.begin(), vSortedByHeight.end());
+    std::set<int> setBlkDataFiles;
     for (const std::pair<int, CBlockIndex*>& item : vSortedByHeight)
     {
         CBlockIndex* pindex = item.second;
@@ -4979,14 +4987,17 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
             pindex->nStatus |= BLOCK_FAILED_CHILD;
             setDirtyBlockIndex.insert(pindex);
         }
+        // Work mostly increases with height, hinting at the end makes most inserts constant time
         if (pindex->IsValid(BLOCK_VALID_TRANSACTIONS) && (pindex->nChainTx || pindex->pprev == nullptr))
-            setBlockIndexCandidates.insert(pindex);
+            setBlockIndexCandidates.insert(setBlockIndexCandidates.end(), pindex);
         if (pindex->nStatus & BLOCK_FAILED_MASK && (!pindexBestInvalid || pindex->nChainWork > pindexBestInvalid->nChainWork))
             pindexBestInvalid = pindex;
         if (pindex->pprev)
             pindex->BuildSkip();
         if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == nullptr || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
             pindexBestHeader = pindex;
+        if (pindex->nStatus & BLOCK_HAVE_DATA)
+            setBlkDataFiles.insert(pindex->nFile);
     }
 
     // Load block file info
@@ -5008,14 +5019,6 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
 
     // Check presence of blk files
     LogPrintf("Checking all blk files are present...\n");
-    std::set<int> setBlkDataFiles;
-    for (const std::pair<uint256, CBlockIndex*>& item : mapBlockIndex)
-    {
-        CBlockIndex* pindex = item.second;
-        if (pindex->nStatus & BLOCK_HAVE_DATA) {
-            setBlkDataFiles.insert(pindex->nFile);
-        }
-    }
     for (std::set<int>::iterator it = setBlkDataFiles.begin(); it != setBlkDataFiles.end(); it++)
     {
         CDiskBlockPos pos(*it, 0);
@@ -5029,6 +5032,18 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
     if (fHavePruned)
         LogPrintf("LoadBlockIndexDB(): Block files have previously been pruned\n");
 
+    // Blocks below a UTXO snapshot were never downloaded, handle them as pruned
+    bool fLoadingSnapshot = false;
+    pblocktree->ReadFlag("utxosnapshotloading", fLoadingSnapshot);
+    if (fLoadingSnapshot)
+        return error("%s: Loading a UTXO snapshot did not complete, -reindex is required", __func__);
+    pblocktree->ReadFlag("utxosnapshot", fHaveUTXOSnapshot);
+    if (fHaveUTXOSnapshot)
+    {
+        LogPrintf("LoadBlockIndexDB(): Chainstate was loaded from a UTXO snapshot\n");
+        fHavePruned = true;
+    };
+
     // Check whether we need to continue reindexing
     bool fReindexing = false;
     pblocktree->ReadReindexing(fReindexing);
@@ -5042,6 +5057,17 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
     pblocktree->ReadFlag("addressindex", fAddressIndex);
     LogPrintf("%s: address index %s\n", __func__, fAddressIndex ? "enabled" : "disabled");
 
+    // Address indices created before the balance totals were added need them summed once
+    bool fAddressBalanceIndex = false;
+    pblocktree->ReadFlag("addressbalanceindex", fAddressBalanceIndex);
+    if (fAddressIndex && !fAddressBalanceIndex)
+    {
+        LogPrintf("%s: Building address balance index...\n", __func__);
+        if (!pblocktree->RebuildAddressBalanceIndex())
+            return error("%s: Failed to build address balance index.", __func__);
+        pblocktree->WriteFlag("addressbalanceindex", true);
+    };
+
     // Check whether we have a timestamp index
     pblocktree->ReadFlag("timestampindex", fTimestampIndex);
     LogPrintf("%s: timestamp index %s\n", __func__, fTimestampIndex ? "enabled" : "disabled");
@@ -5050,6 +5076,10 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
     pblocktree->ReadFlag("spentindex", fSpentIndex);
     LogPrintf("%s: spent index %s\n", __func__, fSpentIndex ? "enabled" : "disabled");
 
+    if (!pblocktree->LoadRCTOutputTable(rctOutputTable))
+        return error("%s: Failed to load RCT output table.", __func__);
+    LogPrintf("%s: loaded %d RCT outputs\n", __func__, rctOutputTable.GetLastIndex());
+
     return true;
 }
 
@@ -5124,7 +5154,7 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
         uiInterface.ShowProgress(_("Verifying blocks..."), percentageDone);
         if (pindex->nHeight < chainActive.Height()-nCheckDepth)
             break;
-        if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+        if ((fPruneMode || fHaveUTXOSnapshot) && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
             // If pruning, only go back as far as we have data.
             LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
             break;
@@ -5391,11 +5421,13 @@ void UnloadBlockIndex()
         warningcache[b].clear();
     }
 
-    for (BlockMap::value_type& entry : mapBlockIndex) {
-        delete entry.second;
-    }
     mapBlockIndex.clear();
     fHavePruned = false;
+    fHaveUTXOSnapshot = false;
+    coinsSetStats.SetNull();
+    fCoinsSetStatsComplete = false;
+    rctOutputTable.Clear();
+    rctKeyImageFilter.Clear();
 }
 
 bool LoadBlockIndex(const CChainParams& chainparams)
@@ -5424,6 +5456,7 @@ bool LoadBlockIndex(const CChainParams& chainparams)
         // Use the provided setting for -addressindex in the new database
         fAddressIndex = gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
         pblocktree->WriteFlag("addressindex", fAddressIndex);
+        pblocktree->WriteFlag("addressbalanceindex", fAddressIndex);
         LogPrintf("%s: address index %s\n", __func__, fAddressIndex ? "enabled" : "disabled");
 
         // Use the provided setting for -timestampindex in the new database
@@ -5470,7 +5503,309 @@ bool LoadGenesisBlock(const CChainParams& chainparams)
     return true;
 }
 
-bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
+namespace {
+
+/** Bounded FIFO between two stages of the block import pipeline, bounded by the summed weight of its items. */
+template <typename T>
+class CImportQueue
+{
+public:
+    explicit CImportQueue(size_t nMaxWeightIn) : nMaxWeight(nMaxWeightIn) {};
+
+    /** Wait while the queue is full, returns false if the queue was closed. An empty queue takes any item. */
+    bool Push(const T &item, size_t nWeight)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        int64_t nWaitStart = GetTimeMicros();
+        while (!fClosed && !queue.empty() && nWeightQueued + nWeight > nMaxWeight)
+            condPush.wait(lock);
+        nPushWaitMicros += GetTimeMicros() - nWaitStart;
+        if (fClosed)
+            return false;
+        queue.push_back(std::make_pair(item, nWeight));
+        nWeightQueued += nWeight;
+        condPop.notify_one();
+        return true;
+    };
+
+    /** Wait while the queue is empty, returns false once the queue is closed and drained. */
+    bool Pop(T &item)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        int64_t nWaitStart = GetTimeMicros();
+        while (!fClosed && queue.empty())
+            condPop.wait(lock);
+        nPopWaitMicros += GetTimeMicros() - nWaitStart;
+        if (queue.empty())
+            return false;
+        item = queue.front().first;
+        nWeightQueued -= queue.front().second;
+        queue.pop_front();
+        condPush.notify_one();
+        return true;
+    };
+
+    void Close()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fClosed = true;
+        condPush.notify_all();
+        condPop.notify_all();
+    };
+
+    int64_t GetPushWaitMicros()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        return nPushWaitMicros;
+    };
+
+    int64_t GetPopWaitMicros()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        return nPopWaitMicros;
+    };
+
+private:
+    boost::mutex mutex;
+    boost::condition_variable condPush;
+    boost::condition_variable condPop;
+    std::deque<std::pair<T, size_t> > queue;
+    size_t nMaxWeight;
+    size_t nWeightQueued = 0;
+    bool fClosed = false;
+    int64_t nPushWaitMicros = 0;
+    int64_t nPopWaitMicros = 0;
+};
+
+struct CImportBlock
+{
+    uint64_t nPos = 0;                  // Offset of the block data in the file
+    std::unique_ptr<CDataStream> pdata; // Serialised block, released once deserialised
+    std::shared_ptr<CBlock> pblock;     // Null if deserialisation failed
+    uint256 hash;
+    std::string strError;
+    bool fDone = false;
+};
+typedef std::shared_ptr<CImportBlock> CImportBlockRef;
+
+// Serialised bytes held between the read and accept stages
+static const size_t IMPORT_QUEUE_BYTES = 64 * 1024 * 1024;
+
+/**
+ * Import pipeline for a block file, the stages run concurrently with bounded queues between them:
+ * 1. one thread reads blocks from the file,
+ * 2. worker threads deserialise blocks and run the context-free CheckBlock,
+ * 3. the calling thread takes the blocks in file order and accepts them, see LoadExternalBlockFile,
+ * 4. a CImportConnector, if given, connects the accepted blocks.
+ */
+class CBlockImportPipeline
+{
+public:
+    CBlockImportPipeline(const CChainParams &chainparamsIn, FILE *fileIn, int nWorkersIn)
+        : chainparams(chainparamsIn), nWorkers(nWorkersIn),
+          queueCheck(IMPORT_QUEUE_BYTES), queueAccept(IMPORT_QUEUE_BYTES)
+    {
+        threads.create_thread(boost::bind(&CBlockImportPipeline::ThreadRead, this, fileIn));
+        for (int i = 0; i < nWorkers; ++i)
+            threads.create_thread(boost::bind(&CBlockImportPipeline::ThreadCheck, this));
+    };
+
+    ~CBlockImportPipeline()
+    {
+        Stop();
+    };
+
+    /** Next block in file order once it has been checked, returns false at the end of the file. */
+    bool Next(CImportBlockRef &item)
+    {
+        if (!queueAccept.Pop(item))
+            return false;
+
+        boost::unique_lock<boost::mutex> lock(csDone);
+        while (!item->fDone)
+            condDone.wait(lock);
+        return true;
+    };
+
+    void Stop()
+    {
+        queueCheck.Close();
+        queueAccept.Close();
+        threads.interrupt_all();
+        threads.join_all();
+    };
+
+    void LogTimings(int64_t nAcceptMicros)
+    {
+        LogPrint(BCLog::BENCH, "Block import: read %.2fs (%.2fs waiting), check %.2fs on %d threads, accept %.2fs (%.2fs waiting)\n",
+            nReadMicros * 0.000001, queueAccept.GetPushWaitMicros() * 0.000001,
+            nCheckMicros * 0.000001, nWorkers,
+            nAcceptMicros * 0.000001, queueAccept.GetPopWaitMicros() * 0.000001);
+    };
+
+private:
+    void ThreadRead(FILE *fileIn)
+    {
+        RenameThread("particl-loadblk-read");
+        int64_t nStart = GetTimeMicros(), nWait = 0;
+        try {
+            // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
+            CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
+            uint64_t nRewind = blkdat.GetPos();
+            while (!blkdat.eof()) {
+                boost::this_thread::interruption_point();
+
+                blkdat.SetPos(nRewind);
+                nRewind++; // start one byte further next time, in case of failure
+                blkdat.SetLimit(); // remove former limit
+                unsigned int nSize = 0;
+                try {
+                    // locate a header
+                    unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+                    blkdat.FindByte(chainparams.MessageStart()[0]);
+                    nRewind = blkdat.GetPos()+1;
+                    blkdat >> FLATDATA(buf);
+                    if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
+                        continue;
+                    // read size
+                    blkdat >> nSize;
+                    if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                        continue;
+                } catch (const std::exception&) {
+                    // no valid block header found; don't complain
+                    break;
+                }
+                CImportBlockRef item = std::make_shared<CImportBlock>();
+                try {
+                    // read block
+                    item->nPos = blkdat.GetPos();
+                    blkdat.SetLimit(item->nPos + nSize);
+                    blkdat.SetPos(item->nPos);
+                    item->pdata.reset(new CDataStream(SER_DISK, CLIENT_VERSION));
+                    item->pdata->resize(nSize);
+                    blkdat.read(&(*item->pdata)[0], nSize);
+                    nRewind = blkdat.GetPos();
+                } catch (const std::exception& e) {
+                    LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+                    continue;
+                }
+
+                int64_t nWaitStart = GetTimeMicros();
+                if (!queueAccept.Push(item, nSize)
+                    || !queueCheck.Push(item, nSize))
+                    break;
+                nWait += GetTimeMicros() - nWaitStart;
+            }
+        } catch (const std::runtime_error& e) {
+            AbortNode(std::string("System error: ") + e.what());
+        } catch (const boost::thread_interrupted&) {
+        }
+        nReadMicros = GetTimeMicros() - nStart - nWait;
+        queueCheck.Close();
+        queueAccept.Close();
+    };
+
+    void ThreadCheck()
+    {
+        RenameThread("particl-loadblk-check");
+        try {
+            CImportBlockRef item;
+            while (queueCheck.Pop(item))
+            {
+                int64_t nStart = GetTimeMicros();
+                try {
+                    item->pblock = std::make_shared<CBlock>();
+                    *item->pdata >> *item->pblock;
+                    item->hash = item->pblock->GetHash();
+
+                    // Sets fChecked on success so AcceptBlock doesn't repeat the checks, a failed block is
+                    // checked again in AcceptBlock to mark it invalid.
+                    // Not on the script check queue, it can only be driven by one thread at a time.
+                    CValidationState state;
+                    CheckBlock(*item->pblock, state, chainparams.GetConsensus(), true, true, false);
+                } catch (const std::exception& e) {
+                    item->pblock.reset();
+                    item->strError = e.what();
+                }
+                item->pdata.reset();
+                nCheckMicros += GetTimeMicros() - nStart;
+
+                boost::unique_lock<boost::mutex> lock(csDone);
+                item->fDone = true;
+                condDone.notify_all();
+            };
+        } catch (const boost::thread_interrupted&) {
+        }
+    };
+
+    const CChainParams &chainparams;
+    int nWorkers;
+    CImportQueue<CImportBlockRef> queueCheck;
+    CImportQueue<CImportBlockRef> queueAccept;
+    boost::thread_group threads;
+
+    boost::mutex csDone;
+    boost::condition_variable condDone;
+
+    std::atomic<int64_t> nReadMicros{0};
+    std::atomic<int64_t> nCheckMicros{0};
+};
+
+} // namespace
+
+CImportConnector::CImportConnector(const CChainParams &chainparamsIn) : chainparams(chainparamsIn)
+{
+    thread.reset(new boost::thread(boost::bind(&CImportConnector::ThreadConnect, this)));
+};
+
+CImportConnector::~CImportConnector()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        fStopping = true;
+        cond.notify_one();
+    }
+    // Not interrupted, an interruption could land inside ConnectBlock while it waits for the script checks
+    thread->join();
+    LogPrint(BCLog::BENCH, "Block import: connect %.2fs\n", nConnectMicros * 0.000001);
+};
+
+void CImportConnector::BlockAccepted()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    if (++nAccepted % IMPORT_CONNECT_INTERVAL != 0)
+        return;
+    fPending = true;
+    cond.notify_one();
+};
+
+void CImportConnector::ThreadConnect()
+{
+    RenameThread("particl-loadblk-connect");
+    while (true)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            while (!fPending && !fStopping)
+                cond.wait(lock);
+            if (fStopping)
+                return;
+            fPending = false;
+        }
+
+        // Returns early if shutdown is requested
+        int64_t nStart = GetTimeMicros();
+        CValidationState state;
+        if (!ActivateBestChain(state, chainparams))
+        {
+            LogPrintf("%s: ActivateBestChain failed %s\n", __func__, FormatStateMessage(state));
+            return;
+        };
+        nConnectMicros += GetTimeMicros() - nStart;
+    };
+};
+
+bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp, CImportConnector *connector)
 {
     // Map of disk positions for blocks with unknown parent (only used for reindex)
     static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
@@ -5482,47 +5817,28 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
     fSpentIndex = gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
 
     int nLoaded = 0;
-    try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
-            boost::this_thread::interruption_point();
+    int64_t nAcceptMicros = 0;
+    CBlockImportPipeline pipeline(chainparams, fileIn, std::max(nScriptCheckThreads, 1));
+    CImportBlockRef item;
+    while (pipeline.Next(item)) {
+        boost::this_thread::interruption_point();
+        int64_t nAcceptStart = GetTimeMicros();
 
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
-                blkdat.FindByte(chainparams.MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
-            }
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-                CBlock& block = *pblock;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
+        if (!item->pblock) {
+            LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, item->strError);
+            continue;
+        }
+        if (dbp)
+            dbp->nPos = item->nPos;
+        try {
+            std::shared_ptr<CBlock> pblock = item->pblock;
+            CBlock& block = *pblock;
+            uint256 hash = item->hash;
+            item.reset();
+
+            // detect out of order blocks, and store them for later
+            {
+                LOCK(cs_main);
                 if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
                     LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
                             block.hashPrevBlock.ToString());
@@ -5533,60 +5849,66 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
 
                 // process in case the block isn't known yet
                 if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    LOCK(cs_main);
                     CValidationState state;
-                    if (AcceptBlock(pblock, state, chainparams, nullptr, true, dbp, nullptr))
+                    if (AcceptBlock(pblock, state, chainparams, nullptr, true, dbp, nullptr)) {
                         nLoaded++;
+                        if (connector)
+                            connector->BlockAccepted();
+                    }
                     if (state.IsError())
                         break;
                 } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
                     LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
                 }
+            }
 
-                // Activate the genesis block so normal node progress can continue
-                if (hash == chainparams.GetConsensus().hashGenesisBlock) {
-                    CValidationState state;
-                    if (!ActivateBestChain(state, chainparams)) {
-                        break;
-                    }
+            // Activate the genesis block so normal node progress can continue
+            if (hash == chainparams.GetConsensus().hashGenesisBlock) {
+                CValidationState state;
+                if (!ActivateBestChain(state, chainparams)) {
+                    break;
                 }
+            }
 
-                NotifyHeaderTip();
-
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
-                        if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus()))
+            NotifyHeaderTip();
+
+            // Recursively process earlier encountered successors of this block
+            std::deque<uint256> queue;
+            queue.push_back(hash);
+            while (!queue.empty()) {
+                uint256 head = queue.front();
+                queue.pop_front();
+                std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+                while (range.first != range.second) {
+                    std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
+                    std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
+                    if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus()))
+                    {
+                        LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
+                                head.ToString());
+                        LOCK(cs_main);
+                        CValidationState dummy;
+                        if (AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second, nullptr))
                         {
-                            LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
-                                    head.ToString());
-                            LOCK(cs_main);
-                            CValidationState dummy;
-                            if (AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second, nullptr))
-                            {
-                                nLoaded++;
-                                queue.push_back(pblockrecursive->GetHash());
-                            }
+                            nLoaded++;
+                            if (connector)
+                                connector->BlockAccepted();
+                            queue.push_back(pblockrecursive->GetHash());
                         }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                        NotifyHeaderTip();
                     }
+                    range.first++;
+                    mapBlocksUnknownParent.erase(it);
+                    NotifyHeaderTip();
                 }
-            } catch (const std::exception& e) {
-                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
             }
+        } catch (const std::exception& e) {
+            LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
         }
-    } catch (const std::runtime_error& e) {
-        AbortNode(std::string("System error: ") + e.what());
+        nAcceptMicros += GetTimeMicros() - nAcceptStart;
     }
+    pipeline.Stop();
+    pipeline.LogTimings(nAcceptMicros);
+
     if (nLoaded > 0)
         LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
     return nLoaded > 0;
@@ -5918,6 +6240,764 @@ void DumpMempool(void)
     }
 }
 
+static const char *RCT_KEYIMAGE_FILTER_FILENAME = "rctkeyimages.dat";
+
+bool LoadRCTKeyImageFilter()
+{
+    AssertLockHeld(cs_main);
+    int64_t nStart = GetTimeMillis();
+
+    fs::path path = GetDataDir() / RCT_KEYIMAGE_FILTER_FILENAME;
+    {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        if (!file.IsNull())
+        {
+            // Only valid if written at the current tip
+            uint256 hashBlock;
+            try {
+                file >> hashBlock;
+            } catch (const std::exception&) {
+                hashBlock.SetNull();
+            }
+            if (chainActive.Tip()
+                && hashBlock == chainActive.Tip()->GetBlockHash()
+                && rctKeyImageFilter.Read(file))
+            {
+                LogPrintf("%s: Read %s at %s in %dms\n", __func__, RCT_KEYIMAGE_FILTER_FILENAME,
+                    hashBlock.ToString(), GetTimeMillis() - nStart);
+            } else
+            {
+                rctKeyImageFilter.Clear();
+            };
+        };
+    }
+    // The file is stale as soon as a block is connected, it is rewritten at shutdown
+    fs::remove(path);
+
+    if (rctKeyImageFilter.IsLoaded())
+        return true;
+
+    if (!pblocktree->LoadRCTKeyImageFilter(rctKeyImageFilter))
+        return error("%s: Failed to build RCT key image filter.", __func__);
+    LogPrintf("%s: Built from %d key images in %dms\n", __func__,
+        rctKeyImageFilter.GetStats().nElements, GetTimeMillis() - nStart);
+    return true;
+}
+
+void DumpRCTKeyImageFilter()
+{
+    LOCK(cs_main);
+    if (!rctKeyImageFilter.IsLoaded() || !chainActive.Tip())
+        return;
+
+    fs::path path = GetDataDir() / RCT_KEYIMAGE_FILTER_FILENAME;
+    fs::path pathNew = path.string() + ".new";
+    try {
+        FILE *filestr = fsbridge::fopen(pathNew, "wb");
+        if (!filestr)
+            return;
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        file << chainActive.Tip()->GetBlockHash();
+        if (!rctKeyImageFilter.Write(file))
+            return;
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(pathNew, path);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump RCT key image filter: %s. Continuing anyway.\n", e.what());
+    }
+}
+
+void ApplyCoinsStats(CCoinsStats &stats, CHashWriter &ss, const uint256 &hash, const std::map<uint32_t, Coin> &outputs)
+{
+    assert(!outputs.empty());
+    ss << hash;
+    ss << VARINT(outputs.begin()->second.nHeight * 2 + outputs.begin()->second.fCoinBase);
+    stats.nTransactions++;
+    for (const auto output : outputs) {
+        ss << VARINT(output.first + 1);
+        ss << output.second.out.scriptPubKey;
+
+        if (output.second.nType == OUTPUT_STANDARD)
+        {
+            ss << VARINT(output.second.out.nValue);
+            stats.nTransactionOutputs++;
+            stats.nTotalAmount += output.second.out.nValue;
+        } else
+        if (output.second.nType == OUTPUT_CT)
+        {
+            //ss << output.second.commitment;
+            ss.write((char*)&output.second.commitment.data[0], 33);
+            stats.nBlindedTransactionOutputs++;
+        };
+        stats.nBogoSize += GetCoinBogoSize(output.second);
+    }
+    ss << VARINT(0);
+}
+
+bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
+{
+    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
+
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    stats.hashBlock = pcursor->GetBestBlock();
+    {
+        LOCK(cs_main);
+        stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
+    }
+    ss << stats.hashBlock;
+    uint256 prevkey;
+    std::map<uint32_t, Coin> outputs;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        COutPoint key;
+        Coin coin;
+        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
+            if (!outputs.empty() && key.hash != prevkey) {
+                ApplyCoinsStats(stats, ss, prevkey, outputs);
+                outputs.clear();
+            }
+            prevkey = key.hash;
+            outputs[key.n] = std::move(coin);
+        } else {
+            return error("%s: unable to read value", __func__);
+        }
+        pcursor->Next();
+    }
+    if (!outputs.empty()) {
+        ApplyCoinsStats(stats, ss, prevkey, outputs);
+    }
+    stats.hashSerialized = ss.GetHash();
+    stats.nDiskSize = view->EstimateSize();
+    return true;
+}
+
+/** Held while the running coin set statistics are rebuilt or replaced, taken before cs_main */
+static CCriticalSection cs_coinsSetStatsRebuild;
+
+void InitCoinsSetStats()
+{
+    LOCK(cs_main);
+    coinsSetStats.SetNull();
+    fCoinsSetStatsComplete = false;
+    if (!fCoinStatsIndex)
+    {
+        // Updating the totals costs every coin flushed into pcoinsTip a muhash operation under cs_main
+        pcoinsTip->SetStatsTracker(nullptr);
+        return;
+    };
+
+    uint256 hashBestBlock = pcoinsdbview->GetBestBlock();
+    fCoinsSetStatsComplete = pcoinsdbview->ReadCoinsSetStats(coinsSetStats)
+        && coinsSetStats.hashBlock == hashBestBlock;
+    if (hashBestBlock.IsNull())
+    {
+        // The coins db is empty
+        coinsSetStats.SetNull();
+        fCoinsSetStatsComplete = true;
+    } else
+    if (!fCoinsSetStatsComplete)
+    {
+        // Rebuilt from the coins db when first requested
+        coinsSetStats.SetNull();
+        coinsSetStats.hashBlock = pcoinsTip->GetBestBlock();
+    };
+    pcoinsTip->SetStatsTracker(&coinsSetStats);
+    LogPrint(BCLog::COINDB, "%s: Coin set statistics %s\n", __func__, fCoinsSetStatsComplete ? "loaded" : "not available");
+}
+
+namespace {
+
+/** Scans the coins with txids in [nBegin, nEnd) by first byte */
+struct CCoinsSetStatsScan
+{
+    std::unique_ptr<CCoinsViewCursor> pcursor;
+    int nEnd;
+    CCoinsSetStats stats;
+    uint64_t nTransactions = 0;
+    bool fOk = false;
+
+    void Run()
+    {
+        uint256 prevkey;
+        for (; pcursor->Valid(); pcursor->Next())
+        {
+            COutPoint key;
+            Coin coin;
+            if (!pcursor->GetKey(key) || (int)*key.hash.begin() >= nEnd)
+                break;
+            if (!pcursor->GetValue(coin))
+            {
+                LogPrintf("%s: unable to read value\n", __func__);
+                return;
+            };
+            if (nTransactions == 0 || key.hash != prevkey)
+                nTransactions++;
+            prevkey = key.hash;
+            stats.Add(key, coin);
+        };
+        fOk = true;
+    };
+};
+
+} // namespace
+
+/**
+ * Compute the statistics of the coins db by splitting it into ranges of txids scanned on separate threads.
+ * Must be called with cs_main held to create the cursors, which are all taken from the same db state.
+ */
+static void StartCoinsSetStatsScan(std::vector<CCoinsSetStatsScan> &vScans)
+{
+    AssertLockHeld(cs_main);
+    int nShards = std::min(std::max(GetNumCores(), 1), 256);
+    vScans.resize(nShards);
+    for (int i = 0; i < nShards; ++i)
+    {
+        COutPoint start;
+        *start.hash.begin() = (256 * i) / nShards;
+        start.n = 0;
+        vScans[i].pcursor.reset(pcoinsdbview->Cursor(start));
+        vScans[i].nEnd = (256 * (i + 1)) / nShards;
+        vScans[i].stats.hashBlock = vScans[i].pcursor->GetBestBlock();
+    };
+}
+
+static bool FinishCoinsSetStatsScan(std::vector<CCoinsSetStatsScan> &vScans, CCoinsSetStats &stats, uint64_t &nTransactions)
+{
+    boost::thread_group threads;
+    for (size_t i = 1; i < vScans.size(); ++i)
+        threads.create_thread(boost::bind(&CCoinsSetStatsScan::Run, &vScans[i]));
+    vScans[0].Run();
+    threads.join_all();
+
+    stats.SetNull();
+    stats.hashBlock = vScans[0].stats.hashBlock;
+    nTransactions = 0;
+    for (const auto &scan : vScans)
+    {
+        if (!scan.fOk)
+            return false;
+        stats += scan.stats;
+        nTransactions += scan.nTransactions;
+    };
+    return true;
+}
+
+bool GetCoinsSetStats(CCoinsSetStats &stats, bool fFullScan, uint64_t *pnTransactions)
+{
+    {
+        LOCK(cs_main);
+        if (!fFullScan && fCoinsSetStatsComplete)
+        {
+            stats = coinsSetStats;
+            return true;
+        };
+    }
+
+    int64_t nStart = GetTimeMillis();
+    LOCK(cs_coinsSetStatsRebuild);
+    std::vector<CCoinsSetStatsScan> vScans;
+    bool fRebuild;
+    {
+        LOCK(cs_main);
+        if (!fFullScan && fCoinsSetStatsComplete)
+        {
+            stats = coinsSetStats;
+            return true;
+        };
+        FlushStateToDisk();
+        StartCoinsSetStatsScan(vScans);
+
+        // Accumulate the changes made while the db is scanned
+        fRebuild = fCoinStatsIndex && !fCoinsSetStatsComplete;
+        if (fRebuild)
+        {
+            uint256 hashBlock = coinsSetStats.hashBlock;
+            coinsSetStats.SetNull();
+            coinsSetStats.hashBlock = hashBlock;
+        };
+    }
+
+    uint64_t nTransactions;
+    if (!FinishCoinsSetStatsScan(vScans, stats, nTransactions))
+        return error("%s: Scanning the coins db failed", __func__);
+    if (pnTransactions)
+        *pnTransactions = nTransactions;
+    LogPrint(BCLog::BENCH, "%s: Scanned %d outputs on %d threads, %dms\n", __func__,
+        stats.nTransactionOutputs + stats.nBlindedTransactionOutputs, vScans.size(), GetTimeMillis() - nStart);
+
+    if (fRebuild)
+    {
+        LOCK(cs_main);
+        CCoinsSetStats statsDelta = coinsSetStats;
+        coinsSetStats = stats;
+        coinsSetStats += statsDelta;
+        coinsSetStats.hashBlock = statsDelta.hashBlock;
+        fCoinsSetStatsComplete = true;
+    };
+    return true;
+}
+
+bool DumpUTXOSnapshot(const fs::path &path, CUTXOSnapshotHeader &header, CValidationState &state)
+{
+    int64_t nStart = GetTimeMillis();
+
+    // Iterators read from the database state at the time they were created
+    std::unique_ptr<CCoinsViewCursor> pcursor;
+    std::unique_ptr<CDBIterator> pcursorRCT;
+    header.SetNull();
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        pcursor.reset(pcoinsdbview->Cursor());
+        pcursorRCT.reset(pblocktree->NewIterator());
+
+        BlockMap::iterator mi = mapBlockIndex.find(pcursor->GetBestBlock());
+        if (mi == mapBlockIndex.end())
+            return state.Error("Unknown best block in coins db");
+        const CBlockIndex *pindex = mi->second;
+
+        memcpy(header.pchMessageStart, Params().MessageStart(), sizeof(header.pchMessageStart));
+        header.hashBlock = pindex->GetBlockHash();
+        header.nHeight = pindex->nHeight;
+        header.nChainTx = pindex->nChainTx;
+        header.nFlags = pindex->nFlags;
+        header.bnStakeModifier = pindex->bnStakeModifier;
+        header.prevoutStake = pindex->prevoutStake;
+        header.nMoneySupply = pindex->nMoneySupply;
+        if (!pblocktree->ReadLastRCTOutput(header.nLastRCTOutput))
+            return state.Error("ReadLastRCTOutput failed");
+    }
+
+    fs::path pathNew = path;
+    pathNew += ".new";
+    CAutoFile file(fsbridge::fopen(pathNew, "wb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return state.Error(strprintf("Unable to open %s for writing", pathNew.string()));
+
+    try {
+        file << header; // Rewritten once the body is complete
+
+        CHashWriter ssContents(SER_DISK, CLIENT_VERSION);
+        CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+        CCoinsStats stats;
+        ss << header.hashBlock;
+        uint256 prevkey;
+        std::map<uint32_t, Coin> outputs;
+        for (; pcursor->Valid(); pcursor->Next())
+        {
+            boost::this_thread::interruption_point();
+            COutPoint key;
+            Coin coin;
+            if (!pcursor->GetKey(key) || !pcursor->GetValue(coin))
+                return state.Error("Unable to read UTXO set");
+
+            file << key << coin;
+            ssContents << key << coin;
+            header.nCoins++;
+
+            if (!outputs.empty() && key.hash != prevkey)
+            {
+                ApplyCoinsStats(stats, ss, prevkey, outputs);
+                outputs.clear();
+            };
+            prevkey = key.hash;
+            outputs[key.n] = std::move(coin);
+        };
+        if (!outputs.empty())
+            ApplyCoinsStats(stats, ss, prevkey, outputs);
+        header.hashSerialized = ss.GetHash();
+
+        int64_t nRCTOutputs = 0;
+        pcursorRCT->Seek(std::make_pair(DB_RCTOUTPUT, (int64_t)0));
+        for (; pcursorRCT->Valid(); pcursorRCT->Next())
+        {
+            boost::this_thread::interruption_point();
+            std::pair<char, int64_t> key;
+            if (!pcursorRCT->GetKey(key) || key.first != DB_RCTOUTPUT)
+                break;
+            if (key.second < 1 || key.second > header.nLastRCTOutput)
+                continue;
+
+            CAnonOutput ao;
+            if (!pcursorRCT->GetValue(ao))
+                return state.Error(strprintf("Unable to read RCT output %d", key.second));
+            file << key.second << ao;
+            ssContents << key.second << ao;
+            nRCTOutputs++;
+        };
+        if (nRCTOutputs != header.nLastRCTOutput)
+            return state.Error(strprintf("RCT output index is incomplete, found %d of %d", nRCTOutputs, header.nLastRCTOutput));
+
+        pcursorRCT->Seek(std::make_pair(DB_RCTKEYIMAGE, CCmpPubKey()));
+        for (; pcursorRCT->Valid(); pcursorRCT->Next())
+        {
+            boost::this_thread::interruption_point();
+            std::pair<char, CCmpPubKey> key;
+            if (!pcursorRCT->GetKey(key) || key.first != DB_RCTKEYIMAGE)
+                break;
+
+            uint256 txhash;
+            if (!pcursorRCT->GetValue(txhash))
+                return state.Error("Unable to read RCT key image");
+            file << key.second << txhash;
+            ssContents << key.second << txhash;
+            header.nKeyImages++;
+        };
+        header.hashContents = ssContents.GetHash();
+
+        if (fseek(file.Get(), 0, SEEK_SET) != 0)
+            return state.Error("Unable to rewrite snapshot header");
+        file << header;
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(pathNew, path);
+    } catch (const std::exception &e) {
+        return state.Error(strprintf("Failed to write snapshot: %s", e.what()));
+    };
+
+    LogPrintf("Dumped UTXO snapshot at %s (%d): %d coins, %d RCT outputs, %d key images, %dms\n",
+        header.hashBlock.ToString(), header.nHeight, header.nCoins, header.nLastRCTOutput, header.nKeyImages, GetTimeMillis() - nStart);
+    return true;
+}
+
+/**
+ * Read the body of a snapshot and check it against the header.
+ * If fApply is set the records are also written to the chainstate and RCT index as they are read.
+ */
+static bool ProcessUTXOSnapshot(CAutoFile &file, const CUTXOSnapshotHeader &header, bool fApply, CValidationState &state,
+    CCoinsSetStats *pSetStats = nullptr)
+{
+    try {
+        CHashWriter ssContents(SER_DISK, CLIENT_VERSION);
+        CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+        CCoinsStats stats;
+        ss << header.hashBlock;
+        uint256 prevkey;
+        std::map<uint32_t, Coin> outputs;
+        for (uint64_t i = 0; i < header.nCoins; ++i)
+        {
+            if (i % 100000 == 0)
+                boost::this_thread::interruption_point();
+            COutPoint key;
+            Coin coin;
+            file >> key >> coin;
+            ssContents << key << coin;
+
+            if (coin.IsSpent() || coin.nHeight > (uint32_t)header.nHeight)
+                return state.Error(strprintf("Invalid coin %s,%d", key.hash.ToString(), key.n));
+
+            if (!outputs.empty() && key.hash != prevkey)
+            {
+                ApplyCoinsStats(stats, ss, prevkey, outputs);
+                outputs.clear();
+            };
+            prevkey = key.hash;
+
+            if (fApply)
+            {
+                if (pSetStats)
+                    pSetStats->Add(key, coin);
+                pcoinsTip->AddCoin(key, Coin(coin), false);
+                if (pcoinsTip->DynamicMemoryUsage() > nCoinCacheUsage)
+                {
+                    pcoinsTip->SetBestBlock(header.hashBlock);
+                    if (!pcoinsTip->Flush())
+                        return state.Error("Failed to write to coin database");
+                };
+            };
+            outputs[key.n] = std::move(coin);
+        };
+        if (!outputs.empty())
+            ApplyCoinsStats(stats, ss, prevkey, outputs);
+        if (ss.GetHash() != header.hashSerialized)
+            return state.Error(strprintf("UTXO set hash %s does not match snapshot header", ss.GetHash().ToString()));
+
+        if (header.nLastRCTOutput < 0)
+            return state.Error("Invalid RCT output count");
+        std::vector<bool> vHave(header.nLastRCTOutput, false);
+        CDBBatch batch(*pblocktree);
+        for (int64_t i = 0; i < header.nLastRCTOutput; ++i)
+        {
+            int64_t nIndex;
+            CAnonOutput ao;
+            file >> nIndex >> ao;
+            ssContents << nIndex << ao;
+
+            if (nIndex < 1 || nIndex > header.nLastRCTOutput || vHave[nIndex-1]
+                || ao.nBlockHeight > header.nHeight)
+                return state.Error(strprintf("Invalid RCT output %d", nIndex));
+            vHave[nIndex-1] = true;
+
+            if (fApply)
+            {
+                batch.Write(std::make_pair(DB_RCTOUTPUT, nIndex), ao);
+                batch.Write(std::make_pair(DB_RCTOUTPUT_LINK, ao.pubkey), nIndex);
+            };
+            if (batch.SizeEstimate() > nDefaultDbBatchSize)
+            {
+                if (!pblocktree->WriteBatch(batch))
+                    return state.Error("Failed to write to block index database");
+                batch.Clear();
+            };
+        };
+
+        for (uint64_t i = 0; i < header.nKeyImages; ++i)
+        {
+            CCmpPubKey ki;
+            uint256 txhash;
+            file >> ki >> txhash;
+            ssContents << ki << txhash;
+
+            if (fApply)
+                batch.Write(std::make_pair(DB_RCTKEYIMAGE, ki), txhash);
+            if (batch.SizeEstimate() > nDefaultDbBatchSize)
+            {
+                if (!pblocktree->WriteBatch(batch))
+                    return state.Error("Failed to write to block index database");
+                batch.Clear();
+            };
+        };
+        if (ssContents.GetHash() != header.hashContents)
+            return state.Error("Snapshot contents do not match the header hash");
+
+        if (fApply)
+        {
+            batch.Write(DB_RCTOUTPUT_LAST, header.nLastRCTOutput);
+            if (!pblocktree->WriteBatch(batch, true))
+                return state.Error("Failed to write to block index database");
+            pcoinsTip->SetBestBlock(header.hashBlock);
+            if (!pcoinsTip->Flush())
+                return state.Error("Failed to write to coin database");
+        };
+    } catch (const std::exception &e) {
+        return state.Error(strprintf("Failed to read snapshot: %s", e.what()));
+    };
+
+    return true;
+}
+
+/** The chainstate is partially written once a snapshot starts loading */
+static bool UTXOSnapshotLoadFailed(CValidationState &state)
+{
+    std::string strReason = state.IsError() ? state.GetRejectReason() : "Failed to write to database";
+    LogPrintf("ERROR: Loading UTXO snapshot failed: %s\n", strReason);
+    state = CValidationState();
+    return state.Error(strprintf("%s, the node must be restarted with -reindex", strReason));
+}
+
+static bool CheckUTXOSnapshotBase(const CUTXOSnapshotHeader &header, CBlockIndex *&pindexBase, CValidationState &state)
+{
+    AssertLockHeld(cs_main);
+
+    BlockMap::iterator mi = mapBlockIndex.find(header.hashBlock);
+    if (mi == mapBlockIndex.end())
+        return state.Error(strprintf("Snapshot block %s is not in the header chain", header.hashBlock.ToString()));
+    pindexBase = mi->second;
+
+    if (!pindexBase->IsValid(BLOCK_VALID_TREE) || (pindexBase->nStatus & BLOCK_FAILED_MASK))
+        return state.Error(strprintf("Snapshot block %s is invalid", header.hashBlock.ToString()));
+    if (pindexBase->nHeight != header.nHeight || pindexBase->nHeight < 1)
+        return state.Error(strprintf("Snapshot block height %d is invalid", header.nHeight));
+    if (chainActive.Height() != 0)
+        return state.Error("Snapshots can only be loaded before any blocks past genesis are connected");
+    return true;
+}
+
+bool LoadUTXOSnapshot(const CChainParams &chainparams, const fs::path &path, const uint256 &hashExpected, bool fUnsafe,
+    CUTXOSnapshotHeader &header, CValidationState &state)
+{
+    int64_t nStart = GetTimeMillis();
+
+    // Only the expected hash ties the coins, RCT records and stake fields to a trusted source
+    if (hashExpected.IsNull() && !fUnsafe)
+        return state.Error("A snapshot hash is required to load a snapshot");
+
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return state.Error(strprintf("Unable to open %s", path.string()));
+
+    try {
+        file >> header;
+    } catch (const std::exception &e) {
+        return state.Error(strprintf("Failed to read snapshot header: %s", e.what()));
+    };
+    if (header.nVersion != UTXO_SNAPSHOT_VERSION)
+        return state.Error(strprintf("Unknown snapshot version %d", header.nVersion));
+    if (memcmp(header.pchMessageStart, chainparams.MessageStart(), sizeof(header.pchMessageStart)) != 0)
+        return state.Error("Snapshot is for a different network");
+    if (!hashExpected.IsNull() && header.GetHash() != hashExpected)
+        return state.Error(strprintf("Snapshot hash %s does not match %s", header.GetHash().ToString(), hashExpected.ToString()));
+    if (hashExpected.IsNull())
+        LogPrintf("%s: Loading unverified snapshot %s\n", __func__, header.GetHash().ToString());
+
+    CBlockIndex *pindexBase;
+    {
+        LOCK(cs_main);
+        if (!CheckUTXOSnapshotBase(header, pindexBase, state))
+            return false;
+    }
+
+    // Verify the whole file before the chainstate is touched
+    if (!ProcessUTXOSnapshot(file, header, false, state))
+        return false;
+    LogPrintf("%s: Verified snapshot at %s (%d), %d coins, %dms\n", __func__,
+        header.hashBlock.ToString(), header.nHeight, header.nCoins, GetTimeMillis() - nStart);
+
+    {
+        LOCK2(cs_coinsSetStatsRebuild, cs_main);
+        if (!CheckUTXOSnapshotBase(header, pindexBase, state))
+            return false;
+
+        mempool.clear();
+        if (!FlushStateToDisk(chainparams, state, FLUSH_STATE_ALWAYS))
+            return false;
+
+        // Cleared once the snapshot is complete, a node that stops before then must reindex
+        if (!pblocktree->WriteFlag("utxosnapshotloading", true))
+            return state.Error("Failed to write to block index database");
+
+        // Outputs created by the genesis block are in the snapshot if unspent
+        std::unique_ptr<CCoinsViewCursor> pcursor(pcoinsdbview->Cursor());
+        for (; pcursor->Valid(); pcursor->Next())
+        {
+            COutPoint key;
+            if (pcursor->GetKey(key))
+                pcoinsTip->SpendCoin(key);
+        };
+        pcursor.reset();
+
+        CUTXOSnapshotHeader headerVerified = header;
+        if (fseek(file.Get(), 0, SEEK_SET) != 0)
+            return state.Error("Failed to rewind snapshot file");
+        try {
+            file >> header;
+        } catch (const std::exception &e) {
+            return state.Error(strprintf("Failed to read snapshot header: %s", e.what()));
+        };
+        if (SerializeHash(header) != SerializeHash(headerVerified))
+            return state.Error("Snapshot file changed while loading");
+
+        // The RCT records are written to the database directly, nothing may be held over them
+        if (!pblocktree->FlushRCTIndex())
+            return state.Error("Failed to write RCT index");
+
+        // Coins are written directly to pcoinsTip, bypassing the running statistics
+        CCoinsSetStats setStats;
+        if (!ProcessUTXOSnapshot(file, header, true, state, &setStats))
+            return UTXOSnapshotLoadFailed(state);
+        if (fCoinStatsIndex)
+        {
+            setStats.hashBlock = header.hashBlock;
+            coinsSetStats = setStats;
+            fCoinsSetStatsComplete = true;
+        };
+
+        // Blocks below the snapshot are treated as pruned, they were never downloaded
+        std::vector<CBlockIndex*> vChain;
+        for (CBlockIndex *pindex = pindexBase; pindex->pprev; pindex = pindex->pprev)
+            vChain.push_back(pindex);
+        std::reverse(vChain.begin(), vChain.end());
+
+        std::deque<CBlockIndex*> queue;
+        for (CBlockIndex *pindex : vChain)
+        {
+            if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+            {
+                if (pindex != pindexBase)
+                    pindex->nTx = 1;
+                else
+                    pindex->nTx = header.nChainTx > pindex->pprev->nChainTx ? header.nChainTx - pindex->pprev->nChainTx : 1;
+            };
+            pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
+            if (IsWitnessEnabled(pindex->pprev, chainparams.GetConsensus()))
+                pindex->nStatus |= BLOCK_OPT_WITNESS;
+            pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
+            setDirtyBlockIndex.insert(pindex);
+
+            // Blocks already received on other branches
+            auto range = mapBlocksUnlinked.equal_range(pindex);
+            for (auto it = range.first; it != range.second; )
+            {
+                if (pindexBase->GetAncestor(it->second->nHeight) != it->second)
+                    queue.push_back(it->second);
+                it = mapBlocksUnlinked.erase(it);
+            };
+        };
+
+        pindexBase->nFlags = header.nFlags;
+        pindexBase->bnStakeModifier = header.bnStakeModifier;
+        pindexBase->prevoutStake = header.prevoutStake;
+        pindexBase->nMoneySupply = header.nMoneySupply;
+        {
+            LOCK(cs_nBlockSequenceId);
+            pindexBase->nSequenceId = nBlockSequenceId++;
+        }
+        setBlockIndexCandidates.insert(pindexBase);
+
+        // As in ReceivedBlockTransactions
+        while (!queue.empty())
+        {
+            CBlockIndex *pindex = queue.front();
+            queue.pop_front();
+            pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
+            {
+                LOCK(cs_nBlockSequenceId);
+                pindex->nSequenceId = nBlockSequenceId++;
+            }
+            setBlockIndexCandidates.insert(pindex);
+            auto range = mapBlocksUnlinked.equal_range(pindex);
+            for (auto it = range.first; it != range.second; )
+            {
+                queue.push_back(it->second);
+                it = mapBlocksUnlinked.erase(it);
+            };
+        };
+
+        fHavePruned = true;
+        fHaveUTXOSnapshot = true;
+        chainActive.SetTip(pindexBase);
+        PruneBlockIndexCandidates();
+
+        if (!pblocktree->WriteFlag("utxosnapshot", true)
+            || !FlushStateToDisk(chainparams, state, FLUSH_STATE_ALWAYS)
+            || !pblocktree->WriteFlag("utxosnapshotloading", false))
+            return UTXOSnapshotLoadFailed(state);
+
+        if (!pblocktree->LoadRCTOutputTable(rctOutputTable))
+            return state.Error("Failed to load RCT output table");
+        pblocktree->LoadRCTKeyImageFilter(rctKeyImageFilter);
+
+        // Checkpoints used by wallet rescans, written every 250 blocks by WriteRCTIndex
+        CDBBatch batch(*pblocktree);
+        int64_t nLastIndex = rctOutputTable.GetLastIndex(), nIndex = 0;
+        for (int nCheckpoint = 250; nCheckpoint <= header.nHeight; nCheckpoint += 250)
+        {
+            CRCTOutputTable::Entry entry;
+            while (nIndex < nLastIndex && rctOutputTable.Get(nIndex + 1, entry) && entry.nBlockHeight <= nCheckpoint)
+                nIndex++;
+            batch.Write(std::make_pair(DB_RCTOUTPUT_CHECKPOINT, nCheckpoint), nIndex);
+        };
+        if (!pblocktree->WriteBatch(batch))
+            return state.Error("Failed to write to block index database");
+
+        CheckBlockIndex(chainparams.GetConsensus());
+    }
+
+    LogPrintf("%s: Loaded snapshot at %s (%d), %d coins, %d RCT outputs, %d key images, %dms\n", __func__,
+        header.hashBlock.ToString(), header.nHeight, header.nCoins, header.nLastRCTOutput, header.nKeyImages, GetTimeMillis() - nStart);
+
+    bool fInitialDownload = IsInitialBlockDownload();
+    GetMainSignals().UpdatedBlockTip(pindexBase, chainActive.Genesis(), fInitialDownload);
+    uiInterface.NotifyBlockTip(fInitialDownload, pindexBase);
+
+    // Connect any blocks received above the snapshot
+    CValidationState stateActivate;
+    ActivateBestChain(stateActivate, chainparams);
+    return true;
+}
+
 //! Guess how far we are in the verification process at the given block index
 double GuessVerificationProgress(const ChainTxData& data, CBlockIndex *pindex) {
     if (pindex == nullptr)
@@ -5936,20 +7016,6 @@ double GuessVerificationProgress(const ChainTxData& data, CBlockIndex *pindex) {
     return pindex->nChainTx / fTxTotal;
 }
 
-class CMainCleanup
-{
-public:
-    CMainCleanup() {}
-    ~CMainCleanup() {
-        // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
-        mapBlockIndex.clear();
-    }
-} instance_of_cmaincleanup;
-
-
 bool CoinStakeCache::GetCoinStake(const uint256 &blockHash, CTransactionRef &tx)
 {
 
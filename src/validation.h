@@ -11,6 +11,7 @@
 #endif
 
 #include "amount.h"
+#include "blockindexmap.h"
 #include "coins.h"
 #include "fs.h"
 #include "protocol.h" // For CMessageHeader::MessageStartChars
@@ -32,6 +33,11 @@
 #include <vector>
 
 #include <atomic>
+#include <memory>
+
+namespace boost {
+class thread;
+} // namespace boost
 
 class CBlockIndex;
 class CBlockTreeDB;
@@ -39,6 +45,7 @@ class CChainParams;
 class CCoinsViewDB;
 class CInv;
 class CConnman;
+class CHashWriter;
 class CScriptCheck;
 class CBlockPolicyEstimator;
 class CTxMemPool;
@@ -136,6 +143,7 @@ static const bool DEFAULT_TXINDEX = true; // required for staking
 static const bool DEFAULT_ADDRESSINDEX = false;
 static const bool DEFAULT_TIMESTAMPINDEX = false;
 static const bool DEFAULT_SPENTINDEX = false;
+static const bool DEFAULT_COINSTATSINDEX = false;
 static const unsigned int DEFAULT_DB_MAX_OPEN_FILES = 64; // set to 1000 for insight
 static const bool DEFAULT_DB_COMPRESSION = false; // set to true for insight
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
@@ -162,11 +170,6 @@ inline int64_t FutureDrift(int64_t nTime) { return nTime + 15; } // FutureDriftV
 static const int DEFAULT_STOPATHEIGHT = 0;
 
 
-struct BlockHasher
-{
-    size_t operator()(const uint256& hash) const { return hash.GetCheapHash(); }
-};
-
 typedef int64_t NodeId;
 class StakeConflict
 {
@@ -197,7 +200,7 @@ extern CScript COINBASE_FLAGS;
 extern CCriticalSection cs_main;
 extern CBlockPolicyEstimator feeEstimator;
 extern CTxMemPool mempool;
-typedef std::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
+typedef CBlockIndexMap BlockMap;
 extern BlockMap mapBlockIndex;
 extern std::map<COutPoint, uint256> mapStakeSeen;
 extern std::list<COutPoint> listStakeSeen;
@@ -216,6 +219,7 @@ extern bool fTxIndex;
 extern bool fAddressIndex;
 extern bool fSpentIndex;
 extern bool fTimestampIndex;
+extern bool fCoinStatsIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
@@ -244,6 +248,8 @@ static const uint64_t nMinDiskSpace = 52428800;
 /** Pruning-related variables and constants */
 /** True if any block files have ever been pruned. */
 extern bool fHavePruned;
+/** True if the chainstate was loaded from a UTXO snapshot, blocks below it are treated as pruned. */
+extern bool fHaveUTXOSnapshot;
 /** True if we're running in -prune mode. */
 extern bool fPruneMode;
 /** Number of MiB of block files that we're trying to stay below. */
@@ -304,8 +310,33 @@ bool CheckDiskSpace(uint64_t nAdditionalBytes = 0);
 FILE* OpenBlockFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 /** Translation to a filesystem path */
 fs::path GetBlockPosFilename(const CDiskBlockPos &pos, const char *prefix);
-/** Import blocks from an external file */
-bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp = nullptr);
+/** Connects blocks on its own thread while they are imported, the last connect finishes before the destructor returns. */
+class CImportConnector
+{
+public:
+    // Accepted blocks between each attempt to connect
+    static const int IMPORT_CONNECT_INTERVAL = 100;
+
+    explicit CImportConnector(const CChainParams &chainparamsIn);
+    ~CImportConnector();
+
+    void BlockAccepted();
+
+private:
+    void ThreadConnect();
+
+    const CChainParams &chainparams;
+    std::unique_ptr<boost::thread> thread;
+    boost::mutex cs;
+    boost::condition_variable cond;
+    bool fPending = false;
+    bool fStopping = false;
+    int nAccepted = 0;
+    int64_t nConnectMicros = 0;
+};
+
+/** Import blocks from an external file, reading and checking blocks in parallel with accepting them */
+bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp = nullptr, CImportConnector *connector = nullptr);
 /** Ensures we have a genesis block in the block tree, possibly writing one to disk. */
 bool LoadGenesisBlock(const CChainParams& chainparams);
 /** Load the block tree and coins database from disk,
@@ -437,21 +468,43 @@ private:
     bool cacheStore;
     ScriptError error;
     PrecomputedTransactionData *txdata;
+
+    // Particl: deferred MLSAG verification of anon input nIn, vM holds the prepared ring matrix,
+    // or rangeproof verification of output nIn
+    int nType;
+    std::vector<uint8_t> vM;
+    size_t nCols;
+    size_t nRows;
 public:
-    CScriptCheck(): amount(0), ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
+    enum CheckType { CHECK_SCRIPT = 0, CHECK_MLSAG, CHECK_RANGEPROOF };
+
+    CScriptCheck(): amount(0), ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR), nType(CHECK_SCRIPT), nCols(0), nRows(0) {}
 
     CScriptCheck(const CScript& scriptPubKeyIn, const std::vector<uint8_t> &vchAmountIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, PrecomputedTransactionData* txdataIn) :
         scriptPubKey(scriptPubKeyIn), vchAmount(vchAmountIn),
-        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn) { }
+        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn), nType(CHECK_SCRIPT), nCols(0), nRows(0) { }
 
     CScriptCheck(const CScript& scriptPubKeyIn, const CAmount amountIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, PrecomputedTransactionData* txdataIn) :
         scriptPubKey(scriptPubKeyIn), amount(amountIn),
-        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn)
+        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn), nType(CHECK_SCRIPT), nCols(0), nRows(0)
         {
             vchAmount.resize(8);
             memcpy(&vchAmount[0], &amountIn, 8);
         };
 
+    /** MLSAG check for anon input nInIn, takes ownership of the prepared matrix in vMIn */
+    CScriptCheck(std::vector<uint8_t> &vMIn, size_t nColsIn, size_t nRowsIn, const CTransaction& txToIn, unsigned int nInIn, bool cacheIn) :
+        amount(0), ptxTo(&txToIn), nIn(nInIn), nFlags(0), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(nullptr),
+        nType(CHECK_MLSAG), nCols(nColsIn), nRows(nRowsIn)
+        {
+            vM.swap(vMIn);
+        };
+
+    /** Rangeproof check for blinded or anon output nOutIn */
+    CScriptCheck(const CTransaction& txToIn, unsigned int nOutIn, bool cacheIn) :
+        amount(0), ptxTo(&txToIn), nIn(nOutIn), nFlags(0), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(nullptr),
+        nType(CHECK_RANGEPROOF), nCols(0), nRows(0) { };
+
     bool operator()();
 
     void swap(CScriptCheck &check) {
@@ -464,6 +517,10 @@ public:
         std::swap(cacheStore, check.cacheStore);
         std::swap(error, check.error);
         std::swap(txdata, check.txdata);
+        std::swap(nType, check.nType);
+        vM.swap(check.vM);
+        std::swap(nCols, check.nCols);
+        std::swap(nRows, check.nRows);
     }
 
     ScriptError GetScriptError() const { return error; }
@@ -476,9 +533,11 @@ bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
 bool HashOnchainActive(const uint256 &hash);
 bool GetAddressIndex(uint256 addressHash, int type,
                      std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
-                     int start = 0, int end = 0);
+                     int start = 0, int end = 0, size_t nLimit = 0, const CAddressIndexKey *pAfter = nullptr);
+bool GetAddressBalance(uint256 addressHash, int type, CAddressBalanceValue &value);
 bool GetAddressUnspent(uint256 addressHash, int type,
-                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
+                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                       size_t nLimit = 0, const CAddressUnspentKey *pAfter = nullptr);
 
 /** Initializes the script-execution cache */
 void InitScriptExecutionCache();
@@ -497,7 +556,7 @@ bool CheckStakeUnused(const COutPoint &kernel);
 bool CheckStakeUnique(const CBlock &block, bool fUpdate=true);
 
 /** Context-independent validity checks */
-bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true, bool fCheckMerkleRoot = true);
+bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fUseCheckQueue = true);
 
 unsigned int GetNextTargetRequired(const CBlockIndex *pindexLast);
 
@@ -594,5 +653,141 @@ void DumpMempool();
 /** Load the mempool from disk. */
 bool LoadMempool();
 
+/** Load the RCT key image filter from disk if it matches the chain tip, otherwise build it from txdb. */
+bool LoadRCTKeyImageFilter();
+
+/** Dump the RCT key image filter to disk. */
+void DumpRCTKeyImageFilter();
+
+struct CCoinsStats
+{
+    int nHeight;
+    uint256 hashBlock;
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    uint64_t nBlindedTransactionOutputs;
+    uint64_t nBogoSize;
+    uint256 hashSerialized;
+    uint64_t nDiskSize;
+    CAmount nTotalAmount;
+
+    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBlindedTransactionOutputs(0), nBogoSize(0), nDiskSize(0), nTotalAmount(0) {}
+};
+
+/** Add the unspent outputs of one transaction to stats, transactions must be applied in coins db order */
+void ApplyCoinsStats(CCoinsStats &stats, CHashWriter &ss, const uint256 &hash, const std::map<uint32_t, Coin> &outputs);
+
+/** Calculate statistics about the unspent transaction output set */
+bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats);
+
+/** Statistics of the coins at the tip, updated as blocks are flushed into pcoinsTip with -coinstatsindex (cs_main) */
+extern CCoinsSetStats coinsSetStats;
+/** Whether coinsSetStats covers the whole set, otherwise it is rebuilt on first use */
+extern bool fCoinsSetStatsComplete;
+
+/** With -coinstatsindex, load the coin set statistics stored in the chainstate and track pcoinsTip */
+void InitCoinsSetStats();
+
+/**
+ * Get the coin set statistics at the tip, from the running totals if available.
+ * Otherwise, or if fFullScan is set, the coins db is scanned on multiple threads and
+ * pnTransactions is set to the number of transactions with unspent outputs.
+ * Without -coinstatsindex every request scans.
+ */
+bool GetCoinsSetStats(CCoinsSetStats &stats, bool fFullScan, uint64_t *pnTransactions = nullptr);
+
+static const uint64_t UTXO_SNAPSHOT_VERSION = 1;
+
+/**
+ * Header of a UTXO set snapshot file.
+ * Fields are fixed size so the counts and hashes can be filled in once the body has been written.
+ * The body holds nCoins (COutPoint, Coin) pairs in coins db order, nLastRCTOutput (index, CAnonOutput)
+ * pairs and nKeyImages (key image, txid) pairs.
+ */
+class CUTXOSnapshotHeader
+{
+public:
+    uint64_t nVersion;
+    CMessageHeader::MessageStartChars pchMessageStart;
+    uint256 hashBlock;
+    int32_t nHeight;
+    uint64_t nChainTx;
+
+    // Fields of the base block index that are only set when the block is connected
+    uint32_t nFlags;
+    uint256 bnStakeModifier;
+    COutPoint prevoutStake;
+    int64_t nMoneySupply;
+
+    uint256 hashSerialized; // gettxoutsetinfo hash_serialized_2 at hashBlock
+    uint64_t nCoins;
+    int64_t nLastRCTOutput;
+    uint64_t nKeyImages;
+    uint256 hashContents; // Hash of all records in the body
+
+    CUTXOSnapshotHeader()
+    {
+        SetNull();
+    };
+
+    void SetNull()
+    {
+        nVersion = UTXO_SNAPSHOT_VERSION;
+        memset(pchMessageStart, 0, sizeof(pchMessageStart));
+        hashBlock.SetNull();
+        nHeight = 0;
+        nChainTx = 0;
+        nFlags = 0;
+        bnStakeModifier.SetNull();
+        prevoutStake.SetNull();
+        nMoneySupply = 0;
+        hashSerialized.SetNull();
+        nCoins = 0;
+        nLastRCTOutput = 0;
+        nKeyImages = 0;
+        hashContents.SetNull();
+    };
+
+    ADD_SERIALIZE_METHODS;
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(nVersion);
+        READWRITE(FLATDATA(pchMessageStart));
+        READWRITE(hashBlock);
+        READWRITE(nHeight);
+        READWRITE(nChainTx);
+        READWRITE(nFlags);
+        READWRITE(bnStakeModifier);
+        READWRITE(prevoutStake);
+        READWRITE(nMoneySupply);
+        READWRITE(hashSerialized);
+        READWRITE(nCoins);
+        READWRITE(nLastRCTOutput);
+        READWRITE(nKeyImages);
+        READWRITE(hashContents);
+    };
+
+    /**
+     * Commits to every header field and, through hashContents, to every record in the body,
+     * this is the hash a snapshot must be checked against before it can be trusted.
+     */
+    uint256 GetHash() const
+    {
+        return SerializeHash(*this);
+    };
+};
+
+/** Write the coins db, RCT output index and spent key images at the current tip to a snapshot file. */
+bool DumpUTXOSnapshot(const fs::path &path, CUTXOSnapshotHeader &header, CValidationState &state);
+
+/**
+ * Replace the chainstate of a node that has not connected any blocks past genesis with a snapshot.
+ * The header chain must contain the snapshot block, blocks below it are treated as pruned.
+ * hashExpected must match CUTXOSnapshotHeader::GetHash() of the snapshot, it can only be null if fUnsafe is set.
+ */
+bool LoadUTXOSnapshot(const CChainParams &chainparams, const fs::path &path, const uint256 &hashExpected, bool fUnsafe,
+    CUTXOSnapshotHeader &header, CValidationState &state);
+
 
 #endif // BITCOIN_VALIDATION_H
@@ -29,12 +29,17 @@
 #include "anon.h"
 #include "txdb.h"
 #include "rpc/server.h"
+#include "workerpool.h"
 
 #include "univalue.h"
 
 #include <secp256k1_mlsag.h>
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <random>
 
 #include <boost/algorithm/string/replace.hpp>
@@ -127,6 +132,7 @@ int CHDWallet::FreeExtKeyMaps()
         if (it->second)
             delete it->second;
     mapExtAccounts.clear();
+    InvalidateStealthScanKeys();
 
     ExtKeyMap::iterator itl = mapExtKeys.begin();
     for (itl = mapExtKeys.begin(); itl != mapExtKeys.end(); ++itl)
@@ -245,7 +251,7 @@ bool CHDWallet::InitLoadWallet()
             }
 
             int64_t nStart = GetTimeMillis();
-            pwallet->ScanForWalletTransactions(pindexRescan, true);
+            pwallet->ScanBlocksPipelined(pindexRescan, true);
             LogPrintf(" rescan      %15dms\n", GetTimeMillis() - nStart);
             pwallet->SetBestChain(chainActive.GetLocator());
             pwallet->dbw->IncrementUpdateCounter();
@@ -937,7 +943,14 @@ bool CHDWallet::Lock()
         ExtKeyLock();
     }
 
-    return CCryptoKeyStore::Lock();
+    if (!CCryptoKeyStore::Lock())
+        return false;
+
+    // Drop the private keys SMSG prepared for scanning incoming messages,
+    // after locking so they can't be read again from the keystore.
+    SecureMsgInvalidateScanKeys();
+
+    return true;
 };
 
 bool CHDWallet::Unlock(const SecureString &strWalletPassphrase)
@@ -1199,6 +1212,7 @@ bool CHDWallet::ImportStealthAddress(const CStealthAddress &sxAddr, const CKey &
 
     // Must add before changing spend_secret
     stealthAddresses.insert(sxAddr);
+    InvalidateStealthScanKeys();
 
     bool fOwned = skSpend.IsValid();
 
@@ -1208,6 +1222,7 @@ bool CHDWallet::ImportStealthAddress(const CStealthAddress &sxAddr, const CKey &
         if (IsLocked())
         {
             stealthAddresses.erase(sxAddr);
+            InvalidateStealthScanKeys();
             return error("%s: Wallet must be unlocked.", __func__);
         };
 
@@ -1215,6 +1230,7 @@ bool CHDWallet::ImportStealthAddress(const CStealthAddress &sxAddr, const CKey &
         if (!AddKeyPubKey(skSpend, pk))
         {
             stealthAddresses.erase(sxAddr);
+            InvalidateStealthScanKeys();
             return error("%s: AddKeyPubKey failed.", __func__);
         };
     };
@@ -1222,6 +1238,7 @@ bool CHDWallet::ImportStealthAddress(const CStealthAddress &sxAddr, const CKey &
     if (!CHDWalletDB(*dbw).WriteStealthAddress(sxAddr))
     {
         stealthAddresses.erase(sxAddr);
+        InvalidateStealthScanKeys();
         return error("%s: WriteStealthAddress failed.", __func__);
     };
 
@@ -1369,6 +1386,7 @@ bool CHDWallet::DelAddressBook(const CTxDestination &address)
             {
                 //fOwned = si->scan_secret.size() < 32 ? false : true;
 
+                InvalidateStealthScanKeys();
                 if (stealthAddresses.erase(sxAddr) < 1
                     || !CHDWalletDB(*dbw).EraseStealthAddress(sxAddr))
                 {
@@ -4099,8 +4117,8 @@ int CHDWallet::PickHidingOutputs(std::vector<std::vector<int64_t> > &vMI, size_t
 
             if (nDecoy > nLastDepthCheckPassed)
             {
-                CAnonOutput ao;
-                if (!pblocktree->ReadRCTOutput(nDecoy, ao))
+                CRCTOutputTable::Entry ao;
+                if (!rctOutputTable.Get(nDecoy, ao))
                     return errorN(1, sError, __func__, _("Anon output not found in db, %d").c_str(), nDecoy);
 
                 if (ao.nBlockHeight > nBestHeight - (consensusParams.nMinRCTOutputDepth+nExtraDepth))
@@ -4733,6 +4751,19 @@ int CHDWallet::AddAnonInputs(CWalletTx &wtx, CTransactionRecord &rtx,
     return 0;
 };
 
+bool CHDWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
+{
+    LOCK(cs_wallet);
+    bool fSizeMatched = nStakeCandidatesWalletSize == mapWallet.size();
+    if (!CWallet::AddToWallet(wtxIn, fFlushOnClose))
+        return false;
+
+    UpdateStakeCandidates(wtxIn.GetHash());
+    if (fSizeMatched)
+        nStakeCandidatesWalletSize = mapWallet.size();
+    return true;
+};
+
 bool CHDWallet::LoadToWallet(const CWalletTx& wtxIn)
 {
     uint256 hash = wtxIn.GetHash();
@@ -4799,6 +4830,7 @@ void CHDWallet::RemoveFromTxSpends(const uint256 &hash, const CTransactionRef pt
 int CHDWallet::UnloadTransaction(const uint256 &hash)
 {
     // Remove txn from wallet, inc TxSpends
+    InvalidateStakeCandidates();
 
     MapWallet_t::iterator itw;
     MapRecords_t::iterator itr;
@@ -6103,6 +6135,7 @@ int CHDWallet::ExtKeyAddAccountToMaps(CKeyID &idAccount, CExtKeyAccount *sea, bo
     };
 
     mapExtAccounts[idAccount] = sea;
+    InvalidateStealthScanKeys();
     return 0;
 };
 
@@ -6118,6 +6151,7 @@ int CHDWallet::ExtKeyRemoveAccountFromMapsAndFree(CExtKeyAccount *sea)
         mapExtKeys.erase(sea->vExtKeyIDs[i]);
 
     mapExtAccounts.erase(idAccount);
+    InvalidateStealthScanKeys();
     sea->FreeChains();
     delete sea;
     return 0;
@@ -6223,6 +6257,7 @@ int CHDWallet::ExtKeyLoadAccountPacks()
             nStealthKeys++;
             sea->mapStealthKeys[it->id] = it->aks;
         };
+        InvalidateStealthScanKeys();
     };
 
     if (LogAcceptCategory(BCLog::HDWALLET))
@@ -6853,6 +6888,7 @@ int CHDWallet::NewStealthKeyFromAccount(
 
     CKeyID idKey = aks.GetID();
     sea->mapStealthKeys[idKey] = aks;
+    InvalidateStealthScanKeys();
 
     if (!pwdb->ReadExtStealthKeyPack(idAccount, sea->nPackStealth, aksPak))
     {
@@ -6867,6 +6903,7 @@ int CHDWallet::NewStealthKeyFromAccount(
     if (!pwdb->WriteExtStealthKeyPack(idAccount, sea->nPackStealth, aksPak))
     {
         sea->mapStealthKeys.erase(idKey);
+        InvalidateStealthScanKeys();
         sek->SetCounter(nChildBkp, true);
         return errorN(1, "%s Save key pack %u failed.", __func__, sea->nPackStealth);
     };
@@ -6874,6 +6911,7 @@ int CHDWallet::NewStealthKeyFromAccount(
     if (!pwdb->WriteExtKey(sea->vExtKeyIDs[nChain], *sek))
     {
         sea->mapStealthKeys.erase(idKey);
+        InvalidateStealthScanKeys();
         sek->SetCounter(nChildBkp, true);
         return errorN(1, "%s Save account chain failed.", __func__);
     };
@@ -7130,13 +7168,12 @@ int CHDWallet::ScanChainFromTime(int64_t nTimeStartScan)
 
     {
         LOCK2(cs_main, cs_wallet);
-
         MarkDirty();
-
-        ScanForWalletTransactions(pindex, true);
-        ReacceptWalletTransactions();
     } // cs_main, cs_wallet
 
+    ScanBlocksPipelined(pindex, true);
+    ReacceptWalletTransactions();
+
     return 0;
 };
 
@@ -7157,16 +7194,314 @@ int CHDWallet::ScanChainFromHeight(int nHeight)
 
     {
         LOCK2(cs_main, cs_wallet);
-
         MarkDirty();
-
-        ScanForWalletTransactions(pindex, true);
-        ReacceptWalletTransactions();
     } // cs_main, cs_wallet
 
+    ScanBlocksPipelined(pindex, true);
+    ReacceptWalletTransactions();
+
     return 0;
 };
 
+// Blocks read and matched ahead of the block being added to the wallet
+static const size_t RESCAN_PIPELINE_WINDOW = 128;
+
+/** Get the stealth key data for an output as ScanForOwnedOutputs and CheckForStealthAndNarration would read it */
+static bool GetStealthOutputKeys(const CTransaction &tx, size_t nOut,
+    CKeyID &idMatch, ec_point &vchEphemPK, uint32_t &prefix, bool &fHavePrefix)
+{
+    const CTxOutBase *txout = tx.vpout[nOut].get();
+    const std::vector<uint8_t> *pvData = nullptr;
+    CTxDestination address;
+
+    prefix = 0;
+    fHavePrefix = false;
+
+    if (txout->IsType(OUTPUT_CT)
+        || txout->IsType(OUTPUT_RINGCT))
+    {
+        if (txout->IsType(OUTPUT_CT))
+        {
+            const CTxOutCT *ctout = (CTxOutCT*) txout;
+            if (!ExtractDestination(ctout->scriptPubKey, address)
+                || address.type() != typeid(CKeyID))
+                return false;
+            idMatch = boost::get<CKeyID>(address);
+            pvData = &ctout->vData;
+        } else
+        {
+            const CTxOutRingCT *rctout = (CTxOutRingCT*) txout;
+            idMatch = rctout->pk.GetID();
+            pvData = &rctout->vData;
+        };
+
+        const std::vector<uint8_t> &vData = *pvData;
+        if (vData.size() != 33)
+        {
+            if (vData.size() != 38
+                || vData[33] != DO_STEALTH_PREFIX)
+                return false;
+            fHavePrefix = true;
+            memcpy(&prefix, &vData[34], 4);
+        };
+        vchEphemPK.assign(vData.begin(), vData.begin() + 33);
+        return true;
+    };
+
+    if (!txout->IsType(OUTPUT_STANDARD)
+        || nOut + 1 >= tx.vpout.size()
+        || !tx.vpout[nOut+1]->IsType(OUTPUT_DATA))
+        return false;
+
+    const std::vector<uint8_t> &vData = ((CTxOutData*)tx.vpout[nOut+1].get())->vData;
+    if (vData.size() < 34
+        || vData[0] != DO_STEALTH)
+        return false;
+
+    const CTxOutStandard *so = (CTxOutStandard*) txout;
+    if (!ExtractDestination(so->scriptPubKey, address)
+        || address.type() != typeid(CKeyID))
+        return false;
+    idMatch = boost::get<CKeyID>(address);
+
+    if (vData.size() >= 34 + 5
+        && vData[34] == DO_STEALTH_PREFIX)
+    {
+        fHavePrefix = true;
+        memcpy(&prefix, &vData[35], 4);
+    };
+    vchEphemPK.assign(vData.begin() + 1, vData.begin() + 34);
+    return true;
+};
+
+CBlockIndex *CHDWallet::ScanBlocksPipelined(CBlockIndex *pindexStart, bool fUpdate, size_t nThreads)
+{
+    if (nThreads == 0)
+        nThreads = std::max(GetNumCores(), 1);
+    if (nThreads < 2
+        || !pindexStart)
+        return ScanForWalletTransactions(pindexStart, fUpdate);
+
+    /*
+        Three stages:
+        - The ordered stage below queues block positions while holding cs_main.
+        - Worker threads read queued blocks and match their stealth outputs against a
+          copy of the scan keys, holding no locks.
+        - The ordered stage adds the transactions of each block to the wallet in chain
+          order under cs_main and cs_wallet, ProcessStealthOutput uses the precomputed matches.
+    */
+    struct ScanItem
+    {
+        CBlockIndex *pindex = nullptr;
+        CDiskBlockPos pos;
+        CBlock block;
+        CStealthScanHints hints;
+        bool fDone = false;
+        bool fRead = false;
+    };
+
+    const CChainParams &chainParams = Params();
+    std::vector<ScanItem> vItems(RESCAN_PIPELINE_WINDOW);
+    std::vector<CStealthScanKey> vKeys;
+    uint64_t nGeneration;
+
+    std::mutex mtx;
+    std::condition_variable cvQueued, cvDone;
+    size_t nQueued = 0, nClaimed = 0, nCommitted = 0;
+    bool fStop = false;
+
+    CBlockIndex *pindexLastQueued = nullptr;
+    CBlockIndex *pindexResume = nullptr;
+    CBlockIndex *ret = nullptr;
+    double dProgressStart, dProgressTip;
+    int64_t nNow = GetTime();
+
+    // Must be called with cs_main locked
+    auto QueueBlocks = [&]() {
+        AssertLockHeld(cs_main);
+        std::lock_guard<std::mutex> lock(mtx);
+        while (nQueued - nCommitted < vItems.size())
+        {
+            CBlockIndex *pindexNext = pindexLastQueued ? chainActive.Next(pindexLastQueued) : pindexStart;
+            if (!pindexNext)
+                break;
+            ScanItem &item = vItems[nQueued % vItems.size()];
+            item.pindex = pindexNext;
+            item.pos = pindexNext->GetBlockPos();
+            item.fDone = false;
+            item.fRead = false;
+            pindexLastQueued = pindexNext;
+            nQueued++;
+        };
+        nRescanEndHeight = chainActive.Height();
+        cvQueued.notify_all();
+    };
+
+    {
+        LOCK2(cs_main, cs_wallet);
+        fAbortRescan = false;
+        fScanningWallet = true;
+
+        if (!fStealthScanKeysValid)
+            BuildStealthScanKeys();
+        vKeys = vStealthScanKeys;
+        nGeneration = nStealthScanKeysGeneration;
+
+        nRescanStartHeight = pindexStart->nHeight;
+        nRescanHeight = pindexStart->nHeight;
+        nRescanStartTime = GetTimeMillis();
+        nRescanTransactions = 0;
+
+        ShowProgress(_("Rescanning..."), 0);
+        dProgressStart = GuessVerificationProgress(chainParams.TxData(), pindexStart);
+        dProgressTip = GuessVerificationProgress(chainParams.TxData(), chainActive.Tip());
+
+        QueueBlocks();
+    } // cs_main, cs_wallet
+
+    // Stops and joins the workers when leaving early, as when adding a block throws
+    struct WorkerStopper
+    {
+        std::mutex &mtx;
+        std::condition_variable &cvQueued;
+        bool &fStop;
+        std::vector<std::thread> &vThreads;
+
+        ~WorkerStopper() { Stop(); };
+        void Stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                fStop = true;
+                cvQueued.notify_all();
+            }
+            for (auto &thread : vThreads)
+                if (thread.joinable())
+                    thread.join();
+        };
+    };
+
+    std::vector<std::thread> vThreads;
+    WorkerStopper stopper{mtx, cvQueued, fStop, vThreads};
+    for (size_t t = 0; t < nThreads; ++t)
+    {
+        vThreads.emplace_back([&]() {
+            for (;;)
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cvQueued.wait(lock, [&]() { return fStop || nClaimed < nQueued; });
+                if (fStop)
+                    return;
+                ScanItem &item = vItems[nClaimed++ % vItems.size()];
+                lock.unlock();
+
+                item.hints.nGeneration = nGeneration;
+                item.hints.mapMatches.clear();
+                item.fRead = ReadBlockFromDisk(item.block, item.pos, chainParams.GetConsensus())
+                    && item.block.GetHash() == item.pindex->GetBlockHash();
+
+                for (size_t i = 0; item.fRead && i < item.block.vtx.size(); ++i)
+                {
+                    const CTransaction &tx = *item.block.vtx[i];
+                    for (size_t k = 0; k < tx.vpout.size(); ++k)
+                    {
+                        CKeyID idMatch;
+                        ec_point vchEphemPK, pkExtracted;
+                        uint32_t prefix;
+                        bool fHavePrefix;
+                        secp256k1_pubkey pkEphem;
+                        if (!GetStealthOutputKeys(tx, k, idMatch, vchEphemPK, prefix, fHavePrefix)
+                            || StealthParsePubKey(vchEphemPK, pkEphem) != 0)
+                            continue;
+
+                        CKey sShared;
+                        size_t nMatch;
+                        int64_t nHint = FindStealthScanKey(vKeys, pkEphem, idMatch, prefix, fHavePrefix,
+                            nMatch, sShared, pkExtracted, 1) ? (int64_t)nMatch : -1;
+                        item.hints.mapMatches[std::make_pair(idMatch, vchEphemPK)] = nHint;
+                    };
+                };
+
+                lock.lock();
+                item.fDone = true;
+                cvDone.notify_all();
+            };
+        });
+    };
+
+    while (!fAbortRescan)
+    {
+        ScanItem *pitem;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            if (nCommitted >= nQueued)
+                break;
+            pitem = &vItems[nCommitted % vItems.size()];
+            cvDone.wait(lock, [&]() { return pitem->fDone; });
+        }
+        ScanItem &item = *pitem;
+        CBlockIndex *pindex = item.pindex;
+
+        {
+            LOCK2(cs_main, cs_wallet);
+
+            if (!chainActive.Contains(pindex))
+            {
+                // Reorganised since queued, continue from the fork with the unpipelined scan
+                pindexResume = chainActive.Next(chainActive.FindFork(pindex));
+                break;
+            };
+
+            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
+                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((GuessVerificationProgress(chainParams.TxData(), pindex) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+            if (GetTime() >= nNow + 60)
+            {
+                nNow = GetTime();
+                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, GuessVerificationProgress(chainParams.TxData(), pindex));
+            };
+
+            if (item.fRead)
+            {
+                pStealthScanHints = &item.hints;
+                for (size_t posInBlock = 0; posInBlock < item.block.vtx.size(); ++posInBlock)
+                    AddToWalletIfInvolvingMe(item.block.vtx[posInBlock], pindex, posInBlock, fUpdate);
+                pStealthScanHints = nullptr;
+                nRescanTransactions += item.block.vtx.size();
+            } else
+            {
+                ret = pindex;
+            };
+            nRescanHeight = pindex->nHeight;
+
+            item.block.SetNull();
+            item.hints.mapMatches.clear();
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                nCommitted++;
+            }
+            QueueBlocks();
+        } // cs_main, cs_wallet
+    };
+
+    stopper.Stop();
+
+    if (fAbortRescan)
+        LogPrintf("Rescan aborted at block %d.\n", nRescanHeight.load());
+    ShowProgress(_("Rescanning..."), 100);
+
+    if (pindexResume && !fAbortRescan)
+    {
+        CBlockIndex *pindexFailed = ScanForWalletTransactions(pindexResume, fUpdate);
+        if (pindexFailed)
+            ret = pindexFailed;
+    };
+
+    LogPrint(BCLog::HDWALLET, "%s: Scanned %d blocks, %u txns in %d ms, %d threads.\n", __func__,
+        nRescanHeight - nRescanStartHeight + 1, nRescanTransactions.load(), GetTimeMillis() - nRescanStartTime, nThreads);
+    fScanningWallet = false;
+    return ret;
+};
+
 CAmount CHDWallet::GetMinimumFee(unsigned int nTxBytes, const CCoinControl& coin_control, const CTxMemPool& pool, const CBlockPolicyEstimator& estimator, FeeCalculation *feeCalc) const
 {
     /* User control of how to calculate fee uses the following parameter precedence:
@@ -7468,6 +7803,7 @@ bool CHDWallet::CommitTransaction(CWalletTx &wtxNew, CTransactionRecord &rtx,
         LogPrintf("CommitTransaction:\n%s", wtxNew.tx->ToString());
 
         AddToRecord(rtx, *wtxNew.tx, nullptr, -1);
+        UpdateStakeCandidates(wtxNew.GetHash());
 
         // Track how many getdata requests our transaction gets
         mapRequestCount[wtxNew.GetHash()] = 0;
@@ -7525,6 +7861,7 @@ int CHDWallet::LoadStealthAddresses()
         stealthAddresses.insert(sx);
     };
     pcursor->close();
+    InvalidateStealthScanKeys();
 
     LogPrint(BCLog::HDWALLET, "Loaded %u stealth address.\n", stealthAddresses.size());
 
@@ -7921,6 +8258,135 @@ inline bool MatchPrefix(uint32_t nAddrBits, uint32_t addrPrefix, uint32_t output
     return (addrPrefix & mask) == (outputPrefix & mask);
 };
 
+static CWorkerPool &StealthScanPool()
+{
+    // Started on first use, the calling thread takes a share of the keys
+    static CWorkerPool pool(std::max(GetNumCores(), 1) - 1, "stealth-scan");
+    return pool;
+};
+
+void CHDWallet::BuildStealthScanKeys()
+{
+    vStealthScanKeys.clear();
+
+    std::set<CStealthAddress>::const_iterator it;
+    for (it = stealthAddresses.begin(); it != stealthAddresses.end(); ++it)
+    {
+        if (!it->scan_secret.IsValid())
+            continue; // stealth address is not owned
+
+        CStealthScanKey sk;
+        if (StealthParsePubKey(it->spend_pubkey, sk.pkSpend) != 0)
+            continue;
+        sk.nPrefixBits = it->prefix.number_bits;
+        sk.nPrefix = it->prefix.bitfield;
+        sk.skScan = it->scan_secret;
+        sk.fAccount = false;
+        sk.sx = *it;
+        vStealthScanKeys.push_back(sk);
+    };
+
+    ExtKeyAccountMap::const_iterator mi;
+    for (mi = mapExtAccounts.begin(); mi != mapExtAccounts.end(); ++mi)
+    {
+        CExtKeyAccount *ea = mi->second;
+
+        for (AccStealthKeyMap::const_iterator it = ea->mapStealthKeys.begin(); it != ea->mapStealthKeys.end(); ++it)
+        {
+            const CEKAStealthKey &aks = it->second;
+
+            if (!aks.skScan.IsValid())
+                continue;
+
+            CStealthScanKey sk;
+            if (StealthParsePubKey(aks.pkSpend, sk.pkSpend) != 0)
+                continue;
+            sk.nPrefixBits = aks.nPrefixBits;
+            sk.nPrefix = aks.nPrefix;
+            sk.skScan = aks.skScan;
+            sk.fAccount = true;
+            sk.idAccount = mi->first;
+            sk.idStealthKey = it->first;
+            vStealthScanKeys.push_back(sk);
+        };
+    };
+
+    fStealthScanKeysValid = true;
+    nStealthScanKeysGeneration++;
+    LogPrint(BCLog::HDWALLET, "%s: %u scan keys.\n", __func__, vStealthScanKeys.size());
+};
+
+static bool MatchStealthScanKey(const CHDWallet::CStealthScanKey &sk, const secp256k1_pubkey &pkEphem, const CKeyID &idMatch,
+    CKey &sShared, ec_point &pkExtracted)
+{
+    if (StealthSecret(sk.skScan, pkEphem, sk.pkSpend, sShared, pkExtracted) != 0)
+    {
+        LogPrintf("%s: StealthSecret failed.\n", __func__);
+        return false;
+    };
+
+    CPubKey pkE(pkExtracted);
+    return pkE.IsValid() && pkE.GetID() == idMatch;
+};
+
+bool CHDWallet::FindStealthScanKey(const std::vector<CStealthScanKey> &vKeys,
+    const secp256k1_pubkey &pkEphem, const CKeyID &idMatch, uint32_t prefix, bool fHavePrefix,
+    size_t &nMatch, CKey &sShared, ec_point &pkExtracted, size_t nTasks)
+{
+    // Prefix filter first, only the remaining keys need an EC multiply
+    std::vector<size_t> vCandidates;
+    for (size_t i = 0; i < vKeys.size(); ++i)
+    {
+        const CStealthScanKey &sk = vKeys[i];
+        if (MatchPrefix(sk.nPrefixBits, sk.nPrefix, prefix, fHavePrefix))
+            vCandidates.push_back(i);
+    };
+
+    bool fAutoTasks = nTasks == 0;
+    if (fAutoTasks)
+        nTasks = std::min((size_t)std::max(GetNumCores(), 1), vCandidates.size() / STEALTH_SCAN_MIN_KEYS_PER_THREAD);
+    CWorkerPool *pool = nullptr;
+    if (nTasks > 1)
+    {
+        pool = &StealthScanPool();
+        if (fAutoTasks)
+            nTasks = std::min(nTasks, pool->Size() + 1);
+    };
+    if (nTasks < 2)
+    {
+        for (size_t k = 0; k < vCandidates.size(); ++k)
+        {
+            if (!MatchStealthScanKey(vKeys[vCandidates[k]], pkEphem, idMatch, sShared, pkExtracted))
+                continue;
+            nMatch = vCandidates[k];
+            return true;
+        };
+        return false;
+    };
+
+    // Tasks take interleaved candidates and stop once a lower candidate has matched,
+    // so the first matching key is found as in the sequential loop.
+    std::atomic<size_t> nFound(vCandidates.size());
+    pool->Run(nTasks, [&](size_t t) {
+        CKey sSharedT;
+        ec_point pkExtractedT;
+        for (size_t k = t; k < vCandidates.size() && k < nFound; k += nTasks)
+        {
+            if (!MatchStealthScanKey(vKeys[vCandidates[k]], pkEphem, idMatch, sSharedT, pkExtractedT))
+                continue;
+            size_t nPrev = nFound;
+            while (k < nPrev && !nFound.compare_exchange_weak(nPrev, k));
+            break;
+        };
+    });
+
+    if (nFound >= vCandidates.size())
+        return false;
+
+    nMatch = vCandidates[nFound];
+    return MatchStealthScanKey(vKeys[nMatch], pkEphem, idMatch, sShared, pkExtracted);
+};
+
 bool CHDWallet::ProcessStealthOutput(const CTxDestination &address,
     std::vector<uint8_t> &vchEphemPK, uint32_t prefix, bool fHavePrefix, CKey &sShared, bool fNeedShared)
 {
@@ -7944,34 +8410,44 @@ bool CHDWallet::ProcessStealthOutput(const CTxDestination &address,
         return true;
     };
 
-    std::set<CStealthAddress>::iterator it;
-    for (it = stealthAddresses.begin(); it != stealthAddresses.end(); ++it)
-    {
-        if (!MatchPrefix(it->prefix.number_bits, it->prefix.bitfield, prefix, fHavePrefix))
-            continue;
+    // Parse the ephemeral pubkey once for all scan keys
+    secp256k1_pubkey pkEphem;
+    if (StealthParsePubKey(vchEphemPK, pkEphem) != 0)
+        return false;
 
-        if (!it->scan_secret.IsValid())
-            continue; // stealth address is not owned
+    if (!fStealthScanKeysValid)
+        BuildStealthScanKeys();
 
-        if (StealthSecret(it->scan_secret, vchEphemPK, it->spend_pubkey, sShared, pkExtracted) != 0)
-        {
-            LogPrintf("%s: StealthSecret failed.\n", __func__);
-            continue;
-        };
+    size_t nMatch;
+    std::map<std::pair<CKeyID, ec_point>, int64_t>::const_iterator itHint;
+    if (pStealthScanHints
+        && pStealthScanHints->nGeneration == nStealthScanKeysGeneration
+        && (itHint = pStealthScanHints->mapMatches.find(std::make_pair(ckidMatch, vchEphemPK))) != pStealthScanHints->mapMatches.end())
+    {
+        // Matched during a pipelined rescan, only the found key needs to be recomputed
+        if (itHint->second < 0
+            || (size_t)itHint->second >= vStealthScanKeys.size())
+            return false;
+        nMatch = itHint->second;
+        if (!MatchStealthScanKey(vStealthScanKeys[nMatch], pkEphem, ckidMatch, sShared, pkExtracted))
+            return false;
+    } else
+    if (!FindStealthScanKey(vStealthScanKeys, pkEphem, ckidMatch, prefix, fHavePrefix, nMatch, sShared, pkExtracted))
+        return false;
 
-        CPubKey pkE(pkExtracted);
-        if (!pkE.IsValid())
-            continue;
+    const CStealthScanKey &sk = vStealthScanKeys[nMatch];
+    CPubKey pkE(pkExtracted);
+    CKeyID idExtracted = pkE.GetID();
 
-        CKeyID idExtracted = pkE.GetID();
-        if (ckidMatch != idExtracted)
-            continue;
+    if (!sk.fAccount)
+    {
+        const CStealthAddress &sx = sk.sx;
 
         if (LogAcceptCategory(BCLog::HDWALLET))
-            LogPrintf("Found stealth txn to address %s\n", it->Encoded());
+            LogPrintf("Found stealth txn to address %s\n", sx.Encoded());
 
         CStealthAddressIndexed sxi;
-        it->ToRaw(sxi.addrRaw);
+        sx.ToRaw(sxi.addrRaw);
         uint32_t sxId;
         if (!UpdateStealthAddressIndex(ckidMatch, sxi, sxId))
             return error("%s: UpdateStealthAddressIndex failed.\n", __func__);
@@ -7986,7 +8462,7 @@ bool CHDWallet::ProcessStealthOutput(const CTxDestination &address,
             CBitcoinAddress coinAddress(idExtracted);
 
             CPubKey cpkEphem(vchEphemPK);
-            CPubKey cpkScan(it->scan_pubkey);
+            CPubKey cpkScan(sx.scan_pubkey);
             CStealthKeyMetadata lockedSkMeta(cpkEphem, cpkScan);
 
             if (!CHDWalletDB(*dbw).WriteStealthKeyMeta(idExtracted, lockedSkMeta))
@@ -7996,33 +8472,33 @@ bool CHDWallet::ProcessStealthOutput(const CTxDestination &address,
             return true;
         };
 
-        if (!GetKey(it->spend_secret_id, sSpend))
+        if (!GetKey(sx.spend_secret_id, sSpend))
         {
             // silently fail?
             if (LogAcceptCategory(BCLog::HDWALLET))
                 LogPrintf("GetKey() stealth spend failed.\n");
-            continue;
+            return false;
         };
 
         CKey sSpendR;
         if (StealthSharedToSecretSpend(sShared, sSpend, sSpendR) != 0)
         {
             LogPrintf("%s: StealthSharedToSecretSpend() failed.\n", __func__);
-            continue;
+            return false;
         };
 
         CPubKey pkT = sSpendR.GetPubKey();
         if (!pkT.IsValid())
         {
             LogPrintf("%s: pkT is invalid.\n", __func__);
-            continue;
+            return false;
         };
 
         CKeyID keyID = pkT.GetID();
         if (keyID != ckidMatch)
         {
             LogPrintf("%s: Spend key mismatch!\n", __func__);
-            continue;
+            return false;
         };
 
         if (LogAcceptCategory(BCLog::HDWALLET))
@@ -8031,7 +8507,7 @@ bool CHDWallet::ProcessStealthOutput(const CTxDestination &address,
         if (!AddKeyPubKey(sSpendR, pkT))
         {
             LogPrintf("%s: AddKeyPubKey failed.\n", __func__);
-            continue;
+            return false;
         };
 
         nFoundStealth++;
@@ -8039,80 +8515,56 @@ bool CHDWallet::ProcessStealthOutput(const CTxDestination &address,
     };
 
     // ext account stealth keys
-    ExtKeyAccountMap::const_iterator mi;
-    for (mi = mapExtAccounts.begin(); mi != mapExtAccounts.end(); ++mi)
+    ExtKeyAccountMap::const_iterator mi = mapExtAccounts.find(sk.idAccount);
+    if (mi == mapExtAccounts.end())
+        return error("%s: Unknown account %s.", __func__, sk.idAccount.ToString());
+    CExtKeyAccount *ea = mi->second;
+    AccStealthKeyMap::const_iterator itAks = ea->mapStealthKeys.find(sk.idStealthKey);
+    if (itAks == ea->mapStealthKeys.end())
+        return error("%s: Unknown stealth key %s.", __func__, sk.idStealthKey.ToString());
+    const CEKAStealthKey &aks = itAks->second;
+
+    if (LogAcceptCategory(BCLog::HDWALLET))
     {
-        CExtKeyAccount *ea = mi->second;
+        LogPrintf("Found stealth txn to address %s\n", aks.ToStealthAddress());
 
-        for (AccStealthKeyMap::iterator it = ea->mapStealthKeys.begin(); it != ea->mapStealthKeys.end(); ++it)
+        // Check key if not locked
+        if (!IsLocked())
         {
-            const CEKAStealthKey &aks = it->second;
-
-            if (!MatchPrefix(aks.nPrefixBits, aks.nPrefix, prefix, fHavePrefix))
-                continue;
-
-            if (!aks.skScan.IsValid())
-                continue;
-
-            if (StealthSecret(aks.skScan, vchEphemPK, aks.pkSpend, sShared, pkExtracted) != 0)
-            {
-                LogPrintf("%s: StealthSecret failed.\n", __func__);
-                continue;
-            };
-
-            CPubKey pkE(pkExtracted);
-            if (!pkE.IsValid())
-                continue;
-
-            CKeyID idExtracted = pkE.GetID();
-            if (ckidMatch != idExtracted)
-                continue;
-
-            if (LogAcceptCategory(BCLog::HDWALLET))
+            CKey kTest;
+            if (0 != ea->ExpandStealthChildKey(&aks, sShared, kTest))
             {
-                LogPrintf("Found stealth txn to address %s\n", aks.ToStealthAddress());
-
-                // Check key if not locked
-                if (!IsLocked())
-                {
-                    CKey kTest;
-                    if (0 != ea->ExpandStealthChildKey(&aks, sShared, kTest))
-                    {
-                        LogPrintf("%s: Error: ExpandStealthChildKey failed! %s.\n", __func__, aks.ToStealthAddress());
-                        continue;
-                    };
-
-                    CKeyID kTestId = kTest.GetPubKey().GetID();
-                    if (kTestId != ckidMatch)
-                    {
-                        LogPrintf("%s: Error: Spend key mismatch!\n", __func__);
-                        continue;
-                    };
-                    CBitcoinAddress coinAddress(kTestId);
-                    LogPrintf("Debug: ExpandStealthChildKey matches! %s, %s.\n", aks.ToStealthAddress(), coinAddress.ToString());
-                };
+                LogPrintf("%s: Error: ExpandStealthChildKey failed! %s.\n", __func__, aks.ToStealthAddress());
+                return false;
             };
 
-            // Don't need to extract key now, wallet may be locked
-            CKeyID idStealthKey = aks.GetID();
-            CEKASCKey kNew(idStealthKey, sShared);
-            if (0 != ExtKeySaveKey(ea, ckidMatch, kNew))
+            CKeyID kTestId = kTest.GetPubKey().GetID();
+            if (kTestId != ckidMatch)
             {
-                LogPrintf("%s: Error: ExtKeySaveKey failed!\n", __func__);
-                continue;
+                LogPrintf("%s: Error: Spend key mismatch!\n", __func__);
+                return false;
             };
-
-            CStealthAddressIndexed sxi;
-            aks.ToRaw(sxi.addrRaw);
-            uint32_t sxId;
-            if (!UpdateStealthAddressIndex(ckidMatch, sxi, sxId))
-                return error("%s: UpdateStealthAddressIndex failed.\n", __func__);
-
-            return true;
+            CBitcoinAddress coinAddress(kTestId);
+            LogPrintf("Debug: ExpandStealthChildKey matches! %s, %s.\n", aks.ToStealthAddress(), coinAddress.ToString());
         };
     };
 
-    return false;
+    // Don't need to extract key now, wallet may be locked
+    CKeyID idStealthKey = aks.GetID();
+    CEKASCKey kNew(idStealthKey, sShared);
+    if (0 != ExtKeySaveKey(ea, ckidMatch, kNew))
+    {
+        LogPrintf("%s: Error: ExtKeySaveKey failed!\n", __func__);
+        return false;
+    };
+
+    CStealthAddressIndexed sxi;
+    aks.ToRaw(sxi.addrRaw);
+    uint32_t sxId;
+    if (!UpdateStealthAddressIndex(ckidMatch, sxi, sxId))
+        return error("%s: UpdateStealthAddressIndex failed.\n", __func__);
+
+    return true;
 };
 
 int CHDWallet::CheckForStealthAndNarration(const CTxOutBase *pb, const CTxOutData *pdata, std::string &sNarr)
@@ -8463,6 +8915,7 @@ bool CHDWallet::AddToWalletIfInvolvingMe(const CTransactionRef& ptx, const CBloc
             {
                 CTransactionRecord rtx;
                 bool rv = AddToRecord(rtx, tx, pIndex, posInBlock, false);
+                UpdateStakeCandidates(tx.GetHash());
                 WakeThreadStakeMiner(this); // wallet balance may have changed
                 return rv;
             };
@@ -10099,6 +10552,9 @@ bool CHDWallet::AbandonTransaction(const uint256 &hashTx)
         };
     };
 
+    for (const auto &txid : done)
+        UpdateStakeCandidates(txid);
+
     return true;
 };
 
@@ -10205,6 +10661,9 @@ void CHDWallet::MarkConflicted(const uint256 &hashBlock, const uint256 &hashTx)
     if (nChangedRecords > 0) // HACK, alternative is to load CStoredTransaction to get vin
         MarkDirty();
 
+    for (const auto &txid : done)
+        UpdateStakeCandidates(txid);
+
     if (LogAcceptCategory(BCLog::HDWALLET))
         LogPrintf("%s: %s, %s processed %d txns.", __func__, hashBlock.ToString(), hashTx.ToString(), done.size());
 };
@@ -10344,166 +10803,270 @@ uint64_t CHDWallet::GetStakeWeight() const
     return nWeight;
 };
 
-void CHDWallet::AvailableCoinsForStaking(std::vector<COutput> &vCoins, int64_t nTime, int nHeight) const
+void CHDWallet::EraseStakeCandidates(const uint256 &txid) const
 {
-    vCoins.clear();
+    std::map<COutPoint, CStakeCandidate>::iterator it = mapStakeCandidates.lower_bound(COutPoint(txid, 0));
+    while (it != mapStakeCandidates.end() && it->first.hash == txid)
+        mapStakeCandidates.erase(it++);
+};
 
-    deepestTxnDepth = 0;
+bool CHDWallet::AddStakeCandidates(MapWallet_t::const_iterator it) const
+{
+    const CWalletTx *pcoin = &it->second;
+    CTransactionRef tx = pcoin->tx;
 
+    const CBlockIndex *pindex;
+    if (pcoin->GetDepthInMainChain(pindex) < 1)
+        return true;
+
+    const uint256 &wtxid = it->first;
+    for (size_t i = 0; i < tx->vpout.size(); ++i)
     {
-        LOCK2(cs_main, cs_wallet);
+        const auto &txout = tx->vpout[i];
+        if (!txout->IsType(OUTPUT_STANDARD))
+            continue;
 
-        int nHeight = chainActive.Tip()->nHeight;
-        int nRequiredDepth = std::min((int)(Params().GetStakeMinConfirmations()-1), (int)(nHeight / 2));
+        if (IsSpent(wtxid, i))
+            continue;
 
-        for (MapWallet_t::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx *pcoin = &it->second;
-            CTransactionRef tx = pcoin->tx;
+        std::vector<std::vector<uint8_t> > vSolutionsRet;
+        txnouttype typeRet;
 
-            int nDepth = pcoin->GetDepthInMainChainCached();
+        const CScript *pscriptPubKey = txout->GetPScriptPubKey();
+        CScript coinstakePath;
+        if ((HasIsCoinstakeOp(*pscriptPubKey)))
+        {
+            if (!GetCoinstakeScriptPath(*pscriptPubKey, coinstakePath))
+                continue;
+            pscriptPubKey = &coinstakePath;
+        };
 
-            if (nDepth > deepestTxnDepth)
-                deepestTxnDepth = nDepth;
+        if (!Solver(*pscriptPubKey, typeRet, vSolutionsRet)
+            || typeRet != TX_PUBKEYHASH)
+            continue;
 
-            if (nDepth < nRequiredDepth)
-                continue;
+        CKeyID keyID = CKeyID(uint160(vSolutionsRet[0]));
+        if (!HaveKey(keyID))
+            continue;
 
-            const uint256 &wtxid = it->first;
-            for (size_t i = 0; i < tx->vpout.size(); ++i)
-            {
-                const auto &txout = tx->vpout[i];
-                if (!txout->IsType(OUTPUT_STANDARD))
-                    continue;
+        CStakeCandidate c;
+        c.prevout = COutPoint(wtxid, i);
+        c.pcoin = pcoin;
+        c.nValue = txout->GetValue();
+        c.pindex = pindex;
+        c.nBlockTime = pindex->GetBlockTime();
+        mapStakeCandidates[c.prevout] = c;
+    };
+    return true;
+};
 
-                COutPoint kernel(wtxid, i);
-                if (!CheckStakeUnused(kernel)
-                     || IsSpent(wtxid, i))
-                    continue;
+bool CHDWallet::AddStakeCandidates(MapRecords_t::const_iterator it) const
+{
+    const uint256 &txid = it->first;
+    const CTransactionRecord &rtx = it->second;
 
-                std::vector<std::vector<uint8_t> > vSolutionsRet;
-                txnouttype typeRet;
+    if (GetDepthInMainChain(rtx.blockHash, rtx.nIndex) < 1)
+        return true;
+    const CBlockIndex *pindex = mapBlockIndex[rtx.blockHash];
 
-                const CScript *pscriptPubKey = txout->GetPScriptPubKey();
-                CScript coinstakePath;
-                if ((HasIsCoinstakeOp(*pscriptPubKey)))
-                {
-                    if (!GetCoinstakeScriptPath(*pscriptPubKey, coinstakePath))
-                        continue;
-                    pscriptPubKey = &coinstakePath;
-                };
+    MapWallet_t::const_iterator twi = mapTempWallet.end();
+    for (auto &r : rtx.vout)
+    {
+        if (r.nType != OUTPUT_STANDARD)
+            continue;
 
-                if (!Solver(*pscriptPubKey, typeRet, vSolutionsRet)
-                    || typeRet != TX_PUBKEYHASH)
+        if ((r.nFlags & ORF_OWNED || r.nFlags & ORF_STAKEONLY)
+            && !(IsSpent(txid, r.n)))
+        {
+            std::vector<std::vector<uint8_t> > vSolutionsRet;
+            txnouttype typeRet;
+            const CScript *pscriptPubKey = &r.scriptPubKey;
+            CScript coinstakePath;
+            bool fHasIsCoinstakeOp = HasIsCoinstakeOp(r.scriptPubKey);
+            if (fHasIsCoinstakeOp)
+            {
+                if (!GetCoinstakeScriptPath(r.scriptPubKey, coinstakePath))
                     continue;
+                pscriptPubKey = &coinstakePath;
+            };
 
+            if (!Solver(*pscriptPubKey, typeRet, vSolutionsRet)
+                || typeRet != TX_PUBKEYHASH)
+                continue;
+
+            // Must check if this wallet owns the staking key
+            if (fHasIsCoinstakeOp)
+            {
                 CKeyID keyID = CKeyID(uint160(vSolutionsRet[0]));
-                if (HaveKey(keyID))
-                    vCoins.push_back(COutput(pcoin, i, nDepth, true, true, true));
+                if (!HaveKey(keyID))
+                    continue;
             };
+
+            if (twi == mapTempWallet.end()
+                && (twi = mapTempWallet.find(txid)) == mapTempWallet.end())
+            {
+                if (0 != InsertTempTxn(txid, &rtx)
+                    || (twi = mapTempWallet.find(txid)) == mapTempWallet.end())
+                    return error("%s: InsertTempTxn failed %s.", __func__, txid.ToString());
+            };
+
+            CStakeCandidate c;
+            c.prevout = COutPoint(txid, r.n);
+            c.pcoin = &twi->second;
+            c.nValue = r.nValue;
+            c.pindex = pindex;
+            c.nBlockTime = pindex->GetBlockTime();
+            mapStakeCandidates[c.prevout] = c;
         };
+    };
+    return true;
+};
+
+void CHDWallet::UpdateStakeCandidates(const uint256 &txid) const
+{
+    if (!fStakeCandidatesValid)
+        return; // Built in full on next use
+
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
 
-        for (MapRecords_t::const_iterator it = mapRecords.begin(); it != mapRecords.end(); ++it)
+    // The spent state of the outputs txid spends changes with it
+    std::vector<uint256> vUpdate(1, txid);
+    MapWallet_t::const_iterator mwi = mapWallet.find(txid);
+    if (mwi != mapWallet.end())
+    {
+        for (const auto &txin : mwi->second.tx->vin)
+            if (!txin.IsAnonInput())
+                vUpdate.push_back(txin.prevout.hash);
+    };
+    MapRecords_t::const_iterator mri = mapRecords.find(txid);
+    if (mri != mapRecords.end()
+        && !(mri->second.nFlags & ORF_ANON_IN))
+    {
+        for (const auto &prevout : mri->second.vin)
+            vUpdate.push_back(prevout.hash);
+    };
+
+    for (const auto &hash : vUpdate)
+    {
+        EraseStakeCandidates(hash);
+        if ((mwi = mapWallet.find(hash)) != mapWallet.end()
+            && !AddStakeCandidates(mwi))
         {
-            const uint256 &txid = it->first;
-            const CTransactionRecord &rtx = it->second;
+            InvalidateStakeCandidates();
+            return;
+        };
+        if ((mri = mapRecords.find(hash)) != mapRecords.end()
+            && !AddStakeCandidates(mri))
+        {
+            InvalidateStakeCandidates();
+            return;
+        };
+    };
+};
 
-            int nDepth = GetDepthInMainChain(rtx.blockHash, rtx.nIndex);
-            if (nDepth > deepestTxnDepth)
-                deepestTxnDepth = nDepth;
+void CHDWallet::BuildStakeCandidates() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
 
-            if (nDepth < nRequiredDepth)
-                continue;
+    mapStakeCandidates.clear();
 
-            MapWallet_t::const_iterator twi = mapTempWallet.end();
-            for (auto &r : rtx.vout)
-            {
-                if (r.nType != OUTPUT_STANDARD)
-                    continue;
+    for (MapWallet_t::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        AddStakeCandidates(it);
 
-                if ((r.nFlags & ORF_OWNED || r.nFlags & ORF_STAKEONLY)
-                    && !(IsSpent(txid, r.n)))
-                {
-                    std::vector<std::vector<uint8_t> > vSolutionsRet;
-                    txnouttype typeRet;
-                    const CScript *pscriptPubKey = &r.scriptPubKey;
-                    CScript coinstakePath;
-                    bool fHasIsCoinstakeOp = HasIsCoinstakeOp(r.scriptPubKey);
-                    if (fHasIsCoinstakeOp)
-                    {
-                        if (!GetCoinstakeScriptPath(r.scriptPubKey, coinstakePath))
-                            continue;
-                        pscriptPubKey = &coinstakePath;
-                    };
+    for (MapRecords_t::const_iterator it = mapRecords.begin(); it != mapRecords.end(); ++it)
+        if (!AddStakeCandidates(it))
+            return;
 
-                    if (!Solver(*pscriptPubKey, typeRet, vSolutionsRet)
-                        || typeRet != TX_PUBKEYHASH)
-                        continue;
+    fStakeCandidatesValid = true;
+    nStakeCandidatesWalletSize = mapWallet.size();
+    LogPrint(BCLog::POS, "%s: %u candidates.\n", __func__, mapStakeCandidates.size());
+};
 
-                    // Must check if this wallet owns the staking key
-                    if (fHasIsCoinstakeOp)
-                    {
-                        CKeyID keyID = CKeyID(uint160(vSolutionsRet[0]));
-                        if (!HaveKey(keyID))
-                            continue;
-                    };
+void CHDWallet::AvailableStakeCandidates(std::vector<CStakeCandidate> &vCandidates) const
+{
+    vCandidates.clear();
 
-                    if (twi == mapTempWallet.end()
-                        && (twi = mapTempWallet.find(txid)) == mapTempWallet.end())
-                    {
-                        if (0 != InsertTempTxn(txid, &rtx)
-                            || (twi = mapTempWallet.find(txid)) == mapTempWallet.end())
-                        {
-                            LogPrintf("ERROR: %s - InsertTempTxn failed %s.", __func__, txid.ToString());
-                            return;
-                        };
-                    };
-                    vCoins.push_back(COutput(&twi->second, r.n, nDepth, true, true, true));
-                };
-            };
-        };
+    deepestTxnDepth = 0;
 
+    {
+        LOCK2(cs_main, cs_wallet);
+
+        // Depth changes with each block, wallet changes update the candidates of the txns involved
+        if (!fStakeCandidatesValid
+            || nStakeCandidatesWalletSize != mapWallet.size())
+            BuildStakeCandidates();
+
+        int nHeight = chainActive.Tip()->nHeight;
+        int nRequiredDepth = std::min((int)(Params().GetStakeMinConfirmations()-1), (int)(nHeight / 2));
+
+        vCandidates.reserve(mapStakeCandidates.size());
+        for (const auto &mc : mapStakeCandidates)
+        {
+            const CStakeCandidate &c = mc.second;
+            if (!chainActive.Contains(c.pindex))
+                continue;
+
+            int nDepth = nHeight - c.pindex->nHeight + 1;
+            if (nDepth > deepestTxnDepth)
+                deepestTxnDepth = nDepth;
+
+            if (nDepth < nRequiredDepth
+                || !CheckStakeUnused(c.prevout))
+                continue;
+
+            vCandidates.push_back(c);
+        };
     }
 
-    random_shuffle(vCoins.begin(), vCoins.end(), GetRandInt);
+    random_shuffle(vCandidates.begin(), vCandidates.end(), GetRandInt);
 };
 
-bool CHDWallet::SelectCoinsForStaking(int64_t nTargetValue, int64_t nTime, int nHeight, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64_t& nValueRet) const
+bool CHDWallet::SelectStakeCandidates(int64_t nTargetValue, std::vector<CStakeCandidate> &vCandidatesRet, int64_t &nValueRet) const
 {
-    std::vector<COutput> vCoins;
-    AvailableCoinsForStaking(vCoins, nTime, nHeight);
+    std::vector<CStakeCandidate> vCandidates;
+    AvailableStakeCandidates(vCandidates);
 
-    setCoinsRet.clear();
+    vCandidatesRet.clear();
     nValueRet = 0;
 
-    for (auto &output : vCoins)
+    for (const auto &c : vCandidates)
     {
-        const CWalletTx *pcoin = output.tx;
-        int i = output.i;
-
         // Stop if we've chosen enough inputs
         if (nValueRet >= nTargetValue)
             break;
 
-        int64_t n = pcoin->tx->vpout[i]->GetValue();
-
-        std::pair<int64_t, std::pair<const CWalletTx*, unsigned int> > coin = std::make_pair(n, std::make_pair(pcoin, i));
+        int64_t n = c.nValue;
 
         if (n >= nTargetValue)
         {
             // If input value is greater or equal to target then simply insert
             //    it into the current subset and exit
-            setCoinsRet.insert(coin.second);
-            nValueRet += coin.first;
+            vCandidatesRet.push_back(c);
+            nValueRet += n;
             break;
         } else
         if (n < nTargetValue + CENT)
         {
-            setCoinsRet.insert(coin.second);
-            nValueRet += coin.first;
+            vCandidatesRet.push_back(c);
+            nValueRet += n;
         };
     };
 
+    return true;
+};
+
+bool CHDWallet::SelectCoinsForStaking(int64_t nTargetValue, int64_t nTime, int nHeight, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64_t& nValueRet) const
+{
+    std::vector<CStakeCandidate> vCandidates;
+    if (!SelectStakeCandidates(nTargetValue, vCandidates, nValueRet))
+        return false;
+
+    setCoinsRet.clear();
+    for (const auto &c : vCandidates)
+        setCoinsRet.insert(std::make_pair(c.pcoin, c.prevout.n));
+
     return true;
 }
 
@@ -10519,28 +11082,39 @@ bool CHDWallet::CreateCoinStake(unsigned int nBits, int64_t nTime, int nBlockHei
 
     // Choose coins to use
     std::vector<const CWalletTx*> vwtxPrev;
+    std::vector<CStakeCandidate> vCandidates;
     std::set<std::pair<const CWalletTx*,unsigned int> > setCoins;
     CAmount nValueIn = 0;
 
     // Select coins with suitable depth
-    if (!SelectCoinsForStaking(nBalance - nReserveBalance, nTime, nBlockHeight, setCoins, nValueIn))
+    if (!SelectStakeCandidates(nBalance - nReserveBalance, vCandidates, nValueIn))
         return false;
 
-    if (setCoins.empty())
+    if (vCandidates.empty())
         return false;
 
+    for (const auto &c : vCandidates)
+        setCoins.insert(std::make_pair(c.pcoin, c.prevout.n));
+
     CAmount nCredit = 0;
     CScript scriptPubKeyKernel;
 
-    std::set<std::pair<const CWalletTx*,unsigned int> >::iterator it = setCoins.begin();
+    std::set<std::pair<const CWalletTx*,unsigned int> >::iterator it;
 
-    for (; it != setCoins.end(); ++it)
+    for (const auto &c : vCandidates)
     {
-        auto pcoin = *it;
         if (ThreadStakeMinerStopped()) // interruption_point
             return false;
 
-        COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
+        // Block time and value were resolved when the candidates were cached,
+        // the coins view is only read for a candidate that meets the target.
+        uint256 hashProofOfStake, targetProofOfStake;
+        if (!CheckStakeKernelHash(pindexPrev, nBits, c.nBlockTime,
+            c.nValue, c.prevout, nTime, hashProofOfStake, targetProofOfStake))
+            continue;
+
+        auto pcoin = std::make_pair(c.pcoin, c.prevout.n);
+        const COutPoint &prevoutStake = c.prevout;
 
         int64_t nBlockTime;
         if (CheckKernel(pindexPrev, nBits, nTime, prevoutStake, &nBlockTime))
@@ -10693,7 +11267,7 @@ bool CHDWallet::CreateCoinStake(unsigned int nBits, int64_t nTime, int nBlockHei
 
             LogPrint(BCLog::POS, "%s: Added kernel.\n", __func__);
 
-            setCoins.erase(it);
+            setCoins.erase(pcoin);
             break;
         };
     };
@@ -27,6 +27,9 @@ typedef std::multimap<int64_t, std::map<uint256, CTransactionRecord>::iterator>
 class UniValue;
 
 const uint16_t PLACEHOLDER_N = 0xFFFF;
+
+// Below this many candidate scan keys per thread the ECDH is done on the calling thread
+static const size_t STEALTH_SCAN_MIN_KEYS_PER_THREAD = 64;
 enum OutputRecordFlags
 {
     ORF_OWNED        = (1 << 0),
@@ -520,6 +523,7 @@ public:
 
 
 
+    bool AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose=true) override;
     bool LoadToWallet(const CWalletTx& wtxIn) override;
     bool LoadToWallet(const uint256 &hash, const CTransactionRecord &rtx);
 
@@ -597,6 +601,13 @@ public:
     int ScanChainFromTime(int64_t nTimeStartScan);
     int ScanChainFromHeight(int nHeight);
 
+    /**
+     * Rescan as ScanForWalletTransactions, blocks are read and stealth outputs matched on worker
+     * threads without the wallet lock, transactions are then added to the wallet in block order.
+     * nThreads worker threads are started, 0 for one per core.
+     */
+    CBlockIndex *ScanBlocksPipelined(CBlockIndex *pindexStart, bool fUpdate, size_t nThreads=0);
+
     /**
      * Estimate the minimum fee considering user set parameters
      * and the required fee
@@ -628,6 +639,31 @@ public:
     bool ProcessStealthOutput(const CTxDestination &address,
         std::vector<uint8_t> &vchEphemPK, uint32_t prefix, bool fHavePrefix, CKey &sShared, bool fNeedShared=false);
 
+    /** Owned stealth scan keys with parsed spend pubkeys, in the order ProcessStealthOutput checks them */
+    struct CStealthScanKey
+    {
+        uint8_t nPrefixBits;
+        uint32_t nPrefix;
+        CKey skScan;
+        secp256k1_pubkey pkSpend;
+        bool fAccount;
+        CStealthAddress sx;             // copy of the loose stealth address, if !fAccount
+        CKeyID idAccount;               // account and stealth key ids, looked up again on a match
+        CKeyID idStealthKey;
+    };
+    /** Stealth matches precomputed for a block against a copy of vStealthScanKeys */
+    struct CStealthScanHints
+    {
+        uint64_t nGeneration;
+        std::map<std::pair<CKeyID, ec_point>, int64_t> mapMatches; // index into vStealthScanKeys, -1 if no key matched
+    };
+    void InvalidateStealthScanKeys() { fStealthScanKeysValid = false; vStealthScanKeys.clear(); };
+    void BuildStealthScanKeys();
+    /** First key in vKeys matching the output, split into nTasks on the scan pool, 0 picks from the cores and candidates */
+    static bool FindStealthScanKey(const std::vector<CStealthScanKey> &vKeys,
+        const secp256k1_pubkey &pkEphem, const CKeyID &idMatch, uint32_t prefix, bool fHavePrefix,
+        size_t &nMatch, CKey &sShared, ec_point &pkExtracted, size_t nTasks=0);
+
     int CheckForStealthAndNarration(const CTxOutBase *pb, const CTxOutData *pdata, std::string &sNarr);
     bool FindStealthTransactions(const CTransaction &tx, mapValue_t &mapNarr);
 
@@ -689,16 +725,41 @@ public:
 
     bool SetReserveBalance(CAmount nNewReserveBalance);
     uint64_t GetStakeWeight() const;
-    void AvailableCoinsForStaking(std::vector<COutput> &vCoins, int64_t nTime, int nHeight) const;
+
+    /** Owned unspent standard output in the main chain, with the values the kernel hash needs */
+    struct CStakeCandidate
+    {
+        COutPoint prevout;
+        const CWalletTx *pcoin; // entry in mapWallet or mapTempWallet
+        CAmount nValue;
+        const CBlockIndex *pindex; // block containing the output
+        uint32_t nBlockTime;
+    };
+    void InvalidateStakeCandidates() const { fStakeCandidatesValid = false; };
+    /** Recheck the candidates of txid and of the txns its inputs spend, after txid was added or changed */
+    void UpdateStakeCandidates(const uint256 &txid) const;
+    void EraseStakeCandidates(const uint256 &txid) const;
+    bool AddStakeCandidates(MapWallet_t::const_iterator it) const;
+    bool AddStakeCandidates(MapRecords_t::const_iterator it) const;
+    void BuildStakeCandidates() const;
+    void AvailableStakeCandidates(std::vector<CStakeCandidate> &vCandidates) const;
+    bool SelectStakeCandidates(int64_t nTargetValue, std::vector<CStakeCandidate> &vCandidatesRet, int64_t &nValueRet) const;
+
     bool SelectCoinsForStaking(int64_t nTargetValue, int64_t nTime, int nHeight, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64_t& nValueRet) const;
     bool CreateCoinStake(unsigned int nBits, int64_t nTime, int nBlockHeight, int64_t nFees, CMutableTransaction &txNew, CKey &key);
     bool SignBlock(CBlockTemplate *pblocktemplate, int nHeight, int64_t nSearchTime);
 
     int64_t nLastCoinStakeSearchTime = 0;
     uint32_t nStealth, nFoundStealth; // for reporting, zero before use
+    std::atomic<int> nRescanStartHeight{0}, nRescanEndHeight{0}, nRescanHeight{0}; // for reporting while IsScanning()
+    std::atomic<int64_t> nRescanStartTime{0};
+    std::atomic<uint64_t> nRescanTransactions{0};
     int64_t nReserveBalance;
     size_t nStakeThread = 9999999; // unset
     mutable int deepestTxnDepth = 0; // for stake mining
+    mutable std::map<COutPoint, CStakeCandidate> mapStakeCandidates; // Cache, call UpdateStakeCandidates when owned outputs or spends change
+    mutable bool fStakeCandidatesValid = false;
+    mutable size_t nStakeCandidatesWalletSize = 0; // size of mapWallet, entries erased outside CHDWallet force a rebuild
     int nStakeLimitHeight = 0; // for regtest, don't stake above nStakeLimitHeight
 
     enum eStakingState {
@@ -711,6 +772,10 @@ public:
     } nIsStaking = NOT_STAKING;
 
     std::set<CStealthAddress> stealthAddresses;
+    std::vector<CStealthScanKey> vStealthScanKeys; // Cache, call InvalidateStealthScanKeys when stealth keys are added or removed
+    bool fStealthScanKeysValid = false;
+    uint64_t nStealthScanKeysGeneration = 0;
+    const CStealthScanHints *pStealthScanHints = nullptr; // set while ScanBlocksPipelined adds a block
 
     CStoredExtKey *pEKMaster;
     CKeyID idDefaultAccount;
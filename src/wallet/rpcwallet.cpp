@@ -3105,6 +3105,14 @@ UniValue getwalletinfo(const JSONRPCRequest& request)
             "  \"unlocked_until\": ttt,         (numeric) the timestamp in seconds since epoch (midnight Jan 1 1970 GMT) that the wallet is unlocked for transfers, or 0 if the wallet is locked\n"
             "  \"paytxfee\": x.xxxx,            (numeric) the transaction fee configuration, set in " + CURRENCY_UNIT + "/kB\n"
             "  \"hdmasterkeyid\": \"<hash160>\" (string) the Hash160 of the HD master pubkey\n"
+            "  \"rescan\": {                    (object) present while the wallet is rescanning the chain\n"
+            "    \"start_height\": n,           (numeric) the height the rescan started from\n"
+            "    \"height\": n,                 (numeric) the last block added to the wallet\n"
+            "    \"end_height\": n,             (numeric) the current chain height\n"
+            "    \"progress\": x.xxx,           (numeric) fraction of blocks scanned\n"
+            "    \"blocks_per_second\": x.xx,   (numeric) average blocks scanned per second\n"
+            "    \"txns_per_second\": x.xx,     (numeric) average transactions scanned per second\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getwalletinfo", "")
@@ -3190,6 +3198,23 @@ UniValue getwalletinfo(const JSONRPCRequest& request)
     if (!masterKeyID.IsNull())
          obj.push_back(Pair("hdmasterkeyid", masterKeyID.GetHex()));
 
+    if (IsHDWallet(pwallet) && pwallet->IsScanning())
+    {
+        CHDWallet *pwhd = GetHDWallet(pwallet);
+        int nStart = pwhd->nRescanStartHeight, nHeight = pwhd->nRescanHeight, nEnd = pwhd->nRescanEndHeight;
+        double dSeconds = std::max((int64_t)1, GetTimeMillis() - pwhd->nRescanStartTime) / 1000.0;
+        int nBlocks = std::max(0, nHeight - nStart);
+
+        UniValue rescan(UniValue::VOBJ);
+        rescan.pushKV("start_height", nStart);
+        rescan.pushKV("height", nHeight);
+        rescan.pushKV("end_height", nEnd);
+        rescan.pushKV("progress", nEnd > nStart ? std::min(1.0, (double)nBlocks / (nEnd - nStart)) : 1.0);
+        rescan.pushKV("blocks_per_second", nBlocks / dSeconds);
+        rescan.pushKV("txns_per_second", pwhd->nRescanTransactions / dSeconds);
+        obj.pushKV("rescan", rescan);
+    };
+
     return obj;
 }
 
@@ -7,6 +7,8 @@
 #include "wallet/test/hdwallet_test_fixture.h"
 #include "base58.h"
 #include "chainparams.h"
+#include "validation.h"
+#include "consensus/validation.h"
 #include "smsg/smessage.h"
 #include "smsg/crypter.h"
 
@@ -217,5 +219,305 @@ BOOST_AUTO_TEST_CASE(ext_key_index)
 }
 
 
+static CHDWallet::CStealthScanKey MakeStealthScanKey(const CKey &skScan, const ec_point &pkSpend, uint8_t nPrefixBits, uint32_t nPrefix)
+{
+    CHDWallet::CStealthScanKey sk;
+    sk.nPrefixBits = nPrefixBits;
+    sk.nPrefix = nPrefix;
+    sk.skScan = skScan;
+    BOOST_REQUIRE(0 == StealthParsePubKey(pkSpend, sk.pkSpend));
+    sk.fAccount = false;
+    return sk;
+}
+
+static void MakeStealthOutput(const ec_point &pkScan, const ec_point &pkSpend, ec_point &vchEphemPK, CKeyID &idMatch)
+{
+    CKey sEphem, sShared;
+    ec_point pkSendTo;
+    sEphem.MakeNewKey(true);
+    BOOST_REQUIRE(0 == SecretToPublicKey(sEphem, vchEphemPK));
+    BOOST_REQUIRE(0 == StealthSecret(sEphem, pkScan, pkSpend, sShared, pkSendTo));
+    idMatch = CPubKey(pkSendTo).GetID();
+}
+
+BOOST_AUTO_TEST_CASE(stealth_scan_key_search)
+{
+    ECC_Start_Stealth();
+
+    CKey skScan, skSpend;
+    skScan.MakeNewKey(true);
+    skSpend.MakeNewKey(true);
+    ec_point pkScan, pkSpend;
+    BOOST_REQUIRE(0 == SecretToPublicKey(skScan, pkScan));
+    BOOST_REQUIRE(0 == SecretToPublicKey(skSpend, pkSpend));
+
+    // Enough candidates for the search to be split, the receiving key is listed more than once
+    size_t nKeys = 2 * STEALTH_SCAN_MIN_KEYS_PER_THREAD + 7;
+    std::vector<CHDWallet::CStealthScanKey> vKeys;
+    for (size_t i = 0; i < nKeys; ++i)
+    {
+        CKey skScanOther, skSpendOther;
+        skScanOther.MakeNewKey(true);
+        skSpendOther.MakeNewKey(true);
+        ec_point pkSpendOther;
+        BOOST_REQUIRE(0 == SecretToPublicKey(skSpendOther, pkSpendOther));
+        vKeys.push_back(MakeStealthScanKey(skScanOther, pkSpendOther, 0, 0));
+    };
+
+    uint32_t nPrefix = 0xaaaaaaaa;
+    vKeys[3] = MakeStealthScanKey(skScan, pkSpend, 8, ~nPrefix); // filtered by prefix
+    vKeys[78] = MakeStealthScanKey(skScan, pkSpend, 8, nPrefix);
+    vKeys[101] = MakeStealthScanKey(skScan, pkSpend, 0, 0);
+    vKeys[nKeys - 1] = MakeStealthScanKey(skScan, pkSpend, 0, 0);
+
+    ec_point vchEphemPK;
+    CKeyID idMatch;
+    MakeStealthOutput(pkScan, pkSpend, vchEphemPK, idMatch);
+    secp256k1_pubkey pkEphem;
+    BOOST_REQUIRE(0 == StealthParsePubKey(vchEphemPK, pkEphem));
+
+    CKeyID idOther;
+    GetStrongRandBytes(idOther.begin(), idOther.size());
+
+    size_t nMatchSeq, nMatch;
+    CKey sSharedSeq, sShared;
+    ec_point pkExtractedSeq, pkExtracted;
+
+    // The key at 78 is only a candidate when the output has a prefix
+    for (bool fHavePrefix : {true, false})
+    {
+        BOOST_REQUIRE(CHDWallet::FindStealthScanKey(vKeys, pkEphem, idMatch, nPrefix, fHavePrefix,
+            nMatchSeq, sSharedSeq, pkExtractedSeq, 1));
+        BOOST_CHECK(nMatchSeq == (fHavePrefix ? 78u : 101u));
+        BOOST_CHECK(!CHDWallet::FindStealthScanKey(vKeys, pkEphem, idOther, nPrefix, fHavePrefix,
+            nMatch, sShared, pkExtracted, 1));
+
+        // 0 picks the split from the cores, the others run tasks on the scan pool
+        for (size_t nTasks : {0, 2, 3, 4, 8, 16})
+        {
+            nMatch = 0;
+            BOOST_CHECK(CHDWallet::FindStealthScanKey(vKeys, pkEphem, idMatch, nPrefix, fHavePrefix,
+                nMatch, sShared, pkExtracted, nTasks));
+            BOOST_CHECK(nMatch == nMatchSeq);
+            BOOST_CHECK(sShared == sSharedSeq);
+            BOOST_CHECK(pkExtracted == pkExtractedSeq);
+
+            BOOST_CHECK(!CHDWallet::FindStealthScanKey(vKeys, pkEphem, idOther, nPrefix, fHavePrefix,
+                nMatch, sShared, pkExtracted, nTasks));
+        };
+    };
+
+    ECC_Stop_Stealth();
+}
+
+BOOST_AUTO_TEST_CASE(stealth_scan_keys_rebuild)
+{
+    CHDWallet *pwallet = (CHDWallet*) pwalletMain;
+    ECC_Start_Stealth();
+
+    CKey skScan, skSpend;
+    skScan.MakeNewKey(true);
+    skSpend.MakeNewKey(true);
+    CStealthAddress sx;
+    sx.scan_secret = skScan;
+    BOOST_REQUIRE(0 == SecretToPublicKey(skScan, sx.scan_pubkey));
+    BOOST_REQUIRE(0 == SecretToPublicKey(skSpend, sx.spend_pubkey));
+
+    auto FindScanKey = [&]() {
+        for (size_t i = 0; i < pwallet->vStealthScanKeys.size(); ++i)
+            if (pwallet->vStealthScanKeys[i].skScan == skScan)
+                return (int64_t)i;
+        return (int64_t)-1;
+    };
+
+    size_t nKeys;
+    uint64_t nGeneration;
+    {
+        LOCK(pwallet->cs_wallet);
+        pwallet->BuildStealthScanKeys();
+        BOOST_CHECK(pwallet->fStealthScanKeysValid);
+        BOOST_CHECK(FindScanKey() < 0);
+        nKeys = pwallet->vStealthScanKeys.size();
+        nGeneration = pwallet->nStealthScanKeysGeneration;
+    }
+
+    BOOST_REQUIRE(pwallet->ImportStealthAddress(sx, CKey()));
+
+    ec_point vchEphemPK;
+    CKeyID idMatch;
+    MakeStealthOutput(sx.scan_pubkey, sx.spend_pubkey, vchEphemPK, idMatch);
+    secp256k1_pubkey pkEphem;
+    BOOST_REQUIRE(0 == StealthParsePubKey(vchEphemPK, pkEphem));
+
+    {
+        LOCK(pwallet->cs_wallet);
+        BOOST_CHECK(!pwallet->fStealthScanKeysValid);
+        BOOST_CHECK(pwallet->vStealthScanKeys.empty());
+
+        // Rebuilt by the next output checked
+        CKeyID idOther;
+        GetStrongRandBytes(idOther.begin(), idOther.size());
+        CKey sShared;
+        BOOST_CHECK(!pwallet->ProcessStealthOutput(idOther, vchEphemPK, 0, false, sShared));
+        BOOST_CHECK(pwallet->fStealthScanKeysValid);
+        BOOST_CHECK(pwallet->vStealthScanKeys.size() == nKeys + 1);
+        BOOST_CHECK(pwallet->nStealthScanKeysGeneration > nGeneration);
+        nGeneration = pwallet->nStealthScanKeysGeneration;
+
+        size_t nMatch;
+        ec_point pkExtracted;
+        BOOST_REQUIRE(CHDWallet::FindStealthScanKey(pwallet->vStealthScanKeys, pkEphem, idMatch, 0, false,
+            nMatch, sShared, pkExtracted));
+        BOOST_CHECK((int64_t)nMatch == FindScanKey());
+    }
+
+    pwallet->DelAddressBook(sx);
+
+    {
+        LOCK(pwallet->cs_wallet);
+        BOOST_CHECK(!pwallet->fStealthScanKeysValid);
+        BOOST_CHECK(pwallet->vStealthScanKeys.empty());
+
+        pwallet->BuildStealthScanKeys();
+        BOOST_CHECK(pwallet->vStealthScanKeys.size() == nKeys);
+        BOOST_CHECK(pwallet->nStealthScanKeysGeneration > nGeneration);
+        BOOST_CHECK(FindScanKey() < 0);
+
+        size_t nMatch;
+        CKey sShared;
+        ec_point pkExtracted;
+        BOOST_CHECK(!CHDWallet::FindStealthScanKey(pwallet->vStealthScanKeys, pkEphem, idMatch, 0, false,
+            nMatch, sShared, pkExtracted));
+    }
+
+    ECC_Stop_Stealth();
+}
+
+BOOST_AUTO_TEST_CASE(stealth_scan_hints_stale)
+{
+    CHDWallet *pwallet = (CHDWallet*) pwalletMain;
+    ECC_Start_Stealth();
+
+    CKey skScan, skSpend;
+    skScan.MakeNewKey(true);
+    skSpend.MakeNewKey(true);
+    CStealthAddress sx;
+    sx.scan_secret = skScan;
+    BOOST_REQUIRE(0 == SecretToPublicKey(skScan, sx.scan_pubkey));
+    BOOST_REQUIRE(0 == SecretToPublicKey(skSpend, sx.spend_pubkey));
+    sx.spend_secret_id = sx.GetSpendKeyID();
+
+    ec_point vchEphemPK;
+    CKeyID idMatch;
+    MakeStealthOutput(sx.scan_pubkey, sx.spend_pubkey, vchEphemPK, idMatch);
+
+    // Matched by a rescan worker before the stealth address was added
+    CHDWallet::CStealthScanHints hints;
+    {
+        LOCK(pwallet->cs_wallet);
+        pwallet->BuildStealthScanKeys();
+        hints.nGeneration = pwallet->nStealthScanKeysGeneration;
+        hints.mapMatches[std::make_pair(idMatch, vchEphemPK)] = -1;
+    }
+
+    CKey sShared;
+    {
+        LOCK(pwallet->cs_wallet);
+        pwallet->pStealthScanHints = &hints;
+        BOOST_CHECK(!pwallet->ProcessStealthOutput(idMatch, vchEphemPK, 0, false, sShared));
+        pwallet->pStealthScanHints = nullptr;
+    }
+
+    BOOST_REQUIRE(pwallet->ImportStealthAddress(sx, skSpend));
+
+    {
+        LOCK(pwallet->cs_wallet);
+        pwallet->pStealthScanHints = &hints;
+        BOOST_CHECK(pwallet->ProcessStealthOutput(idMatch, vchEphemPK, 0, false, sShared));
+        pwallet->pStealthScanHints = nullptr;
+        BOOST_CHECK(pwallet->nStealthScanKeysGeneration != hints.nGeneration);
+        BOOST_CHECK(pwallet->HaveKey(idMatch));
+    }
+
+    pwallet->DelAddressBook(sx);
+    ECC_Stop_Stealth();
+}
+
+/** Records the blocks a rescan hands to the wallet, fnAdded is called after each */
+class CScanRecordWallet : public CHDWallet
+{
+public:
+    bool AddToWalletIfInvolvingMe(const CTransactionRef& ptx, const CBlockIndex* pIndex, int posInBlock, bool fUpdate) override
+    {
+        if (posInBlock == 0)
+        {
+            vAdded.push_back(pIndex);
+            if (fnAdded)
+                fnAdded(pIndex);
+        };
+        return false;
+    };
+
+    std::vector<const CBlockIndex*> vAdded;
+    std::function<void(const CBlockIndex*)> fnAdded;
+};
+
+BOOST_FIXTURE_TEST_CASE(rescan_pipelined_reorg, TestChain100Setup)
+{
+    CBlockIndex* const nullBlock = nullptr;
+    CKey keyOther;
+    keyOther.MakeNewKey(true);
+    CScript scriptOther = GetScriptForRawPubKey(keyOther.GetPubKey());
+
+    CBlockIndex *pindexFork;
+    {
+        LOCK(cs_main);
+        pindexFork = chainActive[50];
+    }
+
+    // Reorganise away from the queued blocks while the fork block is added,
+    // the rest of the new chain must be scanned by ScanForWalletTransactions
+    CScanRecordWallet wallet;
+    wallet.fnAdded = [&](const CBlockIndex *pindex) {
+        if (pindex != pindexFork)
+            return;
+        CValidationState state;
+        BOOST_REQUIRE(InvalidateBlock(state, Params(), chainActive.Next(pindexFork)));
+        CreateAndProcessBlock({}, scriptOther);
+        CreateAndProcessBlock({}, scriptOther);
+    };
+    BOOST_CHECK_EQUAL(nullBlock, wallet.ScanBlocksPipelined(chainActive.Genesis(), false, 2));
+
+    LOCK(cs_main);
+    BOOST_CHECK_EQUAL(chainActive.Height(), 52);
+    std::vector<const CBlockIndex*> vExpect;
+    for (int i = 0; i <= chainActive.Height(); ++i)
+        vExpect.push_back(chainActive[i]);
+    BOOST_CHECK(wallet.vAdded == vExpect);
+}
+
+BOOST_FIXTURE_TEST_CASE(rescan_pipelined_read_failed, TestChain100Setup)
+{
+    LOCK(cs_main);
+
+    // Cap last block file size, and mine new block in a new block file.
+    CBlockIndex* oldTip = chainActive.Tip();
+    int nFileOld = oldTip->GetBlockPos().nFile;
+    GetBlockFileInfo(nFileOld)->nSize = MAX_BLOCKFILE_SIZE;
+    CreateAndProcessBlock({}, GetScriptForRawPubKey(coinbaseKey.GetPubKey()));
+    CBlockIndex* newTip = chainActive.Tip();
+
+    PruneOneBlockFile(nFileOld);
+    UnlinkPrunedFiles({nFileOld});
+
+    // The last block that could not be read is returned, as from ScanForWalletTransactions
+    CScanRecordWallet wallet;
+    BOOST_CHECK_EQUAL(oldTip, wallet.ScanBlocksPipelined(chainActive.Genesis(), false, 2));
+    BOOST_CHECK(wallet.vAdded == std::vector<const CBlockIndex*>{newTip});
+
+    wallet.vAdded.clear();
+    BOOST_CHECK_EQUAL(oldTip, wallet.ScanForWalletTransactions(chainActive.Genesis()));
+    BOOST_CHECK(wallet.vAdded == std::vector<const CBlockIndex*>{newTip});
+}
 
 BOOST_AUTO_TEST_SUITE_END()
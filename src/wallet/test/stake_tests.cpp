@@ -345,4 +345,166 @@ BOOST_AUTO_TEST_CASE(stake_test)
 
 }
 
+static void SendToScript(CHDWallet *pwallet, const CScript &scriptPubKey, CAmount nAmount, bool fBroadcast, CWalletTx &wtx)
+{
+    CReserveKey reservekey(pwallet);
+    CAmount nFeeRequired;
+    std::string strError;
+    std::vector<CRecipient> vecSend;
+    int nChangePosRet = -1;
+    CRecipient recipient(scriptPubKey, nAmount, false);
+    vecSend.push_back(recipient);
+
+    CCoinControl coinControl;
+    BOOST_REQUIRE(pwallet->CreateTransaction(vecSend, wtx, reservekey, nFeeRequired, nChangePosRet, strError, coinControl));
+
+    CValidationState state;
+    pwallet->SetBroadcastTransactions(fBroadcast);
+    BOOST_REQUIRE(pwallet->CommitTransaction(wtx, reservekey, g_connman.get(), state));
+}
+
+static bool IsStakeCandidate(CHDWallet *pwallet, const COutPoint &prevout)
+{
+    LOCK(pwallet->cs_wallet);
+    return pwallet->mapStakeCandidates.count(prevout) > 0;
+}
+
+static size_t CountStakeCandidates(CHDWallet *pwallet, const CTransaction &tx)
+{
+    size_t n = 0;
+    for (size_t k = 0; k < tx.vpout.size(); ++k)
+        if (IsStakeCandidate(pwallet, COutPoint(tx.GetHash(), k)))
+            n++;
+    return n;
+}
+
+static size_t CountStakeCandidateInputs(CHDWallet *pwallet, const CTransaction &tx)
+{
+    size_t n = 0;
+    for (const auto &txin : tx.vin)
+        if (IsStakeCandidate(pwallet, txin.prevout))
+            n++;
+    return n;
+}
+
+static void CheckStakeCandidates(CHDWallet *pwallet)
+{
+    LOCK2(cs_main, pwallet->cs_wallet);
+
+    // The candidates were updated in place since the last check, compare against a full build
+    BOOST_CHECK(pwallet->fStakeCandidatesValid);
+    BOOST_CHECK(pwallet->nStakeCandidatesWalletSize == pwallet->mapWallet.size());
+    std::map<COutPoint, CHDWallet::CStakeCandidate> mapUpdated = pwallet->mapStakeCandidates;
+
+    pwallet->BuildStakeCandidates();
+    BOOST_CHECK(pwallet->fStakeCandidatesValid);
+    BOOST_CHECK_EQUAL(mapUpdated.size(), pwallet->mapStakeCandidates.size());
+    for (const auto &mc : pwallet->mapStakeCandidates)
+    {
+        std::map<COutPoint, CHDWallet::CStakeCandidate>::const_iterator it = mapUpdated.find(mc.first);
+        BOOST_CHECK_MESSAGE(it != mapUpdated.end(), "Missing candidate " << mc.first.ToString());
+        if (it == mapUpdated.end())
+            continue;
+        BOOST_CHECK(it->second.pcoin == mc.second.pcoin);
+        BOOST_CHECK(it->second.pindex == mc.second.pindex);
+        BOOST_CHECK(it->second.nValue == mc.second.nValue);
+    };
+}
+
+BOOST_AUTO_TEST_CASE(stake_candidates_test)
+{
+    SeedInsecureRand();
+    CHDWallet *pwallet = (CHDWallet*) pwalletMain;
+    const CChainParams &chainparams = Params();
+    UniValue rv;
+
+    BOOST_CHECK_NO_THROW(rv = CallRPC("extkeyimportmaster tprv8ZgxMBicQKsPeK5mCpvMsd1cwyT1JZsrBN82XkoYuZY1EVK7EwDaiL9sDfqUU5SntTfbRfnRedFWjg5xkDG5i3iwd3yP7neX5F2dtdCojk4"));
+    BOOST_CHECK_NO_THROW(rv = CallRPC("extkeyimportmaster tprv8ZgxMBicQKsPe3x7bUzkHAJZzCuGqN6y28zFFyg5i7Yqxqm897VCnmMJz6QScsftHDqsyWW5djx6FzrbkF9HSD3ET163z1SzRhfcWxvwL4G"));
+    BOOST_CHECK_NO_THROW(rv = CallRPC("getnewextaddress lblHDKey"));
+
+    {
+        LOCK2(cs_main, pwallet->cs_wallet);
+        pwallet->BuildStakeCandidates();
+        BOOST_REQUIRE(pwallet->mapStakeCandidates.size() > 0);
+    }
+
+    StakeNBlocks(pwallet, 1);
+    CheckStakeCandidates(pwallet);
+
+    BOOST_CHECK_NO_THROW(rv = CallRPC("getnewaddress"));
+    CBitcoinAddress addrOwn(StripQuotes(rv.write()));
+    BOOST_REQUIRE(addrOwn.IsValid());
+    CScript scriptOwn = GetScriptForDestination(addrOwn.Get());
+
+    // Spend, the inputs leave the candidates while the txn is in the mempool
+    CWalletTx wtxSpend;
+    SendToScript(pwallet, scriptOwn, 10 * COIN, true, wtxSpend);
+    BOOST_CHECK_EQUAL(CountStakeCandidateInputs(pwallet, *wtxSpend.tx), 0);
+    BOOST_CHECK_EQUAL(CountStakeCandidates(pwallet, *wtxSpend.tx), 0);
+    CheckStakeCandidates(pwallet);
+
+    // Receive, the outputs become candidates once the txn is in a block
+    StakeNBlocks(pwallet, 1);
+    CBlockIndex *pindexSpend;
+    {
+        LOCK(cs_main);
+        pindexSpend = chainActive.Tip();
+    }
+    CBlock blockSpend;
+    BOOST_REQUIRE(ReadBlockFromDisk(blockSpend, pindexSpend, chainparams.GetConsensus()));
+    BOOST_REQUIRE(blockSpend.vtx.size() == 2);
+    BOOST_REQUIRE(blockSpend.vtx[1]->GetHash() == wtxSpend.GetHash());
+    BOOST_CHECK_EQUAL(CountStakeCandidates(pwallet, *wtxSpend.tx), wtxSpend.tx->vpout.size());
+    BOOST_CHECK(CountStakeCandidates(pwallet, *blockSpend.vtx[0]) > 0);
+    CheckStakeCandidates(pwallet);
+
+    // Abandon, a txn that never reached the mempool releases its inputs
+    CWalletTx wtxAbandon;
+    SendToScript(pwallet, scriptOwn, 20 * COIN, false, wtxAbandon);
+    size_t nAbandonInputs = wtxAbandon.tx->vin.size();
+    BOOST_CHECK_EQUAL(CountStakeCandidateInputs(pwallet, *wtxAbandon.tx), 0);
+    CheckStakeCandidates(pwallet);
+
+    BOOST_CHECK(pwallet->AbandonTransaction(wtxAbandon.GetHash()));
+    BOOST_CHECK_EQUAL(CountStakeCandidateInputs(pwallet, *wtxAbandon.tx), nAbandonInputs);
+    CheckStakeCandidates(pwallet);
+    pwallet->SetBroadcastTransactions(true);
+
+    // Reorg, disconnecting the block drops its outputs and returns the spend to the mempool
+    {
+        CValidationState state;
+        LOCK(cs_main);
+        BOOST_REQUIRE(InvalidateBlock(state, chainparams, pindexSpend));
+    }
+    {
+        CValidationState state;
+        BOOST_REQUIRE(ActivateBestChain(state, chainparams));
+    }
+    {
+        LOCK(cs_main);
+        BOOST_REQUIRE(chainActive.Tip() == pindexSpend->pprev);
+    }
+    BOOST_CHECK_EQUAL(CountStakeCandidates(pwallet, *wtxSpend.tx), 0);
+    BOOST_CHECK_EQUAL(CountStakeCandidates(pwallet, *blockSpend.vtx[0]), 0);
+    BOOST_CHECK_EQUAL(CountStakeCandidateInputs(pwallet, *wtxSpend.tx), 0);
+    CheckStakeCandidates(pwallet);
+
+    // Reconnect the block
+    {
+        CValidationState state;
+        {
+            LOCK(cs_main);
+            BOOST_REQUIRE(ResetBlockFailureFlags(pindexSpend));
+        }
+        BOOST_REQUIRE(ActivateBestChain(state, chainparams));
+    }
+    {
+        LOCK(cs_main);
+        BOOST_REQUIRE(chainActive.Tip() == pindexSpend);
+    }
+    BOOST_CHECK_EQUAL(CountStakeCandidates(pwallet, *wtxSpend.tx), wtxSpend.tx->vpout.size());
+    BOOST_CHECK(CountStakeCandidates(pwallet, *blockSpend.vtx[0]) > 0);
+    CheckStakeCandidates(pwallet);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
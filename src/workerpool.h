@@ -0,0 +1,134 @@
+// Copyright (c) 2017 The Particl Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PARTICL_WORKERPOOL_H
+#define PARTICL_WORKERPOOL_H
+
+#include "util.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * A fixed set of threads for splitting short computations into tasks.
+ *
+ * Threads are started once and wait between jobs, callers don't pay for creating and
+ * joining threads on every call. The calling thread runs tasks of its own job too, so a
+ * pool of n threads runs up to n + 1 tasks of a job at once.
+ *
+ * Jobs of different callers share the threads. A task may start a job on the pool it runs
+ * on, that job's tasks are run by the task's thread if no other thread is free.
+ * Tasks must not throw.
+ */
+class CWorkerPool
+{
+public:
+    /** Start nThreads threads, named particl-<name>. */
+    CWorkerPool(size_t nThreads, const std::string &name);
+    ~CWorkerPool();
+
+    CWorkerPool(const CWorkerPool&) = delete;
+    CWorkerPool &operator=(const CWorkerPool&) = delete;
+
+    /** Call f(i) for each i in [0, nTasks), returns when all calls have returned. */
+    void Run(size_t nTasks, const std::function<void(size_t)> &f);
+
+    size_t Size() const { return vThreads.size(); };
+
+private:
+    struct Job
+    {
+        Job(const std::function<void(size_t)> &fIn, size_t nTasksIn) : f(fIn), nTasks(nTasksIn) {};
+        const std::function<void(size_t)> &f;
+        size_t nTasks;
+        size_t nNext = 0;
+        size_t nRunning = 0;
+    };
+
+    std::mutex mtx;
+    std::condition_variable cvWork;
+    std::condition_variable cvDone;
+
+    // Guarded by mtx
+    std::deque<Job*> dJobs; // Jobs with tasks left to start
+    bool fStop = false;
+
+    std::vector<std::thread> vThreads;
+
+    /** Start the next task of job and run it, lock must hold mtx */
+    void RunTask(std::unique_lock<std::mutex> &lock, Job &job);
+    void Work(std::string sThreadName);
+};
+
+inline CWorkerPool::CWorkerPool(size_t nThreads, const std::string &name)
+{
+    vThreads.reserve(nThreads);
+    for (size_t i = 0; i < nThreads; ++i)
+        vThreads.emplace_back(&CWorkerPool::Work, this, "particl-" + name);
+};
+
+inline CWorkerPool::~CWorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        fStop = true;
+    }
+    cvWork.notify_all();
+    for (auto &thread : vThreads)
+        thread.join();
+};
+
+inline void CWorkerPool::Run(size_t nTasks, const std::function<void(size_t)> &f)
+{
+    if (vThreads.empty() || nTasks < 2)
+    {
+        for (size_t i = 0; i < nTasks; ++i)
+            f(i);
+        return;
+    };
+
+    Job job(f, nTasks);
+    std::unique_lock<std::mutex> lock(mtx);
+    dJobs.push_back(&job);
+    cvWork.notify_all();
+
+    while (job.nNext < job.nTasks)
+        RunTask(lock, job);
+    cvDone.wait(lock, [&job]() { return job.nRunning == 0; });
+};
+
+inline void CWorkerPool::RunTask(std::unique_lock<std::mutex> &lock, Job &job)
+{
+    size_t i = job.nNext++;
+    if (job.nNext == job.nTasks)
+        dJobs.erase(std::find(dJobs.begin(), dJobs.end(), &job));
+    job.nRunning++;
+    lock.unlock();
+    job.f(i);
+    lock.lock();
+    if (--job.nRunning == 0 && job.nNext == job.nTasks)
+        cvDone.notify_all();
+};
+
+inline void CWorkerPool::Work(std::string sThreadName)
+{
+    RenameThread(sThreadName.c_str());
+
+    std::unique_lock<std::mutex> lock(mtx);
+    for (;;)
+    {
+        cvWork.wait(lock, [this]() { return fStop || !dJobs.empty(); });
+        if (fStop)
+            return;
+        RunTask(lock, *dJobs.front());
+    };
+};
+
+#endif // PARTICL_WORKERPOOL_H